@@ -0,0 +1,97 @@
+/* ==========================================================================
+    File:     ChangeDetector.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Report on change and motion detection
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "ChangeDetector.h"
+#include <math.h>
+
+void ChangeChannelBegin(ChangeChannel& channel, float deadband, uint32_t heartbeatMicros) {
+  ChangeChannelSetDeadband(channel, 0, CHANGE_MAX_AXES, deadband);
+  channel.heartbeatMicros = heartbeatMicros;
+  channel.reported = 0;
+  channel.suppressed = 0;
+  ChangeChannelReset(channel);
+}
+
+void ChangeChannelSetDeadband(ChangeChannel& channel, size_t firstAxis, size_t axes, float deadband) {
+  for (size_t i = firstAxis; i < firstAxis + axes && i < CHANGE_MAX_AXES; i++)
+    channel.deadband[i] = deadband;
+}
+
+void ChangeChannelReset(ChangeChannel& channel) {
+  channel.hasLast = false;
+  channel.lastReportMicros = 0;
+}
+
+bool ChangeShouldReport(ChangeChannel& channel, const float* values, size_t axes, uint32_t nowMicros) {
+
+  if (!channel.hasLast)
+    return true;
+
+  if (channel.heartbeatMicros > 0 && (nowMicros - channel.lastReportMicros) >= channel.heartbeatMicros)
+    return true;
+
+  if (axes > CHANGE_MAX_AXES)
+    axes = CHANGE_MAX_AXES;
+  for (size_t i = 0; i < axes; i++) {
+    if (fabsf(values[i] - channel.last[i]) > channel.deadband[i])
+      return true;
+  }
+
+  channel.suppressed++;
+  return false;
+}
+
+void ChangeCommit(ChangeChannel& channel, const float* values, size_t axes, uint32_t nowMicros) {
+  if (axes > CHANGE_MAX_AXES)
+    axes = CHANGE_MAX_AXES;
+  for (size_t i = 0; i < axes; i++)
+    channel.last[i] = values[i];
+  channel.hasLast = true;
+  channel.lastReportMicros = nowMicros;
+  channel.reported++;
+}
+
+MotionDetector::MotionDetector()
+  : _threshold(0.05f), _holdMicros(2000000UL), _gravity(1.0f), _settled(false),
+    _moving(false), _lastMotionMicros(0), _wakes(0) {
+}
+
+void MotionDetector::Begin(float threshold, uint32_t holdMicros) {
+  _threshold = threshold;
+  _holdMicros = holdMicros;
+}
+
+bool MotionDetector::Update(float ax, float ay, float az, uint32_t nowMicros) {
+
+  float magnitude = sqrtf(ax * ax + ay * ay + az * az);
+
+  if (!_settled) {
+    _gravity = magnitude;
+    _settled = true;
+  }
+
+  bool motion = fabsf(magnitude - _gravity) > _threshold;
+
+  // learn gravity while still, and only drift while moving so a long shake
+  // does not drag it along but a bad first guess still recovers
+  _gravity += (motion ? MOTION_GRAVITY_DRIFT : MOTION_GRAVITY_SMOOTHING) * (magnitude - _gravity);
+
+  if (motion) {
+    _lastMotionMicros = nowMicros;
+    if (!_moving) {
+      _moving = true;
+      _wakes++;
+      return true;
+    }
+  } else if (_moving && (nowMicros - _lastMotionMicros) >= _holdMicros) {
+    _moving = false;
+    return true;
+  }
+
+  return false;
+}
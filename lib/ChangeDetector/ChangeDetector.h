@@ -0,0 +1,84 @@
+/* ==========================================================================
+    File:     ChangeDetector.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Report on change, a value is only sent when it moved past its
+              deadband or the heartbeat ran out, and a motion detector on
+              the accel magnitude to tell idle from moving
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef CHANGE_DETECTOR_H
+#define CHANGE_DETECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// enough for the packed frame, accel + gyro + mag + orientation
+#define CHANGE_MAX_AXES 12
+
+/* --------------------------------------------------------------------------
+    One reported value of up to CHANGE_MAX_AXES axes
+      deadband          report once any axis moved more than its deadband
+                        since the last report, 0 reports every change
+      heartbeatMicros   report anyway after this much silence, 0 is never
+   -------------------------------------------------------------------------- */
+struct ChangeChannel {
+  float     deadband[CHANGE_MAX_AXES];
+  uint32_t  heartbeatMicros;
+  uint32_t  lastReportMicros;
+  bool      hasLast;
+  float     last[CHANGE_MAX_AXES];
+  uint32_t  reported;
+  uint32_t  suppressed;
+};
+
+// every axis gets the same deadband, ChangeChannelSetDeadband() for mixed units
+void ChangeChannelBegin(ChangeChannel& channel, float deadband, uint32_t heartbeatMicros);
+
+void ChangeChannelSetDeadband(ChangeChannel& channel, size_t firstAxis, size_t axes, float deadband);
+
+// forget the last report, the next value is always reported
+void ChangeChannelReset(ChangeChannel& channel);
+
+/* --------------------------------------------------------------------------
+    True when values should be reported, counts a suppressed report when
+    not. Call ChangeCommit() once the report actually went out
+   -------------------------------------------------------------------------- */
+bool ChangeShouldReport(ChangeChannel& channel, const float* values, size_t axes, uint32_t nowMicros);
+
+void ChangeCommit(ChangeChannel& channel, const float* values, size_t axes, uint32_t nowMicros);
+
+/* --------------------------------------------------------------------------
+    Motion Detector, the accel magnitude is compared against a slow moving
+    average of itself (gravity plus any offset), moving once it strays more
+    than threshold and idle again after holdMicros without that
+   -------------------------------------------------------------------------- */
+#define MOTION_GRAVITY_SMOOTHING  0.01f
+#define MOTION_GRAVITY_DRIFT      0.001f
+
+class MotionDetector {
+public:
+  MotionDetector();
+
+  void Begin(float threshold, uint32_t holdMicros);
+
+  // true when the state changed
+  bool Update(float ax, float ay, float az, uint32_t nowMicros);
+
+  bool Moving() const { return _moving; }
+  float Threshold() const { return _threshold; }
+  uint32_t HoldMicros() const { return _holdMicros; }
+  uint32_t Wakes() const { return _wakes; }
+
+private:
+  float     _threshold;
+  uint32_t  _holdMicros;
+  float     _gravity;
+  bool      _settled;
+  bool      _moving;
+  uint32_t  _lastMotionMicros;
+  uint32_t  _wakes;
+};
+
+#endif
@@ -0,0 +1,250 @@
+/* ==========================================================================
+    File:     CompactCodec.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Encoder/Decoder for the compact telemetry vectors, has no
+              Arduino dependencies so the gateway side can use it
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "CompactCodec.h"
+#include <string.h>
+#include <math.h>
+
+/* --------------------------------------------------------------------------
+    Scaled int16 quantization with rounding and clamping
+   -------------------------------------------------------------------------- */
+static int16_t Quantize(float value, float fullScale) {
+  float scaled = value * (32767.0f / fullScale);
+  if (scaled >= 32767.0f)
+    return 32767;
+  if (scaled <= -32767.0f)
+    return -32767;
+  return (int16_t)lroundf(scaled);
+}
+
+static float Dequantize(int16_t value, float fullScale) {
+  return (float)value * (fullScale / 32767.0f);
+}
+
+uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+  uint32_t mantissa = bits & 0x007FFFFF;
+
+  // NaN and Inf
+  if (((bits >> 23) & 0xFF) == 0xFF)
+    return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+  // overflow saturates to Inf
+  if (exponent >= 31)
+    return (uint16_t)(sign | 0x7C00);
+
+  // subnormal or zero
+  if (exponent <= 0) {
+    if (exponent < -10)
+      return sign;
+    mantissa |= 0x00800000;
+    uint32_t shift = (uint32_t)(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t midpoint = 1u << (shift - 1);
+    if (remainder > midpoint || (remainder == midpoint && (half & 1)))
+      half++;
+    return (uint16_t)(sign | half);
+  }
+
+  // normal, round to nearest even, a carry into the exponent is fine
+  uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+  uint32_t remainder = mantissa & 0x1FFF;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+    half++;
+  return (uint16_t)(sign | half);
+}
+
+float HalfToFloat(uint16_t half) {
+  uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1F;
+  uint32_t mantissa = half & 0x3FF;
+  uint32_t bits;
+
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    } else {
+      // normalize the subnormal
+      exponent = 127 - 15 + 1;
+      while (!(mantissa & 0x400)) {
+        mantissa <<= 1;
+        exponent--;
+      }
+      bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+  } else if (exponent == 31) {
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void CompactChannelBegin(CompactChannel& channel, float fullScale, uint8_t keyframeInterval) {
+  channel.fullScale = fullScale;
+  channel.keyframeInterval = keyframeInterval == 0 ? 1 : keyframeInterval;
+  CompactChannelReset(channel);
+}
+
+void CompactChannelReset(CompactChannel& channel) {
+  channel.sinceKeyframe = 0;
+  channel.hasPrevious = false;
+  memset(channel.previous, 0, sizeof(channel.previous));
+}
+
+size_t CompactEncodeVector(
+  CompactChannel& channel, TelemetryEncoding encoding,
+  const float* values, size_t axes, uint8_t* buffer) {
+
+  if (axes > COMPACT_MAX_AXES)
+    axes = COMPACT_MAX_AXES;
+
+  uint8_t* cursor = &buffer[1];
+
+  switch (encoding) {
+
+    case ENCODING_FLOAT32:
+      buffer[0] = ENCODING_FLOAT32 | COMPACT_KEYFRAME_FLAG;
+      memcpy(cursor, values, axes * sizeof(float));
+      cursor += axes * sizeof(float);
+      break;
+
+    case ENCODING_HALF:
+      buffer[0] = ENCODING_HALF | COMPACT_KEYFRAME_FLAG;
+      for (size_t i = 0; i < axes; i++) {
+        uint16_t half = FloatToHalf(values[i]);
+        *cursor++ = (uint8_t)half;
+        *cursor++ = (uint8_t)(half >> 8);
+      }
+      break;
+
+    case ENCODING_DELTA8:
+      {
+        int16_t quantized[COMPACT_MAX_AXES];
+        bool keyframe = !channel.hasPrevious || channel.sinceKeyframe >= channel.keyframeInterval;
+        for (size_t i = 0; i < axes; i++) {
+          quantized[i] = Quantize(values[i], channel.fullScale);
+          int32_t delta = (int32_t)quantized[i] - channel.previous[i];
+          if (delta < -128 || delta > 127)
+            keyframe = true;
+        }
+
+        if (!keyframe) {
+          buffer[0] = ENCODING_DELTA8;
+          for (size_t i = 0; i < axes; i++) {
+            *cursor++ = (uint8_t)(int8_t)(quantized[i] - channel.previous[i]);
+            channel.previous[i] = quantized[i];
+          }
+          channel.sinceKeyframe++;
+          break;
+        }
+
+        buffer[0] = ENCODING_DELTA8 | COMPACT_KEYFRAME_FLAG;
+        for (size_t i = 0; i < axes; i++) {
+          *cursor++ = (uint8_t)quantized[i];
+          *cursor++ = (uint8_t)((uint16_t)quantized[i] >> 8);
+          channel.previous[i] = quantized[i];
+        }
+        channel.hasPrevious = true;
+        channel.sinceKeyframe = 0;
+      }
+      break;
+
+    case ENCODING_INT16:
+    default:
+      buffer[0] = ENCODING_INT16 | COMPACT_KEYFRAME_FLAG;
+      for (size_t i = 0; i < axes; i++) {
+        int16_t quantized = Quantize(values[i], channel.fullScale);
+        *cursor++ = (uint8_t)quantized;
+        *cursor++ = (uint8_t)((uint16_t)quantized >> 8);
+      }
+      break;
+  }
+
+  return (size_t)(cursor - buffer);
+}
+
+size_t CompactDecodeVector(
+  CompactChannel& channel, const uint8_t* buffer, size_t length,
+  float* values, size_t axes) {
+
+  if (length < 1 || axes > COMPACT_MAX_AXES)
+    return 0;
+
+  uint8_t encoding = buffer[0] & COMPACT_ENCODING_MASK;
+  bool keyframe = (buffer[0] & COMPACT_KEYFRAME_FLAG) != 0;
+  const uint8_t* cursor = &buffer[1];
+
+  size_t axisSize;
+  switch (encoding) {
+    case ENCODING_FLOAT32:  axisSize = sizeof(float); break;
+    case ENCODING_INT16:    axisSize = 2; break;
+    case ENCODING_HALF:     axisSize = 2; break;
+    case ENCODING_DELTA8:   axisSize = keyframe ? 2 : 1; break;
+    default:                return 0;
+  }
+  if (length < 1 + axes * axisSize)
+    return 0;
+
+  for (size_t i = 0; i < axes; i++, cursor += axisSize) {
+    switch (encoding) {
+
+      case ENCODING_FLOAT32:
+        memcpy(&values[i], cursor, sizeof(float));
+        break;
+
+      case ENCODING_HALF:
+        values[i] = HalfToFloat((uint16_t)(cursor[0] | (cursor[1] << 8)));
+        break;
+
+      case ENCODING_INT16:
+        values[i] = Dequantize((int16_t)(cursor[0] | (cursor[1] << 8)), channel.fullScale);
+        break;
+
+      case ENCODING_DELTA8:
+        if (keyframe) {
+          channel.previous[i] = (int16_t)(cursor[0] | (cursor[1] << 8));
+        } else {
+          if (!channel.hasPrevious)
+            return 0;
+          channel.previous[i] = (int16_t)(channel.previous[i] + (int8_t)cursor[0]);
+        }
+        values[i] = Dequantize(channel.previous[i], channel.fullScale);
+        break;
+    }
+  }
+
+  if (encoding == ENCODING_DELTA8 && keyframe)
+    channel.hasPrevious = true;
+
+  return (size_t)(cursor - buffer);
+}
+
+float CompactErrorBound(TelemetryEncoding encoding, float fullScale, float value) {
+  switch (encoding) {
+    case ENCODING_FLOAT32:
+      return 0.0f;
+    case ENCODING_HALF:
+      // half an ulp of an 11 bit significand, or of the smallest subnormal
+      return fmaxf(fabsf(value) / 2048.0f, 2.98e-8f);
+    case ENCODING_INT16:
+    case ENCODING_DELTA8:
+    default:
+      // half a step, the delta carries the exact quantized difference
+      return 0.5f * fullScale / 32767.0f;
+  }
+}
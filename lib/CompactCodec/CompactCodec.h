@@ -0,0 +1,90 @@
+/* ==========================================================================
+    File:     CompactCodec.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Quantized and delta encoded compact telemetry vectors, scaled
+              int16, half-float or int8 deltas with periodic keyframes
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef COMPACT_CODEC_H
+#define COMPACT_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    Encodings, selectable at runtime by the Central/Gateway
+      FLOAT32   4 bytes per axis, the original format
+      INT16     2 bytes per axis, scaled to the channel full scale
+      HALF      2 bytes per axis, IEEE 754 binary16
+      DELTA8    1 byte per axis, int8 delta of the scaled int16 value
+                against the previous record, keyframes are INT16
+   -------------------------------------------------------------------------- */
+enum TelemetryEncoding : uint8_t {
+  ENCODING_FLOAT32 = 0,
+  ENCODING_INT16,
+  ENCODING_HALF,
+  ENCODING_DELTA8,
+  ENCODING_COUNT
+};
+
+// advertised with the Device Capability Schema, in TelemetryEncoding order
+#define TELEMETRY_ENCODINGS   "f32,i16,f16,d8"
+
+#define COMPACT_MAX_AXES              4
+#define COMPACT_KEYFRAME_FLAG         0x80
+#define COMPACT_ENCODING_MASK         0x0F
+#define COMPACT_DEFAULT_KEYFRAME      16
+#define COMPACT_MAX_VECTOR_SIZE       (1 + COMPACT_MAX_AXES * sizeof(float))
+
+/* --------------------------------------------------------------------------
+    Full scale of each channel as configured in the LSM9DS1 (Arduino_LSM9DS1
+    defaults), values outside are clamped when quantized
+   -------------------------------------------------------------------------- */
+#define COMPACT_SCALE_ACCELERATION    4.0f      // g
+#define COMPACT_SCALE_GYROSCOPE       2000.0f   // dps
+#define COMPACT_SCALE_MAGNETOMETER    400.0f    // uT
+#define COMPACT_SCALE_ORIENTATION     3.1416f   // radians
+#define COMPACT_SCALE_QUATERNION      1.0f      // unit quaternion
+
+/* --------------------------------------------------------------------------
+    Per channel codec state, one on each side of the link. The delta is
+    always taken against the last value sent, so both ends stay in step
+   -------------------------------------------------------------------------- */
+struct CompactChannel {
+  float     fullScale;
+  uint8_t   keyframeInterval;
+  uint8_t   sinceKeyframe;
+  bool      hasPrevious;
+  int16_t   previous[COMPACT_MAX_AXES];
+};
+
+void CompactChannelBegin(CompactChannel& channel, float fullScale, uint8_t keyframeInterval = COMPACT_DEFAULT_KEYFRAME);
+
+// forces the next record to be a keyframe
+void CompactChannelReset(CompactChannel& channel);
+
+/* --------------------------------------------------------------------------
+    Encode axes values (1..COMPACT_MAX_AXES), buffer needs room for
+    COMPACT_MAX_VECTOR_SIZE. Returns the number of bytes written
+   -------------------------------------------------------------------------- */
+size_t CompactEncodeVector(
+  CompactChannel& channel, TelemetryEncoding encoding,
+  const float* values, size_t axes, uint8_t* buffer);
+
+/* --------------------------------------------------------------------------
+    Decode one record, returns the bytes consumed or 0 when the record is
+    short, unknown or a delta arrives without a keyframe before it
+   -------------------------------------------------------------------------- */
+size_t CompactDecodeVector(
+  CompactChannel& channel, const uint8_t* buffer, size_t length,
+  float* values, size_t axes);
+
+// worst case quantization error per axis for an encoding and full scale
+float CompactErrorBound(TelemetryEncoding encoding, float fullScale, float value);
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t half);
+
+#endif
@@ -0,0 +1,68 @@
+/* ==========================================================================
+    File:     CompactFrame.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Encoder/Decoder for the compact packed telemetry frame
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "CompactFrame.h"
+
+void CompactFrameChannelsBegin(CompactChannel channels[COMPACT_FRAME_CHANNEL_COUNT], uint8_t keyframeInterval) {
+  CompactChannelBegin(channels[COMPACT_FRAME_ACCELERATION], COMPACT_SCALE_ACCELERATION, keyframeInterval);
+  CompactChannelBegin(channels[COMPACT_FRAME_GYROSCOPE], COMPACT_SCALE_GYROSCOPE, keyframeInterval);
+  CompactChannelBegin(channels[COMPACT_FRAME_MAGNETOMETER], COMPACT_SCALE_MAGNETOMETER, keyframeInterval);
+  CompactChannelBegin(channels[COMPACT_FRAME_ORIENTATION], COMPACT_SCALE_ORIENTATION, keyframeInterval);
+}
+
+size_t EncodeCompactTelemetryFrame(
+  const TelemetryFrame& frame, CompactChannel channels[COMPACT_FRAME_CHANNEL_COUNT],
+  TelemetryEncoding encoding, uint8_t* buffer, size_t bufferSize) {
+
+  if (encoding == ENCODING_FLOAT32)
+    return EncodeTelemetryFrame(frame, buffer, bufferSize);
+
+  if (bufferSize < COMPACT_FRAME_MAX_SIZE)
+    return 0;
+
+  buffer[0] = TELEMETRY_FRAME_VERSION;
+  buffer[1] = frame.flags | TELEMETRY_FRAME_FLAG_COMPACT;
+  PutUint16LE(&buffer[2], frame.sequence);
+  PutUint32LE(&buffer[4], frame.timestampMicros);
+
+  size_t length = TELEMETRY_FRAME_HEADER_SIZE;
+  length += CompactEncodeVector(channels[COMPACT_FRAME_ACCELERATION], encoding, frame.acceleration, 3, &buffer[length]);
+  length += CompactEncodeVector(channels[COMPACT_FRAME_GYROSCOPE], encoding, frame.gyroscope, 3, &buffer[length]);
+  length += CompactEncodeVector(channels[COMPACT_FRAME_MAGNETOMETER], encoding, frame.magnetometer, 3, &buffer[length]);
+  length += CompactEncodeVector(channels[COMPACT_FRAME_ORIENTATION], encoding, frame.orientation, 3, &buffer[length]);
+  return length;
+}
+
+bool DecodeCompactTelemetryFrame(
+  const uint8_t* buffer, size_t length,
+  CompactChannel channels[COMPACT_FRAME_CHANNEL_COUNT], TelemetryFrame& frame) {
+
+  if (length < TELEMETRY_FRAME_HEADER_SIZE || buffer[0] != TELEMETRY_FRAME_VERSION)
+    return false;
+
+  if (!(buffer[1] & TELEMETRY_FRAME_FLAG_COMPACT))
+    return DecodeTelemetryFrame(buffer, length, frame);
+
+  frame.version = buffer[0];
+  frame.flags = buffer[1];
+  frame.sequence = GetUint16LE(&buffer[2]);
+  frame.timestampMicros = GetUint32LE(&buffer[4]);
+
+  float* vectors[COMPACT_FRAME_CHANNEL_COUNT] = {
+    frame.acceleration, frame.gyroscope, frame.magnetometer, frame.orientation
+  };
+
+  size_t offset = TELEMETRY_FRAME_HEADER_SIZE;
+  for (int i = 0; i < COMPACT_FRAME_CHANNEL_COUNT; i++) {
+    size_t used = CompactDecodeVector(channels[i], &buffer[offset], length - offset, vectors[i], 3);
+    if (used == 0)
+      return false;
+    offset += used;
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+/* ==========================================================================
+    File:     CompactFrame.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Packed telemetry frame carrying compact encoded vectors
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef COMPACT_FRAME_H
+#define COMPACT_FRAME_H
+
+#include <TelemetryFrame.h>
+#include "CompactCodec.h"
+
+/* --------------------------------------------------------------------------
+    Same 8 byte header as the TelemetryFrame with TELEMETRY_FRAME_FLAG_COMPACT
+    set in flags, followed by the accelerometer, gyroscope, magnetometer and
+    orientation as compact vectors (see CompactEncodeVector)
+   -------------------------------------------------------------------------- */
+#define TELEMETRY_FRAME_FLAG_COMPACT  0x01
+
+// largest compact frame, every encoding but FLOAT32 is 2 bytes per axis or less
+#define COMPACT_FRAME_MAX_SIZE        (TELEMETRY_FRAME_HEADER_SIZE + 4 * (1 + 3 * 2))
+
+enum COMPACT_FRAME_CHANNELS: int {
+  COMPACT_FRAME_ACCELERATION = 0,
+  COMPACT_FRAME_GYROSCOPE,
+  COMPACT_FRAME_MAGNETOMETER,
+  COMPACT_FRAME_ORIENTATION,
+  COMPACT_FRAME_CHANNEL_COUNT
+};
+
+// sets each channel up with the full scale of its sensor
+void CompactFrameChannelsBegin(CompactChannel channels[COMPACT_FRAME_CHANNEL_COUNT], uint8_t keyframeInterval);
+
+size_t EncodeCompactTelemetryFrame(
+  const TelemetryFrame& frame, CompactChannel channels[COMPACT_FRAME_CHANNEL_COUNT],
+  TelemetryEncoding encoding, uint8_t* buffer, size_t bufferSize);
+
+// decodes either frame flavour, channels hold the delta state between frames
+bool DecodeCompactTelemetryFrame(
+  const uint8_t* buffer, size_t length,
+  CompactChannel channels[COMPACT_FRAME_CHANNEL_COUNT], TelemetryFrame& frame);
+
+#endif
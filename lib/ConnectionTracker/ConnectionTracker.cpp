@@ -0,0 +1,95 @@
+/* ==========================================================================
+    File:     ConnectionTracker.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Connection start state machine, see ConnectionTracker.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "ConnectionTracker.h"
+#include <TelemetryFrame.h>
+
+ConnectionTracker::ConnectionTracker()
+  : _micros(0), _connectedMicros(0), _totalFirstSampleMicros(0), _sampled(0) {
+  _status.phase = CONNECTION_IDLE;
+  _status.cause = CONNECTION_START_NONE;
+  _status.connections = 0;
+  _status.timeouts = 0;
+  _status.startMicros = 0;
+  _status.firstSampleMicros = 0;
+  _status.minFirstSampleMicros = 0;
+  _status.maxFirstSampleMicros = 0;
+  _status.averageFirstSampleMicros = 0;
+}
+
+void ConnectionTracker::Begin(unsigned long (*micros)()) {
+  _micros = micros;
+}
+
+void ConnectionTracker::Connected() {
+  if (_status.phase != CONNECTION_IDLE)
+    return;
+
+  _connectedMicros = _micros();
+  _status.phase = CONNECTION_DISCOVERING;
+  _status.cause = CONNECTION_START_NONE;
+  _status.startMicros = 0;
+  _status.firstSampleMicros = 0;
+  _status.connections++;
+}
+
+bool ConnectionTracker::Start(ConnectionStartCause cause) {
+  if (_status.phase == CONNECTION_IDLE) {
+    // subscribed in the same poll as it connected, before Connected()
+    Connected();
+  }
+  if (_status.phase != CONNECTION_DISCOVERING)
+    return false;
+
+  _status.phase = CONNECTION_STARTED;
+  _status.cause = cause;
+  _status.startMicros = _micros() - _connectedMicros;
+  if (cause == CONNECTION_START_TIMEOUT) {
+    _status.timeouts++;
+  }
+  return true;
+}
+
+bool ConnectionTracker::Sampled() {
+  if (_status.phase != CONNECTION_STARTED)
+    return false;
+
+  uint32_t elapsed = _micros() - _connectedMicros;
+  _status.phase = CONNECTION_STREAMING;
+  _status.firstSampleMicros = elapsed;
+  if (_sampled == 0 || elapsed < _status.minFirstSampleMicros) {
+    _status.minFirstSampleMicros = elapsed;
+  }
+  if (elapsed > _status.maxFirstSampleMicros) {
+    _status.maxFirstSampleMicros = elapsed;
+  }
+  _totalFirstSampleMicros += elapsed;
+  _sampled++;
+  _status.averageFirstSampleMicros = (uint32_t)(_totalFirstSampleMicros / _sampled);
+  return true;
+}
+
+void ConnectionTracker::Disconnected() {
+  _status.phase = CONNECTION_IDLE;
+}
+
+size_t EncodeConnectionStatus(const ConnectionStatus& status, uint8_t* buffer, size_t bufferSize) {
+  if (bufferSize < CONNECTION_STATUS_SIZE)
+    return 0;
+
+  buffer[0] = status.phase;
+  buffer[1] = status.cause;
+  PutUint16LE(&buffer[2], status.connections);
+  PutUint16LE(&buffer[4], status.timeouts);
+  PutUint32LE(&buffer[6], status.startMicros);
+  PutUint32LE(&buffer[10], status.firstSampleMicros);
+  PutUint32LE(&buffer[14], status.minFirstSampleMicros);
+  PutUint32LE(&buffer[18], status.maxFirstSampleMicros);
+  PutUint32LE(&buffer[22], status.averageFirstSampleMicros);
+  return CONNECTION_STATUS_SIZE;
+}
@@ -0,0 +1,107 @@
+/* ==========================================================================
+    File:     ConnectionTracker.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Connection start state machine, starts the telemetry as soon
+              as the Central/Gateway is through its service discovery and
+              subscribed instead of after a fixed delay, and measures how
+              long a connection takes to its first sample
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef CONNECTION_TRACKER_H
+#define CONNECTION_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CONNECTION_STATUS_SIZE    26
+
+/* --------------------------------------------------------------------------
+    Connection Phases, from the first Central/Gateway connecting to the
+    last one leaving
+      IDLE          nobody connected
+      DISCOVERING   connected, discovering services until it subscribes
+      STARTED       the telemetry runs, nothing has reached it yet
+      STREAMING     the first sample went out
+   -------------------------------------------------------------------------- */
+enum ConnectionPhase: uint8_t {
+  CONNECTION_IDLE = 0,
+  CONNECTION_DISCOVERING,
+  CONNECTION_STARTED,
+  CONNECTION_STREAMING,
+  CONNECTION_PHASE_COUNT
+};
+
+// the phases in ConnectionPhase order, for the Device Capability Schema
+#define CONNECTION_PHASES "idle,discovering,started,streaming"
+
+enum ConnectionStartCause: uint8_t {
+  CONNECTION_START_NONE = 0,
+  CONNECTION_START_SUBSCRIBED,      // the first subscription
+  CONNECTION_START_TIMEOUT          // it never subscribed, started anyway
+};
+
+/* --------------------------------------------------------------------------
+    The last connection and every connection since Begin(), the times are
+    from the connection coming up
+   -------------------------------------------------------------------------- */
+struct ConnectionStatus {
+  ConnectionPhase       phase;
+  ConnectionStartCause  cause;
+  uint16_t              connections;
+  uint16_t              timeouts;
+  uint32_t              startMicros;              // to the telemetry starting
+  uint32_t              firstSampleMicros;        // to the first sample
+  uint32_t              minFirstSampleMicros;
+  uint32_t              maxFirstSampleMicros;
+  uint32_t              averageFirstSampleMicros;
+};
+
+class ConnectionTracker {
+public:
+  ConnectionTracker();
+
+  void Begin(unsigned long (*micros)());
+
+  // the first Central/Gateway is up
+  void Connected();
+
+  // true when this starts the telemetry, only once per connection. A
+  // subscription can come in the same poll as the connection, before
+  // Connected(), so it starts from IDLE too
+  bool Start(ConnectionStartCause cause);
+
+  // a sample went out, true when it was the first of the connection
+  bool Sampled();
+
+  // the last Central/Gateway left
+  void Disconnected();
+
+  ConnectionPhase Phase() const             { return _status.phase; }
+  bool Started() const                      { return _status.phase >= CONNECTION_STARTED; }
+  const ConnectionStatus& Status() const    { return _status; }
+
+private:
+  unsigned long     (*_micros)();
+  ConnectionStatus  _status;
+  unsigned long     _connectedMicros;
+  uint64_t          _totalFirstSampleMicros;
+  uint16_t          _sampled;                     // connections that got one
+};
+
+/* --------------------------------------------------------------------------
+    Connection Status payload
+      [0]       ConnectionPhase
+      [1]       ConnectionStartCause of the last connection
+      [2..3]    connections
+      [4..5]    connections started by the timeout
+      [6..9]    last connection to the telemetry starting (us)
+      [10..13]  last connection to its first sample (us)
+      [14..17]  fastest first sample (us)
+      [18..21]  slowest first sample (us)
+      [22..25]  average first sample (us)
+   -------------------------------------------------------------------------- */
+size_t EncodeConnectionStatus(const ConnectionStatus& status, uint8_t* buffer, size_t bufferSize);
+
+#endif
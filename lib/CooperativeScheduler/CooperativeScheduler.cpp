@@ -0,0 +1,154 @@
+/* ==========================================================================
+    File:     CooperativeScheduler.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Small deterministic cooperative task scheduler
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "CooperativeScheduler.h"
+#include <string.h>
+
+// wrap safe "a is at or after b" for the free running micros() clock
+static inline bool Reached(unsigned long now, unsigned long deadline) {
+  return (long)(now - deadline) >= 0;
+}
+
+CooperativeScheduler::CooperativeScheduler(SchedulerClock clock, SchedulerIdle idle)
+  : _clock(clock), _idle(idle), _count(0) {
+  memset(_tasks, 0, sizeof(_tasks));
+  memset(_order, 0, sizeof(_order));
+}
+
+int CooperativeScheduler::AddTask(const char* name, uint8_t priority, unsigned long periodMicros, TaskCallback callback) {
+
+  if (_count >= SCHEDULER_MAX_TASKS)
+    return -1;
+
+  int id = _count++;
+  Task& task = _tasks[id];
+  task.name = name;
+  task.callback = callback;
+  task.periodMicros = periodMicros;
+  task.priority = priority;
+  task.active = false;
+
+  // keep _order sorted by priority, ties run in the order they were added
+  int slot = id;
+  while (slot > 0 && _tasks[_order[slot - 1]].priority > priority) {
+    _order[slot] = _order[slot - 1];
+    slot--;
+  }
+  _order[slot] = (uint8_t)id;
+
+  return id;
+}
+
+int CooperativeScheduler::AddPeriodic(const char* name, uint8_t priority, unsigned long periodMicros, TaskCallback callback) {
+  return AddTask(name, priority, periodMicros, callback);
+}
+
+int CooperativeScheduler::AddOneShot(const char* name, uint8_t priority, TaskCallback callback) {
+  return AddTask(name, priority, 0, callback);
+}
+
+void CooperativeScheduler::Start(int task, unsigned long delayMicros) {
+  if (task < 0 || task >= _count)
+    return;
+  _tasks[task].deadline = _clock() + delayMicros;
+  _tasks[task].active = true;
+}
+
+void CooperativeScheduler::Stop(int task) {
+  if (task < 0 || task >= _count)
+    return;
+  _tasks[task].active = false;
+}
+
+bool CooperativeScheduler::Active(int task) const {
+  return task >= 0 && task < _count && _tasks[task].active;
+}
+
+void CooperativeScheduler::SetPeriod(int task, unsigned long periodMicros) {
+  if (task < 0 || task >= _count || periodMicros == 0)
+    return;
+
+  Task& t = _tasks[task];
+  // pull a pending deadline in when the new period is shorter
+  if (t.active && t.periodMicros > periodMicros) {
+    unsigned long sooner = _clock() + periodMicros;
+    if ((long)(t.deadline - sooner) > 0)
+      t.deadline = sooner;
+  }
+  t.periodMicros = periodMicros;
+}
+
+unsigned long CooperativeScheduler::RunPending(unsigned long maxWait) {
+
+  bool ran[SCHEDULER_MAX_TASKS] = { false };
+
+  // restart from the top after every task so priority always wins
+  for (;;) {
+    unsigned long now = _clock();
+    int due = -1;
+    for (int i = 0; i < _count; i++) {
+      int id = _order[i];
+      if (!ran[id] && _tasks[id].active && Reached(now, _tasks[id].deadline)) {
+        due = id;
+        break;
+      }
+    }
+    if (due < 0)
+      break;
+
+    Task& task = _tasks[due];
+    ran[due] = true;
+
+    unsigned long jitter = now - task.deadline;
+    task.stats.runs++;
+    task.stats.totalJitterMicros += jitter;
+    if (jitter > task.stats.maxJitterMicros)
+      task.stats.maxJitterMicros = jitter;
+
+    if (task.periodMicros == 0) {
+      task.active = false;
+    } else if (jitter >= task.periodMicros) {
+      // skip the runs we missed instead of bursting to catch up
+      task.stats.overruns++;
+      task.deadline = now + task.periodMicros;
+    } else {
+      task.deadline += task.periodMicros;
+    }
+
+    task.callback();
+
+    unsigned long runMicros = _clock() - now;
+    if (runMicros > task.stats.maxRunMicros)
+      task.stats.maxRunMicros = runMicros;
+  }
+
+  unsigned long now = _clock();
+  unsigned long wait = maxWait;
+  for (int i = 0; i < _count; i++) {
+    const Task& task = _tasks[i];
+    if (!task.active)
+      continue;
+    if (Reached(now, task.deadline))
+      return 0;
+    unsigned long until = task.deadline - now;
+    if (until < wait)
+      wait = until;
+  }
+  return wait;
+}
+
+void CooperativeScheduler::Run(unsigned long maxIdleMicros) {
+  unsigned long wait = RunPending(maxIdleMicros);
+  if (wait > 0 && _idle)
+    _idle(wait);
+}
+
+void CooperativeScheduler::ResetStats() {
+  for (int i = 0; i < _count; i++)
+    memset(&_tasks[i].stats, 0, sizeof(TaskStats));
+}
@@ -0,0 +1,94 @@
+/* ==========================================================================
+    File:     CooperativeScheduler.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Small deterministic cooperative task scheduler with periodic
+              and one-shot timers, priority ordering, idle sleep between
+              deadlines and per-task jitter/overrun statistics
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef COOPERATIVE_SCHEDULER_H
+#define COOPERATIVE_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 20
+#endif
+
+// microsecond clock, micros() on the device and anything on the host
+typedef unsigned long (*SchedulerClock)();
+
+// called with the time until the next deadline to let the CPU sleep
+typedef void (*SchedulerIdle)(unsigned long idleMicros);
+
+typedef void (*TaskCallback)();
+
+/* --------------------------------------------------------------------------
+    Per Task Statistics
+      jitter    how late a task started against its deadline
+      overrun   the task started a whole period (or more) late, the
+                missed runs are skipped rather than run back to back
+   -------------------------------------------------------------------------- */
+struct TaskStats {
+  uint32_t  runs;
+  uint32_t  overruns;
+  uint32_t  maxJitterMicros;
+  uint32_t  totalJitterMicros;
+  uint32_t  maxRunMicros;
+};
+
+class CooperativeScheduler {
+public:
+  CooperativeScheduler(SchedulerClock clock, SchedulerIdle idle = 0);
+
+  /* ------------------------------------------------------------------------
+      Add a task, lower priority values run first when several are due.
+      Returns the task id, or -1 when the table is full. Tasks are added
+      stopped, Start() them with a first delay
+     ------------------------------------------------------------------------ */
+  int AddPeriodic(const char* name, uint8_t priority, unsigned long periodMicros, TaskCallback callback);
+  int AddOneShot(const char* name, uint8_t priority, TaskCallback callback);
+
+  void Start(int task, unsigned long delayMicros = 0);
+  void Stop(int task);
+  bool Active(int task) const;
+  void SetPeriod(int task, unsigned long periodMicros);
+
+  /* ------------------------------------------------------------------------
+      Run every task that is due, highest priority first and each at most
+      once. Returns the micros until the next deadline (maxWait if none)
+     ------------------------------------------------------------------------ */
+  unsigned long RunPending(unsigned long maxWait);
+
+  // RunPending() and then idle until the next deadline, capped at maxIdle
+  void Run(unsigned long maxIdleMicros);
+
+  int TaskCount() const                   { return _count; }
+  const char* TaskName(int task) const    { return _tasks[task].name; }
+  const TaskStats& Stats(int task) const  { return _tasks[task].stats; }
+  void ResetStats();
+
+private:
+  struct Task {
+    const char*     name;
+    TaskCallback    callback;
+    unsigned long   periodMicros;
+    unsigned long   deadline;
+    uint8_t         priority;
+    bool            active;
+    TaskStats       stats;
+  };
+
+  int AddTask(const char* name, uint8_t priority, unsigned long periodMicros, TaskCallback callback);
+
+  SchedulerClock  _clock;
+  SchedulerIdle   _idle;
+  Task            _tasks[SCHEDULER_MAX_TASKS];
+  uint8_t         _order[SCHEDULER_MAX_TASKS];
+  int             _count;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/* ==========================================================================
+    File:     Decimator.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Half band FIR decimation cascade, see Decimator.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "Decimator.h"
+#include <string.h>
+
+#define DECIMATOR_PI            3.14159265358979323846
+#define DECIMATOR_KAISER_BETA   6.0
+
+/* --------------------------------------------------------------------------
+    The taps are designed by the compiler, the constexpr functions only run
+    at compile time and the table is a constant in flash
+   -------------------------------------------------------------------------- */
+struct HalfBandTaps {
+  float side[DECIMATOR_SIDE_TAPS];    // the pairs 1, 3, 5 ... taps from the centre
+};
+
+static constexpr double SquareRoot(double x) {
+  double root = x > 1.0 ? x : 1.0;
+  for (int i = 0; i < 64; i++) {
+    root = 0.5 * (root + x / root);
+  }
+  return root;
+}
+
+// zeroth order modified Bessel function of the first kind, for the window
+static constexpr double Bessel0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+static constexpr HalfBandTaps DesignHalfBand() {
+  double raw[DECIMATOR_SIDE_TAPS] = {};
+  double sum = 0.0;
+  for (int k = 0; k < DECIMATOR_SIDE_TAPS; k++) {
+    int offset = 2 * k + 1;
+    double r = (double)offset / (DECIMATOR_CENTER + 1);
+    double window = Bessel0(DECIMATOR_KAISER_BETA * SquareRoot(1.0 - r * r)) / Bessel0(DECIMATOR_KAISER_BETA);
+    raw[k] = ((k & 1) ? -1.0 : 1.0) / (DECIMATOR_PI * offset) * window;
+    sum += raw[k];
+  }
+
+  // unity gain at DC, the centre tap carries half and the pairs the rest
+  HalfBandTaps taps = {};
+  for (int k = 0; k < DECIMATOR_SIDE_TAPS; k++) {
+    taps.side[k] = (float)(raw[k] * 0.25 / sum);
+  }
+  return taps;
+}
+
+static constexpr HalfBandTaps halfBand = DesignHalfBand();
+
+Decimator::Decimator() {
+  Reset();
+}
+
+void Decimator::Reset() {
+  memset(_delay, 0, sizeof(_delay));
+  memset(_output, 0, sizeof(_output));
+  memset(_outputs, 0, sizeof(_outputs));
+  memset(_head, 0, sizeof(_head));
+  memset(_phase, 0, sizeof(_phase));
+  _primed = false;
+}
+
+// start every stage as if it had only ever seen the first sample, so a
+// slow stage does not spend its first seconds ramping up from zero
+void Decimator::Prime(const DecimatorBlock& block) {
+  for (int axis = 0; axis < DECIMATOR_AXES; axis++) {
+    float first = block.values[axis][0];
+    for (int stage = 0; stage < DECIMATOR_MAX_STAGES; stage++) {
+      for (int tap = 0; tap < 2 * DECIMATOR_TAPS; tap++) {
+        _delay[stage][axis][tap] = first;
+      }
+    }
+    for (int stage = 0; stage <= DECIMATOR_MAX_STAGES; stage++) {
+      _output[stage][axis] = first;
+    }
+  }
+  _primed = true;
+}
+
+void Decimator::Push(const DecimatorBlock& block) {
+  size_t count = block.count < DECIMATOR_BLOCK ? block.count : DECIMATOR_BLOCK;
+  if (count == 0)
+    return;
+
+  if (!_primed) {
+    Prime(block);
+  }
+
+  for (int axis = 0; axis < DECIMATOR_AXES; axis++) {
+    _output[0][axis] = block.values[axis][count - 1];
+  }
+  _outputs[0] += count;
+
+  // each stage works the whole block before the next takes its half
+  const float (*input)[DECIMATOR_BLOCK] = block.values;
+  for (int stage = 0; stage < DECIMATOR_MAX_STAGES && count > 0; stage++) {
+    float (*output)[DECIMATOR_BLOCK] = _scratch[stage & 1];
+    count = RunStage(stage, input, count, output);
+    if (count > 0) {
+      for (int axis = 0; axis < DECIMATOR_AXES; axis++) {
+        _output[stage + 1][axis] = output[axis][count - 1];
+      }
+      _outputs[stage + 1] += count;
+    }
+    input = output;
+  }
+}
+
+/* --------------------------------------------------------------------------
+    One stage over one block, axis by axis so every loop runs down
+    contiguous rows, an output on every second input. Returns the outputs
+   -------------------------------------------------------------------------- */
+size_t Decimator::RunStage(int stage, const float (*input)[DECIMATOR_BLOCK], size_t count, float (*output)[DECIMATOR_BLOCK]) {
+  uint8_t head = _head[stage];
+  uint8_t phase = _phase[stage];
+  size_t produced = 0;
+
+  for (int axis = 0; axis < DECIMATOR_AXES; axis++) {
+    float* __restrict line = _delay[stage][axis];
+    const float* __restrict samples = input[axis];
+    float* __restrict outputs = output[axis];
+    head = _head[stage];
+    phase = _phase[stage];
+    produced = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      head = head == 0 ? DECIMATOR_TAPS - 1 : head - 1;
+      line[head] = samples[i];
+      line[head + DECIMATOR_TAPS] = samples[i];
+      phase ^= 1;
+      if (phase)
+        continue;
+
+      // newest sample first, the pairs sit either side of the centre
+      const float* taps = &line[head];
+      float sum = 0.5f * taps[DECIMATOR_CENTER];
+      for (int k = 0; k < DECIMATOR_SIDE_TAPS; k++) {
+        sum += halfBand.side[k] * (taps[DECIMATOR_CENTER - 1 - 2 * k] + taps[DECIMATOR_CENTER + 1 + 2 * k]);
+      }
+      outputs[produced++] = sum;
+    }
+  }
+
+  _head[stage] = head;
+  _phase[stage] = phase;
+  return produced;
+}
+
+void Decimator::Output(int stages, int firstAxis, int axes, float* values) const {
+  memcpy(values, &_output[stages][firstAxis], axes * sizeof(float));
+}
+
+float Decimator::OutputHz(float inputHz, int stages) {
+  return inputHz / (float)(1UL << stages);
+}
+
+float Decimator::DelaySamples(int stages) {
+  // every stage delays by its centre tap at its own input rate
+  return (float)(DECIMATOR_CENTER * ((1UL << stages) - 1));
+}
+
+float Decimator::Coefficient(int tap) {
+  if (tap == 0)
+    return 0.5f;
+  if (tap < 0 || tap > DECIMATOR_SIDE_TAPS)
+    return 0.0f;
+  return halfBand.side[tap - 1];
+}
+
+int DecimatorAutoStages(float inputHz, uint32_t publishMicros, int maxStages) {
+  if (publishMicros == 0 || inputHz <= 0.0f)
+    return 0;
+
+  float publishHz = 1000000.0f / publishMicros;
+  int stages = 0;
+  while (stages < maxStages && Decimator::OutputHz(inputHz, stages + 1) >= publishHz) {
+    stages++;
+  }
+  return stages;
+}
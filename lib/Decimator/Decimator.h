@@ -0,0 +1,91 @@
+/* ==========================================================================
+    File:     Decimator.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Anti-aliasing decimation between the sampler and the
+              publisher, a cascade of half band FIR stages per axis so a
+              slower output rate carries band limited averages of the IMU
+              stream instead of point samples that alias vibration
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    Every stage halves the rate, stage n runs at the input rate / 2^n and
+    stage 0 is the input itself. The stages always all run, so a channel
+    can move to another output rate without a settling gap
+   -------------------------------------------------------------------------- */
+#define DECIMATOR_AXES          9     // accel x, y, z, gyro x, y, z, mag x, y, z
+#define DECIMATOR_MAX_STAGES    7     // 119 Hz down to 0.93 Hz
+#define DECIMATOR_BLOCK         32    // samples per Push(), LSM9DS1_FIFO_DEPTH
+#define DECIMATOR_AUTO          0xFF  // a channel's stages follow its publish period
+
+/* --------------------------------------------------------------------------
+    Half band FIR, every other tap is zero but the centre one, so the
+    polyphase form only works the DECIMATOR_SIDE_TAPS symmetric pairs and
+    the centre once per output. Kaiser windowed sinc, flat to 0.006 dB up
+    to 0.15 and down 63 dB from 0.35 of the stage's input rate, the band
+    kept is 0.3 of the output rate
+   -------------------------------------------------------------------------- */
+#define DECIMATOR_SIDE_TAPS     5
+#define DECIMATOR_TAPS          (4 * DECIMATOR_SIDE_TAPS - 1)
+#define DECIMATOR_CENTER        ((DECIMATOR_TAPS - 1) / 2)
+
+// structure of arrays, one row of samples per axis
+struct DecimatorBlock {
+  float     values[DECIMATOR_AXES][DECIMATOR_BLOCK];
+  uint16_t  count;
+};
+
+class Decimator {
+public:
+  Decimator();
+
+  // the next Push() primes every stage with its first sample
+  void Reset();
+
+  // run the block through every stage
+  void Push(const DecimatorBlock& block);
+
+  // newest output of a stage, for one axis or a run of them
+  float Output(int stages, int axis) const        { return _output[stages][axis]; }
+  void Output(int stages, int firstAxis, int axes, float* values) const;
+
+  // outputs of a stage since the last Reset()
+  uint32_t Outputs(int stages) const              { return _outputs[stages]; }
+
+  static float OutputHz(float inputHz, int stages);
+
+  // group delay of the cascade in input samples
+  static float DelaySamples(int stages);
+
+  // the non zero taps, tap 0 the centre then the pairs outwards
+  static float Coefficient(int tap);
+
+private:
+  size_t RunStage(int stage, const float (*input)[DECIMATOR_BLOCK], size_t count, float (*output)[DECIMATOR_BLOCK]);
+  void Prime(const DecimatorBlock& block);
+
+  // two copies of each delay line back to back, so the taps of the newest
+  // sample are always one contiguous run however far the head has moved
+  float     _delay[DECIMATOR_MAX_STAGES][DECIMATOR_AXES][2 * DECIMATOR_TAPS];
+  float     _scratch[2][DECIMATOR_AXES][DECIMATOR_BLOCK];
+  float     _output[DECIMATOR_MAX_STAGES + 1][DECIMATOR_AXES];
+  uint32_t  _outputs[DECIMATOR_MAX_STAGES + 1];
+  uint8_t   _head[DECIMATOR_MAX_STAGES];
+  uint8_t   _phase[DECIMATOR_MAX_STAGES];
+  bool      _primed;
+};
+
+/* --------------------------------------------------------------------------
+    The most stages that still give at least one output per publish period,
+    capped at maxStages
+   -------------------------------------------------------------------------- */
+int DecimatorAutoStages(float inputHz, uint32_t publishMicros, int maxStages);
+
+#endif
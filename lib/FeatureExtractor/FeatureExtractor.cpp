@@ -0,0 +1,242 @@
+/* ==========================================================================
+    File:     FeatureExtractor.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Windowed RMS, peak, crest factor and FFT band levels
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "FeatureExtractor.h"
+#include <TelemetryFrame.h>
+#include <CompactCodec.h>
+#include <math.h>
+#include <string.h>
+
+#define FEATURE_PI 3.14159265f
+
+/* --------------------------------------------------------------------------
+    Shared scratch for the transform, only one window is worked on at a
+    time so every extractor can use the same buffers and twiddles
+   -------------------------------------------------------------------------- */
+static float fftReal[FEATURE_MAX_WINDOW];
+static float fftImag[FEATURE_MAX_WINDOW];
+static float twiddleCos[FEATURE_MAX_WINDOW / 2];
+static float twiddleSin[FEATURE_MAX_WINDOW / 2];
+static bool  twiddlesReady = false;
+
+static void BeginTwiddles() {
+  if (twiddlesReady)
+    return;
+  for (int k = 0; k < FEATURE_MAX_WINDOW / 2; k++) {
+    twiddleCos[k] = cosf(2.0f * FEATURE_PI * k / FEATURE_MAX_WINDOW);
+    twiddleSin[k] = -sinf(2.0f * FEATURE_PI * k / FEATURE_MAX_WINDOW);
+  }
+  twiddlesReady = true;
+}
+
+/* --------------------------------------------------------------------------
+    In place radix-2 decimation in time FFT of n (power of two) points,
+    the loops run over contiguous arrays with no aliasing so the compiler
+    can unroll and pipeline them onto the FPU
+   -------------------------------------------------------------------------- */
+static void Fft(float* __restrict re, float* __restrict im, int n) {
+
+  // bit reversed reorder
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      float t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+
+  for (int length = 2; length <= n; length <<= 1) {
+    int half = length >> 1;
+    int step = FEATURE_MAX_WINDOW / length;
+    for (int start = 0; start < n; start += length) {
+      for (int k = 0; k < half; k++) {
+        float wr = twiddleCos[k * step];
+        float wi = twiddleSin[k * step];
+        int a = start + k;
+        int b = a + half;
+        float tr = re[b] * wr - im[b] * wi;
+        float ti = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+      }
+    }
+  }
+}
+
+FeatureExtractor::FeatureExtractor()
+  : _windowPower(0.0f), _windowLength(0), _hop(0), _head(0), _filled(0),
+    _sinceWindow(0), _sequence(0), _timestampMicros(0) {
+  BeginTwiddles();
+  Configure(FEATURE_MAX_WINDOW, FEATURE_MAX_WINDOW / 2);
+}
+
+bool FeatureExtractor::Configure(uint16_t windowLength, uint16_t overlap) {
+
+  if (windowLength < FEATURE_MIN_WINDOW || windowLength > FEATURE_MAX_WINDOW)
+    return false;
+  if ((windowLength & (windowLength - 1)) != 0 || overlap >= windowLength)
+    return false;
+
+  _windowLength = windowLength;
+  _hop = windowLength - overlap;
+
+  // Hann window and its power, so the band levels come out in signal units
+  _windowPower = 0.0f;
+  for (int i = 0; i < windowLength; i++) {
+    _window[i] = 0.5f - 0.5f * cosf(2.0f * FEATURE_PI * i / windowLength);
+    _windowPower += _window[i] * _window[i];
+  }
+
+  Reset();
+  return true;
+}
+
+void FeatureExtractor::Reset() {
+  _head = 0;
+  _filled = 0;
+  _sinceWindow = 0;
+}
+
+bool FeatureExtractor::Push(const float values[FEATURE_AXES], uint32_t timestampMicros) {
+
+  for (int axis = 0; axis < FEATURE_AXES; axis++)
+    _history[axis][_head] = values[axis];
+
+  _head = (_head + 1) & (FEATURE_MAX_WINDOW - 1);
+  if (_filled < FEATURE_MAX_WINDOW)
+    _filled++;
+  if (_sinceWindow < 0xFFFF)
+    _sinceWindow++;
+  _timestampMicros = timestampMicros;
+
+  return Ready();
+}
+
+bool FeatureExtractor::Compute(FeatureSet& features) {
+
+  if (!Ready())
+    return false;
+
+  unsigned skipped = _sinceWindow / _hop - 1;
+  features.sequence = _sequence++;
+  features.windowLength = _windowLength;
+  features.skipped = skipped > 255 ? 255 : (uint8_t)skipped;
+  features.timestampMicros = _timestampMicros;
+
+  for (int axis = 0; axis < FEATURE_AXES; axis++)
+    ComputeAxis(axis, features);
+
+  _sinceWindow = 0;
+  return true;
+}
+
+void FeatureExtractor::ComputeAxis(int axis, FeatureSet& features) {
+
+  const int n = _windowLength;
+  const float* history = _history[axis];
+  int start = (_head - n) & (FEATURE_MAX_WINDOW - 1);
+
+  // unwrap the newest n samples, tracking the mean on the way
+  float sum = 0.0f;
+  for (int i = 0; i < n; i++) {
+    fftReal[i] = history[(start + i) & (FEATURE_MAX_WINDOW - 1)];
+    sum += fftReal[i];
+  }
+  float mean = sum / n;
+
+  float sumSquares = 0.0f;
+  float peak = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float centered = fftReal[i] - mean;
+    sumSquares += centered * centered;
+    float magnitude = fabsf(centered);
+    if (magnitude > peak)
+      peak = magnitude;
+    fftReal[i] = centered * _window[i];
+    fftImag[i] = 0.0f;
+  }
+
+  float rms = sqrtf(sumSquares / n);
+  features.rms[axis] = rms;
+  features.peak[axis] = peak;
+  features.crest[axis] = rms > 0.0f ? peak / rms : 0.0f;
+
+  Fft(fftReal, fftImag, n);
+
+  // one sided spectrum, scaled so the band levels square sum to the variance
+  const int bins = n / 2;
+  const int binsPerBand = bins / FEATURE_BANDS > 0 ? bins / FEATURE_BANDS : 1;
+  const float scale = 2.0f / (n * _windowPower);
+
+  for (int band = 0; band < FEATURE_BANDS; band++) {
+    float energy = 0.0f;
+    int first = 1 + band * binsPerBand;
+    int last = band == FEATURE_BANDS - 1 ? bins : first + binsPerBand - 1;
+    for (int bin = first; bin <= last && bin <= bins; bin++) {
+      float power = fftReal[bin] * fftReal[bin] + fftImag[bin] * fftImag[bin];
+      energy += bin == bins ? 0.5f * power : power;
+    }
+    features.bands[axis][band] = sqrtf(energy * scale);
+  }
+}
+
+size_t EncodeFeatureSet(const FeatureSet& features, uint8_t* buffer, size_t bufferSize) {
+
+  if (bufferSize < FEATURE_PAYLOAD_SIZE)
+    return 0;
+
+  buffer[0] = FEATURE_SET_VERSION;
+  buffer[1] = FEATURE_AXES;
+  buffer[2] = FEATURE_BANDS;
+  buffer[3] = features.skipped;
+  PutUint16LE(&buffer[4], features.sequence);
+  PutUint16LE(&buffer[6], features.windowLength);
+  PutUint32LE(&buffer[8], features.timestampMicros);
+
+  uint8_t* cursor = &buffer[FEATURE_HEADER_SIZE];
+  for (int axis = 0; axis < FEATURE_AXES; axis++) {
+    PutUint16LE(&cursor[0], FloatToHalf(features.rms[axis]));
+    PutUint16LE(&cursor[2], FloatToHalf(features.peak[axis]));
+    PutUint16LE(&cursor[4], FloatToHalf(features.crest[axis]));
+    for (int band = 0; band < FEATURE_BANDS; band++)
+      PutUint16LE(&cursor[6 + band * 2], FloatToHalf(features.bands[axis][band]));
+    cursor += FEATURE_VALUES * 2;
+  }
+
+  return FEATURE_PAYLOAD_SIZE;
+}
+
+bool DecodeFeatureSet(const uint8_t* buffer, size_t length, FeatureSet& features) {
+
+  if (length < FEATURE_PAYLOAD_SIZE || buffer[0] != FEATURE_SET_VERSION)
+    return false;
+  if (buffer[1] != FEATURE_AXES || buffer[2] != FEATURE_BANDS)
+    return false;
+
+  features.skipped = buffer[3];
+  features.sequence = GetUint16LE(&buffer[4]);
+  features.windowLength = GetUint16LE(&buffer[6]);
+  features.timestampMicros = GetUint32LE(&buffer[8]);
+
+  const uint8_t* cursor = &buffer[FEATURE_HEADER_SIZE];
+  for (int axis = 0; axis < FEATURE_AXES; axis++) {
+    features.rms[axis] = HalfToFloat(GetUint16LE(&cursor[0]));
+    features.peak[axis] = HalfToFloat(GetUint16LE(&cursor[2]));
+    features.crest[axis] = HalfToFloat(GetUint16LE(&cursor[4]));
+    for (int band = 0; band < FEATURE_BANDS; band++)
+      features.bands[axis][band] = HalfToFloat(GetUint16LE(&cursor[6 + band * 2]));
+    cursor += FEATURE_VALUES * 2;
+  }
+
+  return true;
+}
@@ -0,0 +1,102 @@
+/* ==========================================================================
+    File:     FeatureExtractor.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Windowed condition monitoring features over the IMU sample
+              stream, per axis RMS, peak, crest factor and FFT band levels,
+              so the gateway gets a summary instead of every raw vector
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef FEATURE_EXTRACTOR_H
+#define FEATURE_EXTRACTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    Window lengths are powers of two from FEATURE_MIN_WINDOW up to
+    FEATURE_MAX_WINDOW samples, every buffer is sized for the largest
+   -------------------------------------------------------------------------- */
+#define FEATURE_MIN_WINDOW      16
+#define FEATURE_MAX_WINDOW      128
+#define FEATURE_AXES            6     // accel x, y, z then gyro x, y, z
+#define FEATURE_BANDS           8     // equal width bands from DC to Nyquist
+#define FEATURE_VALUES          (3 + FEATURE_BANDS)
+
+/* --------------------------------------------------------------------------
+    Features Layout (little endian), version 1
+      [0]      version
+      [1]      axes
+      [2]      bands
+      [3]      windows skipped since the last one (saturates at 255)
+      [4..5]   sequence
+      [6..7]   window length (samples)
+      [8..11]  timestamp of the newest sample (micros)
+      then per axis, as half floats
+      rms, peak, crest factor, band rms[FEATURE_BANDS]
+   -------------------------------------------------------------------------- */
+#define FEATURE_SET_VERSION     1
+#define FEATURE_HEADER_SIZE     12
+#define FEATURE_PAYLOAD_SIZE    (FEATURE_HEADER_SIZE + FEATURE_AXES * FEATURE_VALUES * 2)
+
+struct FeatureSet {
+  uint16_t  sequence;
+  uint16_t  windowLength;
+  uint8_t   skipped;
+  uint32_t  timestampMicros;
+  float     rms[FEATURE_AXES];          // of the signal around its mean
+  float     peak[FEATURE_AXES];         // largest distance from the mean
+  float     crest[FEATURE_AXES];        // peak / rms
+  float     bands[FEATURE_AXES][FEATURE_BANDS];   // rms of each band, Hann windowed
+};
+
+class FeatureExtractor {
+public:
+  FeatureExtractor();
+
+  /* ------------------------------------------------------------------------
+      windowLength must be a power of two in range and overlap less than
+      it, a window is ready every windowLength - overlap samples. Returns
+      false and keeps the old configuration otherwise
+     ------------------------------------------------------------------------ */
+  bool Configure(uint16_t windowLength, uint16_t overlap);
+
+  uint16_t WindowLength() const { return _windowLength; }
+  uint16_t Overlap() const { return _windowLength - _hop; }
+
+  void Reset();
+
+  // queue one sample of FEATURE_AXES values, true once a window is ready
+  bool Push(const float values[FEATURE_AXES], uint32_t timestampMicros);
+
+  bool Ready() const { return _filled >= _windowLength && _sinceWindow >= _hop; }
+
+  // work out the features of the newest window, false when none is ready
+  bool Compute(FeatureSet& features);
+
+private:
+  void ComputeAxis(int axis, FeatureSet& features);
+
+  // structure of arrays, one history ring per axis
+  float     _history[FEATURE_AXES][FEATURE_MAX_WINDOW];
+  float     _window[FEATURE_MAX_WINDOW];
+  float     _windowPower;
+  uint16_t  _windowLength;
+  uint16_t  _hop;
+  uint16_t  _head;
+  uint16_t  _filled;
+  uint16_t  _sinceWindow;
+  uint16_t  _sequence;
+  uint32_t  _timestampMicros;
+};
+
+/* --------------------------------------------------------------------------
+    Pack a FeatureSet, buffer needs FEATURE_PAYLOAD_SIZE bytes. Returns the
+    bytes written, 0 if the buffer is too small
+   -------------------------------------------------------------------------- */
+size_t EncodeFeatureSet(const FeatureSet& features, uint8_t* buffer, size_t bufferSize);
+
+bool DecodeFeatureSet(const uint8_t* buffer, size_t length, FeatureSet& features);
+
+#endif
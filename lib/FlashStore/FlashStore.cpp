@@ -0,0 +1,242 @@
+/* ==========================================================================
+    File:     FlashStore.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Log structured record store for internal flash
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "FlashStore.h"
+#include <string.h>
+
+uint8_t FlashStoreCrc8(const uint8_t* data, size_t length) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+FlashStore::FlashStore()
+  : _device(0), _headPage(FLASH_STORE_NO_PAGE), _headPosition(0),
+    _records(0), _erases(0), _pagesLost(0) {
+  for (int i = 0; i < FLASH_STORE_MAX_PAGES; i++)
+    _sequence[i] = FLASH_STORE_NO_PAGE;
+}
+
+bool FlashStore::Begin(const FlashDevice& device) {
+
+  if (device.pageCount < 2 || device.pageCount > FLASH_STORE_MAX_PAGES)
+    return false;
+  if (device.pageSize <= FLASH_STORE_PAGE_HEADER + FLASH_STORE_RECORD_HEADER + FLASH_STORE_MAX_RECORD)
+    return false;
+
+  _deviceCopy = device;
+  _device = &_deviceCopy;
+  _headPage = FLASH_STORE_NO_PAGE;
+  _headPosition = 0;
+
+  // anything without our header is treated as free and erased when reached
+  for (uint32_t page = 0; page < device.pageCount; page++) {
+    uint32_t header[2];
+    _sequence[page] = FLASH_STORE_NO_PAGE;
+    if (!device.read(PageOffset(page), header, sizeof(header)))
+      continue;
+    if (header[0] != FLASH_STORE_PAGE_MAGIC || header[1] == FLASH_STORE_NO_PAGE)
+      continue;
+
+    _sequence[page] = header[1];
+    if (_headPage == FLASH_STORE_NO_PAGE || header[1] > _sequence[_headPage])
+      _headPage = page;
+  }
+
+  if (_headPage != FLASH_STORE_NO_PAGE)
+    _headPosition = ScanPage(_headPage);
+
+  return true;
+}
+
+int FlashStore::FindPage(uint32_t sequence) const {
+  for (uint32_t page = 0; page < _device->pageCount; page++) {
+    if (_sequence[page] == sequence)
+      return (int)page;
+  }
+  return -1;
+}
+
+bool FlashStore::ReadRecordHeader(uint32_t page, uint32_t position, uint8_t& length, uint8_t& crc) {
+
+  if (position + FLASH_STORE_RECORD_HEADER > DataSize())
+    return false;
+
+  uint8_t header[FLASH_STORE_RECORD_HEADER];
+  if (!_device->read(PageOffset(page) + FLASH_STORE_PAGE_HEADER + position, header, sizeof(header)))
+    return false;
+
+  length = header[0];
+  crc = header[1];
+  return header[3] == FLASH_STORE_RECORD_MARK && length > 0 &&
+         length <= FLASH_STORE_MAX_RECORD && header[2] == (uint8_t)~length &&
+         position + FLASH_STORE_RECORD_HEADER + length <= DataSize();
+}
+
+/* --------------------------------------------------------------------------
+    Where the records of a page end, a torn write ends the page early
+   -------------------------------------------------------------------------- */
+uint32_t FlashStore::ScanPage(uint32_t page) {
+  uint32_t position = 0;
+  uint8_t length, crc;
+  while (ReadRecordHeader(page, position, length, crc)) {
+    position += FLASH_STORE_RECORD_HEADER + ((length + 3) & ~3u);
+  }
+
+  // if anything was written past the last record we can not append to it
+  uint32_t word;
+  if (position + sizeof(word) <= DataSize() &&
+      _device->read(PageOffset(page) + FLASH_STORE_PAGE_HEADER + position, &word, sizeof(word)) &&
+      word != 0xFFFFFFFFUL)
+    return DataSize();
+
+  return position;
+}
+
+/* --------------------------------------------------------------------------
+    Move the head to the next page round robin, giving up the oldest
+   -------------------------------------------------------------------------- */
+bool FlashStore::OpenPage() {
+
+  uint32_t page = _headPage == FLASH_STORE_NO_PAGE ? 0 : (_headPage + 1) % _device->pageCount;
+  uint32_t sequence = _headPage == FLASH_STORE_NO_PAGE ? 0 : _sequence[_headPage] + 1;
+
+  if (_sequence[page] != FLASH_STORE_NO_PAGE)
+    _pagesLost++;
+
+  _sequence[page] = FLASH_STORE_NO_PAGE;
+  if (!_device->erase(page))
+    return false;
+  _erases++;
+
+  uint32_t header[2] = { FLASH_STORE_PAGE_MAGIC, sequence };
+  if (!_device->program(PageOffset(page), header, sizeof(header)))
+    return false;
+
+  _sequence[page] = sequence;
+  _headPage = page;
+  _headPosition = 0;
+  return true;
+}
+
+bool FlashStore::Append(const void* record, size_t length) {
+
+  if (!_device || length == 0 || length > FLASH_STORE_MAX_RECORD)
+    return false;
+
+  uint32_t size = FLASH_STORE_RECORD_HEADER + ((length + 3) & ~3u);
+  if (_headPage == FLASH_STORE_NO_PAGE || _headPosition + size > DataSize()) {
+    if (!OpenPage())
+      return false;
+  }
+
+  uint32_t words[(FLASH_STORE_RECORD_HEADER + FLASH_STORE_MAX_RECORD + 3) / 4];
+  uint8_t* bytes = (uint8_t*)words;
+  memset(bytes, 0xFF, size);
+  bytes[0] = (uint8_t)length;
+  bytes[1] = FlashStoreCrc8((const uint8_t*)record, length);
+  bytes[2] = (uint8_t)~length;
+  bytes[3] = FLASH_STORE_RECORD_MARK;
+  memcpy(&bytes[FLASH_STORE_RECORD_HEADER], record, length);
+
+  uint32_t offset = PageOffset(_headPage) + FLASH_STORE_PAGE_HEADER + _headPosition;
+  _headPosition += size;
+  if (!_device->program(offset, words, size))
+    return false;
+
+  _records++;
+  return true;
+}
+
+size_t FlashStore::ReadChunk(uint32_t offset, uint8_t* buffer, size_t bufferSize, uint32_t& nextOffset) {
+
+  nextOffset = offset;
+  if (!_device || _headPage == FLASH_STORE_NO_PAGE)
+    return 0;
+
+  if (offset < TailOffset())
+    offset = TailOffset();
+
+  uint32_t headSequence = _sequence[_headPage];
+  uint32_t sequence = offset / DataSize();
+  uint32_t position = offset % DataSize();
+  size_t written = 0;
+
+  while (sequence <= headSequence) {
+    int page = FindPage(sequence);
+    uint32_t end = sequence == headSequence ? _headPosition : DataSize();
+
+    uint8_t length, crc;
+    while (page >= 0 && position < end && ReadRecordHeader(page, position, length, crc)) {
+      if (written + 1 + length > bufferSize) {
+        nextOffset = sequence * DataSize() + position;
+        return written;
+      }
+
+      uint8_t* payload = &buffer[written + 1];
+      uint32_t at = PageOffset(page) + FLASH_STORE_PAGE_HEADER + position + FLASH_STORE_RECORD_HEADER;
+      position += FLASH_STORE_RECORD_HEADER + ((length + 3) & ~3u);
+      if (!_device->read(at, payload, length) || FlashStoreCrc8(payload, length) != crc)
+        continue;
+
+      buffer[written] = length;
+      written += 1 + length;
+    }
+
+    if (sequence == headSequence) {
+      nextOffset = sequence * DataSize() + position;
+      break;
+    }
+
+    // the rest of this page is empty or torn, go on with the next
+    sequence++;
+    position = 0;
+    nextOffset = sequence * DataSize();
+  }
+
+  return written;
+}
+
+bool FlashStore::Format() {
+
+  if (!_device)
+    return false;
+
+  for (uint32_t page = 0; page < _device->pageCount; page++) {
+    _sequence[page] = FLASH_STORE_NO_PAGE;
+    if (!_device->erase(page))
+      return false;
+    _erases++;
+  }
+  _headPage = FLASH_STORE_NO_PAGE;
+  _headPosition = 0;
+  return true;
+}
+
+uint32_t FlashStore::TailOffset() const {
+
+  if (!_device || _headPage == FLASH_STORE_NO_PAGE)
+    return 0;
+
+  uint32_t tail = _sequence[_headPage];
+  for (uint32_t page = 0; page < _device->pageCount; page++) {
+    if (_sequence[page] != FLASH_STORE_NO_PAGE && _sequence[page] < tail)
+      tail = _sequence[page];
+  }
+  return tail * DataSize();
+}
+
+uint32_t FlashStore::HeadOffset() const {
+  if (!_device || _headPage == FLASH_STORE_NO_PAGE)
+    return 0;
+  return _sequence[_headPage] * DataSize() + _headPosition;
+}
@@ -0,0 +1,106 @@
+/* ==========================================================================
+    File:     FlashStore.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Log structured record store for internal flash, keeps
+              telemetry while no Central/Gateway is connected and reads it
+              back in sequential chunks from any offset
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    Flash access, the nRF52840 NVMC on the Nano 33 BLE and a simulated
+    page erase device on the host. Offsets are from the start of the store,
+    program() takes word aligned offsets and lengths and can only clear
+    bits, erase() sets a whole page back to 0xFF. All return false on
+    failure
+   -------------------------------------------------------------------------- */
+struct FlashDevice {
+  uint32_t  pageSize;
+  uint32_t  pageCount;
+  bool      (*read)(uint32_t offset, void* data, size_t length);
+  bool      (*program)(uint32_t offset, const void* data, size_t length);
+  bool      (*erase)(uint32_t page);
+};
+
+/* --------------------------------------------------------------------------
+    Page Layout
+      [0..3]   FLASH_STORE_PAGE_MAGIC
+      [4..7]   page sequence, counts up forever, erased pages read 0xFFFFFFFF
+      then records, each word aligned
+      [0]      length (1..FLASH_STORE_MAX_RECORD)
+      [1]      crc8 of the payload
+      [2]      ~length
+      [3]      FLASH_STORE_RECORD_MARK
+      [4..]    payload, padded with 0xFF to a word
+
+    Pages are written round robin, so every page is erased once per lap
+    of the store and the oldest page is given up when it is full.
+
+    Offsets are logical, page sequence * data bytes per page + position,
+    so one taken from ReadChunk() stays valid until its page is erased
+   -------------------------------------------------------------------------- */
+#define FLASH_STORE_PAGE_MAGIC    0x31475346UL    // "FSG1"
+#define FLASH_STORE_PAGE_HEADER   8
+#define FLASH_STORE_RECORD_HEADER 4
+#define FLASH_STORE_RECORD_MARK   0x5A
+#define FLASH_STORE_MAX_RECORD    128
+#define FLASH_STORE_MAX_PAGES     64
+#define FLASH_STORE_NO_PAGE       0xFFFFFFFFUL
+
+class FlashStore {
+public:
+  FlashStore();
+
+  // mount the store, picking up where the last power cycle left off
+  bool Begin(const FlashDevice& device);
+
+  bool Ready() const { return _device != 0; }
+
+  bool Append(const void* record, size_t length);
+
+  /* ------------------------------------------------------------------------
+      Copy whole records from offset on into buffer, each as [length]
+      followed by the payload. An offset older than the store starts at
+      the oldest record. Returns the bytes written and where to go on from
+     ------------------------------------------------------------------------ */
+  size_t ReadChunk(uint32_t offset, uint8_t* buffer, size_t bufferSize, uint32_t& nextOffset);
+
+  // erase every page
+  bool Format();
+
+  uint32_t TailOffset() const;
+  uint32_t HeadOffset() const;
+  bool Empty() const { return TailOffset() == HeadOffset(); }
+
+  uint32_t Records() const { return _records; }
+  uint32_t Erases() const { return _erases; }
+  uint32_t PagesLost() const { return _pagesLost; }
+
+private:
+  uint32_t DataSize() const { return _device->pageSize - FLASH_STORE_PAGE_HEADER; }
+  uint32_t PageOffset(uint32_t page) const { return page * _device->pageSize; }
+  int FindPage(uint32_t sequence) const;
+  bool ReadRecordHeader(uint32_t page, uint32_t position, uint8_t& length, uint8_t& crc);
+  uint32_t ScanPage(uint32_t page);
+  bool OpenPage();
+
+  const FlashDevice*  _device;
+  FlashDevice         _deviceCopy;
+  uint32_t            _sequence[FLASH_STORE_MAX_PAGES];
+  uint32_t            _headPage;
+  uint32_t            _headPosition;
+  uint32_t            _records;
+  uint32_t            _erases;
+  uint32_t            _pagesLost;
+};
+
+uint8_t FlashStoreCrc8(const uint8_t* data, size_t length);
+
+#endif
@@ -0,0 +1,390 @@
+/* ==========================================================================
+    File:     FusionEngine.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Madgwick, Mahony and complementary orientation filters
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "FusionEngine.h"
+#include <math.h>
+
+#define DEG_TO_RAD_F 0.0174532925f
+
+/* --------------------------------------------------------------------------
+    On the Cortex-M4F sqrt is a single VSQRT.F32 (14 cycles, exact), so
+    1 / sqrt(x) is that plus a VDIV.F32 in place of the bit trick and Newton
+    step the MadgwickAHRS library uses, anything else gets sqrtf()
+   -------------------------------------------------------------------------- */
+static inline float Sqrt(float x) {
+#if defined(__ARM_FP) && (__ARM_FP & 0x4)
+  float root;
+  __asm__ ("vsqrt.f32 %0, %1" : "=t" (root) : "t" (x));
+  return root;
+#else
+  return sqrtf(x);
+#endif
+}
+
+static inline float InvSqrt(float x) {
+  return 1.0f / Sqrt(x);
+}
+
+FusionEngine::FusionEngine()
+  : _algorithm(FUSION_MADGWICK), _dt(1.0f / 119.0f) {
+  _gains.beta = FUSION_DEFAULT_BETA;
+  _gains.kp = FUSION_DEFAULT_KP;
+  _gains.ki = FUSION_DEFAULT_KI;
+  _gains.alpha = FUSION_DEFAULT_ALPHA;
+  Reset();
+}
+
+void FusionEngine::Begin(FusionAlgorithm algorithm, float sampleHz) {
+  _dt = 1.0f / sampleHz;
+  _algorithm = algorithm < FUSION_ALGORITHM_COUNT ? algorithm : FUSION_MADGWICK;
+  Reset();
+}
+
+void FusionEngine::SetSampleRate(float sampleHz) {
+  if (sampleHz > 0.0f) {
+    _dt = 1.0f / sampleHz;
+  }
+}
+
+void FusionEngine::SetAlgorithm(FusionAlgorithm algorithm) {
+  if (algorithm >= FUSION_ALGORITHM_COUNT)
+    return;
+  _algorithm = algorithm;
+  _integral[0] = _integral[1] = _integral[2] = 0.0f;
+}
+
+void FusionEngine::Reset() {
+  _q[0] = 1.0f;
+  _q[1] = _q[2] = _q[3] = 0.0f;
+  _integral[0] = _integral[1] = _integral[2] = 0.0f;
+}
+
+void FusionEngine::Update(float gx, float gy, float gz,
+                          float ax, float ay, float az,
+                          float mx, float my, float mz) {
+
+  bool useMag = !(mx == 0.0f && my == 0.0f && mz == 0.0f);
+
+  gx *= DEG_TO_RAD_F;
+  gy *= DEG_TO_RAD_F;
+  gz *= DEG_TO_RAD_F;
+
+  // without gravity we have nothing to correct against
+  if (ax == 0.0f && ay == 0.0f && az == 0.0f) {
+    IntegrateGyro(gx, gy, gz);
+    Normalize();
+    return;
+  }
+
+  switch (_algorithm) {
+    case FUSION_MAHONY:
+      UpdateMahony(gx, gy, gz, ax, ay, az, mx, my, mz, useMag);
+      break;
+
+    case FUSION_COMPLEMENTARY:
+      UpdateComplementary(gx, gy, gz, ax, ay, az, mx, my, mz, useMag);
+      break;
+
+    default:
+      if (useMag)
+        UpdateMadgwick(gx, gy, gz, ax, ay, az, mx, my, mz);
+      else
+        UpdateMadgwickIMU(gx, gy, gz, ax, ay, az);
+      break;
+  }
+}
+
+void FusionEngine::GetQuaternion(float q[4]) const {
+  q[0] = _q[0];
+  q[1] = _q[1];
+  q[2] = _q[2];
+  q[3] = _q[3];
+}
+
+void FusionEngine::GetEuler(float euler[3]) const {
+  float q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+  float sinPitch = -2.0f * (q1 * q3 - q0 * q2);
+  if (sinPitch > 1.0f)
+    sinPitch = 1.0f;
+  else if (sinPitch < -1.0f)
+    sinPitch = -1.0f;
+
+  euler[0] = atan2f(q1 * q2 + q0 * q3, 0.5f - q2 * q2 - q3 * q3);
+  euler[1] = asinf(sinPitch);
+  euler[2] = atan2f(q0 * q1 + q2 * q3, 0.5f - q1 * q1 - q2 * q2);
+}
+
+/* --------------------------------------------------------------------------
+    q += 0.5 * q x (0, g) * dt
+   -------------------------------------------------------------------------- */
+void FusionEngine::IntegrateGyro(float gx, float gy, float gz) {
+  float q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+  float halfDt = 0.5f * _dt;
+  _q[0] += (-q1 * gx - q2 * gy - q3 * gz) * halfDt;
+  _q[1] += ( q0 * gx + q2 * gz - q3 * gy) * halfDt;
+  _q[2] += ( q0 * gy - q1 * gz + q3 * gx) * halfDt;
+  _q[3] += ( q0 * gz + q1 * gy - q2 * gx) * halfDt;
+}
+
+void FusionEngine::Normalize() {
+  float recipNorm = InvSqrt(_q[0] * _q[0] + _q[1] * _q[1] + _q[2] * _q[2] + _q[3] * _q[3]);
+  _q[0] *= recipNorm;
+  _q[1] *= recipNorm;
+  _q[2] *= recipNorm;
+  _q[3] *= recipNorm;
+}
+
+/* --------------------------------------------------------------------------
+    Madgwick, gradient descent on the gravity and earth flux error
+   -------------------------------------------------------------------------- */
+void FusionEngine::UpdateMadgwick(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz) {
+
+  float q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+  float recipNorm;
+
+  float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+  float qDot1 = 0.5f * ( q0 * gx + q2 * gz - q3 * gy);
+  float qDot2 = 0.5f * ( q0 * gy - q1 * gz + q3 * gx);
+  float qDot3 = 0.5f * ( q0 * gz + q1 * gy - q2 * gx);
+
+  recipNorm = InvSqrt(ax * ax + ay * ay + az * az);
+  ax *= recipNorm;
+  ay *= recipNorm;
+  az *= recipNorm;
+
+  recipNorm = InvSqrt(mx * mx + my * my + mz * mz);
+  mx *= recipNorm;
+  my *= recipNorm;
+  mz *= recipNorm;
+
+  float _2q0mx = 2.0f * q0 * mx;
+  float _2q0my = 2.0f * q0 * my;
+  float _2q0mz = 2.0f * q0 * mz;
+  float _2q1mx = 2.0f * q1 * mx;
+  float _2q0 = 2.0f * q0;
+  float _2q1 = 2.0f * q1;
+  float _2q2 = 2.0f * q2;
+  float _2q3 = 2.0f * q3;
+  float _2q0q2 = 2.0f * q0 * q2;
+  float _2q2q3 = 2.0f * q2 * q3;
+  float q0q0 = q0 * q0;
+  float q0q1 = q0 * q1;
+  float q0q2 = q0 * q2;
+  float q0q3 = q0 * q3;
+  float q1q1 = q1 * q1;
+  float q1q2 = q1 * q2;
+  float q1q3 = q1 * q3;
+  float q2q2 = q2 * q2;
+  float q2q3 = q2 * q3;
+  float q3q3 = q3 * q3;
+
+  // reference direction of the earth magnetic field
+  float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+  float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+  float _2bx = Sqrt(hx * hx + hy * hy);
+  float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+  float _4bx = 2.0f * _2bx;
+  float _4bz = 2.0f * _2bz;
+
+  // shared error terms of the objective function
+  float fax = 2.0f * q1q3 - _2q0q2 - ax;
+  float fay = 2.0f * q0q1 + _2q2q3 - ay;
+  float faz = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+  float fmx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+  float fmy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+  float fmz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+  float s0 = -_2q2 * fax + _2q1 * fay - _2bz * q2 * fmx + (-_2bx * q3 + _2bz * q1) * fmy + _2bx * q2 * fmz;
+  float s1 = _2q3 * fax + _2q0 * fay - 4.0f * q1 * faz + _2bz * q3 * fmx + (_2bx * q2 + _2bz * q0) * fmy + (_2bx * q3 - _4bz * q1) * fmz;
+  float s2 = -_2q0 * fax + _2q3 * fay - 4.0f * q2 * faz + (-_4bx * q2 - _2bz * q0) * fmx + (_2bx * q1 + _2bz * q3) * fmy + (_2bx * q0 - _4bz * q2) * fmz;
+  float s3 = _2q1 * fax + _2q2 * fay + (-_4bx * q3 + _2bz * q1) * fmx + (-_2bx * q0 + _2bz * q2) * fmy + _2bx * q1 * fmz;
+
+  float stepNorm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+  if (stepNorm > 0.0f) {
+    recipNorm = InvSqrt(stepNorm);
+    qDot0 -= _gains.beta * s0 * recipNorm;
+    qDot1 -= _gains.beta * s1 * recipNorm;
+    qDot2 -= _gains.beta * s2 * recipNorm;
+    qDot3 -= _gains.beta * s3 * recipNorm;
+  }
+
+  _q[0] = q0 + qDot0 * _dt;
+  _q[1] = q1 + qDot1 * _dt;
+  _q[2] = q2 + qDot2 * _dt;
+  _q[3] = q3 + qDot3 * _dt;
+  Normalize();
+}
+
+void FusionEngine::UpdateMadgwickIMU(float gx, float gy, float gz, float ax, float ay, float az) {
+
+  float q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+  float recipNorm;
+
+  float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+  float qDot1 = 0.5f * ( q0 * gx + q2 * gz - q3 * gy);
+  float qDot2 = 0.5f * ( q0 * gy - q1 * gz + q3 * gx);
+  float qDot3 = 0.5f * ( q0 * gz + q1 * gy - q2 * gx);
+
+  recipNorm = InvSqrt(ax * ax + ay * ay + az * az);
+  ax *= recipNorm;
+  ay *= recipNorm;
+  az *= recipNorm;
+
+  float _2q0 = 2.0f * q0;
+  float _2q1 = 2.0f * q1;
+  float _2q2 = 2.0f * q2;
+  float _2q3 = 2.0f * q3;
+  float _4q0 = 4.0f * q0;
+  float _4q1 = 4.0f * q1;
+  float _4q2 = 4.0f * q2;
+  float _8q1 = 8.0f * q1;
+  float _8q2 = 8.0f * q2;
+  float q0q0 = q0 * q0;
+  float q1q1 = q1 * q1;
+  float q2q2 = q2 * q2;
+  float q3q3 = q3 * q3;
+
+  float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+  float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+  float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+  float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+
+  float stepNorm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+  if (stepNorm > 0.0f) {
+    recipNorm = InvSqrt(stepNorm);
+    qDot0 -= _gains.beta * s0 * recipNorm;
+    qDot1 -= _gains.beta * s1 * recipNorm;
+    qDot2 -= _gains.beta * s2 * recipNorm;
+    qDot3 -= _gains.beta * s3 * recipNorm;
+  }
+
+  _q[0] = q0 + qDot0 * _dt;
+  _q[1] = q1 + qDot1 * _dt;
+  _q[2] = q2 + qDot2 * _dt;
+  _q[3] = q3 + qDot3 * _dt;
+  Normalize();
+}
+
+/* --------------------------------------------------------------------------
+    Mahony, PI feedback of the cross product between measured and
+    estimated gravity (and flux) into the gyro rate
+   -------------------------------------------------------------------------- */
+void FusionEngine::UpdateMahony(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, bool useMag) {
+
+  float q0 = _q[0], q1 = _q[1], q2 = _q[2], q3 = _q[3];
+  float recipNorm;
+
+  recipNorm = InvSqrt(ax * ax + ay * ay + az * az);
+  ax *= recipNorm;
+  ay *= recipNorm;
+  az *= recipNorm;
+
+  float q0q0 = q0 * q0;
+  float q0q1 = q0 * q1;
+  float q0q2 = q0 * q2;
+  float q0q3 = q0 * q3;
+  float q1q1 = q1 * q1;
+  float q1q2 = q1 * q2;
+  float q1q3 = q1 * q3;
+  float q2q2 = q2 * q2;
+  float q2q3 = q2 * q3;
+  float q3q3 = q3 * q3;
+
+  // estimated direction of gravity
+  float halfvx = q1q3 - q0q2;
+  float halfvy = q0q1 + q2q3;
+  float halfvz = q0q0 - 0.5f + q3q3;
+
+  float halfex = ay * halfvz - az * halfvy;
+  float halfey = az * halfvx - ax * halfvz;
+  float halfez = ax * halfvy - ay * halfvx;
+
+  if (useMag) {
+    recipNorm = InvSqrt(mx * mx + my * my + mz * mz);
+    mx *= recipNorm;
+    my *= recipNorm;
+    mz *= recipNorm;
+
+    // reference direction of the earth magnetic field, then its estimate
+    float hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+    float hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+    float bx = Sqrt(hx * hx + hy * hy);
+    float bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+    float halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+    float halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+    float halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+    halfex += my * halfwz - mz * halfwy;
+    halfey += mz * halfwx - mx * halfwz;
+    halfez += mx * halfwy - my * halfwx;
+  }
+
+  if (_gains.ki > 0.0f) {
+    _integral[0] += 2.0f * _gains.ki * halfex * _dt;
+    _integral[1] += 2.0f * _gains.ki * halfey * _dt;
+    _integral[2] += 2.0f * _gains.ki * halfez * _dt;
+    gx += _integral[0];
+    gy += _integral[1];
+    gz += _integral[2];
+  } else {
+    _integral[0] = _integral[1] = _integral[2] = 0.0f;
+  }
+
+  gx += 2.0f * _gains.kp * halfex;
+  gy += 2.0f * _gains.kp * halfey;
+  gz += 2.0f * _gains.kp * halfez;
+
+  IntegrateGyro(gx, gy, gz);
+  Normalize();
+}
+
+/* --------------------------------------------------------------------------
+    Complementary, the gyro integrated quaternion is pulled toward the
+    orientation the accel (roll, pitch) and tilt compensated magnetometer
+    (yaw) measure, by 1 - alpha per step
+   -------------------------------------------------------------------------- */
+void FusionEngine::UpdateComplementary(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, bool useMag) {
+
+  IntegrateGyro(gx, gy, gz);
+  Normalize();
+
+  float roll = atan2f(ay, az);
+  float pitch = atan2f(-ax, Sqrt(ay * ay + az * az));
+  float yaw;
+
+  float sinRoll = sinf(roll), cosRoll = cosf(roll);
+  float sinPitch = sinf(pitch), cosPitch = cosf(pitch);
+
+  if (useMag) {
+    float hx = mx * cosPitch + my * sinRoll * sinPitch + mz * cosRoll * sinPitch;
+    float hy = my * cosRoll - mz * sinRoll;
+    yaw = atan2f(-hy, hx);
+  } else {
+    // no heading reference, keep the one the gyro integrated
+    yaw = atan2f(_q[1] * _q[2] + _q[0] * _q[3], 0.5f - _q[2] * _q[2] - _q[3] * _q[3]);
+  }
+
+  float cr = cosf(roll * 0.5f), sr = sinf(roll * 0.5f);
+  float cp = cosf(pitch * 0.5f), sp = sinf(pitch * 0.5f);
+  float cy = cosf(yaw * 0.5f), sy = sinf(yaw * 0.5f);
+
+  float m[4];
+  m[0] = cr * cp * cy + sr * sp * sy;
+  m[1] = sr * cp * cy - cr * sp * sy;
+  m[2] = cr * sp * cy + sr * cp * sy;
+  m[3] = cr * cp * sy - sr * sp * cy;
+
+  // q and -q are the same rotation, blend along the short way
+  float dot = _q[0] * m[0] + _q[1] * m[1] + _q[2] * m[2] + _q[3] * m[3];
+  float weight = dot < 0.0f ? -(1.0f - _gains.alpha) : (1.0f - _gains.alpha);
+
+  for (int i = 0; i < 4; i++)
+    _q[i] = _gains.alpha * _q[i] + weight * m[i];
+  Normalize();
+}
@@ -0,0 +1,96 @@
+/* ==========================================================================
+    File:     FusionEngine.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Orientation fusion for the LSM9DS1 with a selectable
+              algorithm (Madgwick, Mahony or complementary) and the
+              quaternion available directly, Euler angles on request
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef FUSION_ENGINE_H
+#define FUSION_ENGINE_H
+
+#include <stdint.h>
+
+enum FusionAlgorithm : uint8_t {
+  FUSION_MADGWICK = 0,
+  FUSION_MAHONY,
+  FUSION_COMPLEMENTARY,
+  FUSION_ALGORITHM_COUNT
+};
+
+// advertised in the Device Capability Schema, same order as FusionAlgorithm
+#define FUSION_ALGORITHMS "madgwick,mahony,complementary"
+
+enum FusionOutput : uint8_t {
+  FUSION_OUTPUT_EULER = 0,      // yaw, pitch, roll in radians
+  FUSION_OUTPUT_QUATERNION,     // w, x, y, z
+  FUSION_OUTPUT_COUNT
+};
+
+/* --------------------------------------------------------------------------
+    Gains, the defaults match the MadgwickAHRS and MahonyAHRS libraries
+      beta   Madgwick gradient descent step
+      kp/ki  Mahony proportional and integral feedback
+      alpha  Complementary weight of the gyro path per step
+   -------------------------------------------------------------------------- */
+#define FUSION_DEFAULT_BETA   0.1f
+#define FUSION_DEFAULT_KP     0.5f
+#define FUSION_DEFAULT_KI     0.0f
+#define FUSION_DEFAULT_ALPHA  0.98f
+
+struct FusionGains {
+  float beta;
+  float kp;
+  float ki;
+  float alpha;
+};
+
+class FusionEngine {
+public:
+  FusionEngine();
+
+  void Begin(FusionAlgorithm algorithm, float sampleHz);
+
+  // a new sample rate keeps the orientation, only the filter step changes
+  void SetSampleRate(float sampleHz);
+
+  // switching keeps the current orientation so the output does not jump
+  void SetAlgorithm(FusionAlgorithm algorithm);
+  FusionAlgorithm Algorithm() const { return _algorithm; }
+
+  FusionGains& Gains() { return _gains; }
+
+  /* ------------------------------------------------------------------------
+      One filter step of 1 / sampleHz, gyro in degrees per second, accel and
+      magnetometer in any unit (they are normalized), a magnetometer of all
+      zeros runs the 6 axis variant
+     ------------------------------------------------------------------------ */
+  void Update(float gx, float gy, float gz,
+              float ax, float ay, float az,
+              float mx, float my, float mz);
+
+  void Reset();
+
+  void GetQuaternion(float q[4]) const;
+
+  // yaw, pitch, roll in radians, the only place any trig runs
+  void GetEuler(float euler[3]) const;
+
+private:
+  void UpdateMadgwick(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
+  void UpdateMadgwickIMU(float gx, float gy, float gz, float ax, float ay, float az);
+  void UpdateMahony(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, bool useMag);
+  void UpdateComplementary(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, bool useMag);
+  void IntegrateGyro(float gx, float gy, float gz);
+  void Normalize();
+
+  FusionAlgorithm _algorithm;
+  FusionGains     _gains;
+  float           _q[4];
+  float           _integral[3];
+  float           _dt;
+};
+
+#endif
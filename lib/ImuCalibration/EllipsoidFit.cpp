@@ -0,0 +1,277 @@
+/* ==========================================================================
+    File:     EllipsoidFit.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Incremental least squares ellipsoid fit for the magnetometer
+              hard and soft iron and a sphere fit for accelerometer offsets
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "EllipsoidFit.h"
+#include <math.h>
+#include <string.h>
+
+/* --------------------------------------------------------------------------
+    Gaussian elimination with partial pivoting on the first n rows and
+    columns, the solution replaces b
+   -------------------------------------------------------------------------- */
+static bool SolveLinear(double a[ELLIPSOID_PARAMETERS][ELLIPSOID_PARAMETERS], double b[ELLIPSOID_PARAMETERS], int n) {
+  for (int column = 0; column < n; column++) {
+    int pivot = column;
+    for (int row = column + 1; row < n; row++) {
+      if (fabs(a[row][column]) > fabs(a[pivot][column]))
+        pivot = row;
+    }
+    if (fabs(a[pivot][column]) < 1e-12)
+      return false;
+
+    if (pivot != column) {
+      for (int k = 0; k < n; k++) {
+        double swap = a[column][k];
+        a[column][k] = a[pivot][k];
+        a[pivot][k] = swap;
+      }
+      double swap = b[column];
+      b[column] = b[pivot];
+      b[pivot] = swap;
+    }
+
+    for (int row = column + 1; row < n; row++) {
+      double factor = a[row][column] / a[column][column];
+      for (int k = column; k < n; k++) {
+        a[row][k] -= factor * a[column][k];
+      }
+      b[row] -= factor * b[column];
+    }
+  }
+
+  for (int row = n - 1; row >= 0; row--) {
+    double sum = b[row];
+    for (int k = row + 1; k < n; k++) {
+      sum -= a[row][k] * b[k];
+    }
+    b[row] = sum / a[row][row];
+  }
+  return true;
+}
+
+/* --------------------------------------------------------------------------
+    Cyclic Jacobi eigen decomposition of a symmetric 3x3 matrix, a is
+    destroyed, the eigenvectors end up in the columns of vectors
+   -------------------------------------------------------------------------- */
+static void SymmetricEigen3(double a[3][3], double vectors[3][3], double values[3]) {
+  static const int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      vectors[i][j] = i == j ? 1.0 : 0.0;
+    }
+  }
+
+  for (int sweep = 0; sweep < 16; sweep++) {
+    double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    if (off < 1e-24)
+      break;
+
+    for (int i = 0; i < 3; i++) {
+      int p = pairs[i][0];
+      int q = pairs[i][1];
+      if (fabs(a[p][q]) < 1e-30)
+        continue;
+
+      double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+      double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+      double c = 1.0 / sqrt(t * t + 1.0);
+      double s = t * c;
+
+      for (int k = 0; k < 3; k++) {
+        double kp = a[k][p];
+        double kq = a[k][q];
+        a[k][p] = c * kp - s * kq;
+        a[k][q] = s * kp + c * kq;
+      }
+      for (int k = 0; k < 3; k++) {
+        double pk = a[p][k];
+        double qk = a[q][k];
+        a[p][k] = c * pk - s * qk;
+        a[q][k] = s * pk + c * qk;
+      }
+      for (int k = 0; k < 3; k++) {
+        double kp = vectors[k][p];
+        double kq = vectors[k][q];
+        vectors[k][p] = c * kp - s * kq;
+        vectors[k][q] = s * kp + c * kq;
+      }
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    values[i] = a[i][i];
+  }
+}
+
+EllipsoidFit::EllipsoidFit() {
+  Reset(1.0f);
+}
+
+void EllipsoidFit::Reset(float scale) {
+  memset(_normal, 0, sizeof(_normal));
+  memset(_rhs, 0, sizeof(_rhs));
+  _scale = scale > 0 ? scale : 1.0f;
+  _count = 0;
+}
+
+void EllipsoidFit::Add(const float point[3]) {
+  double x = point[0] / _scale;
+  double y = point[1] / _scale;
+  double z = point[2] / _scale;
+  double row[ELLIPSOID_PARAMETERS] = {
+    x * x + y * y - 2 * z * z, x * x + z * z - 2 * y * y,
+    2 * x * y, 2 * x * z, 2 * y * z, 2 * x, 2 * y, 2 * z, 1
+  };
+  double squared = x * x + y * y + z * z;
+
+  // the matrix is symmetric, the lower half is filled in by Solve()
+  for (int i = 0; i < ELLIPSOID_PARAMETERS; i++) {
+    for (int j = i; j < ELLIPSOID_PARAMETERS; j++) {
+      _normal[i][j] += row[i] * row[j];
+    }
+    _rhs[i] += row[i] * squared;
+  }
+  _count++;
+}
+
+void EllipsoidFit::Decay() {
+  for (int i = 0; i < ELLIPSOID_PARAMETERS; i++) {
+    for (int j = i; j < ELLIPSOID_PARAMETERS; j++) {
+      _normal[i][j] *= 0.5;
+    }
+    _rhs[i] *= 0.5;
+  }
+  _count /= 2;
+}
+
+bool EllipsoidFit::Solve(float center[3], float correction[9], float& radius, float& ratio) const {
+  if (_count < ELLIPSOID_PARAMETERS)
+    return false;
+
+  double a[ELLIPSOID_PARAMETERS][ELLIPSOID_PARAMETERS];
+  double p[ELLIPSOID_PARAMETERS];
+  for (int i = 0; i < ELLIPSOID_PARAMETERS; i++) {
+    for (int j = 0; j < ELLIPSOID_PARAMETERS; j++) {
+      a[i][j] = j >= i ? _normal[i][j] : _normal[j][i];
+    }
+    p[i] = _rhs[i];
+  }
+  if (!SolveLinear(a, p, ELLIPSOID_PARAMETERS))
+    return false;
+
+  // x'Mx + 2v'x + constant = 0, centered (x - c)'M(x - c) = c'Mc - constant
+  double m[3][3] = {
+    { p[0] + p[1] - 1, p[2], p[3] },
+    { p[2], p[0] - 2 * p[1] - 1, p[4] },
+    { p[3], p[4], p[1] - 2 * p[0] - 1 }
+  };
+  double v[3] = { p[5], p[6], p[7] };
+  double constant = p[8];
+
+  double cofactor[3][3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+      int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+      cofactor[i][j] = m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1];
+    }
+  }
+  double determinant = m[0][0] * cofactor[0][0] + m[0][1] * cofactor[0][1] + m[0][2] * cofactor[0][2];
+  if (fabs(determinant) < 1e-12)
+    return false;
+
+  double c[3];
+  for (int i = 0; i < 3; i++) {
+    // M is symmetric, so is its inverse: cofactor / determinant
+    c[i] = -(cofactor[i][0] * v[0] + cofactor[i][1] * v[1] + cofactor[i][2] * v[2]) / determinant;
+  }
+
+  double k = -constant;
+  for (int row = 0; row < 3; row++) {
+    for (int column = 0; column < 3; column++) {
+      k += c[row] * m[row][column] * c[column];
+    }
+  }
+  if (fabs(k) < 1e-12)
+    return false;
+
+  // M is only known up to its sign, dividing by k makes it positive definite
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      m[i][j] /= k;
+    }
+  }
+
+  double vectors[3][3];
+  double values[3];
+  SymmetricEigen3(m, vectors, values);
+  if (values[0] <= 0 || values[1] <= 0 || values[2] <= 0)
+    return false;
+
+  // the semi axes are 1 / sqrt(eigenvalue), scale onto their geometric mean
+  double mean = 1.0 / cbrt(sqrt(values[0] * values[1] * values[2]));
+  double longest = 0, shortest = 1e30;
+  double gain[3];
+  for (int i = 0; i < 3; i++) {
+    double axis = 1.0 / sqrt(values[i]);
+    longest = axis > longest ? axis : longest;
+    shortest = axis < shortest ? axis : shortest;
+    gain[i] = mean / axis;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      double sum = 0;
+      for (int e = 0; e < 3; e++) {
+        sum += vectors[i][e] * gain[e] * vectors[j][e];
+      }
+      correction[i * 3 + j] = (float)sum;
+    }
+    center[i] = (float)(c[i] * _scale);
+  }
+  radius = (float)(mean * _scale);
+  ratio = (float)(longest / shortest);
+  return true;
+}
+
+bool SphereFit(const float (*points)[3], size_t count, float center[3], float& radius) {
+  if (count < 4)
+    return false;
+
+  // |p|^2 = 2p'c + (r^2 - |c|^2), linear in c and the constant
+  double a[ELLIPSOID_PARAMETERS][ELLIPSOID_PARAMETERS];
+  double b[ELLIPSOID_PARAMETERS];
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+
+  for (size_t n = 0; n < count; n++) {
+    const float* point = points[n];
+    double row[4] = { 2.0 * point[0], 2.0 * point[1], 2.0 * point[2], 1.0 };
+    double squared = (double)point[0] * point[0] + (double)point[1] * point[1] + (double)point[2] * point[2];
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        a[i][j] += row[i] * row[j];
+      }
+      b[i] += row[i] * squared;
+    }
+  }
+  if (!SolveLinear(a, b, 4))
+    return false;
+
+  double squared = b[3] + b[0] * b[0] + b[1] * b[1] + b[2] * b[2];
+  if (squared <= 0)
+    return false;
+
+  for (int i = 0; i < 3; i++) {
+    center[i] = (float)b[i];
+  }
+  radius = (float)sqrt(squared);
+  return true;
+}
@@ -0,0 +1,60 @@
+/* ==========================================================================
+    File:     EllipsoidFit.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Incremental least squares ellipsoid fit for the magnetometer
+              hard and soft iron and a sphere fit for accelerometer offsets
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef ELLIPSOID_FIT_H
+#define ELLIPSOID_FIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    General ellipsoid
+      A x^2 + B y^2 + C z^2 + 2D xy + 2E xz + 2F yz + 2G x + 2H y + 2I z + J = 0
+    with A + B + C = -3 (Petrov's form) leaves nine parameters and stays
+    well conditioned when the origin is near or outside the ellipsoid. Every
+    point adds to their normal equations, so the fit streams in constant
+    memory and can be solved at any time. Points are divided by scale first
+    to keep the sums well conditioned
+   -------------------------------------------------------------------------- */
+#define ELLIPSOID_PARAMETERS  9
+
+class EllipsoidFit {
+public:
+  EllipsoidFit();
+
+  void Reset(float scale);
+  void Add(const float point[3]);
+
+  // halve every sum so the newest points weigh more
+  void Decay();
+
+  uint32_t Count() const { return _count; }
+
+  /* ------------------------------------------------------------------------
+      center is the hard iron offset, correction the symmetric soft iron
+      matrix (row major) that maps the ellipsoid onto a sphere of radius,
+      the geometric mean of its axes. ratio is the longest axis over the
+      shortest. False when the points do not describe an ellipsoid
+     ------------------------------------------------------------------------ */
+  bool Solve(float center[3], float correction[9], float& radius, float& ratio) const;
+
+private:
+  double    _normal[ELLIPSOID_PARAMETERS][ELLIPSOID_PARAMETERS];
+  double    _rhs[ELLIPSOID_PARAMETERS];
+  float     _scale;
+  uint32_t  _count;
+};
+
+/* --------------------------------------------------------------------------
+    Least squares sphere through count points, false when they do not pin
+    one down (fewer than four or all in a plane)
+   -------------------------------------------------------------------------- */
+bool SphereFit(const float (*points)[3], size_t count, float center[3], float& radius);
+
+#endif
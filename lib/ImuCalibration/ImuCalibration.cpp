@@ -0,0 +1,407 @@
+/* ==========================================================================
+    File:     ImuCalibration.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  On device IMU calibration, gyro bias whenever the device is
+              at rest, magnetometer hard/soft iron from an incremental
+              ellipsoid fit, accelerometer offsets from the rest positions,
+              a per block correction stage and the coefficients kept in a
+              flash page across power cycles
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "ImuCalibration.h"
+#include <TelemetryFrame.h>
+#include <math.h>
+#include <string.h>
+
+void CalibrationIdentity(CalibrationCoefficients& coefficients) {
+  memset(&coefficients, 0, sizeof(coefficients));
+  coefficients.magSoftIron[0] = 1.0f;
+  coefficients.magSoftIron[4] = 1.0f;
+  coefficients.magSoftIron[8] = 1.0f;
+}
+
+size_t EncodeCalibration(const CalibrationCoefficients& coefficients, uint8_t* buffer) {
+  buffer[0] = CALIBRATION_VERSION;
+  buffer[1] = coefficients.flags;
+  buffer[2] = 0;
+  buffer[3] = 0;
+
+  uint8_t* cursor = &buffer[4];
+  for (int i = 0; i < 3; i++, cursor += sizeof(float))
+    PutFloatLE(cursor, coefficients.gyroBias[i]);
+  for (int i = 0; i < 3; i++, cursor += sizeof(float))
+    PutFloatLE(cursor, coefficients.accelOffset[i]);
+  for (int i = 0; i < 3; i++, cursor += sizeof(float))
+    PutFloatLE(cursor, coefficients.magOffset[i]);
+  for (int i = 0; i < 9; i++, cursor += sizeof(float))
+    PutFloatLE(cursor, coefficients.magSoftIron[i]);
+  PutFloatLE(cursor, coefficients.magField);
+
+  return CALIBRATION_PAYLOAD_SIZE;
+}
+
+bool DecodeCalibration(const uint8_t* buffer, size_t length, CalibrationCoefficients& coefficients) {
+  if (length < CALIBRATION_PAYLOAD_SIZE || buffer[0] != CALIBRATION_VERSION)
+    return false;
+
+  coefficients.flags = buffer[1];
+  const uint8_t* cursor = &buffer[4];
+  for (int i = 0; i < 3; i++, cursor += sizeof(float))
+    coefficients.gyroBias[i] = GetFloatLE(cursor);
+  for (int i = 0; i < 3; i++, cursor += sizeof(float))
+    coefficients.accelOffset[i] = GetFloatLE(cursor);
+  for (int i = 0; i < 3; i++, cursor += sizeof(float))
+    coefficients.magOffset[i] = GetFloatLE(cursor);
+  for (int i = 0; i < 9; i++, cursor += sizeof(float))
+    coefficients.magSoftIron[i] = GetFloatLE(cursor);
+  coefficients.magField = GetFloatLE(cursor);
+  return true;
+}
+
+ImuCalibration::ImuCalibration()
+  : _device(0), _nextSlot(0), _saves(0) {
+  Begin();
+}
+
+void ImuCalibration::Begin() {
+  CalibrationIdentity(_coefficients);
+  _saved = _coefficients;
+  _changed = false;
+  _device = 0;
+  _nextSlot = 0;
+  RestartGyroscope();
+  RestartAccelerometer();
+  RestartMagnetometer();
+}
+
+bool ImuCalibration::Begin(const FlashDevice& device) {
+  Begin();
+  if (device.pageSize < CALIBRATION_SLOT_SIZE)
+    return false;
+
+  _deviceCopy = device;
+  _device = &_deviceCopy;
+
+  // slots fill up in order, the first blank one is where the next goes
+  for (uint32_t slot = 0; slot < SlotCount(); slot++) {
+    uint8_t buffer[CALIBRATION_SLOT_SIZE];
+    if (!_device->read(slot * CALIBRATION_SLOT_SIZE, buffer, sizeof(buffer)))
+      return false;
+
+    uint32_t magic = GetUint32LE(&buffer[0]);
+    if (magic == 0xFFFFFFFFUL)
+      break;
+    _nextSlot = slot + 1;
+
+    CalibrationCoefficients coefficients;
+    if (magic == CALIBRATION_MAGIC &&
+        FlashStoreCrc8(&buffer[4], CALIBRATION_PAYLOAD_SIZE) == buffer[4 + CALIBRATION_PAYLOAD_SIZE] &&
+        DecodeCalibration(&buffer[4], CALIBRATION_PAYLOAD_SIZE, coefficients)) {
+      _coefficients = coefficients;
+    }
+  }
+
+  _saved = _coefficients;
+  return true;
+}
+
+uint32_t ImuCalibration::SlotCount() const {
+  return _device ? _device->pageSize / CALIBRATION_SLOT_SIZE : 0;
+}
+
+void ImuCalibration::Correct(Lsm9ds1FifoSample* samples, size_t count) {
+
+  for (size_t n = 0; n < count; n++) {
+    const Lsm9ds1FifoSample& sample = samples[n];
+    const float* a = sample.acceleration;
+    float norm = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    for (int i = 0; i < 3; i++) {
+      _gyroSum[i] += sample.gyroscope[i];
+      _gyroSquares[i] += sample.gyroscope[i] * sample.gyroscope[i];
+      _accelSum[i] += a[i];
+    }
+    _normSum += norm;
+    _normSquares += norm * norm;
+
+    if (++_restCount == CALIBRATION_REST_SAMPLES) {
+      EndRestWindow();
+    }
+  }
+
+  // one pass over the block per coefficient set, identity is all zeros
+  const float* bias = _coefficients.gyroBias;
+  const float* offset = _coefficients.accelOffset;
+  for (size_t n = 0; n < count; n++) {
+    float* gyroscope = samples[n].gyroscope;
+    float* acceleration = samples[n].acceleration;
+    gyroscope[0] -= bias[0];
+    gyroscope[1] -= bias[1];
+    gyroscope[2] -= bias[2];
+    acceleration[0] -= offset[0];
+    acceleration[1] -= offset[1];
+    acceleration[2] -= offset[2];
+  }
+}
+
+void ImuCalibration::EndRestWindow() {
+  const float samples = CALIBRATION_REST_SAMPLES;
+  float gyroMean[3];
+  float accelMean[3];
+  bool rest = true;
+
+  for (int i = 0; i < 3; i++) {
+    gyroMean[i] = _gyroSum[i] / samples;
+    accelMean[i] = _accelSum[i] / samples;
+    float variance = _gyroSquares[i] / samples - gyroMean[i] * gyroMean[i];
+    if (variance > CALIBRATION_REST_GYRO_DPS * CALIBRATION_REST_GYRO_DPS ||
+        fabsf(gyroMean[i]) > CALIBRATION_GYRO_MAX_BIAS)
+      rest = false;
+  }
+
+  float normMean = _normSum / samples;
+  float normVariance = _normSquares / samples - normMean * normMean;
+  if (normVariance > CALIBRATION_REST_ACCEL_G * CALIBRATION_REST_ACCEL_G ||
+      fabsf(normMean - 1.0f) > 2 * CALIBRATION_ACCEL_TOLERANCE)
+    rest = false;
+
+  _atRest = rest;
+  if (rest) {
+    for (int i = 0; i < 3; i++) {
+      if (_coefficients.flags & CALIBRATION_GYROSCOPE) {
+        _coefficients.gyroBias[i] += CALIBRATION_GYRO_BLEND * (gyroMean[i] - _coefficients.gyroBias[i]);
+      } else {
+        _coefficients.gyroBias[i] = gyroMean[i];
+      }
+    }
+    _coefficients.flags |= CALIBRATION_GYROSCOPE;
+    _changed = true;
+    AddPosition(accelMean);
+  }
+
+  _restCount = 0;
+  memset(_gyroSum, 0, sizeof(_gyroSum));
+  memset(_gyroSquares, 0, sizeof(_gyroSquares));
+  memset(_accelSum, 0, sizeof(_accelSum));
+  _normSum = 0;
+  _normSquares = 0;
+}
+
+void ImuCalibration::AddPosition(const float acceleration[3]) {
+  if (_positionCount >= CALIBRATION_ACCEL_POSITIONS)
+    return;
+
+  float length = sqrtf(acceleration[0] * acceleration[0] + acceleration[1] * acceleration[1] + acceleration[2] * acceleration[2]);
+  for (uint8_t n = 0; n < _positionCount; n++) {
+    const float* position = _positions[n];
+    float other = sqrtf(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]);
+    float cosine = (acceleration[0] * position[0] + acceleration[1] * position[1] + acceleration[2] * position[2]) / (length * other);
+    if (cosine > CALIBRATION_ACCEL_MIN_COS)
+      return;
+  }
+
+  memcpy(_positions[_positionCount++], acceleration, sizeof(_positions[0]));
+  _positionAdded = true;
+}
+
+void ImuCalibration::CorrectMagnetometer(float field[3]) {
+
+  float step = 0;
+  for (int i = 0; i < 3; i++) {
+    float delta = field[i] - _magLast[i];
+    step += delta * delta;
+  }
+
+  if (_magFit.Count() == 0 || step >= CALIBRATION_MAG_STEP * CALIBRATION_MAG_STEP) {
+    if (_magFit.Count() >= CALIBRATION_MAG_MAX_SAMPLES) {
+      _magFit.Decay();
+    }
+    _magFit.Add(field);
+    _magSinceSolve++;
+    memcpy(_magLast, field, sizeof(_magLast));
+
+    // coverage around the fitted center, the middle of the range until then
+    float direction[3];
+    int face = 0;
+    for (int i = 0; i < 3; i++) {
+      _magMin[i] = field[i] < _magMin[i] ? field[i] : _magMin[i];
+      _magMax[i] = field[i] > _magMax[i] ? field[i] : _magMax[i];
+      float center = (_coefficients.flags & CALIBRATION_MAGNETOMETER) ?
+        _coefficients.magOffset[i] : (_magMin[i] + _magMax[i]) / 2;
+      direction[i] = field[i] - center;
+      if (fabsf(direction[i]) > fabsf(direction[face]))
+        face = i;
+    }
+    _magBins |= 1 << (face * 2 + (direction[face] < 0));
+    _magBins |= 1 << (6 + (direction[0] < 0) + 2 * (direction[1] < 0) + 4 * (direction[2] < 0));
+  }
+
+  if (!(_coefficients.flags & CALIBRATION_MAGNETOMETER))
+    return;
+
+  const float* offset = _coefficients.magOffset;
+  const float* w = _coefficients.magSoftIron;
+  float x = field[0] - offset[0];
+  float y = field[1] - offset[1];
+  float z = field[2] - offset[2];
+  field[0] = w[0] * x + w[1] * y + w[2] * z;
+  field[1] = w[3] * x + w[4] * y + w[5] * z;
+  field[2] = w[6] * x + w[7] * y + w[8] * z;
+}
+
+uint8_t ImuCalibration::MagnetometerCoverage() const {
+  int bins = 0;
+  for (int i = 0; i < CALIBRATION_MAG_BINS; i++) {
+    bins += (_magBins >> i) & 1;
+  }
+  return (uint8_t)(bins * 100 / CALIBRATION_MAG_BINS);
+}
+
+bool ImuCalibration::Update() {
+  bool changed = _changed;
+  _changed = false;
+
+  if (_magSinceSolve >= CALIBRATION_MAG_SOLVE_EVERY &&
+      _magFit.Count() >= CALIBRATION_MAG_MIN_SAMPLES &&
+      MagnetometerCoverage() >= CALIBRATION_MAG_MIN_BINS * 100 / CALIBRATION_MAG_BINS) {
+    _magSinceSolve = 0;
+    changed |= SolveMagnetometer();
+  }
+
+  if (_positionAdded) {
+    _positionAdded = false;
+    changed |= SolveAccelerometer();
+  }
+  return changed;
+}
+
+bool ImuCalibration::SolveMagnetometer() {
+  float center[3];
+  float correction[9];
+  float radius, ratio;
+  if (!_magFit.Solve(center, correction, radius, ratio))
+    return false;
+
+  if (radius < CALIBRATION_MAG_MIN_FIELD || radius > CALIBRATION_MAG_MAX_FIELD ||
+      ratio > CALIBRATION_MAG_MAX_RATIO)
+    return false;
+
+  memcpy(_coefficients.magOffset, center, sizeof(center));
+  memcpy(_coefficients.magSoftIron, correction, sizeof(correction));
+  _coefficients.magField = radius;
+  _coefficients.flags |= CALIBRATION_MAGNETOMETER;
+  return true;
+}
+
+bool ImuCalibration::SolveAccelerometer() {
+  if (_positionCount < CALIBRATION_ACCEL_MIN_POSITIONS)
+    return false;
+
+  float center[3];
+  float radius;
+  if (!SphereFit(_positions, _positionCount, center, radius))
+    return false;
+
+  if (fabsf(radius - 1.0f) > CALIBRATION_ACCEL_TOLERANCE)
+    return false;
+  for (int i = 0; i < 3; i++) {
+    if (fabsf(center[i]) > CALIBRATION_ACCEL_MAX_OFFSET)
+      return false;
+  }
+
+  memcpy(_coefficients.accelOffset, center, sizeof(center));
+  _coefficients.flags |= CALIBRATION_ACCELEROMETER;
+  return true;
+}
+
+void ImuCalibration::Clear() {
+  CalibrationIdentity(_coefficients);
+  RestartGyroscope();
+  RestartAccelerometer();
+  RestartMagnetometer();
+  _changed = true;
+}
+
+void ImuCalibration::RestartGyroscope() {
+  _coefficients.flags &= ~CALIBRATION_GYROSCOPE;
+  memset(_coefficients.gyroBias, 0, sizeof(_coefficients.gyroBias));
+  _restCount = 0;
+  memset(_gyroSum, 0, sizeof(_gyroSum));
+  memset(_gyroSquares, 0, sizeof(_gyroSquares));
+  memset(_accelSum, 0, sizeof(_accelSum));
+  _normSum = 0;
+  _normSquares = 0;
+  _atRest = false;
+  _changed = true;
+}
+
+void ImuCalibration::RestartAccelerometer() {
+  _coefficients.flags &= ~CALIBRATION_ACCELEROMETER;
+  memset(_coefficients.accelOffset, 0, sizeof(_coefficients.accelOffset));
+  _positionCount = 0;
+  _positionAdded = false;
+  _changed = true;
+}
+
+void ImuCalibration::RestartMagnetometer() {
+  CalibrationCoefficients identity;
+  CalibrationIdentity(identity);
+  _coefficients.flags &= ~CALIBRATION_MAGNETOMETER;
+  memcpy(_coefficients.magOffset, identity.magOffset, sizeof(identity.magOffset));
+  memcpy(_coefficients.magSoftIron, identity.magSoftIron, sizeof(identity.magSoftIron));
+  _coefficients.magField = 0;
+
+  _magFit.Reset(CALIBRATION_MAG_SCALE);
+  memset(_magLast, 0, sizeof(_magLast));
+  for (int i = 0; i < 3; i++) {
+    _magMin[i] = 1e9f;
+    _magMax[i] = -1e9f;
+  }
+  _magBins = 0;
+  _magSinceSolve = 0;
+  _changed = true;
+}
+
+bool ImuCalibration::Dirty() const {
+  if (_coefficients.flags != _saved.flags)
+    return true;
+
+  for (int i = 0; i < 3; i++) {
+    if (fabsf(_coefficients.gyroBias[i] - _saved.gyroBias[i]) > CALIBRATION_SAVE_GYRO_DPS ||
+        fabsf(_coefficients.accelOffset[i] - _saved.accelOffset[i]) > CALIBRATION_SAVE_ACCEL_G ||
+        fabsf(_coefficients.magOffset[i] - _saved.magOffset[i]) > CALIBRATION_SAVE_MAG_UT)
+      return true;
+  }
+  for (int i = 0; i < 9; i++) {
+    if (fabsf(_coefficients.magSoftIron[i] - _saved.magSoftIron[i]) > CALIBRATION_SAVE_SOFT_IRON)
+      return true;
+  }
+  return false;
+}
+
+bool ImuCalibration::Save() {
+  if (!_device)
+    return false;
+
+  if (_nextSlot >= SlotCount()) {
+    if (!_device->erase(0))
+      return false;
+    _nextSlot = 0;
+  }
+
+  uint8_t buffer[CALIBRATION_SLOT_SIZE];
+  memset(buffer, 0xFF, sizeof(buffer));
+  PutUint32LE(&buffer[0], CALIBRATION_MAGIC);
+  EncodeCalibration(_coefficients, &buffer[4]);
+  buffer[4 + CALIBRATION_PAYLOAD_SIZE] = FlashStoreCrc8(&buffer[4], CALIBRATION_PAYLOAD_SIZE);
+
+  // the slot is used up even if programming fails half way
+  uint32_t slot = _nextSlot++;
+  if (!_device->program(slot * CALIBRATION_SLOT_SIZE, buffer, sizeof(buffer)))
+    return false;
+
+  _saved = _coefficients;
+  _saves++;
+  return true;
+}
@@ -0,0 +1,190 @@
+/* ==========================================================================
+    File:     ImuCalibration.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  On device IMU calibration, gyro bias whenever the device is
+              at rest, magnetometer hard/soft iron from an incremental
+              ellipsoid fit, accelerometer offsets from the rest positions,
+              a per block correction stage and the coefficients kept in a
+              flash page across power cycles
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef IMU_CALIBRATION_H
+#define IMU_CALIBRATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <FlashStore.h>
+#include <Lsm9ds1Fifo.h>
+#include "EllipsoidFit.h"
+
+/* --------------------------------------------------------------------------
+    Coefficients, which ones are fitted is in flags
+   -------------------------------------------------------------------------- */
+#define CALIBRATION_GYROSCOPE         0x01
+#define CALIBRATION_ACCELEROMETER     0x02
+#define CALIBRATION_MAGNETOMETER      0x04
+
+struct CalibrationCoefficients {
+  uint8_t   flags;
+  float     gyroBias[3];        // dps
+  float     accelOffset[3];     // g
+  float     magOffset[3];       // uT, hard iron
+  float     magSoftIron[9];     // row major, applied after the offset
+  float     magField;           // uT, radius of the fitted sphere
+};
+
+// no correction at all
+void CalibrationIdentity(CalibrationCoefficients& coefficients);
+
+/* --------------------------------------------------------------------------
+    Coefficients Layout (little endian), version 1
+      [0]      version
+      [1]      flags
+      [2..3]   reserved
+      [4..15]  gyro bias x, y, z (float)
+      [16..27] accel offset x, y, z (float)
+      [28..39] magnetometer offset x, y, z (float)
+      [40..75] magnetometer soft iron, row major (float)
+      [76..79] magnetometer field (float)
+   -------------------------------------------------------------------------- */
+#define CALIBRATION_VERSION           1
+#define CALIBRATION_PAYLOAD_SIZE      80
+
+size_t EncodeCalibration(const CalibrationCoefficients& coefficients, uint8_t* buffer);
+bool DecodeCalibration(const uint8_t* buffer, size_t length, CalibrationCoefficients& coefficients);
+
+/* --------------------------------------------------------------------------
+    Flash Layout, one page of slots that are appended until the page is
+    full, the last good slot wins
+      [0..3]   CALIBRATION_MAGIC
+      [4..83]  coefficients
+      [84]     crc8 of the coefficients
+      [85..87] 0xFF
+   -------------------------------------------------------------------------- */
+#define CALIBRATION_MAGIC             0x314C4143UL    // "CAL1"
+#define CALIBRATION_SLOT_SIZE         88
+
+/* --------------------------------------------------------------------------
+    Rest Detection, a window of samples is at rest when the gyro and the
+    length of the acceleration barely move
+   -------------------------------------------------------------------------- */
+#define CALIBRATION_REST_SAMPLES      64
+#define CALIBRATION_REST_GYRO_DPS     0.3f      // standard deviation
+#define CALIBRATION_REST_ACCEL_G      0.01f     // standard deviation of |a|
+#define CALIBRATION_GYRO_MAX_BIAS     30.0f     // LSM9DS1 zero rate level
+#define CALIBRATION_GYRO_BLEND        0.25f
+
+/* --------------------------------------------------------------------------
+    Magnetometer Fit, a reading joins the fit once it is CALIBRATION_MAG_STEP
+    away from the last one, so holding still does not skew it
+   -------------------------------------------------------------------------- */
+#define CALIBRATION_MAG_SCALE         50.0f     // uT
+#define CALIBRATION_MAG_STEP          2.0f      // uT
+#define CALIBRATION_MAG_MIN_SAMPLES   150
+#define CALIBRATION_MAG_MAX_SAMPLES   1500      // then the sums are halved
+#define CALIBRATION_MAG_SOLVE_EVERY   25
+#define CALIBRATION_MAG_BINS          14        // 6 faces and 8 octants
+#define CALIBRATION_MAG_MIN_BINS      12
+#define CALIBRATION_MAG_MIN_FIELD     15.0f     // uT
+#define CALIBRATION_MAG_MAX_FIELD     100.0f    // uT
+#define CALIBRATION_MAG_MAX_RATIO     2.0f      // longest over shortest axis
+
+/* --------------------------------------------------------------------------
+    Accelerometer Offsets, each rest position at least 30 degrees from the
+    others is a point on the 1 g sphere
+   -------------------------------------------------------------------------- */
+#define CALIBRATION_ACCEL_POSITIONS   12
+#define CALIBRATION_ACCEL_MIN_POSITIONS 6
+#define CALIBRATION_ACCEL_MIN_COS     0.866f
+#define CALIBRATION_ACCEL_MAX_OFFSET  0.2f      // g
+#define CALIBRATION_ACCEL_TOLERANCE   0.1f      // g off the 1 g radius
+
+/* --------------------------------------------------------------------------
+    How far the coefficients may drift from the saved ones before they are
+    worth a flash write
+   -------------------------------------------------------------------------- */
+#define CALIBRATION_SAVE_GYRO_DPS     0.1f
+#define CALIBRATION_SAVE_ACCEL_G      0.005f
+#define CALIBRATION_SAVE_MAG_UT       0.5f
+#define CALIBRATION_SAVE_SOFT_IRON    0.01f
+
+class ImuCalibration {
+public:
+  ImuCalibration();
+
+  // start uncalibrated and without persistence
+  void Begin();
+
+  // start from the newest coefficients saved in the first page of device
+  bool Begin(const FlashDevice& device);
+
+  /* ------------------------------------------------------------------------
+      Correction Stage, the raw samples go to the rest detector and then
+      have the gyro bias and the accel offset taken out in place
+     ------------------------------------------------------------------------ */
+  void Correct(Lsm9ds1FifoSample* samples, size_t count);
+
+  // a raw reading joins the fit, then gets the hard/soft iron taken out
+  void CorrectMagnetometer(float field[3]);
+
+  // refit whatever has new data, true when the coefficients changed
+  bool Update();
+
+  // back to no correction, every fit starts over
+  void Clear();
+  void RestartGyroscope();
+  void RestartAccelerometer();
+  void RestartMagnetometer();
+
+  bool Save();
+  bool Dirty() const;
+
+  const CalibrationCoefficients& Coefficients() const { return _coefficients; }
+  uint8_t MagnetometerCoverage() const;
+  uint8_t AccelerometerPositions() const { return _positionCount; }
+  bool AtRest() const { return _atRest; }
+  uint32_t Saves() const { return _saves; }
+
+private:
+  void EndRestWindow();
+  void AddPosition(const float acceleration[3]);
+  bool SolveMagnetometer();
+  bool SolveAccelerometer();
+  uint32_t SlotCount() const;
+
+  CalibrationCoefficients _coefficients;
+  CalibrationCoefficients _saved;
+  bool                _changed;
+
+  // rest detector
+  uint16_t            _restCount;
+  float               _gyroSum[3];
+  float               _gyroSquares[3];
+  float               _accelSum[3];
+  float               _normSum;
+  float               _normSquares;
+  bool                _atRest;
+
+  // magnetometer fit
+  EllipsoidFit        _magFit;
+  float               _magLast[3];
+  float               _magMin[3];
+  float               _magMax[3];
+  uint16_t            _magBins;
+  uint16_t            _magSinceSolve;
+
+  // accelerometer rest positions
+  float               _positions[CALIBRATION_ACCEL_POSITIONS][3];
+  uint8_t             _positionCount;
+  bool                _positionAdded;
+
+  // persistence
+  const FlashDevice*  _device;
+  FlashDevice         _deviceCopy;
+  uint32_t            _nextSlot;
+  uint32_t            _saves;
+};
+
+#endif
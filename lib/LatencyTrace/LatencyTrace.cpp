@@ -0,0 +1,99 @@
+/* ==========================================================================
+    File:     LatencyTrace.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Encoder/Decoder for latency trace and clock sync records
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "LatencyTrace.h"
+
+size_t EncodeLatencyTrace(
+  const TraceEntry* entries, size_t count, uint16_t lost,
+  uint8_t* buffer, size_t bufferSize, size_t& encodedCount) {
+
+  encodedCount = 0;
+  if (bufferSize < LATENCY_TRACE_HEADER_SIZE + LATENCY_TRACE_ENTRY_SIZE)
+    return 0;
+
+  size_t capacity = (bufferSize - LATENCY_TRACE_HEADER_SIZE) / LATENCY_TRACE_ENTRY_SIZE;
+  if (capacity > 255)
+    capacity = 255;
+
+  uint8_t* cursor = &buffer[LATENCY_TRACE_HEADER_SIZE];
+  while (encodedCount < count && encodedCount < capacity) {
+    const TraceEntry& entry = entries[encodedCount];
+    PutUint16LE(&cursor[0], entry.uuid);
+    PutUint16LE(&cursor[2], entry.sequence);
+    PutUint32LE(&cursor[4], entry.sampledMicros);
+    PutUint32LE(&cursor[8], entry.fusedMicros);
+    PutUint32LE(&cursor[12], entry.queuedMicros);
+    PutUint32LE(&cursor[16], entry.notifiedMicros);
+    cursor += LATENCY_TRACE_ENTRY_SIZE;
+    encodedCount++;
+  }
+
+  buffer[0] = LATENCY_TRACE_VERSION;
+  buffer[1] = (uint8_t)encodedCount;
+  PutUint16LE(&buffer[2], lost);
+
+  return (size_t)(cursor - buffer);
+}
+
+bool DecodeLatencyTrace(
+  const uint8_t* buffer, size_t length, uint16_t& lost,
+  TraceEntry* entries, size_t maxEntries, size_t& count) {
+
+  count = 0;
+  if (length < LATENCY_TRACE_HEADER_SIZE || buffer[0] != LATENCY_TRACE_VERSION)
+    return false;
+
+  size_t entriesInTrace = buffer[1];
+  if (length < LATENCY_TRACE_HEADER_SIZE + entriesInTrace * LATENCY_TRACE_ENTRY_SIZE ||
+      entriesInTrace > maxEntries)
+    return false;
+
+  lost = GetUint16LE(&buffer[2]);
+  const uint8_t* cursor = &buffer[LATENCY_TRACE_HEADER_SIZE];
+  for (count = 0; count < entriesInTrace; count++, cursor += LATENCY_TRACE_ENTRY_SIZE) {
+    TraceEntry& entry = entries[count];
+    entry.uuid = GetUint16LE(&cursor[0]);
+    entry.sequence = GetUint16LE(&cursor[2]);
+    entry.sampledMicros = GetUint32LE(&cursor[4]);
+    entry.fusedMicros = GetUint32LE(&cursor[8]);
+    entry.queuedMicros = GetUint32LE(&cursor[12]);
+    entry.notifiedMicros = GetUint32LE(&cursor[16]);
+  }
+  return true;
+}
+
+void EncodeClockSyncReply(const ClockSyncReply& reply, uint8_t* buffer) {
+  PutUint32LE(&buffer[0], (uint32_t)reply.centralSent);
+  PutUint32LE(&buffer[4], (uint32_t)(reply.centralSent >> 32));
+  PutUint32LE(&buffer[8], reply.deviceReceived);
+  PutUint32LE(&buffer[12], reply.deviceSent);
+}
+
+bool DecodeClockSyncReply(const uint8_t* buffer, size_t length, ClockSyncReply& reply) {
+  if (length < CLOCK_SYNC_REPLY_SIZE)
+    return false;
+  reply.centralSent = (uint64_t)GetUint32LE(&buffer[0]) | ((uint64_t)GetUint32LE(&buffer[4]) << 32);
+  reply.deviceReceived = GetUint32LE(&buffer[8]);
+  reply.deviceSent = GetUint32LE(&buffer[12]);
+  return true;
+}
+
+void ClockSyncSolve(
+  const ClockSyncReply& reply, uint64_t centralReceived,
+  int64_t& offset, uint32_t& roundTrip) {
+
+  // device micros wraps every ~71 minutes, the hold time is taken modulo 2^32
+  uint32_t held = reply.deviceSent - reply.deviceReceived;
+  int64_t elapsed = (int64_t)(centralReceived - reply.centralSent);
+  roundTrip = elapsed > (int64_t)held ? (uint32_t)(elapsed - held) : 0;
+
+  // offset = ((t2 - t1) + (t3 - t4)) / 2, rearranged to keep the sums small
+  int64_t deviceMid = (int64_t)reply.deviceReceived + (int64_t)held / 2;
+  int64_t centralMid = (int64_t)reply.centralSent + (int64_t)((centralReceived - reply.centralSent) / 2);
+  offset = centralMid - deviceMid;
+}
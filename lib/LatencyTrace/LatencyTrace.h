@@ -0,0 +1,100 @@
+/* ==========================================================================
+    File:     LatencyTrace.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Per-record latency trace points (sampled, fused, queued,
+              notified), the trace notification layout and the clock sync
+              exchange used to put device micros on the gateway clock
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include "TelemetryFrame.h"
+
+/* --------------------------------------------------------------------------
+    Trace Layout (little endian), version 1
+      [0]      version
+      [1]      entry count
+      [2..3]   entries lost to a full trace buffer so far (wraps)
+      then per entry
+      [0..1]   characteristic uuid of the traced record
+      [2..3]   sequence number carried by the record
+      [4..7]   sampled, sensor time of the newest sample in the record
+      [8..11]  fused, fusion finished with that sample (0 = no fusion stage)
+      [12..15] queued, record encoded and handed to the BLE stack
+      [16..19] notified, the BLE stack accepted the notification
+   -------------------------------------------------------------------------- */
+#define LATENCY_TRACE_VERSION         1
+#define LATENCY_TRACE_HEADER_SIZE     4
+#define LATENCY_TRACE_ENTRY_SIZE      20
+
+struct TraceEntry {
+  uint16_t  uuid;
+  uint16_t  sequence;
+  uint32_t  sampledMicros;
+  uint32_t  fusedMicros;
+  uint32_t  queuedMicros;
+  uint32_t  notifiedMicros;
+};
+
+/* --------------------------------------------------------------------------
+    Stamp prefixed to a vector record when stamping is enabled
+      [0..1]   sequence number of the characteristic
+      [2..5]   sample time (micros)
+   -------------------------------------------------------------------------- */
+#define VECTOR_STAMP_SIZE             6
+
+inline void PutVectorStamp(uint8_t* buffer, uint16_t sequence, uint32_t sampleMicros) {
+  PutUint16LE(&buffer[0], sequence);
+  PutUint32LE(&buffer[2], sampleMicros);
+}
+
+/* --------------------------------------------------------------------------
+    Encode up to count entries, stops early when the buffer is full.
+    encodedCount is set to the entries consumed, returns the bytes written
+   -------------------------------------------------------------------------- */
+size_t EncodeLatencyTrace(
+  const TraceEntry* entries, size_t count, uint16_t lost,
+  uint8_t* buffer, size_t bufferSize, size_t& encodedCount);
+
+/* --------------------------------------------------------------------------
+    Decode a trace notification, returns false on a malformed record
+   -------------------------------------------------------------------------- */
+bool DecodeLatencyTrace(
+  const uint8_t* buffer, size_t length, uint16_t& lost,
+  TraceEntry* entries, size_t maxEntries, size_t& count);
+
+/* --------------------------------------------------------------------------
+    Clock Sync exchange, NTP style
+      The central writes its own time t1 (8 bytes, any unit it likes as
+      long as it is microseconds), the device answers on the same
+      characteristic with
+      [0..7]   t1 echoed back
+      [8..11]  device micros when the write arrived (t2)
+      [12..15] device micros when the reply was sent (t3)
+      The central stamps the reply with t4 on arrival
+   -------------------------------------------------------------------------- */
+#define CLOCK_SYNC_REQUEST_SIZE       8
+#define CLOCK_SYNC_REPLY_SIZE         16
+
+struct ClockSyncReply {
+  uint64_t  centralSent;
+  uint32_t  deviceReceived;
+  uint32_t  deviceSent;
+};
+
+void EncodeClockSyncReply(const ClockSyncReply& reply, uint8_t* buffer);
+bool DecodeClockSyncReply(const uint8_t* buffer, size_t length, ClockSyncReply& reply);
+
+/* --------------------------------------------------------------------------
+    Central side: from a reply and its arrival time work out the offset
+    that maps device micros onto the central clock (central = device +
+    offset) and the round trip, minus the time the device held the request
+   -------------------------------------------------------------------------- */
+void ClockSyncSolve(
+  const ClockSyncReply& reply, uint64_t centralReceived,
+  int64_t& offset, uint32_t& roundTrip);
+
+#endif
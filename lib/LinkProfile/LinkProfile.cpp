@@ -0,0 +1,130 @@
+/* ==========================================================================
+    File:     LinkProfile.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  BLE link profiles, see LinkProfile.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "LinkProfile.h"
+#include <TelemetryFrame.h>
+
+/* --------------------------------------------------------------------------
+    The profiles, every one keeps the supervision timeout above
+    (1 + latency) * maxInterval * 2 as the specification asks
+      LOW_LATENCY       7.5 to 15 ms, no latency
+      HIGH_THROUGHPUT   15 to 30 ms (the fastest iOS grants), no latency,
+                        the largest link layer packets
+      LOW_POWER         100 to 200 ms, skips up to 4 events when idle
+   -------------------------------------------------------------------------- */
+static const LinkParameters LINK_PROFILE_PARAMETERS[LINK_PROFILE_COUNT] = {
+  { 6,  12,  0, 200, 251 },
+  { 12, 24,  0, 400, 251 },
+  { 80, 160, 4, 600, 27 }
+};
+
+const LinkParameters& LinkProfileParameters(LinkProfileId profile) {
+  return LINK_PROFILE_PARAMETERS[profile < LINK_PROFILE_COUNT ? profile : LINK_PROFILE_HIGH_THROUGHPUT];
+}
+
+LinkManager::LinkManager()
+  : _maxPayload(LINK_DEFAULT_MTU - LINK_ATT_HEADER_SIZE) {
+  _bus.prefer = 0;
+  _bus.requestConnection = 0;
+  _bus.requestDataLength = 0;
+  _bus.mtu = 0;
+  _status.profile = LINK_PROFILE_HIGH_THROUGHPUT;
+  _status.flags = 0;
+  _status.requested = LinkProfileParameters(_status.profile);
+  _status.mtu = LINK_DEFAULT_MTU;
+  _status.payloadSize = Payload(LINK_DEFAULT_MTU);
+}
+
+void LinkManager::Begin(const LinkBus& bus, LinkProfileId profile, uint16_t maxPayload) {
+  _bus = bus;
+  _maxPayload = maxPayload;
+  _status.flags = 0;
+  _status.mtu = LINK_DEFAULT_MTU;
+  _status.payloadSize = Payload(LINK_DEFAULT_MTU);
+  SetProfile(profile < LINK_PROFILE_COUNT ? profile : LINK_PROFILE_HIGH_THROUGHPUT);
+}
+
+bool LinkManager::SetProfile(LinkProfileId profile) {
+  if (profile >= LINK_PROFILE_COUNT)
+    return false;
+
+  _status.profile = profile;
+  _status.requested = LinkProfileParameters(profile);
+  if (_bus.prefer) {
+    _bus.prefer(_status.requested);
+  }
+  if (_status.flags & LINK_FLAG_CONNECTED) {
+    Request();
+  }
+  return true;
+}
+
+void LinkManager::Connected() {
+  _status.flags = LINK_FLAG_CONNECTED;
+  _status.mtu = LINK_DEFAULT_MTU;
+  _status.payloadSize = Payload(LINK_DEFAULT_MTU);
+  Request();
+  Update();
+}
+
+void LinkManager::Disconnected() {
+  _status.flags = 0;
+  _status.mtu = LINK_DEFAULT_MTU;
+  _status.payloadSize = Payload(LINK_DEFAULT_MTU);
+}
+
+void LinkManager::Request() {
+  _status.flags &= ~(LINK_FLAG_REQUESTED | LINK_FLAG_DATA_LENGTH);
+
+  if (_bus.requestConnection && _bus.requestConnection(_status.requested)) {
+    _status.flags |= LINK_FLAG_REQUESTED;
+  }
+  if (_bus.requestDataLength && _bus.requestDataLength(_status.requested.dataLength)) {
+    _status.flags |= LINK_FLAG_DATA_LENGTH;
+  }
+}
+
+bool LinkManager::Update() {
+  if (!(_status.flags & LINK_FLAG_CONNECTED) || !_bus.mtu)
+    return false;
+
+  uint16_t mtu = _bus.mtu();
+  if (mtu < LINK_DEFAULT_MTU) {
+    mtu = LINK_DEFAULT_MTU;
+  }
+  if (mtu > LINK_DEFAULT_MTU) {
+    _status.flags |= LINK_FLAG_MTU_EXCHANGED;
+  }
+
+  uint16_t payloadSize = Payload(mtu);
+  bool changed = payloadSize != _status.payloadSize;
+  _status.mtu = mtu;
+  _status.payloadSize = payloadSize;
+  return changed;
+}
+
+uint16_t LinkManager::Payload(uint16_t mtu) const {
+  uint16_t payload = mtu - LINK_ATT_HEADER_SIZE;
+  return payload < _maxPayload ? payload : _maxPayload;
+}
+
+size_t EncodeLinkStatus(const LinkStatus& status, uint8_t* buffer, size_t bufferSize) {
+  if (bufferSize < LINK_STATUS_SIZE)
+    return 0;
+
+  buffer[0] = status.profile;
+  buffer[1] = status.flags;
+  PutUint16LE(&buffer[2], status.requested.minInterval);
+  PutUint16LE(&buffer[4], status.requested.maxInterval);
+  PutUint16LE(&buffer[6], status.requested.latency);
+  PutUint16LE(&buffer[8], status.requested.supervisionTimeout);
+  PutUint16LE(&buffer[10], status.requested.dataLength);
+  PutUint16LE(&buffer[12], status.mtu);
+  PutUint16LE(&buffer[14], status.payloadSize);
+  return LINK_STATUS_SIZE;
+}
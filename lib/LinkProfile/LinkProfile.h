@@ -0,0 +1,125 @@
+/* ==========================================================================
+    File:     LinkProfile.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  BLE link profiles, asks the Central/Gateway for the connection
+              interval, slave latency, supervision timeout and data length
+              that suit low latency, throughput or power, and tracks what
+              the link actually granted so notifications fit the ATT MTU
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef LINK_PROFILE_H
+#define LINK_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LINK_DEFAULT_MTU          23      // until the Central/Gateway exchanges MTUs
+#define LINK_ATT_HEADER_SIZE      3       // opcode and handle of a notification
+#define LINK_STATUS_SIZE          16
+
+enum LinkProfileId: uint8_t {
+  LINK_PROFILE_LOW_LATENCY = 0,
+  LINK_PROFILE_HIGH_THROUGHPUT,
+  LINK_PROFILE_LOW_POWER,
+  LINK_PROFILE_COUNT
+};
+
+// the profiles in LinkProfileId order, for the Device Capability Schema
+#define LINK_PROFILES "latency,throughput,power"
+
+/* --------------------------------------------------------------------------
+    Connection parameters in Bluetooth units
+      minInterval/maxInterval   1.25 ms
+      latency                   connection events we may skip
+      supervisionTimeout        10 ms
+      dataLength                link layer payload octets (27 to 251)
+   -------------------------------------------------------------------------- */
+struct LinkParameters {
+  uint16_t  minInterval;
+  uint16_t  maxInterval;
+  uint16_t  latency;
+  uint16_t  supervisionTimeout;
+  uint16_t  dataLength;
+};
+
+/* --------------------------------------------------------------------------
+    Link access, ArduinoBLE on the Nano 33 BLE and a mocked link on the host
+      prefer              what the stack asks for when the next Central
+                          connects, may be NULL
+      requestConnection   ask the connected Central for new parameters
+      requestDataLength   data length extension, NULL when the stack has
+                          no way to ask for it
+      mtu                 the ATT MTU of the connection, 0 when unknown
+    the requests return false when nothing was sent
+   -------------------------------------------------------------------------- */
+struct LinkBus {
+  void      (*prefer)(const LinkParameters& parameters);
+  bool      (*requestConnection)(const LinkParameters& parameters);
+  bool      (*requestDataLength)(uint16_t octets);
+  uint16_t  (*mtu)();
+};
+
+enum LINK_FLAGS: uint8_t {
+  LINK_FLAG_CONNECTED       = 0x01,
+  LINK_FLAG_REQUESTED       = 0x02,   // the connection parameters were sent
+  LINK_FLAG_DATA_LENGTH     = 0x04,   // so was the data length
+  LINK_FLAG_MTU_EXCHANGED   = 0x08
+};
+
+struct LinkStatus {
+  LinkProfileId   profile;
+  uint8_t         flags;
+  LinkParameters  requested;
+  uint16_t        mtu;
+  uint16_t        payloadSize;
+};
+
+const LinkParameters& LinkProfileParameters(LinkProfileId profile);
+
+class LinkManager {
+public:
+  LinkManager();
+
+  // maxPayload is the largest notification the firmware has buffers for
+  void Begin(const LinkBus& bus, LinkProfileId profile, uint16_t maxPayload);
+
+  // false when profile is out of range, asks again right away when connected
+  bool SetProfile(LinkProfileId profile);
+  LinkProfileId Profile() const { return _status.profile; }
+
+  void Connected();
+  void Disconnected();
+
+  // picks up the granted MTU, true when the payload size changed
+  bool Update();
+
+  // bytes we can put in one notification, never more than maxPayload
+  uint16_t PayloadSize() const { return _status.payloadSize; }
+  const LinkStatus& Status() const { return _status; }
+
+private:
+  void Request();
+  uint16_t Payload(uint16_t mtu) const;
+
+  LinkBus     _bus;
+  uint16_t    _maxPayload;
+  LinkStatus  _status;
+};
+
+/* --------------------------------------------------------------------------
+    Link Status payload
+      [0]       LinkProfileId
+      [1]       LINK_FLAGS
+      [2..3]    min interval (1.25 ms) requested
+      [4..5]    max interval (1.25 ms) requested
+      [6..7]    slave latency requested
+      [8..9]    supervision timeout (10 ms) requested
+      [10..11]  data length (octets) requested
+      [12..13]  ATT MTU granted
+      [14..15]  notification payload size in use
+   -------------------------------------------------------------------------- */
+size_t EncodeLinkStatus(const LinkStatus& status, uint8_t* buffer, size_t bufferSize);
+
+#endif
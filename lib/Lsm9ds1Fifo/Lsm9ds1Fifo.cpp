@@ -0,0 +1,204 @@
+/* ==========================================================================
+    File:     Lsm9ds1Fifo.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  LSM9DS1 accelerometer/gyroscope FIFO driver
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "Lsm9ds1Fifo.h"
+
+static inline int16_t Word(const uint8_t* data) {
+  return (int16_t)(data[0] | (data[1] << 8));
+}
+
+Lsm9ds1Fifo::Lsm9ds1Fifo()
+  : _mode(LSM9DS1_FIFO_OFF), _periodMicros(0), _lastTimestamp(0), _hasTimestamp(false),
+    _drains(0), _samples(0), _overruns(0), _busErrors(0) {
+  _bus.readRegisters = 0;
+  _bus.writeRegister = 0;
+}
+
+bool Lsm9ds1Fifo::Begin(const Lsm9ds1Bus& bus, Lsm9ds1FifoMode mode, uint8_t watermark, float outputDataRateHz) {
+
+  _bus = bus;
+  _mode = LSM9DS1_FIFO_OFF;
+  _periodMicros = (uint32_t)(1000000.0f / outputDataRateHz);
+  _hasTimestamp = false;
+
+  if (mode == LSM9DS1_FIFO_OFF || outputDataRateHz <= 0.0f)
+    return false;
+
+  if (watermark == 0 || watermark >= LSM9DS1_FIFO_DEPTH)
+    watermark = LSM9DS1_FIFO_DEPTH - 1;
+
+  // keep the other control bits as IMU.begin() left them
+  uint8_t ctrlReg8, ctrlReg9;
+  if (!_bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG8, &ctrlReg8, 1) ||
+      !_bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG9, &ctrlReg9, 1)) {
+    _busErrors++;
+    return false;
+  }
+
+  // restart from an empty FIFO, going through bypass mode clears it
+  if (!_bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG8, ctrlReg8 | LSM9DS1_CTRL_REG8_IF_ADD_INC) ||
+      !_bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_FIFO_CTRL, LSM9DS1_FIFO_MODE_BYPASS) ||
+      !_bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG9, ctrlReg9 | LSM9DS1_CTRL_REG9_FIFO_EN) ||
+      !_bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_FIFO_CTRL, LSM9DS1_FIFO_MODE_CONTINUOUS | watermark)) {
+    _busErrors++;
+    return false;
+  }
+
+  _mode = mode;
+  return true;
+}
+
+void Lsm9ds1Fifo::End() {
+  if (_mode == LSM9DS1_FIFO_OFF)
+    return;
+
+  uint8_t ctrlReg9;
+  if (_bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG9, &ctrlReg9, 1)) {
+    _bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_FIFO_CTRL, LSM9DS1_FIFO_MODE_BYPASS);
+    _bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG9, ctrlReg9 & ~LSM9DS1_CTRL_REG9_FIFO_EN);
+  }
+  _mode = LSM9DS1_FIFO_OFF;
+}
+
+void Lsm9ds1Fifo::SetOutputDataRate(float outputDataRateHz) {
+  // anything still queued was taken at the old rate, Drain() keeps the
+  // timestamps monotonic across the change
+  if (outputDataRateHz > 0.0f) {
+    _periodMicros = (uint32_t)(1000000.0f / outputDataRateHz);
+  }
+}
+
+size_t Lsm9ds1Fifo::Drain(Lsm9ds1FifoSample* samples, size_t maxSamples, uint32_t nowMicros) {
+
+  if (_mode == LSM9DS1_FIFO_OFF || maxSamples == 0)
+    return 0;
+
+  uint8_t source;
+  if (!_bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_FIFO_SRC, &source, 1)) {
+    _busErrors++;
+    return 0;
+  }
+
+  if (source & LSM9DS1_FIFO_SRC_OVRN)
+    _overruns++;
+
+  if (_mode == LSM9DS1_FIFO_WATERMARK && !(source & LSM9DS1_FIFO_SRC_FTH))
+    return 0;
+
+  size_t queued = source & LSM9DS1_FIFO_SRC_FSS_MASK;
+  size_t count = queued;
+  if (count > maxSamples)
+    count = maxSamples;
+  if (count == 0)
+    return 0;
+
+  /* ------------------------------------------------------------------------
+      The FIFO is read through the output registers, every slot holds the
+      gyro word (18h..1Dh) followed by the accel word (28h..2Dh) and the
+      FIFO moves on once the accel word has been read
+     ------------------------------------------------------------------------ */
+  for (size_t i = 0; i < count; i++) {
+    uint8_t gyro[6];
+    uint8_t accel[6];
+    if (!_bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_OUT_X_L_G, gyro, sizeof(gyro)) ||
+        !_bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_OUT_X_L_XL, accel, sizeof(accel))) {
+      _busErrors++;
+      count = i;
+      break;
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+      samples[i].gyroscope[axis] = Word(&gyro[axis * 2]) * LSM9DS1_GYRO_SCALE;
+      samples[i].acceleration[axis] = Word(&accel[axis * 2]) * LSM9DS1_ACCEL_SCALE;
+    }
+  }
+
+  if (count == 0)
+    return 0;
+
+  /* ------------------------------------------------------------------------
+      The newest queued sample was taken about now. The queue covers the
+      time since the previous drain, unless that is longer than it holds at
+      the nominal rate (the first drain, an overrun or a slow sensor). A
+      sensor running fast fits more samples into the gap than the nominal
+      rate would, spacing them across the gap keeps the stamps anchored
+      to nowMicros instead of drifting ahead of it
+     ------------------------------------------------------------------------ */
+  uint32_t period = _periodMicros;
+  if (_hasTimestamp) {
+    uint32_t elapsed = nowMicros - _lastTimestamp;
+    if ((int32_t)elapsed < (int32_t)queued) {
+      // drained again within microseconds, keep the stamps a microsecond apart
+      elapsed = (uint32_t)queued;
+      nowMicros = _lastTimestamp + elapsed;
+    }
+    if (elapsed / queued < period)
+      period = elapsed / queued;
+  }
+
+  // samples still queued behind the ones read are newer than them
+  uint32_t first = nowMicros - (uint32_t)(queued - 1) * period;
+  for (size_t i = 0; i < count; i++) {
+    samples[i].timestampMicros = first + (uint32_t)i * period;
+  }
+
+  _lastTimestamp = samples[count - 1].timestampMicros;
+  _hasTimestamp = true;
+  _drains++;
+  _samples += count;
+  return count;
+}
+
+/* --------------------------------------------------------------------------
+    ODR_G codes in CTRL_REG1_G, the accelerometer follows the gyroscope
+    rate while both are on
+   -------------------------------------------------------------------------- */
+static const float LSM9DS1_OUTPUT_DATA_RATES[] = { 14.9f, 59.5f, 119.0f, 238.0f, 476.0f, 952.0f };
+#define LSM9DS1_OUTPUT_DATA_RATE_COUNT (sizeof(LSM9DS1_OUTPUT_DATA_RATES) / sizeof(LSM9DS1_OUTPUT_DATA_RATES[0]))
+#define LSM9DS1_LOW_POWER_MAX_HZ       119.0f
+
+float Lsm9ds1SetOutputDataRate(const Lsm9ds1Bus& bus, float outputDataRateHz, bool lowPower) {
+
+  size_t code = 0;
+  while (code + 1 < LSM9DS1_OUTPUT_DATA_RATE_COUNT && LSM9DS1_OUTPUT_DATA_RATES[code] < outputDataRateHz) {
+    code++;
+  }
+  float rate = LSM9DS1_OUTPUT_DATA_RATES[code];
+
+  uint8_t ctrlReg1, ctrlReg3;
+  if (!bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG1_G, &ctrlReg1, 1) ||
+      !bus.readRegisters(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG3_G, &ctrlReg3, 1))
+    return 0.0f;
+
+  ctrlReg1 = (ctrlReg1 & ~LSM9DS1_CTRL_REG1_G_ODR_MASK) | (uint8_t)((code + 1) << 5);
+  if (lowPower && rate <= LSM9DS1_LOW_POWER_MAX_HZ) {
+    ctrlReg3 |= LSM9DS1_CTRL_REG3_G_LP_MODE;
+  } else {
+    ctrlReg3 &= ~LSM9DS1_CTRL_REG3_G_LP_MODE;
+  }
+
+  // out of the low power mode before the rate changes, into it after
+  bool written = lowPower
+    ? bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG1_G, ctrlReg1) &&
+      bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG3_G, ctrlReg3)
+    : bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG3_G, ctrlReg3) &&
+      bus.writeRegister(LSM9DS1_AG_ADDRESS, LSM9DS1_CTRL_REG1_G, ctrlReg1);
+  return written ? rate : 0.0f;
+}
+
+bool Lsm9ds1SetMagnetometer(const Lsm9ds1Bus& bus, bool on) {
+  uint8_t ctrlReg3;
+  if (!bus.readRegisters(LSM9DS1_M_ADDRESS, LSM9DS1_CTRL_REG3_M, &ctrlReg3, 1))
+    return false;
+
+  ctrlReg3 &= ~LSM9DS1_CTRL_REG3_M_MD_MASK;
+  if (!on) {
+    ctrlReg3 |= LSM9DS1_CTRL_REG3_M_POWER_DOWN;
+  }
+  return bus.writeRegister(LSM9DS1_M_ADDRESS, LSM9DS1_CTRL_REG3_M, ctrlReg3);
+}
@@ -0,0 +1,135 @@
+/* ==========================================================================
+    File:     Lsm9ds1Fifo.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  LSM9DS1 accelerometer/gyroscope FIFO driver, enables the 32
+              slot hardware FIFO and drains every queued sample per tick
+              with reconstructed timestamps
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef LSM9DS1_FIFO_H
+#define LSM9DS1_FIFO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    LSM9DS1 Accelerometer/Gyroscope Registers we use
+   -------------------------------------------------------------------------- */
+#define LSM9DS1_AG_ADDRESS        0x6B
+#define LSM9DS1_CTRL_REG1_G       0x10
+#define LSM9DS1_CTRL_REG3_G       0x12
+#define LSM9DS1_OUT_X_L_G         0x18
+#define LSM9DS1_CTRL_REG8         0x22
+#define LSM9DS1_CTRL_REG9         0x23
+#define LSM9DS1_OUT_X_L_XL        0x28
+#define LSM9DS1_FIFO_CTRL         0x2E
+#define LSM9DS1_FIFO_SRC          0x2F
+
+#define LSM9DS1_CTRL_REG8_IF_ADD_INC  0x04
+#define LSM9DS1_CTRL_REG9_FIFO_EN     0x02
+#define LSM9DS1_FIFO_MODE_BYPASS      (0x00 << 5)
+#define LSM9DS1_FIFO_MODE_CONTINUOUS  (0x06 << 5)
+#define LSM9DS1_FIFO_SRC_FTH          0x80
+#define LSM9DS1_FIFO_SRC_OVRN         0x40
+#define LSM9DS1_FIFO_SRC_FSS_MASK     0x3F
+#define LSM9DS1_FIFO_DEPTH            32
+#define LSM9DS1_CTRL_REG1_G_ODR_MASK  0xE0
+#define LSM9DS1_CTRL_REG3_G_LP_MODE   0x80
+
+/* --------------------------------------------------------------------------
+    LSM9DS1 Magnetometer Registers we use
+   -------------------------------------------------------------------------- */
+#define LSM9DS1_M_ADDRESS             0x1E
+#define LSM9DS1_CTRL_REG3_M           0x22
+#define LSM9DS1_CTRL_REG3_M_MD_MASK   0x03
+#define LSM9DS1_CTRL_REG3_M_POWER_DOWN 0x03
+
+/* --------------------------------------------------------------------------
+    Full scale the Arduino_LSM9DS1 library configures in IMU.begin()
+   -------------------------------------------------------------------------- */
+#define LSM9DS1_ACCEL_SCALE       (4.0f / 32768.0f)       // g per LSB
+#define LSM9DS1_GYRO_SCALE        (2000.0f / 32768.0f)    // dps per LSB
+
+/* --------------------------------------------------------------------------
+    Register access, Wire1 on the Nano 33 BLE and a register level mock
+    on the host. Both return false when the transfer fails
+   -------------------------------------------------------------------------- */
+struct Lsm9ds1Bus {
+  bool (*readRegisters)(uint8_t address, uint8_t reg, uint8_t* data, size_t length);
+  bool (*writeRegister)(uint8_t address, uint8_t reg, uint8_t value);
+};
+
+/* --------------------------------------------------------------------------
+    FIFO Modes
+      CONTINUOUS  drain whatever is queued on every tick
+      WATERMARK   continuous, but only drain once the watermark is reached
+                  so a fast tick does not cost an I2C read per sample
+   -------------------------------------------------------------------------- */
+enum Lsm9ds1FifoMode : uint8_t {
+  LSM9DS1_FIFO_OFF = 0,
+  LSM9DS1_FIFO_CONTINUOUS,
+  LSM9DS1_FIFO_WATERMARK
+};
+
+struct Lsm9ds1FifoSample {
+  uint32_t  timestampMicros;
+  float     acceleration[3];
+  float     gyroscope[3];
+};
+
+class Lsm9ds1Fifo {
+public:
+  Lsm9ds1Fifo();
+
+  // enable the FIFO, call after IMU.begin() has set the output data rate
+  bool Begin(const Lsm9ds1Bus& bus, Lsm9ds1FifoMode mode, uint8_t watermark, float outputDataRateHz);
+
+  // back to bypass mode
+  void End();
+
+  // the timestamps follow a new output data rate, see Lsm9ds1SetOutputDataRate()
+  void SetOutputDataRate(float outputDataRateHz);
+
+  /* ------------------------------------------------------------------------
+      Read up to maxSamples queued samples, oldest first. Timestamps are
+      reconstructed back from nowMicros, at the output data rate or closer
+      when more samples arrived since the previous drain than that rate
+      allows, so they stay monotonic and never run ahead of nowMicros.
+      Returns the samples read
+     ------------------------------------------------------------------------ */
+  size_t Drain(Lsm9ds1FifoSample* samples, size_t maxSamples, uint32_t nowMicros);
+
+  Lsm9ds1FifoMode Mode() const    { return _mode; }
+  uint32_t  Drains() const        { return _drains; }
+  uint32_t  Samples() const       { return _samples; }
+  uint32_t  Overruns() const      { return _overruns; }
+  uint32_t  BusErrors() const     { return _busErrors; }
+
+private:
+  Lsm9ds1Bus      _bus;
+  Lsm9ds1FifoMode _mode;
+  uint32_t        _periodMicros;
+  uint32_t        _lastTimestamp;
+  bool            _hasTimestamp;
+  uint32_t        _drains;
+  uint32_t        _samples;
+  uint32_t        _overruns;
+  uint32_t        _busErrors;
+};
+
+/* --------------------------------------------------------------------------
+    Power control, both keep the other control bits as IMU.begin() left them
+      Lsm9ds1SetOutputDataRate    the accel/gyro output data rate, the
+                                  nearest the LSM9DS1 has at or above
+                                  outputDataRateHz (14.9 to 952 Hz), and the
+                                  gyroscope low power mode (119 Hz and
+                                  below). Returns the rate set, 0 when the
+                                  bus failed
+      Lsm9ds1SetMagnetometer      continuous conversion or powered down
+   -------------------------------------------------------------------------- */
+float Lsm9ds1SetOutputDataRate(const Lsm9ds1Bus& bus, float outputDataRateHz, bool lowPower);
+bool Lsm9ds1SetMagnetometer(const Lsm9ds1Bus& bus, bool on);
+
+#endif
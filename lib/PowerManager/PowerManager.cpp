@@ -0,0 +1,195 @@
+/* ==========================================================================
+    File:     PowerManager.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Power states of the device, see PowerManager.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "PowerManager.h"
+#include <TelemetryFrame.h>
+
+/* --------------------------------------------------------------------------
+    The profiles, the currents are rough figures from the LSM9DS1 and
+    nRF52840 datasheets (gyroscope 4 mA normal and 1.9 mA low power,
+    magnetometer 0.6 mA, the core mostly asleep) and not measurements.
+    ACTIVE carries the connection events at the link profile intervals
+      ACTIVE        119 Hz, magnetometer on, 20 ms idle
+      ADVERTISING   59.5 Hz low power, magnetometer on, 50 ms idle
+      DORMANT       14.9 Hz low power, magnetometer off, 100 ms idle
+   -------------------------------------------------------------------------- */
+static const PowerProfile POWER_PROFILES[POWER_STATE_COUNT] = {
+  { 119.0f, false, true,  20000,  7800 },
+  { 59.5f,  true,  true,  50000,  3200 },
+  { 14.9f,  true,  false, 100000, 2300 }
+};
+
+/* --------------------------------------------------------------------------
+    Advertising steps, fast while a Central/Gateway is likely looking for
+    us and then the longer intervals iOS still discovers reliably
+      100 ms, after 30 s 417.5 ms, after 2 minutes 1022.5 ms
+   -------------------------------------------------------------------------- */
+static const AdvertisingStep ADVERTISING_STEPS[POWER_ADVERTISING_STEPS] = {
+  { 0,   160 },
+  { 30,  668 },
+  { 120, 1636 }
+};
+
+// one advertising event on all three channels, about 6 mA for 2.5 ms
+#define ADVERTISING_EVENT_CHARGE  15000000ULL   // microamp microseconds
+#define ADVERTISING_UNIT_MICROS   625ULL
+
+const PowerProfile& PowerStateProfile(PowerState state) {
+  return POWER_PROFILES[state < POWER_STATE_COUNT ? state : POWER_ACTIVE];
+}
+
+PowerManager::PowerManager()
+  : _wired(false), _lastMicros(0), _advertisingMicros(0), _stillMicros(0), _charge(0), _totalMicros(0) {
+  _bus.applyImu = 0;
+  _bus.setAdvertisingInterval = 0;
+  _bus.micros = 0;
+  _status.state = POWER_ACTIVE;
+  _status.advertisingStep = 0;
+  _status.advertisingInterval = ADVERTISING_STEPS[0].interval;
+  _status.microAmps = 0;
+  _status.averageMicroAmps = 0;
+  _status.wakeMicros = 0;
+  _status.imuErrors = 0;
+  for (int state = 0; state < POWER_STATE_COUNT; state++) {
+    _status.seconds[state] = 0;
+    _stateMicros[state] = 0;
+  }
+}
+
+void PowerManager::Begin(const PowerBus& bus, bool wired) {
+  _bus = bus;
+  _wired = wired;
+  _lastMicros = _bus.micros();
+  _stillMicros = _lastMicros;
+  _advertisingMicros = _lastMicros;
+  _status.state = POWER_ACTIVE;
+  Enter(wired ? POWER_ACTIVE : POWER_ADVERTISING, _lastMicros);
+  Advertise(0);
+}
+
+void PowerManager::Connected() {
+  Account();
+  Enter(POWER_ACTIVE, _lastMicros);
+}
+
+void PowerManager::Disconnected() {
+  Account();
+  _stillMicros = _lastMicros;
+  _advertisingMicros = _lastMicros;
+  Enter(_wired ? POWER_ACTIVE : POWER_ADVERTISING, _lastMicros);
+  Advertise(0);
+}
+
+bool PowerManager::Motion(unsigned long triggerMicros) {
+  Account();
+  _stillMicros = _lastMicros;
+  if (_status.state != POWER_DORMANT)
+    return false;
+
+  // picked up, someone is likely about to connect
+  _advertisingMicros = _lastMicros;
+  Enter(POWER_ADVERTISING, triggerMicros);
+  Advertise(0);
+  return true;
+}
+
+bool PowerManager::Update(bool moving) {
+  Account();
+  if (moving) {
+    _stillMicros = _lastMicros;
+  }
+  if (_status.state == POWER_ACTIVE)
+    return false;
+
+  bool changed = false;
+  if (_status.state == POWER_ADVERTISING &&
+      _lastMicros - _stillMicros >= POWER_DORMANT_SECONDS * 1000000UL) {
+    Enter(POWER_DORMANT, _lastMicros);
+    changed = true;
+  }
+
+  unsigned long seconds = (_lastMicros - _advertisingMicros) / 1000000UL;
+  uint8_t step = _status.advertisingStep;
+  while (step + 1 < POWER_ADVERTISING_STEPS && seconds >= ADVERTISING_STEPS[step + 1].afterSeconds) {
+    step++;
+  }
+  if (step != _status.advertisingStep) {
+    Advertise(step);
+    changed = true;
+  }
+  return changed;
+}
+
+void PowerManager::Enter(PowerState state, unsigned long triggerMicros) {
+  if (state == _status.state)
+    return;
+
+  // anything faster than where we were is a wake, timed to the IMU at rate
+  bool wake = PowerStateProfile(state).imuHz > Profile().imuHz;
+  _status.state = state;
+  if (_bus.applyImu && !_bus.applyImu(Profile())) {
+    _status.imuErrors++;
+  }
+
+  if (wake) {
+    uint32_t micros = _bus.micros() - triggerMicros;
+    if (micros > _status.wakeMicros) {
+      _status.wakeMicros = micros;
+    }
+  }
+  _status.microAmps = Current();
+}
+
+void PowerManager::Advertise(uint8_t step) {
+  _status.advertisingStep = step;
+  _status.advertisingInterval = ADVERTISING_STEPS[step].interval;
+  if (_bus.setAdvertisingInterval) {
+    _bus.setAdvertisingInterval(_status.advertisingInterval);
+  }
+  _status.microAmps = Current();
+}
+
+void PowerManager::Account() {
+  unsigned long now = _bus.micros();
+  unsigned long elapsed = now - _lastMicros;
+  _lastMicros = now;
+
+  _stateMicros[_status.state] += elapsed;
+  _charge += (uint64_t)Current() * elapsed;
+  _totalMicros += elapsed;
+
+  _status.seconds[_status.state] = (uint32_t)(_stateMicros[_status.state] / 1000000ULL);
+  if (_totalMicros > 0) {
+    _status.averageMicroAmps = (uint16_t)(_charge / _totalMicros);
+  }
+}
+
+uint16_t PowerManager::Current() const {
+  uint32_t microAmps = Profile().microAmps;
+  if (_status.state != POWER_ACTIVE) {
+    microAmps += (uint32_t)(ADVERTISING_EVENT_CHARGE / (_status.advertisingInterval * ADVERTISING_UNIT_MICROS));
+  }
+  return microAmps > 0xFFFF ? 0xFFFF : (uint16_t)microAmps;
+}
+
+size_t EncodePowerStatus(const PowerStatus& status, uint8_t* buffer, size_t bufferSize) {
+  if (bufferSize < POWER_STATUS_SIZE)
+    return 0;
+
+  buffer[0] = status.state;
+  buffer[1] = status.advertisingStep;
+  PutUint16LE(&buffer[2], status.advertisingInterval);
+  PutUint16LE(&buffer[4], status.microAmps);
+  PutUint16LE(&buffer[6], status.averageMicroAmps);
+  for (int state = 0; state < POWER_STATE_COUNT; state++) {
+    PutUint32LE(&buffer[8 + state * 4], status.seconds[state]);
+  }
+  PutUint32LE(&buffer[20], status.wakeMicros);
+  PutUint16LE(&buffer[24], status.imuErrors);
+  return POWER_STATUS_SIZE;
+}
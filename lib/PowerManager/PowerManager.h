@@ -0,0 +1,149 @@
+/* ==========================================================================
+    File:     PowerManager.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Power states of the device, duty cycles the IMU and stretches
+              the advertising interval while no Central/Gateway is around,
+              restores the full rate on a connection or on motion and keeps
+              the time spent and an estimate of the current drawn per state
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define POWER_STATUS_SIZE         26
+#define POWER_DORMANT_SECONDS     60      // still this long while advertising
+#define POWER_ADVERTISING_STEPS   3
+
+/* --------------------------------------------------------------------------
+    Power States
+      ACTIVE        a Central/Gateway is connected, everything at full rate
+      ADVERTISING   waiting for a connection, the IMU slowed down so the
+                    flash store and the motion detector keep going
+      DORMANT       advertising and nothing has moved for a while, the
+                    IMU at its slowest and the magnetometer powered down
+   -------------------------------------------------------------------------- */
+enum PowerState: uint8_t {
+  POWER_ACTIVE = 0,
+  POWER_ADVERTISING,
+  POWER_DORMANT,
+  POWER_STATE_COUNT
+};
+
+// the states in PowerState order, for the Device Capability Schema
+#define POWER_STATES "active,advertising,dormant"
+
+/* --------------------------------------------------------------------------
+    What a state asks of the hardware
+      imuHz             accelerometer/gyroscope output data rate
+      gyroLowPower      the LSM9DS1 gyroscope low power mode
+      magnetometer      false powers the magnetometer down
+      maxSleepMicros    longest the loop idles, also bounds how late a new
+                        connection is noticed
+      microAmps         estimated board current, advertising events are
+                        added on top
+   -------------------------------------------------------------------------- */
+struct PowerProfile {
+  float     imuHz;
+  bool      gyroLowPower;
+  bool      magnetometer;
+  uint32_t  maxSleepMicros;
+  uint16_t  microAmps;
+};
+
+/* --------------------------------------------------------------------------
+    Advertising steps, once afterSeconds have passed without a connection
+    we advertise every interval (0.625 ms units)
+   -------------------------------------------------------------------------- */
+struct AdvertisingStep {
+  uint16_t  afterSeconds;
+  uint16_t  interval;
+};
+
+/* --------------------------------------------------------------------------
+    Power access, the LSM9DS1 and ArduinoBLE on the Nano 33 BLE and a
+    mock on the host
+      applyImu                  switch the IMU to the profile, false when
+                                the bus failed
+      setAdvertisingInterval    restart advertising at the new interval
+      micros                    the microsecond clock
+   -------------------------------------------------------------------------- */
+struct PowerBus {
+  bool          (*applyImu)(const PowerProfile& profile);
+  void          (*setAdvertisingInterval)(uint16_t interval);
+  unsigned long (*micros)();
+};
+
+struct PowerStatus {
+  PowerState  state;
+  uint8_t     advertisingStep;
+  uint16_t    advertisingInterval;
+  uint16_t    microAmps;                        // estimate right now
+  uint16_t    averageMicroAmps;                 // estimate since Begin()
+  uint32_t    seconds[POWER_STATE_COUNT];
+  uint32_t    wakeMicros;                       // slowest return to full rate
+  uint16_t    imuErrors;
+};
+
+const PowerProfile& PowerStateProfile(PowerState state);
+
+class PowerManager {
+public:
+  PowerManager();
+
+  // we boot advertising, or ACTIVE for good when a wired transport streams
+  void Begin(const PowerBus& bus, bool wired = false);
+
+  void Connected();
+  void Disconnected();
+
+  /* ------------------------------------------------------------------------
+      Motion started at triggerMicros, a dormant device goes back to
+      advertising at the fastest interval. Returns true when the state
+      changed
+     ------------------------------------------------------------------------ */
+  bool Motion(unsigned long triggerMicros);
+
+  // accounts the time, steps the advertising and goes dormant when still
+  bool Update(bool moving);
+
+  PowerState State() const            { return _status.state; }
+  const PowerProfile& Profile() const { return PowerStateProfile(_status.state); }
+  uint32_t MaxSleepMicros() const     { return Profile().maxSleepMicros; }
+  const PowerStatus& Status() const   { return _status; }
+
+private:
+  void Enter(PowerState state, unsigned long triggerMicros);
+  void Advertise(uint8_t step);
+  void Account();
+  uint16_t Current() const;
+
+  PowerBus        _bus;
+  PowerStatus     _status;
+  bool            _wired;
+  unsigned long   _lastMicros;
+  unsigned long   _advertisingMicros;           // when advertising started
+  unsigned long   _stillMicros;                 // when we last saw motion
+  uint64_t        _stateMicros[POWER_STATE_COUNT];
+  uint64_t        _charge;                      // microamp microseconds
+  uint64_t        _totalMicros;
+};
+
+/* --------------------------------------------------------------------------
+    Power Status payload
+      [0]       PowerState
+      [1]       advertising step
+      [2..3]    advertising interval (0.625 ms)
+      [4..5]    estimated current now (uA)
+      [6..7]    estimated average current (uA)
+      [8..19]   seconds spent active, advertising, dormant
+      [20..23]  slowest wake to full rate (us)
+      [24..25]  failed IMU reconfigurations
+   -------------------------------------------------------------------------- */
+size_t EncodePowerStatus(const PowerStatus& status, uint8_t* buffer, size_t bufferSize);
+
+#endif
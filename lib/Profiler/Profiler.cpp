@@ -0,0 +1,98 @@
+/* ==========================================================================
+    File:     Profiler.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Hot path instrumentation
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "Profiler.h"
+#include <string.h>
+
+static void Put32(uint8_t* buffer, uint32_t value) {
+  buffer[0] = (uint8_t)(value);
+  buffer[1] = (uint8_t)(value >> 8);
+  buffer[2] = (uint8_t)(value >> 16);
+  buffer[3] = (uint8_t)(value >> 24);
+}
+
+Profiler::Profiler()
+  : _counter(0), _counterHz(0), _loops(0), _loopsPerSecond(0), _notifySent(0), _notifyDropped(0) {
+  Reset();
+}
+
+void Profiler::Begin(ProfilerCounter counter, uint32_t counterHz) {
+  _counter = counter;
+  _counterHz = counterHz;
+  Reset();
+}
+
+void Profiler::Record(int section, uint32_t elapsed) {
+  if (section < 0 || section >= PROFILER_MAX_SECTIONS)
+    return;
+
+  ProfileSection& s = _sections[section];
+  s.count++;
+  s.total += elapsed;
+  if (elapsed < s.min)
+    s.min = elapsed;
+  if (elapsed > s.max)
+    s.max = elapsed;
+
+  int bucket = 0;
+  uint32_t limit = 1UL << PROFILER_HISTOGRAM_BASE;
+  while (bucket < PROFILER_HISTOGRAM_BUCKETS - 1 && elapsed >= limit) {
+    bucket++;
+    limit <<= 2;
+  }
+  if (s.histogram[bucket] < 0xFFFF)
+    s.histogram[bucket]++;
+}
+
+void Profiler::Reset() {
+  memset(_sections, 0, sizeof(_sections));
+  for (int i = 0; i < PROFILER_MAX_SECTIONS; i++)
+    _sections[i].min = 0xFFFFFFFF;
+  _loops = 0;
+  _loopsPerSecond = 0;
+  _notifySent = 0;
+  _notifyDropped = 0;
+}
+
+size_t Profiler::Encode(uint8_t* buffer, size_t bufferSize, int sections,
+                        uint32_t elapsedMicros, uint32_t logDropped) {
+
+  if (sections > PROFILER_MAX_SECTIONS)
+    sections = PROFILER_MAX_SECTIONS;
+  if (bufferSize < DIAGNOSTICS_HEADER_SIZE + (size_t)sections * DIAGNOSTICS_SECTION_SIZE)
+    return 0;
+
+  if (elapsedMicros > 0) {
+    _loopsPerSecond = (uint32_t)(((uint64_t)_loops * 1000000ULL) / elapsedMicros);
+    _loops = 0;
+  }
+
+  buffer[0] = DIAGNOSTICS_VERSION;
+  buffer[1] = (uint8_t)sections;
+  Put32(&buffer[2], _counterHz);
+  Put32(&buffer[6], _loopsPerSecond);
+  Put32(&buffer[10], _notifySent);
+  Put32(&buffer[14], _notifyDropped);
+  Put32(&buffer[18], logDropped);
+
+  uint8_t* cursor = &buffer[DIAGNOSTICS_HEADER_SIZE];
+  for (int i = 0; i < sections; i++) {
+    const ProfileSection& s = _sections[i];
+    Put32(&cursor[0], s.count);
+    Put32(&cursor[4], s.count ? s.min : 0);
+    Put32(&cursor[8], s.count ? (uint32_t)(s.total / s.count) : 0);
+    Put32(&cursor[12], s.max);
+    for (int b = 0; b < PROFILER_HISTOGRAM_BUCKETS; b++) {
+      cursor[16 + b * 2] = (uint8_t)(s.histogram[b]);
+      cursor[17 + b * 2] = (uint8_t)(s.histogram[b] >> 8);
+    }
+    cursor += DIAGNOSTICS_SECTION_SIZE;
+  }
+
+  return (size_t)(cursor - buffer);
+}
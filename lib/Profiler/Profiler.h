@@ -0,0 +1,112 @@
+/* ==========================================================================
+    File:     Profiler.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Hot path instrumentation, min/avg/max and a histogram per
+              instrumented section, counted in DWT cycles on the nRF52840
+              or any other counter on the host
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef PROFILER_MAX_SECTIONS
+#define PROFILER_MAX_SECTIONS 8
+#endif
+
+/* --------------------------------------------------------------------------
+    Histogram buckets are powers of four of the counter, starting at 256
+      [0] < 256, [1] < 1K, [2] < 4K, [3] < 16K, ... [7] >= 1M
+   -------------------------------------------------------------------------- */
+#define PROFILER_HISTOGRAM_BUCKETS  8
+#define PROFILER_HISTOGRAM_BASE     8
+
+// free running counter, DWT->CYCCNT on the device, micros() as a fallback
+typedef uint32_t (*ProfilerCounter)();
+
+struct ProfileSection {
+  uint32_t  count;
+  uint32_t  min;
+  uint32_t  max;
+  uint64_t  total;
+  uint16_t  histogram[PROFILER_HISTOGRAM_BUCKETS];
+};
+
+/* --------------------------------------------------------------------------
+    Diagnostics Layout (little endian), version 1
+      [0]      version
+      [1]      section count
+      [2..5]   counter frequency (Hz)
+      [6..9]   loop iterations per second
+      [10..13] notifications sent
+      [14..17] notifications dropped
+      [18..21] log messages dropped
+      then per section
+      [0..3]   count
+      [4..7]   min
+      [8..11]  avg
+      [12..15] max
+      [16..31] histogram, 8 x uint16
+   -------------------------------------------------------------------------- */
+#define DIAGNOSTICS_VERSION         1
+#define DIAGNOSTICS_HEADER_SIZE     22
+#define DIAGNOSTICS_SECTION_SIZE    (16 + 2 * PROFILER_HISTOGRAM_BUCKETS)
+#define DIAGNOSTICS_SIZE            (DIAGNOSTICS_HEADER_SIZE + PROFILER_MAX_SECTIONS * DIAGNOSTICS_SECTION_SIZE)
+
+class Profiler {
+public:
+  Profiler();
+
+  void Begin(ProfilerCounter counter, uint32_t counterHz);
+
+  uint32_t Now() const { return _counter ? _counter() : 0; }
+  uint32_t CounterHz() const { return _counterHz; }
+
+  void Record(int section, uint32_t elapsed);
+  void Reset();
+
+  const ProfileSection& Section(int section) const { return _sections[section]; }
+
+  // counters that are not timed sections
+  void CountLoop()                  { _loops++; }
+  void CountNotify(bool sent)       { if (sent) _notifySent++; else _notifyDropped++; }
+  uint32_t NotifySent() const       { return _notifySent; }
+  uint32_t NotifyDropped() const    { return _notifyDropped; }
+
+  /* ------------------------------------------------------------------------
+      Work out the loop rate since the last call, elapsedMicros apart, and
+      pack everything into buffer. Returns the bytes written
+     ------------------------------------------------------------------------ */
+  size_t Encode(uint8_t* buffer, size_t bufferSize, int sections,
+                uint32_t elapsedMicros, uint32_t logDropped);
+
+private:
+  ProfilerCounter _counter;
+  uint32_t        _counterHz;
+  ProfileSection  _sections[PROFILER_MAX_SECTIONS];
+  uint32_t        _loops;
+  uint32_t        _loopsPerSecond;
+  uint32_t        _notifySent;
+  uint32_t        _notifyDropped;
+};
+
+/* --------------------------------------------------------------------------
+    Times the enclosing scope into a section
+   -------------------------------------------------------------------------- */
+class ProfileScope {
+public:
+  ProfileScope(Profiler& profiler, int section)
+    : _profiler(profiler), _section(section), _start(profiler.Now()) {}
+  ~ProfileScope() { _profiler.Record(_section, _profiler.Now() - _start); }
+
+private:
+  Profiler& _profiler;
+  int       _section;
+  uint32_t  _start;
+};
+
+#endif
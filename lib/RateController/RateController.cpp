@@ -0,0 +1,76 @@
+/* ==========================================================================
+    File:     RateController.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Closed loop telemetry rate control
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "RateController.h"
+
+// a clean step takes 1 / RATE_STEP_DIVISOR off the period
+#define RATE_STEP_DIVISOR 8
+
+RateController::RateController()
+  : _periodMillis(0), _batch(1), _flags(0), _backoffs(0) {
+  RateBounds bounds = { 100, 30000, 1, 1, -90, 50 };
+  Begin(bounds);
+}
+
+bool RateController::Begin(const RateBounds& bounds) {
+
+  if (bounds.minPeriodMillis == 0 || bounds.minPeriodMillis > bounds.maxPeriodMillis)
+    return false;
+  if (bounds.minBatch == 0 || bounds.minBatch > bounds.maxBatch)
+    return false;
+  if (bounds.backlogPercent == 0 || bounds.backlogPercent > 100)
+    return false;
+
+  _bounds = bounds;
+  Reset();
+  return true;
+}
+
+void RateController::Reset() {
+  _periodMillis = _bounds.minPeriodMillis;
+  _batch = _bounds.minBatch;
+  _flags = 0;
+}
+
+bool RateController::Update(const RateInputs& inputs) {
+
+  uint16_t period = _periodMillis;
+  uint8_t batch = _batch;
+
+  _flags = inputs.active ? RATE_FLAG_ACTIVE : 0;
+  if (inputs.notifyFailed > 0)
+    _flags |= RATE_FLAG_FAILED;
+  if (inputs.backlogPercent > _bounds.backlogPercent)
+    _flags |= RATE_FLAG_BACKLOG;
+  if (inputs.rssi != RATE_RSSI_UNKNOWN && inputs.rssi < _bounds.rssiFloor)
+    _flags |= RATE_FLAG_RSSI;
+
+  if (_flags & (RATE_FLAG_FAILED | RATE_FLAG_RSSI)) {
+    // multiplicative decrease, half the rate and twice the batch
+    uint32_t slower = (uint32_t)period * 2;
+    period = slower > _bounds.maxPeriodMillis ? _bounds.maxPeriodMillis : (uint16_t)slower;
+    uint16_t larger = (uint16_t)batch * 2;
+    batch = larger > _bounds.maxBatch ? _bounds.maxBatch : (uint8_t)larger;
+    _backoffs++;
+  } else if (_flags & RATE_FLAG_BACKLOG) {
+    // the link keeps up but the rate does not, slowing down would only
+    // grow the queue, twice the batch drains it on as many notifies
+    uint16_t larger = (uint16_t)batch * 2;
+    batch = larger > _bounds.maxBatch ? _bounds.maxBatch : (uint8_t)larger;
+  } else if (inputs.active && inputs.notifySent > 0) {
+    // creep back, only probe for more while there is more to send
+    uint16_t step = period / RATE_STEP_DIVISOR > 0 ? period / RATE_STEP_DIVISOR : 1;
+    period = period > _bounds.minPeriodMillis + step ? period - step : _bounds.minPeriodMillis;
+    batch = batch > _bounds.minBatch ? batch - 1 : _bounds.minBatch;
+  }
+
+  bool changed = period != _periodMillis || batch != _batch;
+  _periodMillis = period;
+  _batch = batch;
+  return changed;
+}
@@ -0,0 +1,82 @@
+/* ==========================================================================
+    File:     RateController.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Closed loop telemetry rate control, halves the publish rate
+              and doubles the batch size when the link is congested, only
+              doubles the batch when the queue backs up, and creeps back in
+              small steps once it is clean, within bounds the gateway sets
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef RATE_CONTROLLER_H
+#define RATE_CONTROLLER_H
+
+#include <stdint.h>
+
+#define RATE_RSSI_UNKNOWN         127
+
+/* --------------------------------------------------------------------------
+    Bounds, from the gateway
+      minPeriodMillis   fastest the controller lets the publish stage run
+      maxPeriodMillis   slowest it backs off to
+      minBatch/maxBatch range of samples per batched notification
+      rssiFloor         below this (dBm) the link counts as congested
+      backlogPercent    queue fill above this grows the batch
+   -------------------------------------------------------------------------- */
+struct RateBounds {
+  uint16_t  minPeriodMillis;
+  uint16_t  maxPeriodMillis;
+  uint8_t   minBatch;
+  uint8_t   maxBatch;
+  int8_t    rssiFloor;
+  uint8_t   backlogPercent;
+};
+
+/* --------------------------------------------------------------------------
+    What happened on the link since the last Update()
+   -------------------------------------------------------------------------- */
+struct RateInputs {
+  uint32_t  notifySent;
+  uint32_t  notifyFailed;
+  uint8_t   backlogPercent;     // how full the sample queue is
+  int8_t    rssi;               // RATE_RSSI_UNKNOWN when we could not read it
+  bool      active;             // there is more to send than the rate allows
+};
+
+// why the last Update() backed off, or that it was active
+enum RATE_FLAGS: uint8_t {
+  RATE_FLAG_FAILED  = 0x01,
+  RATE_FLAG_BACKLOG = 0x02,
+  RATE_FLAG_RSSI    = 0x04,
+  RATE_FLAG_ACTIVE  = 0x08
+};
+
+class RateController {
+public:
+  RateController();
+
+  // false and no change when the bounds are inconsistent
+  bool Begin(const RateBounds& bounds);
+  const RateBounds& Bounds() const { return _bounds; }
+
+  // back to the fastest rate and smallest batch
+  void Reset();
+
+  // one control step, true when the period or batch size changed
+  bool Update(const RateInputs& inputs);
+
+  uint16_t PeriodMillis() const { return _periodMillis; }
+  uint8_t BatchSize() const { return _batch; }
+  uint8_t Flags() const { return _flags; }
+  uint32_t Backoffs() const { return _backoffs; }
+
+private:
+  RateBounds  _bounds;
+  uint16_t    _periodMillis;
+  uint8_t     _batch;
+  uint8_t     _flags;
+  uint32_t    _backoffs;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/* ==========================================================================
+    File:     SampleRingBuffer.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Fixed-size, allocation-free ring buffer for IMU samples with
+              overflow and drop counters
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef SAMPLE_RING_BUFFER_H
+#define SAMPLE_RING_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    Ring of CAPACITY elements (a power of two), when full the oldest sample
+    is overwritten so a late flush keeps the most recent motion
+   -------------------------------------------------------------------------- */
+template <typename T, size_t CAPACITY>
+class SampleRingBuffer {
+  static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0,
+                "SampleRingBuffer CAPACITY must be a power of two");
+
+public:
+  SampleRingBuffer() : _head(0), _tail(0), _pushed(0), _overflows(0), _dropped(0) {}
+
+  void Push(const T& sample) {
+    if (Full()) {
+      // overwrite the oldest sample
+      _tail++;
+      _overflows++;
+      _dropped++;
+    }
+    _samples[_head & (CAPACITY - 1)] = sample;
+    _head++;
+    _pushed++;
+  }
+
+  // sample at position index counted from the oldest, index < Count()
+  const T& Peek(size_t index) const {
+    return _samples[(_tail + index) & (CAPACITY - 1)];
+  }
+
+  void Pop(size_t count) {
+    if (count > Count())
+      count = Count();
+    _tail += count;
+  }
+
+  // throw away everything still queued and count it as dropped
+  void Clear() {
+    _dropped += Count();
+    _tail = _head;
+  }
+
+  // samples that were dequeued but never made it out (failed notify, etc.)
+  void CountDropped(size_t count)   { _dropped += count; }
+
+  size_t    Count() const           { return (size_t)(_head - _tail); }
+  bool      Empty() const           { return _head == _tail; }
+  bool      Full() const            { return Count() == CAPACITY; }
+  size_t    Capacity() const        { return CAPACITY; }
+  uint32_t  Pushed() const          { return _pushed; }
+  uint32_t  Overflows() const       { return _overflows; }
+  uint32_t  Dropped() const         { return _dropped; }
+
+private:
+  T         _samples[CAPACITY];
+  uint32_t  _head;
+  uint32_t  _tail;
+  uint32_t  _pushed;
+  uint32_t  _overflows;
+  uint32_t  _dropped;
+};
+
+#endif
@@ -0,0 +1,325 @@
+/* ==========================================================================
+    File:     SerialLog.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Lock-free single producer / single consumer log ring buffer
+              and a small formatter that needs no printf float support
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "SerialLog.h"
+#include <stdarg.h>
+#include <string.h>
+#include <atomic>
+
+static_assert((LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0, "LOG_BUFFER_SIZE must be a power of two");
+
+/* --------------------------------------------------------------------------
+    Ring State, the producer only moves head and the consumer only moves
+    tail, so no lock is needed between loop() and the drain
+   -------------------------------------------------------------------------- */
+static uint8_t                logBuffer[LOG_BUFFER_SIZE];
+static std::atomic<uint32_t>  logHead(0);
+static std::atomic<uint32_t>  logTail(0);
+static uint32_t               logDropped = 0;
+static uint32_t               logWritten = 0;
+static LogClock               logClock = 0;
+
+static const char* const LOG_LEVEL_NAMES[] = { "", "E ", "W ", "I ", "D " };
+
+void LogBegin(LogClock clock) {
+  logClock = clock;
+}
+
+/* --------------------------------------------------------------------------
+    Append length bytes as one message or drop all of it
+   -------------------------------------------------------------------------- */
+static void LogEnqueue(const uint8_t* message, size_t length) {
+  uint32_t head = logHead.load(std::memory_order_relaxed);
+  uint32_t tail = logTail.load(std::memory_order_acquire);
+
+  if (length > LOG_BUFFER_SIZE - (head - tail)) {
+    logDropped++;
+    return;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    logBuffer[(head + i) & (LOG_BUFFER_SIZE - 1)] = message[i];
+  }
+  logHead.store(head + (uint32_t)length, std::memory_order_release);
+  logWritten++;
+}
+
+#if !LOG_BINARY
+
+/* --------------------------------------------------------------------------
+    Text Formatting
+   -------------------------------------------------------------------------- */
+struct LogText {
+  char*   buffer;
+  size_t  length;
+  size_t  size;
+};
+
+static void PutChar(LogText& text, char c) {
+  if (text.length < text.size)
+    text.buffer[text.length++] = c;
+}
+
+static void PutString(LogText& text, const char* s) {
+  while (s && *s)
+    PutChar(text, *s++);
+}
+
+static void PutUnsigned(LogText& text, unsigned long value, unsigned base) {
+  char digits[12];
+  int count = 0;
+  do {
+    unsigned digit = (unsigned)(value % base);
+    digits[count++] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value && count < (int)sizeof(digits));
+  while (count)
+    PutChar(text, digits[--count]);
+}
+
+static void PutSigned(LogText& text, long value) {
+  if (value < 0) {
+    PutChar(text, '-');
+    PutUnsigned(text, (unsigned long)(-(value + 1)) + 1, 10);
+  } else {
+    PutUnsigned(text, (unsigned long)value, 10);
+  }
+}
+
+static void PutFloat(LogText& text, double value, int precision) {
+  if (value != value) {
+    PutString(text, "nan");
+    return;
+  }
+  if (value < 0) {
+    PutChar(text, '-');
+    value = -value;
+  }
+  if (value > 4294967295.0) {
+    PutString(text, "ovf");
+    return;
+  }
+
+  // round like Serial.print does
+  double rounding = 0.5;
+  for (int i = 0; i < precision; i++)
+    rounding /= 10.0;
+  value += rounding;
+
+  unsigned long whole = (unsigned long)value;
+  PutUnsigned(text, whole, 10);
+  if (precision > 0)
+    PutChar(text, '.');
+
+  double fraction = value - (double)whole;
+  for (int i = 0; i < precision; i++) {
+    fraction *= 10.0;
+    int digit = (int)fraction;
+    PutChar(text, (char)('0' + digit));
+    fraction -= digit;
+  }
+}
+
+static size_t FormatText(char* buffer, size_t size, uint8_t level, const char* format, va_list args) {
+  LogText text = { buffer, 0, size - 2 };
+
+  PutString(text, LOG_LEVEL_NAMES[level <= LOG_LEVEL_DEBUG ? level : 0]);
+
+  while (*format) {
+    if (*format != '%') {
+      PutChar(text, *format++);
+      continue;
+    }
+    format++;
+
+    int precision = 2;
+    if (*format == '.') {
+      format++;
+      precision = 0;
+      while (*format >= '0' && *format <= '9')
+        precision = precision * 10 + (*format++ - '0');
+    }
+
+    bool isLong = false;
+    if (*format == 'l') {
+      isLong = true;
+      format++;
+    }
+
+    switch (*format) {
+      case 'd':
+      case 'i':
+        PutSigned(text, isLong ? va_arg(args, long) : (long)va_arg(args, int));
+        break;
+      case 'u':
+        PutUnsigned(text, isLong ? va_arg(args, unsigned long) : (unsigned long)va_arg(args, unsigned), 10);
+        break;
+      case 'x':
+        PutUnsigned(text, isLong ? va_arg(args, unsigned long) : (unsigned long)va_arg(args, unsigned), 16);
+        break;
+      case 'c':
+        PutChar(text, (char)va_arg(args, int));
+        break;
+      case 's':
+        PutString(text, va_arg(args, const char*));
+        break;
+      case 'f':
+        PutFloat(text, va_arg(args, double), precision);
+        break;
+      case '%':
+        PutChar(text, '%');
+        break;
+      case '\0':
+        continue;
+      default:
+        PutChar(text, '?');
+        break;
+    }
+    format++;
+  }
+
+  buffer[text.length++] = '\r';
+  buffer[text.length++] = '\n';
+  return text.length;
+}
+
+#else
+
+/* --------------------------------------------------------------------------
+    Binary Records
+   -------------------------------------------------------------------------- */
+static void PutBinary32(uint8_t* record, size_t& length, size_t size, uint32_t value) {
+  if (length + 4 > size)
+    return;
+  record[length++] = (uint8_t)(value);
+  record[length++] = (uint8_t)(value >> 8);
+  record[length++] = (uint8_t)(value >> 16);
+  record[length++] = (uint8_t)(value >> 24);
+}
+
+static size_t FormatBinary(uint8_t* record, size_t size, uint8_t level, const char* format, va_list args) {
+  size_t length = 2;
+  uint8_t count = 0;
+
+  record[0] = LOG_BINARY_SYNC;
+  PutBinary32(record, length, size, (uint32_t)(uintptr_t)format);
+  PutBinary32(record, length, size, logClock ? (uint32_t)logClock() : 0);
+
+  for (const char* cursor = format; *cursor; cursor++) {
+    if (*cursor != '%')
+      continue;
+    cursor++;
+    while (*cursor == '.' || (*cursor >= '0' && *cursor <= '9'))
+      cursor++;
+    bool isLong = false;
+    if (*cursor == 'l') {
+      isLong = true;
+      cursor++;
+    }
+
+    uint32_t value;
+    switch (*cursor) {
+      case 'd':
+      case 'i':
+        value = (uint32_t)(isLong ? va_arg(args, long) : (long)va_arg(args, int));
+        break;
+      case 'u':
+      case 'x':
+        value = (uint32_t)(isLong ? va_arg(args, unsigned long) : (unsigned long)va_arg(args, unsigned));
+        break;
+      case 'c':
+        value = (uint32_t)va_arg(args, int);
+        break;
+      case 'f':
+        {
+          float f = (float)va_arg(args, double);
+          memcpy(&value, &f, sizeof(value));
+        }
+        break;
+      case 's':
+        {
+          const char* s = va_arg(args, const char*);
+          size_t sl = s ? strlen(s) : 0;
+          if (sl > 255)
+            sl = 255;
+          if (length + 1 + sl > size)
+            sl = size > length + 1 ? size - length - 1 : 0;
+          if (length < size)
+            record[length++] = (uint8_t)sl;
+          if (sl > 0) {
+            memcpy(&record[length], s, sl);
+            length += sl;
+          }
+          count++;
+        }
+        continue;
+      case '\0':
+        cursor--;
+        continue;
+      default:
+        continue;
+    }
+    PutBinary32(record, length, size, value);
+    count++;
+  }
+
+  record[1] = (uint8_t)((level << 4) | (count & 0x0F));
+  return length;
+}
+
+#endif
+
+void LogWrite(uint8_t level, const char* format, ...) {
+  uint8_t message[LOG_MESSAGE_SIZE];
+  va_list args;
+  va_start(args, format);
+#if LOG_BINARY
+  size_t length = FormatBinary(message, sizeof(message), level, format, args);
+#else
+  size_t length = FormatText((char*)message, sizeof(message), level, format, args);
+#endif
+  va_end(args);
+  LogEnqueue(message, length);
+}
+
+size_t LogDrain(LogSink sink, size_t maxBytes) {
+  uint32_t tail = logTail.load(std::memory_order_relaxed);
+  uint32_t head = logHead.load(std::memory_order_acquire);
+  size_t queued = head - tail;
+  if (queued > maxBytes)
+    queued = maxBytes;
+
+  size_t drained = 0;
+  while (drained < queued) {
+    // hand out the contiguous part up to the end of the ring
+    size_t offset = (tail + drained) & (LOG_BUFFER_SIZE - 1);
+    size_t chunk = LOG_BUFFER_SIZE - offset;
+    if (chunk > queued - drained)
+      chunk = queued - drained;
+    size_t accepted = sink(&logBuffer[offset], chunk);
+    drained += accepted;
+    if (accepted < chunk)
+      break;
+  }
+
+  logTail.store(tail + (uint32_t)drained, std::memory_order_release);
+  return drained;
+}
+
+uint32_t LogDropped() {
+  return logDropped;
+}
+
+uint32_t LogWritten() {
+  return logWritten;
+}
+
+size_t LogQueued() {
+  return logHead.load(std::memory_order_acquire) - logTail.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,119 @@
+/* ==========================================================================
+    File:     SerialLog.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Non-blocking, rate-limited logging for the Arduino Nano BLE 33,
+              messages go into a lock-free ring buffer that loop() drains
+              opportunistically to the Serial port
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef SERIAL_LOG_H
+#define SERIAL_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    Log Levels, selected at compile time and every call above the level is
+    stripped out (arguments are not evaluated)
+      -D DEBUG (any value)  everything, the Serial output the sketch has
+                            always printed with DEBUG on
+      -D LOG_LEVEL=n        only up to level n, overrides DEBUG
+      neither               release, nothing is logged
+   -------------------------------------------------------------------------- */
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARN    2
+#define LOG_LEVEL_INFO    3       // connection and configuration events
+#define LOG_LEVEL_DEBUG   4       // every published value
+
+#ifndef LOG_LEVEL
+  #if defined(DEBUG)
+    #define LOG_LEVEL LOG_LEVEL_DEBUG
+  #else
+    #define LOG_LEVEL LOG_LEVEL_NONE
+  #endif
+#endif
+
+// bytes of queued log output, a power of two
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 2048
+#endif
+
+// longest single message once formatted
+#ifndef LOG_MESSAGE_SIZE
+#define LOG_MESSAGE_SIZE 96
+#endif
+
+/* --------------------------------------------------------------------------
+    With -D LOG_BINARY=1 messages are queued as binary records instead of
+    text, which skips the formatting on the device
+      [0]      0xA5 sync
+      [1]      level << 4 | argument count
+      [2..5]   address of the format string, resolve it with firmware.elf
+      [6..9]   timestamp (micros)
+      then per argument 4 bytes (integers and floats as float bits),
+      strings as a length byte followed by the characters
+   -------------------------------------------------------------------------- */
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+
+#define LOG_BINARY_SYNC   0xA5
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(...)  LogWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+  #define LOG_ERROR(...)  do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+  #define LOG_WARN(...)   LogWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+  #define LOG_WARN(...)   do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(...)   LogWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+  #define LOG_INFO(...)   do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_DEBUG(...)  LogWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+  #define LOG_DEBUG(...)  do {} while (0)
+#endif
+
+/* --------------------------------------------------------------------------
+    Where drained log bytes go, returns how many bytes it accepted
+   -------------------------------------------------------------------------- */
+typedef size_t (*LogSink)(const uint8_t* buffer, size_t length);
+
+// timestamp source for binary records, defaults to none (0)
+typedef unsigned long (*LogClock)();
+
+void LogBegin(LogClock clock);
+
+/* --------------------------------------------------------------------------
+    Queue a message, printf style with %d %i %u %ld %lu %x %c %s %f %.Nf
+    A message that does not fit the free space is dropped and counted,
+    this never blocks
+   -------------------------------------------------------------------------- */
+void LogWrite(uint8_t level, const char* format, ...)
+#if defined(__GNUC__)
+  __attribute__((format(printf, 2, 3)))
+#endif
+  ;
+
+/* --------------------------------------------------------------------------
+    Hand up to maxBytes of queued output to the sink, returns bytes drained
+   -------------------------------------------------------------------------- */
+size_t LogDrain(LogSink sink, size_t maxBytes);
+
+uint32_t LogDropped();
+uint32_t LogWritten();
+size_t LogQueued();
+
+#endif
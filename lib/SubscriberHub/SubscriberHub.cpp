@@ -0,0 +1,243 @@
+/* ==========================================================================
+    File:     SubscriberHub.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Per connection subscribers, see SubscriberHub.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "SubscriberHub.h"
+#include <CompactCodec.h>
+#include <TelemetryFrame.h>
+#include <string.h>
+
+SubscriberHub::SubscriberHub()
+  : _next(0) {
+  _bus.send = 0;
+  _bus.payloadSize = 0;
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    Reset(_slots[slot]);
+    _slots[slot].active = false;
+    _slots[slot].connection = 0;
+  }
+}
+
+void SubscriberHub::Begin(const SubscriberBus& bus) {
+  _bus = bus;
+}
+
+void SubscriberHub::Reset(SlotState& slot) {
+  slot.config.channels = 0;
+  slot.config.periodMillis = 0;
+  slot.config.encoding = ENCODING_FLOAT32;
+  slot.dueMicros = 0;
+  slot.started = false;
+  slot.queue.Clear();
+  memset(&slot.stats, 0, sizeof(slot.stats));
+}
+
+int SubscriberHub::Attach(uint16_t connection) {
+  int existing = Slot(connection);
+  if (existing != SUBSCRIBER_NO_SLOT)
+    return existing;
+
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    if (!_slots[slot].active) {
+      Reset(_slots[slot]);
+      _slots[slot].active = true;
+      _slots[slot].connection = connection;
+      return slot;
+    }
+  }
+  return SUBSCRIBER_NO_SLOT;
+}
+
+void SubscriberHub::Detach(uint16_t connection) {
+  int slot = Slot(connection);
+  if (slot != SUBSCRIBER_NO_SLOT) {
+    _slots[slot].active = false;
+    _slots[slot].queue.Clear();
+  }
+}
+
+int SubscriberHub::Slot(uint16_t connection) const {
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    if (_slots[slot].active && _slots[slot].connection == connection)
+      return slot;
+  }
+  return SUBSCRIBER_NO_SLOT;
+}
+
+bool SubscriberHub::Configure(uint16_t connection, const SubscriberConfig& config) {
+  int slot = Slot(connection);
+  if (slot == SUBSCRIBER_NO_SLOT || config.encoding >= ENCODING_COUNT)
+    return false;
+
+  Reset(_slots[slot]);
+  _slots[slot].config = config;
+  return true;
+}
+
+bool SubscriberHub::Wants(int channel) const {
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    if (Wants(slot, channel))
+      return true;
+  }
+  return false;
+}
+
+bool SubscriberHub::Wants(int slot, int channel) const {
+  return _slots[slot].active && (_slots[slot].config.channels & (1U << channel)) != 0;
+}
+
+bool SubscriberHub::Due(int slot, uint32_t nowMicros) {
+  SlotState& entry = _slots[slot];
+  if (!entry.active || entry.config.channels == 0)
+    return false;
+  if (entry.started && (int32_t)(nowMicros - entry.dueMicros) < 0)
+    return false;
+
+  // keep the cadence, the first period and one a whole period late start over
+  uint32_t period = entry.config.periodMillis * 1000UL;
+  entry.dueMicros += period;
+  if (!entry.started || (int32_t)(nowMicros - entry.dueMicros) >= 0) {
+    entry.dueMicros = nowMicros + period;
+  }
+  entry.started = true;
+  return true;
+}
+
+bool SubscriberHub::Room(int slot) {
+  SlotState& entry = _slots[slot];
+  if (entry.queue.Full()) {
+    entry.stats.dropped++;
+    return false;
+  }
+  return true;
+}
+
+bool SubscriberHub::Queue(int slot, int record, const uint8_t* data, size_t length) {
+  SlotState& entry = _slots[slot];
+  if (!entry.active || length > SUBSCRIBER_RECORD_SIZE)
+    return false;
+
+  // refused here rather than dropped by Drain() after the caller moved on
+  if (_bus.payloadSize && length > _bus.payloadSize(entry.connection)) {
+    entry.stats.dropped++;
+    return false;
+  }
+
+  if (!Room(slot))
+    return false;
+
+  SubscriberRecord queued;
+  queued.record = record;
+  queued.length = (uint8_t)length;
+  memcpy(queued.data, data, length);
+  entry.queue.Push(queued);
+  entry.stats.queued++;
+  return true;
+}
+
+int SubscriberHub::Fanout(int channel, int record, const uint8_t* data, size_t length) {
+  int queued = 0;
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    if (Wants(slot, channel) && Queue(slot, record, data, length)) {
+      queued++;
+    }
+  }
+  return queued;
+}
+
+size_t SubscriberHub::Drain() {
+  if (!_bus.send)
+    return 0;
+
+  bool blocked[SUBSCRIBER_MAX_SLOTS] = { false };
+  size_t sent = 0;
+  bool progress = true;
+
+  while (progress) {
+    progress = false;
+    for (int i = 0; i < SUBSCRIBER_MAX_SLOTS; i++) {
+      int slot = (_next + i) % SUBSCRIBER_MAX_SLOTS;
+      SlotState& entry = _slots[slot];
+      if (!entry.active || blocked[slot] || entry.queue.Empty())
+        continue;
+
+      // a record the link will never take would stall the slot for good
+      const SubscriberRecord& head = entry.queue.Peek(0);
+      if (_bus.payloadSize && head.length > _bus.payloadSize(entry.connection)) {
+        entry.queue.Pop(1);
+        entry.stats.dropped++;
+        continue;
+      }
+
+      if (_bus.send(entry.connection, head.record, head.data, head.length)) {
+        entry.queue.Pop(1);
+        entry.stats.sent++;
+        sent++;
+        progress = true;
+      } else {
+        entry.stats.blocked++;
+        blocked[slot] = true;
+      }
+    }
+  }
+
+  // the next round starts one slot on, no link always goes first
+  _next = (_next + 1) % SUBSCRIBER_MAX_SLOTS;
+  return sent;
+}
+
+int SubscriberHub::ActiveCount() const {
+  int count = 0;
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    if (_slots[slot].active) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void SubscriberHub::ResetStats() {
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    memset(&_slots[slot].stats, 0, sizeof(_slots[slot].stats));
+  }
+}
+
+bool DecodeSubscriberConfig(const uint8_t* buffer, size_t length, SubscriberConfig& config) {
+  if (length < SUBSCRIBER_CONFIG_SIZE || buffer[4] >= ENCODING_COUNT)
+    return false;
+
+  config.channels = GetUint16LE(&buffer[0]);
+  config.periodMillis = GetUint16LE(&buffer[2]);
+  config.encoding = buffer[4];
+  return true;
+}
+
+size_t EncodeSubscriberStatus(const SubscriberHub& hub, uint8_t* buffer, size_t bufferSize) {
+  if (bufferSize < SUBSCRIBER_STATUS_SIZE)
+    return 0;
+
+  buffer[0] = (uint8_t)hub.ActiveCount();
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    uint8_t* entry = &buffer[1 + slot * SUBSCRIBER_STATUS_SLOT_SIZE];
+    if (!hub.Active(slot)) {
+      memset(entry, 0, SUBSCRIBER_STATUS_SLOT_SIZE);
+      entry[0] = 0xFF;
+      continue;
+    }
+
+    const SubscriberConfig& config = hub.Config(slot);
+    const SubscriberStats& stats = hub.Stats(slot);
+    entry[0] = (uint8_t)hub.Connection(slot);
+    entry[1] = config.encoding;
+    PutUint16LE(&entry[2], config.channels);
+    PutUint16LE(&entry[4], config.periodMillis);
+    entry[6] = (uint8_t)hub.QueueCount(slot);
+    PutUint32LE(&entry[7], stats.sent);
+    PutUint32LE(&entry[11], stats.dropped);
+  }
+  return SUBSCRIBER_STATUS_SIZE;
+}
@@ -0,0 +1,160 @@
+/* ==========================================================================
+    File:     SubscriberHub.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Per connection subscribers, every connected Central/Gateway
+              gets a slot with its own channels, publish period and
+              encoding, the shared sampling pipeline fans its records out
+              to the slots and each slot drains at the pace of its own link
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef SUBSCRIBER_HUB_H
+#define SUBSCRIBER_HUB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SampleRingBuffer.h>
+
+// the nRF52840 SoftDevice Controller default for peripheral links
+#ifndef SUBSCRIBER_MAX_SLOTS
+#define SUBSCRIBER_MAX_SLOTS      3
+#endif
+
+#define SUBSCRIBER_QUEUE_DEPTH    8       // records per slot, a power of two
+#define SUBSCRIBER_RECORD_SIZE    144     // the largest record, FEATURE_PAYLOAD_SIZE
+#define SUBSCRIBER_CONFIG_SIZE    5
+#define SUBSCRIBER_STATUS_SLOT_SIZE 15
+#define SUBSCRIBER_STATUS_SIZE    (1 + SUBSCRIBER_MAX_SLOTS * SUBSCRIBER_STATUS_SLOT_SIZE)
+#define SUBSCRIBER_NO_SLOT        -1
+
+/* --------------------------------------------------------------------------
+    What one Central/Gateway asks for
+      channels        bit mask of the firmware's subscriber channels
+      periodMillis    how often its snapshot records are queued, 0 on
+                      every Due() check
+      encoding        the TelemetryEncoding of its records
+   -------------------------------------------------------------------------- */
+struct SubscriberConfig {
+  uint16_t  channels;
+  uint16_t  periodMillis;
+  uint8_t   encoding;
+};
+
+/* --------------------------------------------------------------------------
+    Connection access, ArduinoBLE on the Nano 33 BLE and a mocked stack on
+    the host, connection is the controller's connection handle
+      send          false when the link cannot take the record right now,
+                    it stays queued and is tried again on the next Drain()
+      payloadSize   largest notification the connection takes
+   -------------------------------------------------------------------------- */
+struct SubscriberBus {
+  bool      (*send)(uint16_t connection, int record, const uint8_t* data, size_t length);
+  uint16_t  (*payloadSize)(uint16_t connection);
+};
+
+struct SubscriberStats {
+  uint32_t  queued;
+  uint32_t  sent;
+  uint32_t  dropped;      // refused by a full queue or too big for the link
+  uint32_t  blocked;      // a Drain() the link refused
+};
+
+struct SubscriberRecord {
+  int       record;
+  uint8_t   length;
+  uint8_t   data[SUBSCRIBER_RECORD_SIZE];
+};
+
+class SubscriberHub {
+public:
+  SubscriberHub();
+
+  void Begin(const SubscriberBus& bus);
+
+  // the slot of a new connection, SUBSCRIBER_NO_SLOT when all are taken
+  int Attach(uint16_t connection);
+  void Detach(uint16_t connection);
+  int Slot(uint16_t connection) const;
+
+  // a new config starts the slot over, queue and period included
+  bool Configure(uint16_t connection, const SubscriberConfig& config);
+
+  // any slot wants the channel, the pipeline gates its work on this
+  bool Wants(int channel) const;
+  bool Wants(int slot, int channel) const;
+
+  /* ------------------------------------------------------------------------
+      The slot's period ran out at nowMicros, its next period starts now
+     ------------------------------------------------------------------------ */
+  bool Due(int slot, uint32_t nowMicros);
+
+  /* ------------------------------------------------------------------------
+      Queue a record for one slot, or for every slot that wants the
+      channel with Fanout(). A full queue refuses the record, a slow link
+      skips records of its own and never holds back the others. A record
+      longer than the link's payload is refused too. Ask Room() before
+      encoding, it counts the skipped record, and keep the delta state of
+      a record only once Queue() took it, so a delta encoded stream stays
+      in step with what the Central/Gateway gets
+     ------------------------------------------------------------------------ */
+  bool Room(int slot);
+  bool Queue(int slot, int record, const uint8_t* data, size_t length);
+  int Fanout(int channel, int record, const uint8_t* data, size_t length);
+
+  /* ------------------------------------------------------------------------
+      Hand the queued records to the bus, one per slot in turn so every
+      link gets its share, a slot stops for this round once its link
+      refuses one. Returns the records sent
+     ------------------------------------------------------------------------ */
+  size_t Drain();
+
+  int ActiveCount() const;
+  bool Active(int slot) const                       { return _slots[slot].active; }
+  uint16_t Connection(int slot) const               { return _slots[slot].connection; }
+  const SubscriberConfig& Config(int slot) const    { return _slots[slot].config; }
+  const SubscriberStats& Stats(int slot) const      { return _slots[slot].stats; }
+  size_t QueueCount(int slot) const                 { return _slots[slot].queue.Count(); }
+  void ResetStats();
+
+private:
+  struct SlotState {
+    bool              active;
+    uint16_t          connection;
+    SubscriberConfig  config;
+    uint32_t          dueMicros;
+    bool              started;        // dueMicros is set
+    SubscriberStats   stats;
+    SampleRingBuffer<SubscriberRecord, SUBSCRIBER_QUEUE_DEPTH> queue;
+  };
+
+  void Reset(SlotState& slot);
+
+  SubscriberBus   _bus;
+  SlotState       _slots[SUBSCRIBER_MAX_SLOTS];
+  int             _next;          // where the next Drain() round starts
+};
+
+/* --------------------------------------------------------------------------
+    Subscriber Config payload, written by a Central/Gateway for itself
+      [0..1]    channels
+      [2..3]    period (ms)
+      [4]       encoding
+   -------------------------------------------------------------------------- */
+bool DecodeSubscriberConfig(const uint8_t* buffer, size_t length, SubscriberConfig& config);
+
+/* --------------------------------------------------------------------------
+    Subscriber Status payload
+      [0]       connected subscribers
+      then per slot
+      [0]       connection handle, 0xFF for a free slot
+      [1]       encoding
+      [2..3]    channels
+      [4..5]    period (ms)
+      [6]       records queued
+      [7..10]   records sent
+      [11..14]  records dropped
+   -------------------------------------------------------------------------- */
+size_t EncodeSubscriberStatus(const SubscriberHub& hub, uint8_t* buffer, size_t bufferSize);
+
+#endif
@@ -0,0 +1,85 @@
+/* ==========================================================================
+    File:     TelemetryBatch.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Encoder/Decoder for the batched telemetry record
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "TelemetryBatch.h"
+
+size_t TelemetryBatchCapacity(size_t payloadSize) {
+  if (payloadSize < TELEMETRY_BATCH_HEADER_SIZE)
+    return 0;
+  size_t capacity = (payloadSize - TELEMETRY_BATCH_HEADER_SIZE) / TELEMETRY_BATCH_SAMPLE_SIZE;
+  return capacity > 255 ? 255 : capacity;
+}
+
+size_t EncodeTelemetryBatch(
+  const TelemetrySample* samples, size_t count, uint16_t sequence,
+  uint8_t* buffer, size_t bufferSize, size_t& encodedCount) {
+
+  encodedCount = 0;
+  size_t capacity = TelemetryBatchCapacity(bufferSize);
+  if (count == 0 || capacity == 0)
+    return 0;
+
+  uint32_t baseMicros = samples[0].timestampMicros;
+  uint8_t* cursor = &buffer[TELEMETRY_BATCH_HEADER_SIZE];
+
+  while (encodedCount < count && encodedCount < capacity) {
+    const TelemetrySample& sample = samples[encodedCount];
+    uint32_t ticks = (sample.timestampMicros - baseMicros) / TELEMETRY_BATCH_TICK_MICROS;
+    if (ticks > 0xFFFF)
+      break;
+
+    PutUint16LE(cursor, (uint16_t)ticks);
+    cursor += 2;
+    for (int i = 0; i < 3; i++, cursor += sizeof(float))
+      PutFloatLE(cursor, sample.acceleration[i]);
+    for (int i = 0; i < 3; i++, cursor += sizeof(float))
+      PutFloatLE(cursor, sample.gyroscope[i]);
+    for (int i = 0; i < 3; i++, cursor += sizeof(float))
+      PutFloatLE(cursor, sample.magnetometer[i]);
+    encodedCount++;
+  }
+
+  buffer[0] = TELEMETRY_BATCH_VERSION;
+  buffer[1] = (uint8_t)encodedCount;
+  PutUint16LE(&buffer[2], sequence);
+  PutUint32LE(&buffer[4], baseMicros);
+
+  return (size_t)(cursor - buffer);
+}
+
+bool DecodeTelemetryBatch(
+  const uint8_t* buffer, size_t length, uint16_t& sequence,
+  TelemetrySample* samples, size_t maxSamples, size_t& count) {
+
+  count = 0;
+  if (length < TELEMETRY_BATCH_HEADER_SIZE || buffer[0] != TELEMETRY_BATCH_VERSION)
+    return false;
+
+  size_t samplesInBatch = buffer[1];
+  if (length < TELEMETRY_BATCH_HEADER_SIZE + samplesInBatch * TELEMETRY_BATCH_SAMPLE_SIZE ||
+      samplesInBatch > maxSamples)
+    return false;
+
+  sequence = GetUint16LE(&buffer[2]);
+  uint32_t baseMicros = GetUint32LE(&buffer[4]);
+  const uint8_t* cursor = &buffer[TELEMETRY_BATCH_HEADER_SIZE];
+
+  for (count = 0; count < samplesInBatch; count++) {
+    TelemetrySample& sample = samples[count];
+    sample.timestampMicros = baseMicros + (uint32_t)GetUint16LE(cursor) * TELEMETRY_BATCH_TICK_MICROS;
+    cursor += 2;
+    for (int i = 0; i < 3; i++, cursor += sizeof(float))
+      sample.acceleration[i] = GetFloatLE(cursor);
+    for (int i = 0; i < 3; i++, cursor += sizeof(float))
+      sample.gyroscope[i] = GetFloatLE(cursor);
+    for (int i = 0; i < 3; i++, cursor += sizeof(float))
+      sample.magnetometer[i] = GetFloatLE(cursor);
+  }
+
+  return true;
+}
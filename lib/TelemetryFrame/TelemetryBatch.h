@@ -0,0 +1,58 @@
+/* ==========================================================================
+    File:     TelemetryBatch.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Batched telemetry record, N timestamped IMU samples flushed
+              in a single BLE notification
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef TELEMETRY_BATCH_H
+#define TELEMETRY_BATCH_H
+
+#include "TelemetryFrame.h"
+
+/* --------------------------------------------------------------------------
+    Batch Layout (little endian), version 1
+      [0]      version
+      [1]      sample count
+      [2..3]   batch sequence number
+      [4..7]   timestamp of the first sample (micros)
+      then per sample
+      [0..1]   offset from the first sample in 10 microsecond ticks
+      [2..37]  accelerometer, gyroscope, magnetometer x, y, z (float)
+   -------------------------------------------------------------------------- */
+#define TELEMETRY_BATCH_VERSION       1
+#define TELEMETRY_BATCH_HEADER_SIZE   8
+#define TELEMETRY_BATCH_SAMPLE_SIZE   (2 + 9 * sizeof(float))
+#define TELEMETRY_BATCH_TICK_MICROS   10
+
+struct TelemetrySample {
+  uint32_t  timestampMicros;
+  float     acceleration[3];
+  float     gyroscope[3];
+  float     magnetometer[3];
+};
+
+/* --------------------------------------------------------------------------
+    How many samples fit a notification payload of payloadSize bytes
+   -------------------------------------------------------------------------- */
+size_t TelemetryBatchCapacity(size_t payloadSize);
+
+/* --------------------------------------------------------------------------
+    Encode up to count samples, stops early when the buffer is full or a
+    sample is too far from the first one for its offset. encodedCount is
+    set to the number of samples consumed, returns the bytes written
+   -------------------------------------------------------------------------- */
+size_t EncodeTelemetryBatch(
+  const TelemetrySample* samples, size_t count, uint16_t sequence,
+  uint8_t* buffer, size_t bufferSize, size_t& encodedCount);
+
+/* --------------------------------------------------------------------------
+    Decode a batch into samples, returns false on a malformed record
+   -------------------------------------------------------------------------- */
+bool DecodeTelemetryBatch(
+  const uint8_t* buffer, size_t length, uint16_t& sequence,
+  TelemetrySample* samples, size_t maxSamples, size_t& count);
+
+#endif
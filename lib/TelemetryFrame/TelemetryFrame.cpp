@@ -0,0 +1,64 @@
+/* ==========================================================================
+    File:     TelemetryFrame.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Encoder/Decoder for the packed multi-sensor telemetry frame,
+              has no Arduino dependencies so the gateway side can use it
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "TelemetryFrame.h"
+
+static uint8_t* PutVector(uint8_t* cursor, const float vector[3]) {
+  for (int i = 0; i < 3; i++) {
+    PutFloatLE(cursor, vector[i]);
+    cursor += sizeof(float);
+  }
+  return cursor;
+}
+
+static const uint8_t* GetVector(const uint8_t* cursor, float vector[3]) {
+  for (int i = 0; i < 3; i++) {
+    vector[i] = GetFloatLE(cursor);
+    cursor += sizeof(float);
+  }
+  return cursor;
+}
+
+size_t EncodeTelemetryFrame(const TelemetryFrame& frame, uint8_t* buffer, size_t bufferSize) {
+
+  if (bufferSize < TELEMETRY_FRAME_SIZE)
+    return 0;
+
+  buffer[0] = TELEMETRY_FRAME_VERSION;
+  buffer[1] = frame.flags;
+  PutUint16LE(&buffer[2], frame.sequence);
+  PutUint32LE(&buffer[4], frame.timestampMicros);
+
+  uint8_t* cursor = &buffer[TELEMETRY_FRAME_HEADER_SIZE];
+  cursor = PutVector(cursor, frame.acceleration);
+  cursor = PutVector(cursor, frame.gyroscope);
+  cursor = PutVector(cursor, frame.magnetometer);
+  cursor = PutVector(cursor, frame.orientation);
+
+  return (size_t)(cursor - buffer);
+}
+
+bool DecodeTelemetryFrame(const uint8_t* buffer, size_t length, TelemetryFrame& frame) {
+
+  if (length < TELEMETRY_FRAME_SIZE || buffer[0] != TELEMETRY_FRAME_VERSION)
+    return false;
+
+  frame.version = buffer[0];
+  frame.flags = buffer[1];
+  frame.sequence = GetUint16LE(&buffer[2]);
+  frame.timestampMicros = GetUint32LE(&buffer[4]);
+
+  const uint8_t* cursor = &buffer[TELEMETRY_FRAME_HEADER_SIZE];
+  cursor = GetVector(cursor, frame.acceleration);
+  cursor = GetVector(cursor, frame.gyroscope);
+  cursor = GetVector(cursor, frame.magnetometer);
+  GetVector(cursor, frame.orientation);
+
+  return true;
+}
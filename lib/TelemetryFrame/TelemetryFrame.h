@@ -0,0 +1,100 @@
+/* ==========================================================================
+    File:     TelemetryFrame.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Packed multi-sensor telemetry frame for the Arduino Nano BLE 33,
+              one versioned binary record carrying all nine IMU axes plus
+              orientation in a single BLE notification
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* --------------------------------------------------------------------------
+    Frame Layout (little endian), version 1
+      [0]      version
+      [1]      flags
+      [2..3]   sequence number
+      [4..7]   timestamp (micros)
+      [8..19]  accelerometer x, y, z (float)
+      [20..31] gyroscope x, y, z (float)
+      [32..43] magnetometer x, y, z (float)
+      [44..55] orientation heading, pitch, roll (float)
+
+    56 bytes fits a single notification once the ATT MTU is 59 or more
+   -------------------------------------------------------------------------- */
+#define TELEMETRY_FRAME_VERSION       1
+#define TELEMETRY_FRAME_HEADER_SIZE   8
+#define TELEMETRY_FRAME_SIZE          (TELEMETRY_FRAME_HEADER_SIZE + 12 * sizeof(float))
+
+// kept in flash while disconnected, the timestamp is millis() not micros()
+#define TELEMETRY_FRAME_FLAG_STORED   0x02
+
+struct TelemetryFrame {
+  uint8_t   version;
+  uint8_t   flags;
+  uint16_t  sequence;
+  uint32_t  timestampMicros;
+  float     acceleration[3];
+  float     gyroscope[3];
+  float     magnetometer[3];
+  float     orientation[3];
+};
+
+/* --------------------------------------------------------------------------
+    Byte order helpers, the wire format is little endian on every host
+   -------------------------------------------------------------------------- */
+inline void PutUint16LE(uint8_t* buffer, uint16_t value) {
+  buffer[0] = (uint8_t)(value);
+  buffer[1] = (uint8_t)(value >> 8);
+}
+
+inline void PutUint32LE(uint8_t* buffer, uint32_t value) {
+  buffer[0] = (uint8_t)(value);
+  buffer[1] = (uint8_t)(value >> 8);
+  buffer[2] = (uint8_t)(value >> 16);
+  buffer[3] = (uint8_t)(value >> 24);
+}
+
+inline void PutFloatLE(uint8_t* buffer, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  PutUint32LE(buffer, bits);
+}
+
+inline uint16_t GetUint16LE(const uint8_t* buffer) {
+  return (uint16_t)(buffer[0] | (buffer[1] << 8));
+}
+
+inline uint32_t GetUint32LE(const uint8_t* buffer) {
+  return (uint32_t)buffer[0] |
+         ((uint32_t)buffer[1] << 8) |
+         ((uint32_t)buffer[2] << 16) |
+         ((uint32_t)buffer[3] << 24);
+}
+
+inline float GetFloatLE(const uint8_t* buffer) {
+  uint32_t bits = GetUint32LE(buffer);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/* --------------------------------------------------------------------------
+    Encode the frame into buffer, returns the number of bytes written or
+    0 when the buffer is too small
+   -------------------------------------------------------------------------- */
+size_t EncodeTelemetryFrame(const TelemetryFrame& frame, uint8_t* buffer, size_t bufferSize);
+
+/* --------------------------------------------------------------------------
+    Decode a received frame, returns false on a short buffer or a version
+    we do not understand
+   -------------------------------------------------------------------------- */
+bool DecodeTelemetryFrame(const uint8_t* buffer, size_t length, TelemetryFrame& frame);
+
+#endif
@@ -0,0 +1,138 @@
+/* ==========================================================================
+    File:     SerialFrame.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Binary framing for the serial transport, see SerialFrame.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "SerialFrame.h"
+#include <TelemetryFrame.h>
+#include <string.h>
+
+uint16_t SerialFrameCrc16(const uint8_t* data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+size_t CobsEncode(const uint8_t* data, size_t length, uint8_t* encoded) {
+  size_t code = 0;          // where the length of the current block goes
+  size_t out = 1;
+  uint8_t run = 1;
+
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] != 0) {
+      encoded[out++] = data[i];
+      run++;
+    }
+    if (data[i] == 0 || run == 0xFF) {
+      encoded[code] = run;
+      code = out++;
+      run = 1;
+    }
+  }
+  encoded[code] = run;
+  return out;
+}
+
+size_t CobsDecode(const uint8_t* encoded, size_t length, uint8_t* data) {
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < length) {
+    uint8_t run = encoded[in++];
+    if (run == 0 || in + run - 1 > length)
+      return 0;
+
+    for (uint8_t i = 1; i < run; i++) {
+      if (encoded[in] == 0)
+        return 0;
+      data[out++] = encoded[in++];
+    }
+
+    // a full block carries no zero, the last block does not either
+    if (run != 0xFF && in < length) {
+      data[out++] = 0;
+    }
+  }
+  return out;
+}
+
+size_t EncodeSerialFrame(uint16_t record, uint32_t micros, const uint8_t* payload, size_t length,
+                         uint8_t* buffer, size_t bufferSize) {
+  if (length > SERIAL_FRAME_MAX_PAYLOAD || bufferSize < SERIAL_FRAME_WIRE_SIZE(length))
+    return 0;
+
+  uint8_t frame[SERIAL_FRAME_SIZE(SERIAL_FRAME_MAX_PAYLOAD)];
+  PutUint16LE(&frame[0], record);
+  PutUint32LE(&frame[2], micros);
+  memcpy(&frame[SERIAL_FRAME_HEADER_SIZE], payload, length);
+  size_t size = SERIAL_FRAME_HEADER_SIZE + length;
+  PutUint16LE(&frame[size], SerialFrameCrc16(frame, size));
+  size += SERIAL_FRAME_CRC_SIZE;
+
+  size_t encoded = CobsEncode(frame, size, buffer);
+  buffer[encoded++] = SERIAL_FRAME_DELIMITER;
+  return encoded;
+}
+
+SerialFrameDecoder::SerialFrameDecoder()
+  : _frames(0), _crcErrors(0), _framingErrors(0) {
+  Reset();
+}
+
+void SerialFrameDecoder::Reset() {
+  _wireLength = 0;
+  _overflow = false;
+  _record = 0;
+  _micros = 0;
+  _length = 0;
+}
+
+bool SerialFrameDecoder::Push(uint8_t byte) {
+
+  if (byte != SERIAL_FRAME_DELIMITER) {
+    if (_wireLength < sizeof(_wire)) {
+      _wire[_wireLength++] = byte;
+    } else {
+      _overflow = true;
+    }
+    return false;
+  }
+
+  // joined mid frame the first one fails the CRC, it is in step after
+  size_t wireLength = _wireLength;
+  bool overflow = _overflow;
+  _wireLength = 0;
+  _overflow = false;
+  if (wireLength == 0)
+    return false;
+  if (overflow) {
+    _framingErrors++;
+    return false;
+  }
+
+  size_t size = CobsDecode(_wire, wireLength, _frame);
+  if (size < SERIAL_FRAME_HEADER_SIZE + SERIAL_FRAME_CRC_SIZE) {
+    _framingErrors++;
+    return false;
+  }
+
+  size -= SERIAL_FRAME_CRC_SIZE;
+  if (SerialFrameCrc16(_frame, size) != GetUint16LE(&_frame[size])) {
+    _crcErrors++;
+    return false;
+  }
+
+  _record = GetUint16LE(&_frame[0]);
+  _micros = GetUint32LE(&_frame[2]);
+  _length = size - SERIAL_FRAME_HEADER_SIZE;
+  _frames++;
+  return true;
+}
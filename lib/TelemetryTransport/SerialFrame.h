@@ -0,0 +1,88 @@
+/* ==========================================================================
+    File:     SerialFrame.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Binary framing for the serial transport, every record is
+              COBS encoded with a CRC-16 and ends in a zero byte so a reader
+              can join the stream anywhere and drop anything damaged
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------------
+    Frame, little endian before it is COBS encoded
+      [0..1]    record, the 16 bit UUID of the characteristic that carries
+                the same payload over BLE, SERIAL_FRAME_LOG for log text
+      [2..5]    device micros when the frame was written
+      then the payload as the characteristic carries it
+      [n..n+1]  CRC-16/CCITT-FALSE of everything before it
+    on the wire COBS replaces every zero and a single zero ends the frame
+   -------------------------------------------------------------------------- */
+#define SERIAL_FRAME_LOG            0x0000
+#define SERIAL_FRAME_HEADER_SIZE    6
+#define SERIAL_FRAME_CRC_SIZE       2
+#define SERIAL_FRAME_DELIMITER      0x00
+#define SERIAL_FRAME_MAX_PAYLOAD    256
+
+// decoded size, and the worst case on the wire with the COBS overhead
+#define SERIAL_FRAME_SIZE(payload)  (SERIAL_FRAME_HEADER_SIZE + (payload) + SERIAL_FRAME_CRC_SIZE)
+#define SERIAL_FRAME_WIRE_SIZE(payload) \
+  (SERIAL_FRAME_SIZE(payload) + SERIAL_FRAME_SIZE(payload) / 254 + 2)
+
+uint16_t SerialFrameCrc16(const uint8_t* data, size_t length);
+
+/* --------------------------------------------------------------------------
+    Consistent Overhead Byte Stuffing, the output holds no zero byte and
+    is at most length / 254 + 1 bytes longer. CobsDecode() returns 0 when
+    the input is not valid COBS
+   -------------------------------------------------------------------------- */
+size_t CobsEncode(const uint8_t* data, size_t length, uint8_t* encoded);
+size_t CobsDecode(const uint8_t* encoded, size_t length, uint8_t* data);
+
+/* --------------------------------------------------------------------------
+    Build the wire bytes of one frame, delimiter included. Returns 0 when
+    the payload is too long or the buffer too small
+   -------------------------------------------------------------------------- */
+size_t EncodeSerialFrame(uint16_t record, uint32_t micros, const uint8_t* payload, size_t length,
+                         uint8_t* buffer, size_t bufferSize);
+
+/* --------------------------------------------------------------------------
+    Stream decoder, Push() the bytes as they arrive and read the frame
+    once it returns true. Anything before the first delimiter, a frame
+    that does not decode and a CRC mismatch are counted and skipped
+   -------------------------------------------------------------------------- */
+class SerialFrameDecoder {
+public:
+  SerialFrameDecoder();
+
+  void Reset();
+  bool Push(uint8_t byte);
+
+  uint16_t Record() const           { return _record; }
+  uint32_t Micros() const           { return _micros; }
+  const uint8_t* Payload() const    { return &_frame[SERIAL_FRAME_HEADER_SIZE]; }
+  size_t Length() const             { return _length; }
+
+  uint32_t Frames() const           { return _frames; }
+  uint32_t CrcErrors() const        { return _crcErrors; }
+  uint32_t FramingErrors() const    { return _framingErrors; }
+
+private:
+  uint8_t   _wire[SERIAL_FRAME_WIRE_SIZE(SERIAL_FRAME_MAX_PAYLOAD)];
+  uint8_t   _frame[SERIAL_FRAME_WIRE_SIZE(SERIAL_FRAME_MAX_PAYLOAD)];    // decoding never grows
+  size_t    _wireLength;
+  bool      _overflow;
+  uint16_t  _record;
+  uint32_t  _micros;
+  size_t    _length;
+  uint32_t  _frames;
+  uint32_t  _crcErrors;
+  uint32_t  _framingErrors;
+};
+
+#endif
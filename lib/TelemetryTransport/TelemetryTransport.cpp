@@ -0,0 +1,69 @@
+/* ==========================================================================
+    File:     TelemetryTransport.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Pluggable telemetry sinks, see TelemetryTransport.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "TelemetryTransport.h"
+
+TelemetryTransport::TelemetryTransport()
+  : _count(0) {
+  ResetStats();
+}
+
+int TelemetryTransport::Add(const TransportSink& sink) {
+  if (_count >= TRANSPORT_MAX_SINKS)
+    return -1;
+
+  _sinks[_count] = sink;
+  return _count++;
+}
+
+bool TelemetryTransport::Subscribed(int record) const {
+  for (int sink = 0; sink < _count; sink++) {
+    if (_sinks[sink].subscribed(record))
+      return true;
+  }
+  return false;
+}
+
+uint16_t TelemetryTransport::PayloadSize(int record) const {
+  uint16_t size = 0;
+  for (int sink = 0; sink < _count; sink++) {
+    if (!_sinks[sink].subscribed(record))
+      continue;
+    uint16_t payload = _sinks[sink].payloadSize();
+    if (size == 0 || payload < size) {
+      size = payload;
+    }
+  }
+  return size;
+}
+
+bool TelemetryTransport::Send(int record, const uint8_t* data, size_t length) {
+  bool sent = false;
+  for (int sink = 0; sink < _count; sink++) {
+    if (!_sinks[sink].subscribed(record))
+      continue;
+
+    TransportStats& stats = _stats[sink];
+    if (length <= _sinks[sink].payloadSize() && _sinks[sink].send(record, data, length)) {
+      stats.sent++;
+      stats.bytes += length;
+      sent = true;
+    } else {
+      stats.failed++;
+    }
+  }
+  return sent;
+}
+
+void TelemetryTransport::ResetStats() {
+  for (int sink = 0; sink < TRANSPORT_MAX_SINKS; sink++) {
+    _stats[sink].sent = 0;
+    _stats[sink].failed = 0;
+    _stats[sink].bytes = 0;
+  }
+}
@@ -0,0 +1,73 @@
+/* ==========================================================================
+    File:     TelemetryTransport.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Pluggable telemetry sinks, the BLE characteristics are one and
+              the framed serial stream another, every record goes out
+              through each sink that wants it
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef TELEMETRY_TRANSPORT_H
+#define TELEMETRY_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TRANSPORT_MAX_SINKS
+#define TRANSPORT_MAX_SINKS 4
+#endif
+
+/* --------------------------------------------------------------------------
+    Sink access, record is the firmware's own id for the kind of record
+    (the characteristic it goes out on over BLE)
+      name          for the logs
+      subscribed    true when the sink wants the record right now
+      payloadSize   largest record the sink takes
+      send          false when the record did not go out
+   -------------------------------------------------------------------------- */
+struct TransportSink {
+  const char* name;
+  bool      (*subscribed)(int record);
+  uint16_t  (*payloadSize)();
+  bool      (*send)(int record, const uint8_t* data, size_t length);
+};
+
+struct TransportStats {
+  uint32_t  sent;
+  uint32_t  failed;     // the send failed or the record did not fit
+  uint32_t  bytes;
+};
+
+class TelemetryTransport {
+public:
+  TelemetryTransport();
+
+  // the index of the sink, -1 once TRANSPORT_MAX_SINKS are added
+  int Add(const TransportSink& sink);
+
+  // any sink wants the record
+  bool Subscribed(int record) const;
+
+  // smallest payload of the sinks that want the record, 0 when none does
+  uint16_t PayloadSize(int record) const;
+
+  /* ------------------------------------------------------------------------
+      Hand the record to every sink that wants it, true when at least one
+      sent it. The callers keep sequence numbers per record, so a sink that
+      missed one sees the gap
+     ------------------------------------------------------------------------ */
+  bool Send(int record, const uint8_t* data, size_t length);
+
+  int SinkCount() const                       { return _count; }
+  const char* SinkName(int sink) const        { return _sinks[sink].name; }
+  const TransportStats& Stats(int sink) const { return _stats[sink]; }
+  void ResetStats();
+
+private:
+  TransportSink   _sinks[TRANSPORT_MAX_SINKS];
+  TransportStats  _stats[TRANSPORT_MAX_SINKS];
+  int             _count;
+};
+
+#endif
@@ -9,40 +9,496 @@
     This code is licensed under MIT license (see LICENSE.txt for details)    
   ==========================================================================*/
 #include <Arduino_LSM9DS1.h>
-#include <MadgwickAHRS.h>
+#include <Wire.h>
 #include <string>
 #include <ArduinoBLE.h>
+#include <TelemetryFrame.h>
+#include <TelemetryBatch.h>
+#include <SampleRingBuffer.h>
+#include <CompactCodec.h>
+#include <CompactFrame.h>
+#include <SerialLog.h>
+#include <CooperativeScheduler.h>
+#include <Lsm9ds1Fifo.h>
+#include <Profiler.h>
+#include <FusionEngine.h>
+#include <FeatureExtractor.h>
+#include <ChangeDetector.h>
+#include <RateController.h>
+#include <FlashStore.h>
+#include <LinkProfile.h>
+#include <LatencyTrace.h>
+#include <ImuCalibration.h>
+#include <PowerManager.h>
+#include <TelemetryTransport.h>
+#include <SerialFrame.h>
+#include <SubscriberHub.h>
+#include <Decimator.h>
+#include <DeviceSchema.h>
+#include <ConnectionTracker.h>
+#include <utility/ATT.h>
+#include <utility/GATT.h>
+#include <utility/HCI.h>
+#include <local/BLELocalCharacteristic.h>
 
 // MACROS for Reading Build Flags
 #define XSTR(x) #x
 #define STR(x) XSTR(x)
 
+// largest ATT MTU we size notification buffers for, the payload is 3 bytes
+// smaller, each notification is cut to the MTU the link actually granted
+#ifndef BLE_ATT_MTU
+#define BLE_ATT_MTU 185
+#endif
+
 /* --------------------------------------------------------------------------
-    We use this to delay the start when the BLE Central application/gateway
-    is interogating the device...
+    The telemetry starts as soon as the BLE Central application/gateway
+    subscribes to anything, it is through interogating the device by then.
+    One that never subscribes has it started this long after connecting
    -------------------------------------------------------------------------- */
-unsigned long bleStartDelay   = 0;
-bool          bleDelayActive  = false;
+#define CONNECTION_START_TIMEOUT_MICROS   5000000UL
 
 /* --------------------------------------------------------------------------
     Frequency of Simulation on Battery Level
    -------------------------------------------------------------------------- */
-unsigned long   telemetryStartDelay     = 0;
-bool            telemetryDelayActive    = false;
 unsigned long   telemetryFrequency       = 1500;
 
 /* --------------------------------------------------------------------------
     We flash the RTGB to show ready to connect Green/Blue...
    -------------------------------------------------------------------------- */
-unsigned long readyToConnectDelay       = 0;
-bool          readyToConnectDelayActive = false;
+#define READY_TO_CONNECT_MICROS   1000000UL
+bool          readyToConnectBlink       = true;
+
+/* --------------------------------------------------------------------------
+    Cooperative Scheduler, the tasks in priority order (lowest runs first),
+    the longest we sleep between deadlines so BLE keeps being polled comes
+    from the power state (PowerProfile maxSleepMicros)
+   -------------------------------------------------------------------------- */
+#define BATCH_TASK_MICROS         10000UL
+#define FEATURES_TASK_MICROS      10000UL
+#define LOG_TASK_MICROS           5000UL
+#define RATE_TASK_MICROS          1000000UL
+#define DIAGNOSTICS_TASK_MICROS   1000000UL
+#define BACKFILL_TASK_MICROS      20000UL
+#define TRACE_TASK_MICROS         50000UL
+#define CALIBRATION_TASK_MICROS   1000000UL
+#define POWER_TASK_MICROS         1000000UL
+#define SUBSCRIBER_TASK_MICROS    10000UL
+#define SCHEMA_TASK_MICROS        20000UL
+
+enum TASK_PRIORITIES: uint8_t {
+  SAMPLE_PRIORITY = 0,
+  FUSION_PRIORITY,
+  BATCH_PRIORITY,
+  FEATURES_PRIORITY,
+  PUBLISH_PRIORITY,
+  SUBSCRIBER_PRIORITY,
+  BLESTART_PRIORITY,
+  LED_PRIORITY,
+  BATTERY_PRIORITY,
+  RATE_PRIORITY,
+  CALIBRATION_PRIORITY,
+  POWER_PRIORITY,
+  STORE_PRIORITY,
+  SCHEMA_PRIORITY,
+  BACKFILL_PRIORITY,
+  TRACE_PRIORITY,
+  DIAGNOSTICS_PRIORITY,
+  LOG_PRIORITY
+};
+
+int sampleTask    = -1;
+int fusionTask    = -1;
+int batchTask     = -1;
+int featuresTask  = -1;
+int publishTask   = -1;
+int subscriberTask = -1;
+int bleStartTask  = -1;
+int ledTask       = -1;
+int batteryTask   = -1;
+int rateTask      = -1;
+int calibrationTask = -1;
+int powerTask     = -1;
+int storeTask     = -1;
+int schemaTask    = -1;
+int backfillTask  = -1;
+int traceTask     = -1;
+int diagnosticsTask = -1;
+int logTask       = -1;
+
+/* --------------------------------------------------------------------------
+    Profiled Hot Path Sections, timed in DWT cycles of the 64MHz core clock
+    (micros() where there is no DWT) and read back from the Diagnostics
+    characteristic
+   -------------------------------------------------------------------------- */
+enum PROFILE_SECTIONS: int {
+  PROFILE_SAMPLE = 0,
+  PROFILE_FUSION,
+  PROFILE_NOTIFY,
+  PROFILE_BLE_POLL,
+  PROFILE_FEATURES,
+  PROFILE_DECIMATE,
+  PROFILE_SECTION_COUNT
+};
+
+#define DIAGNOSTICS_PAYLOAD_SIZE  (DIAGNOSTICS_HEADER_SIZE + PROFILE_SECTION_COUNT * DIAGNOSTICS_SECTION_SIZE)
+
+Profiler      profiler;
+unsigned long diagnosticsStart = 0;
 
 /* --------------------------------------------------------------------------
-    Configure IMU
+    Configure IMU, IMU_HZ is the full rate and imuHz the rate the power
+    state has the LSM9DS1 running at
    -------------------------------------------------------------------------- */
 const int IMU_HZ = 119;
-Madgwick filter;
-unsigned long msecsPerReading, msecsPrevious;
+float     imuHz  = IMU_HZ;
+
+/* --------------------------------------------------------------------------
+    Orientation Fusion, FUSION_ALGORITHM picks the filter we boot with
+      0 Madgwick, 1 Mahony, 2 complementary
+    and FUSION_OUTPUT what the Orientation characteristic carries
+      0 yaw, pitch, roll (radians), 1 the quaternion w, x, y, z
+    both can be changed from the Fusion characteristic
+   -------------------------------------------------------------------------- */
+#ifndef FUSION_ALGORITHM
+#define FUSION_ALGORITHM 0
+#endif
+#ifndef FUSION_OUTPUT
+#define FUSION_OUTPUT 0
+#endif
+
+FusionEngine  fusion;
+FusionOutput  fusionOutput = (FusionOutput)FUSION_OUTPUT;
+
+/* --------------------------------------------------------------------------
+    Latest IMU State, filled by SampleIMU() at the LSM9DS1 output data rate
+    and published by UpdateIMU() at the telemetryFrequency. The published
+    acceleration, gyroDPS and magneticField come out of the decimators, the
+    fusion takes the raw samples
+   -------------------------------------------------------------------------- */
+struct ImuState {
+  float         acceleration[3];
+  float         gyroDPS[3];
+  float         magneticField[3];
+  float         accelerationSample[3];    // last polled, with the FIFO off
+  float         magneticSample[3];
+  float         quaternion[4];
+  float         orientation[3];
+  unsigned long sampleMicros;
+  unsigned long fusedMicros;
+  unsigned long magneticMicros;
+  unsigned long fusionUpdates;
+};
+ImuState imuState;
+
+/* --------------------------------------------------------------------------
+    LSM9DS1 FIFO Driver Mode (IMU_FIFO_MODE build flag)
+      0 poll the IMU for one sample per tick
+      1 continuous FIFO, drain every queued sample per tick
+      2 watermark FIFO, drain once IMU_FIFO_WATERMARK samples are queued
+    Raw samples wait in imuPending until the fusion stage takes them
+   -------------------------------------------------------------------------- */
+#ifndef IMU_FIFO_MODE
+#define IMU_FIFO_MODE 0
+#endif
+#define IMU_FIFO_WATERMARK      8
+
+Lsm9ds1Fifo       imuFifo;
+Lsm9ds1FifoSample imuPending[LSM9DS1_FIFO_DEPTH];
+size_t            imuPendingCount = 0;
+
+// with the FIFO on we only need to come back before it fills up
+unsigned long SamplePeriodMicros() {
+  if (imuFifo.Mode() != LSM9DS1_FIFO_OFF)
+    return (unsigned long)(IMU_FIFO_WATERMARK * 1000000.0f / imuHz) / 2;
+  return (unsigned long)(1000000.0f / imuHz);
+}
+
+/* --------------------------------------------------------------------------
+    Sequence Number for the Packed Telemetry Frame
+   -------------------------------------------------------------------------- */
+uint16_t frameSequence = 0;
+
+/* --------------------------------------------------------------------------
+    Batched Notification Mode, SampleIMU() queues every sample in the ring
+    and FlushBatch() sends whole batches of batchSize samples per notify
+      batchSize of 0 turns the batch mode off
+   -------------------------------------------------------------------------- */
+#define IMU_RING_CAPACITY   64
+#define BATCH_PAYLOAD_SIZE  (BLE_ATT_MTU - 3)
+#define BATCH_MAX_SAMPLES   ((BATCH_PAYLOAD_SIZE - TELEMETRY_BATCH_HEADER_SIZE) / TELEMETRY_BATCH_SAMPLE_SIZE)
+
+SampleRingBuffer<TelemetrySample, IMU_RING_CAPACITY> sampleRing;
+uint8_t         batchSize             = 0;
+unsigned short  batchFlushInterval    = 100;
+unsigned long   batchFlushStart       = 0;
+uint16_t        batchSequence         = 0;
+
+/* --------------------------------------------------------------------------
+    Condition Monitoring Features, while the Features characteristic is
+    subscribed every accel/gyro sample goes into the extractor and each
+    window is summarized as RMS, peak, crest factor and band levels
+   -------------------------------------------------------------------------- */
+FeatureExtractor featureExtractor;
+
+/* --------------------------------------------------------------------------
+    Decimation, every accel/gyro sample and the magnetometer held at the
+    same rate run through the Decimator, and each channel publishes the
+    output of its stage, imuHz / 2^stages band limited to 0.3 of that
+    rate, instead of the latest point sample. Stage 0 is the raw sample and
+    DECIMATOR_AUTO follows the publish period
+   -------------------------------------------------------------------------- */
+enum DECIMATION_CHANNELS: int {
+  DECIMATION_ACCELEROMETER = 0,
+  DECIMATION_GYROSCOPE,
+  DECIMATION_MAGNETOMETER,
+  DECIMATION_CHANNEL_COUNT
+};
+#define DECIMATION_STATUS_SIZE  (4 * DECIMATION_CHANNEL_COUNT)
+
+static_assert(LSM9DS1_FIFO_DEPTH <= DECIMATOR_BLOCK, "a tick of pending samples must fit one DecimatorBlock");
+
+Decimator       decimator;
+DecimatorBlock  decimatorBlock;
+uint8_t         decimationConfig[DECIMATION_CHANNEL_COUNT] = { DECIMATOR_AUTO, DECIMATOR_AUTO, DECIMATOR_AUTO };
+uint8_t         decimationStages[DECIMATION_CHANNEL_COUNT] = { 0, 0, 0 };
+
+/* --------------------------------------------------------------------------
+    Report On Change, the publish stage only notifies a value once it moved
+    past its deadband or its heartbeat ran out, and the motion detector
+    runs the publish stage every motionPublish ms while the device moves
+    and every telemetryFrequency ms while it is idle
+   -------------------------------------------------------------------------- */
+struct ChangeConfig {
+  uint16_t  accelerationMilliG;
+  uint16_t  gyroscopeCentiDPS;
+  uint16_t  magnetometerCentiUT;
+  uint16_t  orientationMilliRad;
+  uint16_t  heartbeatSeconds;
+  uint16_t  motionMilliG;
+  uint16_t  motionHoldMillis;
+  uint16_t  motionPublishMillis;
+  uint16_t  batteryLevels;
+};
+#define CHANGE_CONFIG_FIELDS  9
+#define CHANGE_CONFIG_SIZE    (CHANGE_CONFIG_FIELDS * sizeof(uint16_t))
+
+ChangeConfig    changeConfig = { 20, 200, 100, 17, 30, 50, 2000, 100, 1 };
+ChangeChannel   accelerometerChange;
+ChangeChannel   gyroscopeChange;
+ChangeChannel   magnetometerChange;
+ChangeChannel   orientationChange;
+ChangeChannel   frameChange;
+ChangeChannel   batteryChange;
+MotionDetector  motionDetector;
+
+/* --------------------------------------------------------------------------
+    Adaptive Rate Control, once a second the controller looks at failed
+    notifies, the sample queue, the RSSI and whether there is activity and
+    sets how fast the publish stage may run and how big batches must be,
+    within the bounds the gateway writes to the Rate Bounds characteristic
+   -------------------------------------------------------------------------- */
+RateController  rateController;
+bool            rateControlEnabled    = true;
+unsigned long   effectivePublishMillis = 0;
+uint32_t        rateNotifySent        = 0;
+uint32_t        rateNotifyDropped     = 0;
+uint32_t        rateNotifyFailedStep  = 0;
+int8_t          rateRssi              = RATE_RSSI_UNKNOWN;
+uint8_t         rateBacklogPercent    = 0;
+
+/* --------------------------------------------------------------------------
+    Compact Telemetry Encoding for the IMU characteristics and the frame,
+    ENCODING_FLOAT32 keeps the original 3 * sizeof(float) payloads
+   -------------------------------------------------------------------------- */
+TelemetryEncoding telemetryEncoding     = ENCODING_FLOAT32;
+uint8_t           keyframeInterval      = COMPACT_DEFAULT_KEYFRAME;
+CompactChannel    accelerometerChannel;
+CompactChannel    gyroscopeChannel;
+CompactChannel    magnetometerChannel;
+CompactChannel    orientationChannel;
+CompactChannel    frameChannels[COMPACT_FRAME_CHANNEL_COUNT];
+
+/* --------------------------------------------------------------------------
+    Store and Forward, while no Central/Gateway is connected StoreTelemetry()
+    appends an INT16 compact frame every FLASH_STORE_PERIOD_MS to the top
+    FLASH_STORE_PAGES pages of flash, the Backfill characteristics read them
+    back from any offset once connected
+   -------------------------------------------------------------------------- */
+#ifndef FLASH_STORE_PAGES
+#define FLASH_STORE_PAGES         32
+#endif
+
+#ifndef FLASH_STORE_PERIOD_MS
+#define FLASH_STORE_PERIOD_MS     5000
+#endif
+
+#define BACKFILL_HEADER_SIZE      8
+#define BACKFILL_CHUNKS_PER_TICK  2
+#define BACKFILL_STOP             0xFFFFFFFFUL
+#define BACKFILL_FORMAT           0xFFFFFFFEUL
+
+FlashStore        flashStore;
+CompactChannel    storeChannels[COMPACT_FRAME_CHANNEL_COUNT];
+uint16_t          storeSequence         = 0;
+bool              backfillActive        = false;
+uint32_t          backfillOffset        = 0;
+
+/* --------------------------------------------------------------------------
+    Schema Transfer, a Central/Gateway without DEVICE_SCHEMA_HASH cached
+    writes the offset to start from to the Schema Control characteristic
+    and the deflated schema comes back on Schema Data in MTU sized chunks
+   -------------------------------------------------------------------------- */
+#define SCHEMA_HEADER_SIZE        4
+#define SCHEMA_CHUNKS_PER_TICK    2
+#define SCHEMA_STOP               0xFFFFFFFFUL
+
+bool              schemaActive          = false;
+uint32_t          schemaOffset          = 0;
+
+/* --------------------------------------------------------------------------
+    Link Profile, LINK_PROFILE picks what we ask the Central/Gateway for
+      0 low latency, 1 high throughput, 2 low power
+   -------------------------------------------------------------------------- */
+#ifndef LINK_PROFILE
+#define LINK_PROFILE              LINK_PROFILE_HIGH_THROUGHPUT
+#endif
+
+// the nRF52840 controller hands out the first connection handles
+#define LINK_MAX_HANDLE           8
+
+LinkManager       linkManager;
+
+/* --------------------------------------------------------------------------
+    Connection Start, the phase of the connection and how long it takes
+    from connecting to the first sample reaching the Central/Gateway
+   -------------------------------------------------------------------------- */
+ConnectionTracker connectionTracker;
+
+/* --------------------------------------------------------------------------
+    Telemetry Transports, TELEMETRY_TRANSPORTS picks the sinks (bit mask)
+      TRANSPORT_BLE     the characteristic notifications
+      TRANSPORT_SERIAL  COBS framed records on the USB serial port, see
+                        SerialFrame.h. It carries the frame, batch and
+                        features records from boot whether a Central/Gateway
+                        is connected or not, and the log as SERIAL_FRAME_LOG
+                        frames
+    with the serial transport on a batch size of 0 means as many samples as
+    fit, so the whole sample stream goes out and the device stays ACTIVE
+   -------------------------------------------------------------------------- */
+#define TRANSPORT_BLE             0x01
+#define TRANSPORT_SERIAL          0x02
+
+#ifndef TELEMETRY_TRANSPORTS
+#define TELEMETRY_TRANSPORTS      TRANSPORT_BLE
+#endif
+
+// the USB CDC port runs at full USB speed whatever the baud, a UART would not
+#define SERIAL_LOG_BAUD           9600
+#define SERIAL_TRANSPORT_BAUD     2000000
+
+TelemetryTransport transport;
+
+/* --------------------------------------------------------------------------
+    Subscribers, every Central/Gateway that connects gets a slot of the
+    SubscriberHub and picks its own channels, publish period and encoding
+    by writing the Subscriber Config characteristic. Its records come on
+    the Subscriber Data characteristic to that connection alone, each one
+    behind the 16 bit UUID of the characteristic that otherwise carries
+    it. We keep advertising while a slot is free
+   -------------------------------------------------------------------------- */
+enum SUBSCRIBER_CHANNELS: int {
+  SUBSCRIBER_FRAME = 0,
+  SUBSCRIBER_ACCELEROMETER,
+  SUBSCRIBER_GYROSCOPE,
+  SUBSCRIBER_MAGNETOMETER,
+  SUBSCRIBER_ORIENTATION,
+  SUBSCRIBER_FEATURES,
+  SUBSCRIBER_CHANNEL_COUNT
+};
+
+#define SUBSCRIBER_HEADER_SIZE      2
+#define SUBSCRIBER_VECTOR_COUNT     4
+#define SUBSCRIBER_STATUS_MICROS    1000000UL
+
+// what one link may take per subscriber tick and in a row
+#define SUBSCRIBER_NOTIFY_PER_TICK  2
+#define SUBSCRIBER_NOTIFY_BURST     6
+
+// the ATT channel and the handle value notification of the Bluetooth Core spec
+#define ATT_CID                     0x0004
+#define ATT_OP_HANDLE_VALUE_NTF     0x1B
+
+static_assert(FEATURE_PAYLOAD_SIZE <= SUBSCRIBER_RECORD_SIZE && TELEMETRY_FRAME_SIZE <= SUBSCRIBER_RECORD_SIZE,
+              "SUBSCRIBER_RECORD_SIZE must hold every record fanned out to the subscribers");
+
+SubscriberHub     subscriberHub;
+uint16_t          subscriberDataHandle  = 0;
+uint32_t          connectedHandles      = 0;    // a bit per connection handle
+uint8_t           subscriberCredits[SUBSCRIBER_MAX_SLOTS];
+uint16_t          subscriberFrameSequence[SUBSCRIBER_MAX_SLOTS];
+CompactChannel    subscriberChannels[SUBSCRIBER_MAX_SLOTS][SUBSCRIBER_VECTOR_COUNT];
+CompactChannel    subscriberFrameChannels[SUBSCRIBER_MAX_SLOTS][COMPACT_FRAME_CHANNEL_COUNT];
+unsigned long     subscriberStatusMicros = 0;
+
+/* --------------------------------------------------------------------------
+    Sequencing and Latency Trace, TRACE_FLAGS sets what the Trace Config
+    characteristic starts with
+      TRACE_STAMP_VECTORS  prefix each vector notification with its own
+                           sequence number and sample time (PutVectorStamp)
+      TRACE_CAPTURE        keep the sampled/fused/queued/notified micros of
+                           every published record and stream them to the
+                           Trace characteristic
+    the Clock Sync characteristic lets the Central/Gateway put those micros
+    on its own clock
+   -------------------------------------------------------------------------- */
+#define TRACE_STAMP_VECTORS       0x01
+#define TRACE_CAPTURE             0x02
+
+#ifndef TRACE_FLAGS
+#define TRACE_FLAGS               0
+#endif
+
+#define TRACE_CAPACITY            64
+#define TRACE_MAX_ENTRIES         ((BATCH_PAYLOAD_SIZE - LATENCY_TRACE_HEADER_SIZE) / LATENCY_TRACE_ENTRY_SIZE)
+
+uint8_t           traceFlags            = TRACE_FLAGS;
+SampleRingBuffer<TraceEntry, TRACE_CAPACITY> traceRing;
+
+/* --------------------------------------------------------------------------
+    IMU Calibration, the correction stage takes the gyro bias and the accel
+    offset out of each block of samples before it is fused, the
+    magnetometer is corrected as it is read. The coefficients live in the
+    flash page below the store and are saved on a CALIBRATION_COMMAND_SAVE
+    or, while no Central/Gateway is connected, once they drifted and
+    CALIBRATION_AUTOSAVE_SECONDS went by since the last save
+   -------------------------------------------------------------------------- */
+#ifndef CALIBRATION_AUTOSAVE_SECONDS
+#define CALIBRATION_AUTOSAVE_SECONDS  600
+#endif
+
+#define CALIBRATION_STATUS_SIZE   (4 + CALIBRATION_PAYLOAD_SIZE)
+#define CALIBRATION_STATE_REST    0x01
+#define CALIBRATION_STATE_UNSAVED 0x02
+
+enum CALIBRATION_COMMANDS: uint8_t {
+  CALIBRATION_COMMAND_SAVE = 1,
+  CALIBRATION_COMMAND_CLEAR,
+  CALIBRATION_COMMAND_GYROSCOPE,
+  CALIBRATION_COMMAND_ACCELEROMETER,
+  CALIBRATION_COMMAND_MAGNETOMETER
+};
+
+ImuCalibration    calibration;
+unsigned long     calibrationSaved      = 0;
+
+/* --------------------------------------------------------------------------
+    Power States, while no Central/Gateway is connected the IMU runs slower
+    and the advertising interval stretches, after POWER_DORMANT_SECONDS
+    without motion the magnetometer is powered down and the ready to
+    connect blink stops. A connection or motion brings the full rate back
+   -------------------------------------------------------------------------- */
+PowerManager      powerManager;
 
 /* --------------------------------------------------------------------------
     Leds we manipulate for Status, etc.
@@ -52,20 +508,128 @@ unsigned long msecsPerReading, msecsPrevious;
 #define GREEN_LIGHT_PIN 23
 #define BLUE_LIGHT_PIN  24
 
+/* --------------------------------------------------------------------------
+    Characteristic Registry, every characteristic of the service is declared
+    once in this table, in the order they are added to the service. The
+    CHARACTERISTICS enum, the BLECharacteristic and BLEDescriptor globals,
+    SetUpCharacteristics() and the characteristic list in the Device
+    Capability Model are all expanded from it at compile time
+      X(id, name, uuid, properties, size, description, setUp, onWrite)
+    name gives the nameCharacteristic and nameCharacteristicDesc globals,
+    size is the largest value in bytes, setUp writes the initial value and
+    onWrite handles a write from the Central/Gateway, either can be NULL
+   -------------------------------------------------------------------------- */
+#define CHARACTERISTIC_REGISTRY(X) \
+  X(VERSION,            version,            "1001", BLERead | BLEWrite,   sizeof(SEMANTIC_VERSION),         "Version",                 SetUpVersion,             NULL) \
+  /* float percent */ \
+  X(BATTERYCHARGED,     batteryCharged,     "2001", BLERead,              sizeof(float),                    "Battery Charged",         SetUpBatteryCharged,      NULL) \
+  /* int32 milliseconds */ \
+  X(TELEMETRYFREQUENCY, telemetryFrequency, "3001", BLERead | BLEWrite,   sizeof(int32_t),                  "Telemetry Frequency",     UpdateTelemetryFrequency, onTelemetryFrequencyCharacteristicWrite) \
+  /* [0] batch size, [1] reserved, [2..3] flush interval (ms) */ \
+  X(BATCHCONFIG,        batchConfig,        "3002", BLERead | BLEWrite,   4,                                "Batch Configuration",     UpdateBatchConfig,        onBatchConfigCharacteristicWrite) \
+  /* samples pushed, ring overflows, samples dropped, queued */ \
+  X(BATCHSTATS,         batchStats,         "3003", BLERead,              4 * sizeof(uint32_t),             "Batch Statistics",        UpdateBatchStats,         NULL) \
+  /* [0] TelemetryEncoding, [1] keyframe interval */ \
+  X(ENCODING,           encoding,           "3004", BLERead | BLEWrite,   2,                                "Telemetry Encoding",      UpdateEncoding,           onEncodingCharacteristicWrite) \
+  /* [0..1] min period (ms), [2..3] max period (ms), [4] min batch, [5] max batch, */ \
+  /* [6] rssi floor (dBm), [7] backlog %, 0 turns the control off */ \
+  X(RATEBOUNDS,         rateBounds,         "3007", BLERead | BLEWrite,   8,                                "Rate Bounds",             UpdateRateBounds,         onRateBoundsCharacteristicWrite) \
+  /* [0..1] publish period (ms), [2] batch size, [3] RATE_FLAGS, */ \
+  /* [4..5] failed notifies last step, [6] rssi (dBm), [7] backlog % */ \
+  X(RATESTATUS,         rateStatus,         "3008", BLERead | BLENotify,  8,                                "Rate Status",             UpdateRateStatus,         NULL) \
+  /* [0] LinkProfileId */ \
+  X(LINKPROFILE,        linkProfile,        "3009", BLERead | BLEWrite,   1,                                "Link Profile",            UpdateLinkProfile,        onLinkProfileCharacteristicWrite) \
+  /* requested connection parameters and the granted MTU, see EncodeLinkStatus */ \
+  X(LINKSTATUS,         linkStatus,         "300A", BLERead | BLENotify,  LINK_STATUS_SIZE,                 "Link Status",             UpdateLinkStatus,         NULL) \
+  /* ConnectionPhase, how the telemetry started and the time to the first */ \
+  /* sample, see EncodeConnectionStatus */ \
+  X(CONNECTIONSTATUS,   connectionStatus,   "3010", BLERead | BLENotify,  CONNECTION_STATUS_SIZE,           "Connection Status",       UpdateConnectionStatus,   NULL) \
+  /* write [0..3] the offset to read from, BACKFILL_STOP or BACKFILL_FORMAT, */ \
+  /* reads [0..3] oldest offset, [4..7] newest, [8..11] cursor */ \
+  X(BACKFILLCONTROL,    backfillControl,    "C001", BLERead | BLEWrite,   12,                               "Backfill Control",        UpdateBackfillControl,    onBackfillControlCharacteristicWrite) \
+  /* [0..3] offset of the chunk, [4..7] offset of the next one, then the */ \
+  /* stored frames each as [length] followed by the compact frame */ \
+  X(BACKFILLDATA,       backfillData,       "C002", BLENotify,            BATCH_PAYLOAD_SIZE,               "Backfill Data",           NULL,                     NULL) \
+  /* write [0] CALIBRATION_COMMANDS, reads [0] calibrated sensors, [1] magnetometer */ \
+  /* coverage %, [2] accel rest positions, [3] CALIBRATION_STATE, then EncodeCalibration */ \
+  X(CALIBRATION,        calibration,        "300B", BLERead | BLEWrite,   CALIBRATION_STATUS_SIZE,          "IMU Calibration",         UpdateCalibration,        onCalibrationCharacteristicWrite) \
+  /* PowerState, advertising interval, estimated current and seconds per */ \
+  /* state, see EncodePowerStatus */ \
+  X(POWERSTATUS,        powerStatus,        "300C", BLERead | BLENotify,  POWER_STATUS_SIZE,                "Power Status",            UpdatePowerStatus,        NULL) \
+  /* written by each Central/Gateway for itself, [0..1] SUBSCRIBER_CHANNELS */ \
+  /* bits, [2..3] period (ms), [4] TelemetryEncoding */ \
+  X(SUBSCRIBERCONFIG,   subscriberConfig,   "300D", BLERead | BLEWrite,   SUBSCRIBER_CONFIG_SIZE,           "Subscriber Config",       NULL,                     onSubscriberConfigCharacteristicWrite) \
+  /* the slots, their config and what they sent, see EncodeSubscriberStatus */ \
+  X(SUBSCRIBERSTATUS,   subscriberStatus,   "300E", BLERead | BLENotify,  SUBSCRIBER_STATUS_SIZE,           "Subscriber Status",       UpdateSubscriberStatus,   NULL) \
+  /* [0..1] UUID of the characteristic the record belongs to, the record */ \
+  X(SUBSCRIBERDATA,     subscriberData,     "D001", BLENotify,            BATCH_PAYLOAD_SIZE,               "Subscriber Data",         NULL,                     NULL) \
+  /* ChangeConfig as 9 x uint16 */ \
+  X(CHANGECONFIG,       changeConfig,       "3006", BLERead | BLEWrite,   CHANGE_CONFIG_SIZE,               "Report On Change",        UpdateChangeConfig,       onChangeConfigCharacteristicWrite) \
+  /* [0] FusionAlgorithm, [1] FusionOutput */ \
+  X(FUSION,             fusion,             "3005", BLERead | BLEWrite,   2,                                "Orientation Fusion",      UpdateFusionConfig,       onFusionCharacteristicWrite) \
+  /* write [0..2] stages of accel, gyro, mag, 0 raw up to DECIMATOR_MAX_STAGES */ \
+  /* or DECIMATOR_AUTO, reads add the stages in use and the delays */ \
+  X(DECIMATION,         decimation,         "300F", BLERead | BLEWrite,   DECIMATION_STATUS_SIZE,           "Decimation",              UpdateDecimation,         onDecimationCharacteristicWrite) \
+  /* [0..1] sequence, [2..5] sample micros when stamped, then x, y, z */ \
+  X(ACCELEROMETER,      accelerometer,      "4001", BLENotify,            VECTOR_STAMP_SIZE + 3 * sizeof(float), "Accelerometer",           NULL,                     NULL) \
+  X(GYROSCOPE,          gyroscope,          "5001", BLENotify,            VECTOR_STAMP_SIZE + 3 * sizeof(float), "Gyroscope",               NULL,                     NULL) \
+  X(MAGNETOMETER,       magnetometer,       "6001", BLENotify,            VECTOR_STAMP_SIZE + 3 * sizeof(float), "Magnetometer",            NULL,                     NULL) \
+  /* yaw/pitch/roll or the quaternion, stamped like the accelerometer */ \
+  X(ORIENTATION,        orientation,        "7001", BLENotify,            VECTOR_STAMP_SIZE + 4 * sizeof(float), "Orientation",             NULL,                     NULL) \
+  X(RGBLED,             rgbLed,             "8001", BLERead | BLEWrite,   3 * sizeof(byte),                 "RGB Led",                 NULL,                     onRgbLedCharacteristicWrite) \
+  /* [0] schema version, [1] compression, [2..5] schema hash, [6..7] compressed */ \
+  /* size, [8..9] size, then the DCM URN */ \
+  X(DCM,                dcm,                "9901", BLERead,              DCM_SIZE,                         "Device Capability Model", SetUpDcm,                 NULL) \
+  /* write [0..3] the offset to send from or SCHEMA_STOP, */ \
+  /* reads [0..3] cursor, [4..7] size of the deflated schema */ \
+  X(SCHEMACONTROL,      schemaControl,      "9906", BLERead | BLEWrite,   8,                                "Schema Control",          UpdateSchemaControl,      onSchemaControlCharacteristicWrite) \
+  /* [0..3] offset of the chunk, then the deflated schema */ \
+  X(SCHEMADATA,         schemaData,         "9907", BLENotify,            BATCH_PAYLOAD_SIZE,               "Schema Data",             NULL,                     NULL) \
+  /* all IMU axes + orientation in one notification */ \
+  X(FRAME,              frame,              "A001", BLENotify,            TELEMETRY_FRAME_SIZE,             "Telemetry Frame",         NULL,                     NULL) \
+  X(BATCH,              batch,              "A002", BLENotify,            BATCH_PAYLOAD_SIZE,               "Telemetry Batch",         NULL,                     NULL) \
+  /* condition monitoring features, one notification per window */ \
+  X(FEATURES,           features,           "B001", BLENotify,            FEATURE_PAYLOAD_SIZE,             "Features",                NULL,                     NULL) \
+  /* [0..1] window length (samples), [2..3] overlap (samples) */ \
+  X(FEATURECONFIG,      featureConfig,      "B002", BLERead | BLEWrite,   4,                                "Feature Window",          UpdateFeatureConfig,      onFeatureConfigCharacteristicWrite) \
+  /* profiled section timings and loop/notification counters */ \
+  X(DIAGNOSTICS,        diagnostics,        "9902", BLERead,              DIAGNOSTICS_PAYLOAD_SIZE,         "Diagnostics",             UpdateDiagnostics,        NULL) \
+  /* [0] TRACE_FLAGS */ \
+  X(TRACECONFIG,        traceConfig,        "9903", BLERead | BLEWrite,   1,                                "Trace Config",            UpdateTraceConfig,        onTraceConfigCharacteristicWrite) \
+  /* stage micros of the published records, see EncodeLatencyTrace */ \
+  X(TRACE,              trace,              "9904", BLENotify,            BATCH_PAYLOAD_SIZE,               "Latency Trace",           NULL,                     NULL) \
+  /* write [0..7] central micros, answers with a ClockSyncReply */ \
+  X(CLOCKSYNC,          clockSync,          "9905", BLERead | BLEWrite | BLENotify, CLOCK_SYNC_REPLY_SIZE,  "Clock Sync",              NULL,                     onClockSyncCharacteristicWrite)
+
 /* --------------------------------------------------------------------------
     Characteristic Mappers
    -------------------------------------------------------------------------- */
+#define CHARACTERISTIC_ENUM(id, name, uuid, properties, size, description, setUp, onWrite) id##_CHARACTERISTIC,
 enum CHARACTERISTICS: int {
-  VERSION_CHARACTERISTIC = 1,
-  BATTERYCHARGED_CHARACTERISTIC,
-  TELEMETRYFREQUENCY_CHARACTERISTIC,
-  ACCELEROMETER_CHARACTERISTIC,
-  GYROSCOPE_CHARACTERISTIC,
-  MAGNETOMETER_CHARACTERISTIC,
-  ORIENTATION_CHARACTERISTIC,
-  RGBLED_CHARACTERISTIC,
-  DCM_CHARACTERISTIC
+  CHARACTERISTIC_REGISTRY(CHARACTERISTIC_ENUM)
+  CHARACTERISTIC_COUNT
+};
+#undef CHARACTERISTIC_ENUM
+
+/* --------------------------------------------------------------------------
+    16 bit UUID of every characteristic for the trace entries, and the
+    sequence number of the characteristics that have none in their payload
+   -------------------------------------------------------------------------- */
+constexpr uint16_t UuidNibble(char digit) {
+  return digit <= '9' ? digit - '0' : (digit | 0x20) - 'a' + 10;
+}
+
+constexpr uint16_t Uuid16(const char* uuid) {
+  return UuidNibble(uuid[0]) << 12 | UuidNibble(uuid[1]) << 8 | UuidNibble(uuid[2]) << 4 | UuidNibble(uuid[3]);
+}
+
+#define CHARACTERISTIC_UUID16(id, name, uuid, properties, size, description, setUp, onWrite) Uuid16(uuid),
+const uint16_t characteristicUuids[CHARACTERISTIC_COUNT] = {
+  CHARACTERISTIC_REGISTRY(CHARACTERISTIC_UUID16)
 };
+#undef CHARACTERISTIC_UUID16
+
+uint16_t characteristicSequence[CHARACTERISTIC_COUNT];
 
 /* --------------------------------------------------------------------------
     Previous Battery Level Monitors
@@ -78,275 +642,1992 @@ int oldBatteryLevel = 0;
 const unsigned char SEMANTIC_VERSION[14] = STR(VERSION);
 
 /* --------------------------------------------------------------------------
-    Broadcast of the Device Capability Model for BLE Device
+    Device Capability Model for BLE Device, the URN behind a short header
+    with the version, hash and sizes of the Device Capability Schema. The
+    schema (encodings, fusion algorithms, link profiles, power states and
+    the payload layout of every characteristic) is built and deflated into
+    DeviceSchema.h by tools/schema/build_schema.py, a Central/Gateway that
+    has the hash cached never reads more than this
+   -------------------------------------------------------------------------- */
+#define DCM_HEADER_SIZE           10
+#define DCM_SIZE                  (DCM_HEADER_SIZE + sizeof(STR(DCM)) - 1)
+
+/* --------------------------------------------------------------------------
+    BLE Service Definition UUID and DEVICE NAME
+   -------------------------------------------------------------------------- */
+BLEService blePeripheral(STR(SERVICE_UUID)); 
+
+// ************************* BEGIN CHARACTERISTICS **************************
+
+/* --------------------------------------------------------------------------
+    BLE Peripheral Characteristics, see CHARACTERISTIC_REGISTRY
+   -------------------------------------------------------------------------- */
+#define CHARACTERISTIC_DECLARE(id, name, uuid, properties, size, description, setUp, onWrite) \
+  BLECharacteristic name##Characteristic(uuid, properties, size); \
+  BLEDescriptor     name##CharacteristicDesc("2901", description);
+CHARACTERISTIC_REGISTRY(CHARACTERISTIC_DECLARE)
+#undef CHARACTERISTIC_DECLARE
+
+#define CHARACTERISTIC_POINTER(id, name, uuid, properties, size, description, setUp, onWrite) &name##Characteristic,
+BLECharacteristic* const characteristicTable[CHARACTERISTIC_COUNT] = {
+  CHARACTERISTIC_REGISTRY(CHARACTERISTIC_POINTER)
+};
+#undef CHARACTERISTIC_POINTER
+
+// ************************** END CHARACTERISTICS ***************************
+
+/* --------------------------------------------------------------------------
+    Write one frame of the serial transport, a whole frame or nothing as
+    half a frame would cost the reader the next one too
+   -------------------------------------------------------------------------- */
+bool SerialWriteFrame(uint16_t record, const void* data, size_t length) {
+  uint8_t frame[SERIAL_FRAME_WIRE_SIZE(BATCH_PAYLOAD_SIZE)];
+  size_t size = EncodeSerialFrame(record, micros(), (const uint8_t*)data, length, frame, sizeof(frame));
+  if (size == 0 || Serial.availableForWrite() < (int)size)
+    return false;
+
+  return Serial.write(frame, size) == size;
+}
+
+/* --------------------------------------------------------------------------
+    Hand queued log output to the Serial port, at most LOG_DRAIN_CHUNK
+    bytes per call so a slow port never stalls the sampling. With the
+    serial transport on the log shares the port with the records, so it
+    is framed too
+   -------------------------------------------------------------------------- */
+#define LOG_DRAIN_CHUNK 64
+
+#if TELEMETRY_TRANSPORTS & TRANSPORT_SERIAL
+#define LOG_FRAMING_SIZE  (SERIAL_FRAME_WIRE_SIZE(LOG_DRAIN_CHUNK) - LOG_DRAIN_CHUNK)
+
+size_t SerialLogSink(const uint8_t* buffer, size_t length) {
+  return SerialWriteFrame(SERIAL_FRAME_LOG, buffer, length) ? length : 0;
+}
+#else
+#define LOG_FRAMING_SIZE  0
+
+size_t SerialLogSink(const uint8_t* buffer, size_t length) {
+  return Serial.write(buffer, length);
+}
+#endif
+
+void DrainLog() {
+  int room = Serial.availableForWrite() - LOG_FRAMING_SIZE;
+  size_t chunk = (room > 0 && room < LOG_DRAIN_CHUNK) ? (size_t)room : LOG_DRAIN_CHUNK;
+  LogDrain(SerialLogSink, chunk);
+}
+
+/* --------------------------------------------------------------------------
+    Scheduler idle hook, delay() parks the loop thread and lets the mbed OS
+    idle thread sleep (WFE/WFI) until its wake up timer or a BLE/USB
+    interrupt, short gaps are not worth the sleep and wake
+   -------------------------------------------------------------------------- */
+void IdleUntilNextTask(unsigned long idleMicros) {
+  if (idleMicros >= 1000) {
+    delay(idleMicros / 1000);
+  }
+}
+
+CooperativeScheduler scheduler(micros, IdleUntilNextTask);
+
+/* --------------------------------------------------------------------------
+    Cycle Counter for the Profiler, the Cortex-M4 DWT counts core clocks
+    once trace is enabled, anything without one falls back to micros()
+   -------------------------------------------------------------------------- */
+#if defined(DWT)
+uint32_t CycleCounter() {
+  return DWT->CYCCNT;
+}
+#else
+uint32_t CycleCounter() {
+  return micros();
+}
+#endif
+
+void BeginProfiler() {
+  #if defined(DWT)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    profiler.Begin(CycleCounter, SystemCoreClock);
+  #else
+    profiler.Begin(CycleCounter, 1000000UL);
+  #endif
+  diagnosticsStart = micros();
+}
+
+/* --------------------------------------------------------------------------
+    Connection Status, the first telemetry record a connection gets out
+    closes its time to first sample
+   -------------------------------------------------------------------------- */
+void UpdateConnectionStatus() {
+  uint8_t status[CONNECTION_STATUS_SIZE];
+  size_t length = EncodeConnectionStatus(connectionTracker.Status(), status, sizeof(status));
+  connectionStatusCharacteristic.writeValue(status, length);
+}
+
+void TelemetrySent() {
+  if (!connectionTracker.Sampled())
+    return;
+
+  LOG_INFO("[CONNECTION] First sample: %lu us after connecting", (unsigned long)connectionTracker.Status().firstSampleMicros);
+  UpdateConnectionStatus();
+}
+
+/* --------------------------------------------------------------------------
+    Every notification goes through here so it is timed and a write the
+    stack could not queue is counted as a drop
+   -------------------------------------------------------------------------- */
+bool Notify(BLECharacteristic& characteristic, const void* value, int length) {
+  // the stack would cut it to the granted MTU, better not to send at all
+  if (length > linkManager.PayloadSize()) {
+    LOG_DEBUG("[LINK] %d bytes do not fit the %u byte payload", length, linkManager.PayloadSize());
+    return false;
+  }
+
+  ProfileScope scope(profiler, PROFILE_NOTIFY);
+  bool sent = characteristic.writeValue(value, length) != 0;
+  profiler.CountNotify(sent);
+  return sent;
+}
+
+/* --------------------------------------------------------------------------
+    Telemetry sinks for the TelemetryTransport, the characteristic
+    notifications and the framed serial stream. The serial sink takes the
+    packed records, anything a Central/Gateway asks for (backfill, trace)
+    stays on BLE
+   -------------------------------------------------------------------------- */
+bool BleSubscribed(int record) {
+  return characteristicTable[record]->subscribed();
+}
+
+uint16_t BlePayloadSize() {
+  return linkManager.PayloadSize();
+}
+
+bool BleSend(int record, const uint8_t* data, size_t length) {
+  if (!Notify(*characteristicTable[record], data, length))
+    return false;
+
+  TelemetrySent();
+  return true;
+}
+
+const TransportSink bleSink = { "ble", BleSubscribed, BlePayloadSize, BleSend };
+
+bool SerialSubscribed(int record) {
+  return record == FRAME_CHARACTERISTIC || record == BATCH_CHARACTERISTIC || record == FEATURES_CHARACTERISTIC;
+}
+
+// the largest record we have buffers for, no MTU to negotiate
+uint16_t SerialPayloadSize() {
+  return BATCH_PAYLOAD_SIZE;
+}
+
+bool SerialSend(int record, const uint8_t* data, size_t length) {
+  return SerialWriteFrame(characteristicUuids[record], data, length);
+}
+
+const TransportSink serialSink = { "serial", SerialSubscribed, SerialPayloadSize, SerialSend };
+
+void BeginTransport() {
+#if TELEMETRY_TRANSPORTS & TRANSPORT_BLE
+  transport.Add(bleSink);
+#endif
+#if TELEMETRY_TRANSPORTS & TRANSPORT_SERIAL
+  transport.Add(serialSink);
+#endif
+}
+
+// records any sink refused so far, a delta stream restarts on a keyframe after one
+uint32_t TransportFailed() {
+  uint32_t failed = 0;
+  for (int sink = 0; sink < transport.SinkCount(); sink++) {
+    failed += transport.Stats(sink).failed;
+  }
+  return failed;
+}
+
+/* --------------------------------------------------------------------------
+    Keep the trace points of a record that just went out, notified is now
+   -------------------------------------------------------------------------- */
+void TraceRecord(int id, uint16_t sequence, unsigned long sampled, unsigned long fused, unsigned long queued) {
+  if (!(traceFlags & TRACE_CAPTURE))
+    return;
+
+  TraceEntry entry;
+  entry.uuid = characteristicUuids[id];
+  entry.sequence = sequence;
+  entry.sampledMicros = sampled;
+  entry.fusedMicros = fused;
+  entry.queuedMicros = queued;
+  entry.notifiedMicros = micros();
+  traceRing.Push(entry);
+}
+
+/* --------------------------------------------------------------------------
+    Function to set the onboard Nano RGB LED
+   -------------------------------------------------------------------------- */
+void SetBuiltInRGB(
+  PinStatus redLightPinValue,
+  PinStatus blueLightPinValue,
+  PinStatus greenLightPinValue)
+{
+     digitalWrite(RED_LIGHT_PIN, redLightPinValue);
+     digitalWrite(BLUE_LIGHT_PIN, blueLightPinValue);
+     digitalWrite(GREEN_LIGHT_PIN, greenLightPinValue);    
+    return;
+}
+
+/* --------------------------------------------------------------------------
+    Function to set the RGB LED to the color of the battery charge
+      * Green >=50%
+      * Yellow <= 49% && >=20%
+      * Red <=19%
+   -------------------------------------------------------------------------- */
+void BatteryCheck(int level) {
+  if (level >=5 )
+  {
+    LOG_DEBUG("BatteryCheck Set Green");
+    SetBuiltInRGB(HIGH, HIGH, LOW);
+  }
+  else if (level >=2 and level <= 4 )
+  {
+    LOG_DEBUG("BatteryCheck Set Yellow");
+    SetBuiltInRGB(LOW, HIGH, LOW);
+  }
+  else
+  {
+    LOG_DEBUG("BatteryCheck Set Red");
+    SetBuiltInRGB(LOW, HIGH, HIGH);
+  }
+  return;
+}
+
+/* --------------------------------------------------------------------------
+    Register access to the LSM9DS1 on Wire1 for the FIFO driver, the same
+    way the Arduino_LSM9DS1 library talks to it
+   -------------------------------------------------------------------------- */
+bool ImuReadRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t length) {
+  Wire1.beginTransmission(address);
+  Wire1.write(0x80 | reg);
+  if (Wire1.endTransmission(false) != 0)
+    return false;
+
+  if (Wire1.requestFrom(address, length) != length)
+    return false;
+
+  for (size_t i = 0; i < length; i++) {
+    data[i] = Wire1.read();
+  }
+  return true;
+}
+
+bool ImuWriteRegister(uint8_t address, uint8_t reg, uint8_t value) {
+  Wire1.beginTransmission(address);
+  Wire1.write(reg);
+  Wire1.write(value);
+  return Wire1.endTransmission() == 0;
+}
+
+const Lsm9ds1Bus imuBus = { ImuReadRegisters, ImuWriteRegister };
+
+/* --------------------------------------------------------------------------
+    Flash access for the FlashStore and the calibration through the
+    nRF52840 NVMC, the store sits in the last FLASH_STORE_PAGES pages of
+    the code flash and the calibration in the page below. The CPU stalls
+    while a page erases (about 85 ms) so we only write while there is no
+    connection to keep alive
    -------------------------------------------------------------------------- */
-const unsigned char DEVICE_CAPABILITY_MODEL[256] = STR(DCM);
+#if defined(NRF_NVMC)
+uint32_t flashStoreBase = 0;
+uint32_t calibrationBase = 0;
+
+void NvmcWait() {
+  while (NRF_NVMC->READY == NVMC_READY_READY_Busy) {
+  }
+}
+
+bool NvmcRead(uint32_t address, void* data, size_t length) {
+  memcpy(data, (const void*)address, length);
+  return true;
+}
+
+bool NvmcProgram(uint32_t address, const void* data, size_t length) {
+  volatile uint32_t* target = (volatile uint32_t*)address;
+  const uint8_t* source = (const uint8_t*)data;
+
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos;
+  NvmcWait();
+  for (size_t i = 0; i < length / 4; i++) {
+    uint32_t word;
+    memcpy(&word, &source[i * 4], 4);
+    target[i] = word;
+    NvmcWait();
+  }
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos;
+  NvmcWait();
+  return true;
+}
+
+bool NvmcErase(uint32_t address) {
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Een << NVMC_CONFIG_WEN_Pos;
+  NvmcWait();
+  NRF_NVMC->ERASEPAGE = address;
+  NvmcWait();
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos;
+  NvmcWait();
+  return true;
+}
+
+bool StoreRead(uint32_t offset, void* data, size_t length) {
+  return NvmcRead(flashStoreBase + offset, data, length);
+}
+
+bool StoreProgram(uint32_t offset, const void* data, size_t length) {
+  return NvmcProgram(flashStoreBase + offset, data, length);
+}
+
+bool StoreErase(uint32_t page) {
+  return NvmcErase(flashStoreBase + page * NRF_FICR->CODEPAGESIZE);
+}
+
+bool CalibrationRead(uint32_t offset, void* data, size_t length) {
+  return NvmcRead(calibrationBase + offset, data, length);
+}
+
+bool CalibrationProgram(uint32_t offset, const void* data, size_t length) {
+  return NvmcProgram(calibrationBase + offset, data, length);
+}
+
+bool CalibrationErase(uint32_t page) {
+  return NvmcErase(calibrationBase + page * NRF_FICR->CODEPAGESIZE);
+}
+#endif
+
+void BeginFlashStore() {
+#if defined(NRF_NVMC)
+  uint32_t pageSize = NRF_FICR->CODEPAGESIZE;
+  flashStoreBase = NRF_FICR->CODESIZE * pageSize - FLASH_STORE_PAGES * pageSize;
+
+  FlashDevice device = { pageSize, FLASH_STORE_PAGES, StoreRead, StoreProgram, StoreErase };
+  if (flashStore.Begin(device)) {
+    LOG_INFO("[SUCCESS] FlashStore at 0x%08lx, %lu records", (unsigned long)flashStoreBase, (unsigned long)flashStore.Records());
+  } else {
+    LOG_ERROR("[FAILED] FlashStore");
+  }
+#else
+  LOG_WARN("[FlashStore] NO FLASH CONTROLLER, STORE AND FORWARD IS OFF");
+#endif
+  CompactFrameChannelsBegin(storeChannels, keyframeInterval);
+}
+
+void BeginCalibration() {
+#if defined(NRF_NVMC)
+  uint32_t pageSize = NRF_FICR->CODEPAGESIZE;
+  calibrationBase = NRF_FICR->CODESIZE * pageSize - (FLASH_STORE_PAGES + 1) * pageSize;
+
+  FlashDevice device = { pageSize, 1, CalibrationRead, CalibrationProgram, CalibrationErase };
+  if (calibration.Begin(device)) {
+    LOG_INFO("[SUCCESS] Calibration at 0x%08lx, flags: 0x%02x", (unsigned long)calibrationBase, calibration.Coefficients().flags);
+  } else {
+    LOG_ERROR("[FAILED] Calibration, starting uncalibrated");
+  }
+#else
+  calibration.Begin();
+  LOG_WARN("[Calibration] NO FLASH CONTROLLER, CALIBRATION IS NOT KEPT");
+#endif
+}
+
+/* --------------------------------------------------------------------------
+    Link access for the LinkManager through ArduinoBLE, the preferred
+    connection interval goes out as an L2CAP update request when a Central
+    connects, the live connection is updated straight through the HCI
+   -------------------------------------------------------------------------- */
+int LinkConnectionHandle() {
+  for (uint16_t handle = 0; handle < LINK_MAX_HANDLE; handle++) {
+    if (ATT.connected(handle))
+      return handle;
+  }
+  return -1;
+}
+
+void LinkPrefer(const LinkParameters& parameters) {
+  BLE.setConnectionInterval(parameters.minInterval, parameters.maxInterval);
+}
+
+bool LinkRequestConnection(const LinkParameters& parameters) {
+  int handle = LinkConnectionHandle();
+  if (handle < 0)
+    return false;
+
+  return HCI.leConnUpdate(handle, parameters.minInterval, parameters.maxInterval,
+    parameters.latency, parameters.supervisionTimeout) == 0;
+}
+
+uint16_t LinkMtu() {
+  int handle = LinkConnectionHandle();
+  return handle < 0 ? 0 : ATT.mtu(handle);
+}
+
+// ArduinoBLE has no host command for the data length extension
+const LinkBus linkBus = { LinkPrefer, LinkRequestConnection, NULL, LinkMtu };
+
+void UpdateLinkStatus() {
+  uint8_t status[LINK_STATUS_SIZE];
+  EncodeLinkStatus(linkManager.Status(), status, sizeof(status));
+  linkStatusCharacteristic.writeValue(status, sizeof(status));
+}
+
+/* --------------------------------------------------------------------------
+    DECIMATION_CHARACTERISTIC value
+      [0..2]    configured stages, accel, gyro, mag
+      [3..5]    stages in use
+      [6..11]   delay of each channel (ms)
+   -------------------------------------------------------------------------- */
+void UpdateDecimation() {
+  uint8_t current[DECIMATION_STATUS_SIZE];
+  for (int channel = 0; channel < DECIMATION_CHANNEL_COUNT; channel++) {
+    float delayMillis = Decimator::DelaySamples(decimationStages[channel]) * 1000.0f / imuHz;
+    current[channel] = decimationConfig[channel];
+    current[DECIMATION_CHANNEL_COUNT + channel] = decimationStages[channel];
+    PutUint16LE(&current[2 * DECIMATION_CHANNEL_COUNT + 2 * channel], delayMillis > 0xFFFF ? 0xFFFF : (uint16_t)delayMillis);
+  }
+  decimationCharacteristic.writeValue(current, sizeof(current));
+}
+
+/* --------------------------------------------------------------------------
+    The stage each channel publishes from, an auto channel takes the
+    slowest output rate that still has a new value every publish period.
+    The stages all keep running, so a change is only a different tap
+   -------------------------------------------------------------------------- */
+void ResolveDecimation() {
+  bool changed = false;
+  for (int channel = 0; channel < DECIMATION_CHANNEL_COUNT; channel++) {
+    uint8_t stages = decimationConfig[channel];
+    if (stages == DECIMATOR_AUTO) {
+      stages = DecimatorAutoStages(imuHz, effectivePublishMillis * 1000UL, DECIMATOR_MAX_STAGES);
+    }
+    if (stages != decimationStages[channel]) {
+      decimationStages[channel] = stages;
+      changed = true;
+    }
+  }
+
+  if (changed) {
+    UpdateDecimation();
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Power access for the PowerManager, the LSM9DS1 output data rate and
+    magnetometer through the register bus with the FIFO timestamps, the
+    filter step and the sampling stage following the new rate, and the
+    advertising interval through ArduinoBLE which only takes it when
+    advertising starts
+   -------------------------------------------------------------------------- */
+bool PowerApplyImu(const PowerProfile& profile) {
+  float rate = Lsm9ds1SetOutputDataRate(imuBus, profile.imuHz, profile.gyroLowPower);
+  if (rate > 0.0f) {
+    imuHz = rate;
+    imuFifo.SetOutputDataRate(rate);
+    fusion.SetSampleRate(rate);
+    scheduler.SetPeriod(sampleTask, SamplePeriodMicros());
+    scheduler.SetPeriod(fusionTask, SamplePeriodMicros());
+    ResolveDecimation();
+    UpdateDecimation();
+  }
+  return Lsm9ds1SetMagnetometer(imuBus, profile.magnetometer) && rate > 0.0f;
+}
+
+void PowerSetAdvertisingInterval(uint16_t interval) {
+  BLE.stopAdvertise();
+  BLE.setAdvertisingInterval(interval);
+  BLE.advertise();
+}
+
+const PowerBus powerBus = { PowerApplyImu, PowerSetAdvertisingInterval, micros };
+
+void UpdatePowerStatus() {
+  uint8_t status[POWER_STATUS_SIZE];
+  EncodePowerStatus(powerManager.Status(), status, sizeof(status));
+  powerStatusCharacteristic.writeValue(status, sizeof(status));
+}
+
+// the ready to connect blink is the brightest thing on the board
+void PowerChanged() {
+  if (powerManager.State() == POWER_DORMANT) {
+    scheduler.Stop(ledTask);
+    SetBuiltInRGB(HIGH, HIGH, HIGH);
+  } else if (powerManager.State() == POWER_ADVERTISING && !scheduler.Active(ledTask)) {
+    scheduler.Start(ledTask);
+  }
+  UpdatePowerStatus();
+  LOG_INFO("[POWER] state: %u imu: %.1f Hz advertising: %u estimate: %u uA",
+    powerManager.State(), imuHz, powerManager.Status().advertisingInterval, powerManager.Status().microAmps);
+}
+
+/* --------------------------------------------------------------------------
+    Connection access for the SubscriberHub. ArduinoBLE notifies every
+    connection at once, so the Subscriber Data notifications are built
+    here and go out over the HCI to the one connection, on the attribute
+    handle the GATT table gave the characteristic. A link gets
+    SUBSCRIBER_NOTIFY_PER_TICK notifications per subscriber tick and no
+    more than SUBSCRIBER_NOTIFY_BURST in a row, so a slow Central/Gateway
+    backs up in its own queue rather than in the controller buffers every
+    connection shares
+   -------------------------------------------------------------------------- */
+uint16_t FindValueHandle(BLECharacteristic& characteristic) {
+  for (unsigned int i = 0; i < GATT.attributeCount(); i++) {
+    BLELocalAttribute* attribute = GATT.attribute(i);
+    if (attribute->type() == BLETypeCharacteristic && strcasecmp(attribute->uuid(), characteristic.uuid()) == 0)
+      return ((BLELocalCharacteristic*)attribute)->valueHandle();
+  }
+  return 0;
+}
+
+bool SubscriberSend(uint16_t connection, int record, const uint8_t* data, size_t length) {
+  int slot = subscriberHub.Slot(connection);
+  if (subscriberDataHandle == 0 || slot == SUBSCRIBER_NO_SLOT || subscriberCredits[slot] == 0)
+    return false;
+
+  uint8_t pdu[3 + SUBSCRIBER_HEADER_SIZE + SUBSCRIBER_RECORD_SIZE];
+  pdu[0] = ATT_OP_HANDLE_VALUE_NTF;
+  PutUint16LE(&pdu[1], subscriberDataHandle);
+  PutUint16LE(&pdu[3], characteristicUuids[record]);
+  memcpy(&pdu[3 + SUBSCRIBER_HEADER_SIZE], data, length);
+
+  ProfileScope scope(profiler, PROFILE_NOTIFY);
+  bool sent = HCI.sendAclPkt(connection, ATT_CID, 3 + SUBSCRIBER_HEADER_SIZE + length, pdu) == 0;
+  profiler.CountNotify(sent);
+  if (sent) {
+    subscriberCredits[slot]--;
+    TelemetrySent();
+  }
+  return sent;
+}
+
+uint16_t SubscriberPayloadSize(uint16_t connection) {
+  uint16_t mtu = ATT.mtu(connection);
+  return mtu > 3 + SUBSCRIBER_HEADER_SIZE ? mtu - 3 - SUBSCRIBER_HEADER_SIZE : 0;
+}
+
+const SubscriberBus subscriberBus = { SubscriberSend, SubscriberPayloadSize };
+
+void UpdateSubscriberStatus() {
+  uint8_t status[SUBSCRIBER_STATUS_SIZE];
+  EncodeSubscriberStatus(subscriberHub, status, sizeof(status));
+  subscriberStatusCharacteristic.writeValue(status, sizeof(status));
+}
+
+/* --------------------------------------------------------------------------
+    The connection handle of the Central/Gateway behind a write, ArduinoBLE
+    keeps the handle and the address type to itself so we look it up by
+    the address, a Central/Gateway uses a public or a random one
+   -------------------------------------------------------------------------- */
+uint16_t CentralHandle(BLEDevice& central) {
+  unsigned int octets[6];
+  if (sscanf(central.address().c_str(), "%x:%x:%x:%x:%x:%x",
+             &octets[5], &octets[4], &octets[3], &octets[2], &octets[1], &octets[0]) != 6)
+    return 0xFFFF;
+
+  uint8_t address[6];
+  for (int i = 0; i < 6; i++) {
+    address[i] = (uint8_t)octets[i];
+  }
+  for (uint8_t type = 0; type < 2; type++) {
+    uint16_t handle = ATT.connectionHandle(type, address);
+    if (handle != 0xFFFF)
+      return handle;
+  }
+  return 0xFFFF;
+}
+
+/* --------------------------------------------------------------------------
+    (Re)start report on change from the ChangeConfig, ResetChangeChannels()
+    only forgets the last reports so the next ones all go out
+   -------------------------------------------------------------------------- */
+void BeginChangeChannels() {
+  uint32_t heartbeat = changeConfig.heartbeatSeconds * 1000000UL;
+  float acceleration = changeConfig.accelerationMilliG / 1000.0f;
+  float gyroscope = changeConfig.gyroscopeCentiDPS / 100.0f;
+  float magnetometer = changeConfig.magnetometerCentiUT / 100.0f;
+  float orientation = changeConfig.orientationMilliRad / 1000.0f;
+
+  ChangeChannelBegin(accelerometerChange, acceleration, heartbeat);
+  ChangeChannelBegin(gyroscopeChange, gyroscope, heartbeat);
+  ChangeChannelBegin(magnetometerChange, magnetometer, heartbeat);
+  ChangeChannelBegin(orientationChange, orientation, heartbeat);
+  ChangeChannelBegin(batteryChange, changeConfig.batteryLevels, heartbeat);
+
+  // the frame mixes units, same order as the TelemetryFrame
+  ChangeChannelBegin(frameChange, acceleration, heartbeat);
+  ChangeChannelSetDeadband(frameChange, 3, 3, gyroscope);
+  ChangeChannelSetDeadband(frameChange, 6, 3, magnetometer);
+  ChangeChannelSetDeadband(frameChange, 9, 3, orientation);
+
+  motionDetector.Begin(changeConfig.motionMilliG / 1000.0f, changeConfig.motionHoldMillis * 1000UL);
+}
+
+void ResetChangeChannels() {
+  ChangeChannelReset(accelerometerChange);
+  ChangeChannelReset(gyroscopeChange);
+  ChangeChannelReset(magnetometerChange);
+  ChangeChannelReset(orientationChange);
+  ChangeChannelReset(frameChange);
+  ChangeChannelReset(batteryChange);
+}
+
+/* --------------------------------------------------------------------------
+    Publish at full rate while moving, never slower than telemetryFrequency
+   -------------------------------------------------------------------------- */
+void ApplyPublishRate() {
+  unsigned long period = telemetryFrequency * 1000UL;
+  if (motionDetector.Moving() && changeConfig.motionPublishMillis * 1000UL < period) {
+    period = changeConfig.motionPublishMillis * 1000UL;
+  }
+
+  // and never faster than the link takes
+  if (rateControlEnabled && rateController.PeriodMillis() * 1000UL > period) {
+    period = rateController.PeriodMillis() * 1000UL;
+  }
+
+  effectivePublishMillis = period / 1000UL;
+  scheduler.SetPeriod(publishTask, period);
+  ResolveDecimation();
+}
+
+/* --------------------------------------------------------------------------
+    Samples per batched notification, the configured batchSize or the
+    larger batch the rate controller asks for
+   -------------------------------------------------------------------------- */
+uint8_t ConfiguredBatchSize() {
+#if TELEMETRY_TRANSPORTS & TRANSPORT_SERIAL
+  if (batchSize == 0)
+    return BATCH_MAX_SAMPLES;
+#endif
+  return batchSize;
+}
+
+uint8_t EffectiveBatchSize() {
+  uint8_t size = ConfiguredBatchSize();
+  if (size > 0 && rateControlEnabled && rateController.BatchSize() > size) {
+    size = rateController.BatchSize() < BATCH_MAX_SAMPLES ? rateController.BatchSize() : BATCH_MAX_SAMPLES;
+  }
+
+  // and no more than every sink takes, none until they take one sample
+  uint16_t payload = transport.PayloadSize(BATCH_CHARACTERISTIC);
+  uint8_t fit = payload > TELEMETRY_BATCH_HEADER_SIZE ? (payload - TELEMETRY_BATCH_HEADER_SIZE) / TELEMETRY_BATCH_SAMPLE_SIZE : 0;
+  return size < fit ? size : fit;
+}
+
+/* --------------------------------------------------------------------------
+    Sampling Stage, scheduled at the IMU output data rate (imuHz) so the
+    fusion sees every sample regardless of how often we publish to the
+    Central/Gateway
+      Accelerometer
+      Gyroscope
+      MagneticField
+   -------------------------------------------------------------------------- */
+void SampleIMU() {
+
+  ProfileScope scope(profiler, PROFILE_SAMPLE);
+  float x, y, z;
+
+  if (imuFifo.Mode() != LSM9DS1_FIFO_OFF) {
+    // one drain per tick, queued behind anything the fusion has not taken
+    imuPendingCount += imuFifo.Drain(
+      &imuPending[imuPendingCount], LSM9DS1_FIFO_DEPTH - imuPendingCount, micros());
+  } else {
+    if (IMU.accelerationAvailable()) {
+      IMU.readAcceleration(x, y, z);
+      imuState.accelerationSample[0] = x;
+      imuState.accelerationSample[1] = y;
+      imuState.accelerationSample[2] = z;
+    }
+
+    if (IMU.gyroscopeAvailable() && imuPendingCount < LSM9DS1_FIFO_DEPTH) {
+      Lsm9ds1FifoSample& sample = imuPending[imuPendingCount++];
+      IMU.readGyroscope(x, y, z);
+      sample.timestampMicros = micros();
+      memcpy(sample.acceleration, imuState.accelerationSample, sizeof(sample.acceleration));
+      sample.gyroscope[0] = x;
+      sample.gyroscope[1] = y;
+      sample.gyroscope[2] = z;
+    }
+  }
+
+  // the magnetometer runs slower than the accel/gyro, we fuse the last value
+  if (IMU.magneticFieldAvailable()) {
+    IMU.readMagneticField(x, y, z);
+    imuState.magneticMicros = micros();
+    imuState.magneticSample[0] = x;
+    imuState.magneticSample[1] = y;
+    imuState.magneticSample[2] = z;
+    calibration.CorrectMagnetometer(imuState.magneticSample);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Fusion Stage, runs right after the sampling stage
+      Orientation
+   -------------------------------------------------------------------------- */
+void FuseIMU() {
+
+  if (imuPendingCount == 0)
+    return;
+
+  // correction stage, the whole block before any of it is fused or queued
+  calibration.Correct(imuPending, imuPendingCount);
+
+  bool queueForBatch = ConfiguredBatchSize() > 0 && transport.Subscribed(BATCH_CHARACTERISTIC);
+  bool queueForFeatures = transport.Subscribed(FEATURES_CHARACTERISTIC) || subscriberHub.Wants(SUBSCRIBER_FEATURES);
+  bool motionChanged = false;
+  unsigned long motionMicros = 0;
+
+  // the accel and gyro share the same output data rate, so every pending
+  // sample is exactly one filter step of 1 / imuHz
+  for (size_t i = 0; i < imuPendingCount; i++) {
+    const Lsm9ds1FifoSample& pending = imuPending[i];
+
+    {
+      ProfileScope scope(profiler, PROFILE_FUSION);
+      fusion.Update(
+        pending.gyroscope[0], pending.gyroscope[1], pending.gyroscope[2],
+        pending.acceleration[0], pending.acceleration[1], pending.acceleration[2],
+        imuState.magneticSample[0], imuState.magneticSample[1], imuState.magneticSample[2]
+      );
+    }
+    imuState.fusionUpdates++;
+
+    if (motionDetector.Update(
+          pending.acceleration[0], pending.acceleration[1], pending.acceleration[2],
+          pending.timestampMicros)) {
+      motionChanged = true;
+      motionMicros = pending.timestampMicros;
+    }
+
+    // queue the raw sample for the batched notification mode
+    if (queueForBatch) {
+      TelemetrySample sample;
+      sample.timestampMicros = pending.timestampMicros;
+      memcpy(sample.acceleration, pending.acceleration, sizeof(sample.acceleration));
+      memcpy(sample.gyroscope, pending.gyroscope, sizeof(sample.gyroscope));
+      memcpy(sample.magnetometer, imuState.magneticSample, sizeof(sample.magnetometer));
+      sampleRing.Push(sample);
+    }
+
+    if (queueForFeatures) {
+      float values[FEATURE_AXES];
+      memcpy(&values[0], pending.acceleration, sizeof(pending.acceleration));
+      memcpy(&values[3], pending.gyroscope, sizeof(pending.gyroscope));
+      featureExtractor.Push(values, pending.timestampMicros);
+    }
+
+    // the decimators take the block as one row per axis
+    for (int axis = 0; axis < 3; axis++) {
+      decimatorBlock.values[axis][i] = pending.acceleration[axis];
+      decimatorBlock.values[3 + axis][i] = pending.gyroscope[axis];
+      decimatorBlock.values[6 + axis][i] = imuState.magneticSample[axis];
+    }
+  }
+
+  decimatorBlock.count = (uint16_t)imuPendingCount;
+  {
+    ProfileScope scope(profiler, PROFILE_DECIMATE);
+    decimator.Push(decimatorBlock);
+  }
+
+  // the decimator outputs are the state we publish, the euler angles are
+  // left to the publish stage and only when something needs them
+  const Lsm9ds1FifoSample& latest = imuPending[imuPendingCount - 1];
+  decimator.Output(decimationStages[DECIMATION_ACCELEROMETER], 0, 3, imuState.acceleration);
+  decimator.Output(decimationStages[DECIMATION_GYROSCOPE], 3, 3, imuState.gyroDPS);
+  decimator.Output(decimationStages[DECIMATION_MAGNETOMETER], 6, 3, imuState.magneticField);
+  fusion.GetQuaternion(imuState.quaternion);
+  imuState.sampleMicros = latest.timestampMicros;
+  imuState.fusedMicros = micros();
+  imuPendingCount = 0;
+
+  if (motionChanged) {
+    ApplyPublishRate();
+    LOG_INFO("[MOTION] %s", motionDetector.Moving() ? "Moving" : "Idle");
+
+    // picked up while dormant, back to the advertising rate right away
+    if (motionDetector.Moving() && powerManager.Motion(motionMicros)) {
+      PowerChanged();
+    }
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Publish the ring buffer and drop counters to the stats characteristic
+   -------------------------------------------------------------------------- */
+void UpdateBatchStats() {
+  uint8_t stats[4 * sizeof(uint32_t)];
+  PutUint32LE(&stats[0], sampleRing.Pushed());
+  PutUint32LE(&stats[4], sampleRing.Overflows());
+  PutUint32LE(&stats[8], sampleRing.Dropped());
+  PutUint32LE(&stats[12], sampleRing.Count());
+  batchStatsCharacteristic.writeValue(stats, sizeof(stats));
+}
+
+/* --------------------------------------------------------------------------
+    Publish the profiler to the diagnostics characteristic, the loop rate
+    is worked out over the time since the last update
+   -------------------------------------------------------------------------- */
+void UpdateDiagnostics() {
+  unsigned long now = micros();
+  uint8_t buffer[DIAGNOSTICS_PAYLOAD_SIZE];
+  size_t length = profiler.Encode(buffer, sizeof(buffer), PROFILE_SECTION_COUNT, now - diagnosticsStart, LogDropped());
+  diagnosticsStart = now;
+  diagnosticsCharacteristic.writeValue(buffer, length);
+}
+
+/* --------------------------------------------------------------------------
+    Flush a batch once batchSize samples are queued or when the flush
+    interval runs out with a partial batch waiting
+   -------------------------------------------------------------------------- */
+void FlushBatch() {
+
+  uint8_t size = EffectiveBatchSize();
+  if (size == 0 || sampleRing.Empty())
+    return;
+
+  if (sampleRing.Count() < size && (millis() - batchFlushStart) < batchFlushInterval)
+    return;
+
+  TelemetrySample samples[BATCH_MAX_SAMPLES];
+  size_t count = sampleRing.Count() < size ? sampleRing.Count() : size;
+  for (size_t i = 0; i < count; i++) {
+    samples[i] = sampleRing.Peek(i);
+  }
+
+  uint8_t buffer[BATCH_PAYLOAD_SIZE];
+  size_t encoded = 0;
+  size_t length = EncodeTelemetryBatch(samples, count, batchSequence, buffer, transport.PayloadSize(BATCH_CHARACTERISTIC), encoded);
+  sampleRing.Pop(encoded);
+
+  // the batch skips the fusion stage, it is traced from its newest sample
+  unsigned long queued = micros();
+  if (length > 0 && transport.Send(BATCH_CHARACTERISTIC, buffer, length)) {
+    TraceRecord(BATCH_CHARACTERISTIC, batchSequence, samples[encoded - 1].timestampMicros, 0, queued);
+    batchSequence++;
+  } else {
+    sampleRing.CountDropped(encoded);
+  }
+
+  UpdateBatchStats();
+  batchFlushStart = millis();
+}
+
+/* --------------------------------------------------------------------------
+    Work out and send the features once a window is ready, outside of the
+    fusion stage so the transform never delays a sample
+   -------------------------------------------------------------------------- */
+void PublishFeatures() {
+
+  if (!featureExtractor.Ready() ||
+      !(transport.Subscribed(FEATURES_CHARACTERISTIC) || subscriberHub.Wants(SUBSCRIBER_FEATURES)))
+    return;
+
+  FeatureSet features;
+  {
+    ProfileScope scope(profiler, PROFILE_FEATURES);
+    featureExtractor.Compute(features);
+  }
+
+  uint8_t buffer[FEATURE_PAYLOAD_SIZE];
+  size_t length = EncodeFeatureSet(features, buffer, sizeof(buffer));
+  transport.Send(FEATURES_CHARACTERISTIC, buffer, length);
+  subscriberHub.Fanout(SUBSCRIBER_FEATURES, FEATURES_CHARACTERISTIC, buffer, length);
+  LOG_DEBUG("[IMU] Features: %u", features.sequence);
+}
+
+/* --------------------------------------------------------------------------
+    A 3 (or 4) axis vector in the encoding, the compact ones through the
+    channel
+   -------------------------------------------------------------------------- */
+size_t EncodeVector(CompactChannel& channel, TelemetryEncoding encoding, const float* values, size_t axes, uint8_t* buffer) {
+  if (encoding == ENCODING_FLOAT32) {
+    memcpy(buffer, values, axes * sizeof(float));
+    return axes * sizeof(float);
+  }
+  return CompactEncodeVector(channel, encoding, values, axes, buffer);
+}
+
+/* --------------------------------------------------------------------------
+    Write a 3 (or 4) axis vector in the current telemetry encoding, behind
+    its sequence number and sample time when TRACE_STAMP_VECTORS is set.
+    The vector is encoded against a copy of the channel, the delta state
+    only moves once the notification went out
+   -------------------------------------------------------------------------- */
+bool PublishVector(int id, BLECharacteristic& characteristic, CompactChannel& channel, const float* values, size_t axes = 3) {
+
+  // the magnetometer is read on its own and only feeds the fusion
+  bool magnetic = id == MAGNETOMETER_CHARACTERISTIC;
+  unsigned long sampled = magnetic ? imuState.magneticMicros : imuState.sampleMicros;
+  unsigned long fused = magnetic ? 0 : imuState.fusedMicros;
+  uint16_t sequence = characteristicSequence[id]++;
+
+  uint8_t buffer[VECTOR_STAMP_SIZE + COMPACT_MAX_VECTOR_SIZE];
+  size_t length = 0;
+  if (traceFlags & TRACE_STAMP_VECTORS) {
+    PutVectorStamp(buffer, sequence, sampled);
+    length = VECTOR_STAMP_SIZE;
+  }
+
+  CompactChannel next = channel;
+  length += EncodeVector(next, telemetryEncoding, values, axes, &buffer[length]);
+
+  unsigned long queued = micros();
+  if (!Notify(characteristic, buffer, length))
+    return false;
+
+  channel = next;
+  TelemetrySent();
+  TraceRecord(id, sequence, sampled, fused, queued);
+  return true;
+}
+
+/* --------------------------------------------------------------------------
+    Publish a vector only when it changed past its deadband or is due a
+    heartbeat, a notify that did not go out is retried next time
+   -------------------------------------------------------------------------- */
+bool ReportVector(int id, BLECharacteristic& characteristic, CompactChannel& channel, ChangeChannel& change, const float* values, size_t axes = 3) {
+
+  unsigned long now = micros();
+  if (!ChangeShouldReport(change, values, axes, now))
+    return false;
+
+  if (!PublishVector(id, characteristic, channel, values, axes))
+    return false;
+
+  ChangeCommit(change, values, axes, now);
+  return true;
+}
+
+/* --------------------------------------------------------------------------
+    (Re)start every compact channel, the next record of each is a keyframe,
+    a subscriber's own channels when it connects or writes its config
+   -------------------------------------------------------------------------- */
+void ResetSubscriberChannels(int slot) {
+  CompactChannelBegin(subscriberChannels[slot][0], COMPACT_SCALE_ACCELERATION, keyframeInterval);
+  CompactChannelBegin(subscriberChannels[slot][1], COMPACT_SCALE_GYROSCOPE, keyframeInterval);
+  CompactChannelBegin(subscriberChannels[slot][2], COMPACT_SCALE_MAGNETOMETER, keyframeInterval);
+  CompactChannelBegin(subscriberChannels[slot][3],
+    fusionOutput == FUSION_OUTPUT_QUATERNION ? COMPACT_SCALE_QUATERNION : COMPACT_SCALE_ORIENTATION,
+    keyframeInterval);
+  CompactFrameChannelsBegin(subscriberFrameChannels[slot], keyframeInterval);
+}
+
+void ResetCompactChannels() {
+  CompactChannelBegin(accelerometerChannel, COMPACT_SCALE_ACCELERATION, keyframeInterval);
+  CompactChannelBegin(gyroscopeChannel, COMPACT_SCALE_GYROSCOPE, keyframeInterval);
+  CompactChannelBegin(magnetometerChannel, COMPACT_SCALE_MAGNETOMETER, keyframeInterval);
+  CompactChannelBegin(orientationChannel,
+    fusionOutput == FUSION_OUTPUT_QUATERNION ? COMPACT_SCALE_QUATERNION : COMPACT_SCALE_ORIENTATION,
+    keyframeInterval);
+  CompactFrameChannelsBegin(frameChannels, keyframeInterval);
+
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    ResetSubscriberChannels(slot);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Publish Stage, sends the latest sampled and fused IMU State to the
+    subscribed characteristics
+      Accelerometer
+      Gyroscope
+      MagneticField
+      Orientation
+   -------------------------------------------------------------------------- */
+void UpdateIMU() {
+
+  // the frame always carries euler angles, the orientation only when asked
+  bool eulerOrientation = fusionOutput == FUSION_OUTPUT_EULER && orientationCharacteristic.subscribed();
+  bool frameSubscribed = transport.Subscribed(FRAME_CHARACTERISTIC);
+  if (eulerOrientation || frameSubscribed) {
+    fusion.GetEuler(imuState.orientation);
+  }
+
+  // the packed frame carries everything in one notification
+  float frameValues[12];
+  memcpy(&frameValues[0], imuState.acceleration, 3 * sizeof(float));
+  memcpy(&frameValues[3], imuState.gyroDPS, 3 * sizeof(float));
+  memcpy(&frameValues[6], imuState.magneticField, 3 * sizeof(float));
+  memcpy(&frameValues[9], imuState.orientation, 3 * sizeof(float));
+
+  if (frameSubscribed && ChangeShouldReport(frameChange, frameValues, 12, micros())) {
+    TelemetryFrame frame;
+    frame.flags = 0;
+    frame.sequence = frameSequence++;
+    frame.timestampMicros = imuState.sampleMicros;
+    memcpy(frame.acceleration, imuState.acceleration, sizeof(frame.acceleration));
+    memcpy(frame.gyroscope, imuState.gyroDPS, sizeof(frame.gyroscope));
+    memcpy(frame.magnetometer, imuState.magneticField, sizeof(frame.magnetometer));
+    memcpy(frame.orientation, imuState.orientation, sizeof(frame.orientation));
+
+    // fall back to the compact frame until the MTU exchange makes room
+    TelemetryEncoding encoding = telemetryEncoding;
+    if (encoding == ENCODING_FLOAT32 && TELEMETRY_FRAME_SIZE > transport.PayloadSize(FRAME_CHARACTERISTIC)) {
+      encoding = ENCODING_INT16;
+    }
+
+    // the delta state only moves once the frame went out, and a sink that
+    // missed it gets a keyframe next so its decoder does not drift
+    CompactChannel next[COMPACT_FRAME_CHANNEL_COUNT];
+    memcpy(next, frameChannels, sizeof(next));
+    uint8_t buffer[TELEMETRY_FRAME_SIZE];
+    size_t length = EncodeCompactTelemetryFrame(frame, next, encoding, buffer, sizeof(buffer));
+    unsigned long queued = micros();
+    uint32_t failed = TransportFailed();
+    if (transport.Send(FRAME_CHARACTERISTIC, buffer, length)) {
+      memcpy(frameChannels, next, sizeof(next));
+      TraceRecord(FRAME_CHARACTERISTIC, frame.sequence, imuState.sampleMicros, imuState.fusedMicros, queued);
+      ChangeCommit(frameChange, frameValues, 12, micros());
+    }
+    if (TransportFailed() != failed) {
+      for (int channel = 0; channel < COMPACT_FRAME_CHANNEL_COUNT; channel++) {
+        CompactChannelReset(frameChannels[channel]);
+      }
+    }
+    LOG_DEBUG("[IMU] Telemetry Frame: %u", frame.sequence);
+  }
+
+  if (accelerometerCharacteristic.subscribed() &&
+      ReportVector(ACCELEROMETER_CHARACTERISTIC, accelerometerCharacteristic, accelerometerChannel, accelerometerChange, imuState.acceleration)) {
+    LOG_DEBUG("[IMU] Acceleration(X): %f", imuState.acceleration[0]);
+    LOG_DEBUG("[IMU] Acceleration(Y): %f", imuState.acceleration[1]);
+    LOG_DEBUG("[IMU] Acceleration(Z): %f", imuState.acceleration[2]);
+  }
+  if (!accelerometerCharacteristic.subscribed())
+  {
+    LOG_DEBUG("[IMU] Please Subscribe to Acceleration for Notifications");
+  }
+
+  if (gyroscopeCharacteristic.subscribed() &&
+      ReportVector(GYROSCOPE_CHARACTERISTIC, gyroscopeCharacteristic, gyroscopeChannel, gyroscopeChange, imuState.gyroDPS)) {
+    LOG_DEBUG("[IMU] Gyroscope(X): %f", imuState.gyroDPS[0]);
+    LOG_DEBUG("[IMU] Gyroscope(Y): %f", imuState.gyroDPS[1]);
+    LOG_DEBUG("[IMU] Gyroscope(Z): %f", imuState.gyroDPS[2]);
+  }
+  if (!gyroscopeCharacteristic.subscribed())
+  {
+    LOG_DEBUG("[IMU] Please Subscribe to Gyroscope for Notifications");
+  }
+
+  if (magnetometerCharacteristic.subscribed() &&
+      ReportVector(MAGNETOMETER_CHARACTERISTIC, magnetometerCharacteristic, magnetometerChannel, magnetometerChange, imuState.magneticField)) {
+    LOG_DEBUG("[IMU] Magnetometer(X): %f", imuState.magneticField[0]);
+    LOG_DEBUG("[IMU] Magnetometer(Y): %f", imuState.magneticField[1]);
+    LOG_DEBUG("[IMU] Magnetometer(Z): %f", imuState.magneticField[2]);
+  }
+  if (!magnetometerCharacteristic.subscribed())
+  {
+    LOG_DEBUG("[IMU] Please Subscribe to Magnetometer for Notifications");
+  }
+
+  if (orientationCharacteristic.subscribed() && fusionOutput == FUSION_OUTPUT_QUATERNION) {
+    if (ReportVector(ORIENTATION_CHARACTERISTIC, orientationCharacteristic, orientationChannel, orientationChange, imuState.quaternion, 4)) {
+      LOG_DEBUG("[IMU] Orientation(w): %f", imuState.quaternion[0]);
+      LOG_DEBUG("[IMU] Orientation(x): %f", imuState.quaternion[1]);
+      LOG_DEBUG("[IMU] Orientation(y): %f", imuState.quaternion[2]);
+      LOG_DEBUG("[IMU] Orientation(z): %f", imuState.quaternion[3]);
+    }
+  } else if (orientationCharacteristic.subscribed() &&
+             ReportVector(ORIENTATION_CHARACTERISTIC, orientationCharacteristic, orientationChannel, orientationChange, imuState.orientation)) {
+    LOG_DEBUG("[IMU] Orientation(heading): %f", imuState.orientation[0]);
+    LOG_DEBUG("[IMU] Orientation(pitch): %f", imuState.orientation[1]);
+    LOG_DEBUG("[IMU] Orientation(roll): %f", imuState.orientation[2]);
+  }
+  if (!orientationCharacteristic.subscribed())
+  {
+    LOG_DEBUG("[IMU] Please Subscribe to Orientation for Notifications");
+  }
+
+}
+
+/* --------------------------------------------------------------------------
+    Queue a subscriber's snapshot records, the latest sampled and fused IMU
+    State in its own encoding, the frame with its own sequence number. Each
+    record is encoded against a copy of its channels, kept only once the
+    hub took the record
+   -------------------------------------------------------------------------- */
+void QueueSubscriber(int slot) {
+
+  TelemetryEncoding encoding = (TelemetryEncoding)subscriberHub.Config(slot).encoding;
+  uint8_t buffer[TELEMETRY_FRAME_SIZE];
+
+  // a record the queue has no room for is not encoded, nor counted in the sequence
+  if (subscriberHub.Wants(slot, SUBSCRIBER_FRAME) && subscriberHub.Room(slot)) {
+    TelemetryFrame frame;
+    frame.flags = 0;
+    frame.sequence = subscriberFrameSequence[slot]++;
+    frame.timestampMicros = imuState.sampleMicros;
+    memcpy(frame.acceleration, imuState.acceleration, sizeof(frame.acceleration));
+    memcpy(frame.gyroscope, imuState.gyroDPS, sizeof(frame.gyroscope));
+    memcpy(frame.magnetometer, imuState.magneticField, sizeof(frame.magnetometer));
+    memcpy(frame.orientation, imuState.orientation, sizeof(frame.orientation));
+
+    CompactChannel next[COMPACT_FRAME_CHANNEL_COUNT];
+    memcpy(next, subscriberFrameChannels[slot], sizeof(next));
+    size_t length = EncodeCompactTelemetryFrame(frame, next, encoding, buffer, sizeof(buffer));
+    if (subscriberHub.Queue(slot, FRAME_CHARACTERISTIC, buffer, length)) {
+      memcpy(subscriberFrameChannels[slot], next, sizeof(next));
+    }
+  }
+
+  bool quaternion = fusionOutput == FUSION_OUTPUT_QUATERNION;
+  const struct {
+    int           channel;
+    int           record;
+    const float*  values;
+    size_t        axes;
+  } vectors[SUBSCRIBER_VECTOR_COUNT] = {
+    { SUBSCRIBER_ACCELEROMETER, ACCELEROMETER_CHARACTERISTIC, imuState.acceleration, 3 },
+    { SUBSCRIBER_GYROSCOPE, GYROSCOPE_CHARACTERISTIC, imuState.gyroDPS, 3 },
+    { SUBSCRIBER_MAGNETOMETER, MAGNETOMETER_CHARACTERISTIC, imuState.magneticField, 3 },
+    { SUBSCRIBER_ORIENTATION, ORIENTATION_CHARACTERISTIC, quaternion ? imuState.quaternion : imuState.orientation, quaternion ? 4U : 3U }
+  };
+
+  for (int i = 0; i < SUBSCRIBER_VECTOR_COUNT; i++) {
+    if (subscriberHub.Wants(slot, vectors[i].channel) && subscriberHub.Room(slot)) {
+      CompactChannel next = subscriberChannels[slot][i];
+      size_t length = EncodeVector(next, encoding, vectors[i].values, vectors[i].axes, buffer);
+      if (subscriberHub.Queue(slot, vectors[i].record, buffer, length)) {
+        subscriberChannels[slot][i] = next;
+      }
+    }
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Subscriber Stage, queues the records of every subscriber whose period
+    ran out and drains the queues at the pace of each link
+   -------------------------------------------------------------------------- */
+void PublishSubscribers() {
+
+  unsigned long now = micros();
+  bool euler = false;
+
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    subscriberCredits[slot] = subscriberCredits[slot] + SUBSCRIBER_NOTIFY_PER_TICK < SUBSCRIBER_NOTIFY_BURST ?
+      subscriberCredits[slot] + SUBSCRIBER_NOTIFY_PER_TICK : SUBSCRIBER_NOTIFY_BURST;
+
+    if (!subscriberHub.Due(slot, now))
+      continue;
+
+    // the euler angles once per tick, and only when a subscriber wants them
+    if (!euler && (subscriberHub.Wants(slot, SUBSCRIBER_FRAME) ||
+        (subscriberHub.Wants(slot, SUBSCRIBER_ORIENTATION) && fusionOutput == FUSION_OUTPUT_EULER))) {
+      fusion.GetEuler(imuState.orientation);
+      euler = true;
+    }
+    QueueSubscriber(slot);
+  }
+
+  // a record dropped on the way out leaves its delta stream behind, the
+  // slot starts over on keyframes
+  uint32_t dropped[SUBSCRIBER_MAX_SLOTS];
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    dropped[slot] = subscriberHub.Stats(slot).dropped;
+  }
+  subscriberHub.Drain();
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    if (subscriberHub.Active(slot) && subscriberHub.Stats(slot).dropped != dropped[slot]) {
+      ResetSubscriberChannels(slot);
+    }
+  }
+
+  if (now - subscriberStatusMicros >= SUBSCRIBER_STATUS_MICROS) {
+    UpdateSubscriberStatus();
+    subscriberStatusMicros = now;
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Rate Status for the Central/Gateway, what the controller chose and why
+   -------------------------------------------------------------------------- */
+void UpdateRateStatus() {
+  uint8_t status[8];
+  PutUint16LE(&status[0], effectivePublishMillis > 0xFFFF ? 0xFFFF : (uint16_t)effectivePublishMillis);
+  status[2] = EffectiveBatchSize();
+  status[3] = rateController.Flags();
+  PutUint16LE(&status[4], rateNotifyFailedStep > 0xFFFF ? 0xFFFF : (uint16_t)rateNotifyFailedStep);
+  status[6] = (uint8_t)rateRssi;
+  status[7] = rateBacklogPercent;
+  rateStatusCharacteristic.writeValue(status, sizeof(status));
+}
+
+/* --------------------------------------------------------------------------
+    Rate Control Stage, one controller step over what the link did since
+    the last one
+   -------------------------------------------------------------------------- */
+void UpdateRate() {
+
+  // the MTU exchange can come any time after the connection
+  if (linkManager.Update()) {
+    UpdateLinkStatus();
+    LOG_INFO("[LINK] mtu: %u payload: %u", linkManager.Status().mtu, linkManager.PayloadSize());
+  }
+
+  RateInputs inputs;
+  inputs.notifySent = profiler.NotifySent() - rateNotifySent;
+  inputs.notifyFailed = profiler.NotifyDropped() - rateNotifyDropped;
+  rateNotifySent = profiler.NotifySent();
+  rateNotifyDropped = profiler.NotifyDropped();
+  rateNotifyFailedStep = inputs.notifyFailed;
+
+  rateBacklogPercent = (uint8_t)(sampleRing.Count() * 100 / sampleRing.Capacity());
+  inputs.backlogPercent = rateBacklogPercent;
+
+  int rssi = BLE.rssi();
+  rateRssi = (rssi >= -128 && rssi < RATE_RSSI_UNKNOWN) ? (int8_t)rssi : RATE_RSSI_UNKNOWN;
+  inputs.rssi = rateRssi;
+
+  // activity is motion, or batches waiting on the queue
+  uint8_t size = EffectiveBatchSize();
+  inputs.active = motionDetector.Moving() || (size > 0 && sampleRing.Count() >= size);
+
+  if (rateControlEnabled && rateController.Update(inputs)) {
+    ApplyPublishRate();
+    LOG_INFO("[RATE] period: %lu ms batch: %u flags: %x", effectivePublishMillis, EffectiveBatchSize(), rateController.Flags());
+  }
+
+  UpdateRateStatus();
+}
+
+/* --------------------------------------------------------------------------
+    Read the current voltage level on the A0 analog input pin.
+    This is used here to simulate the charge level of a battery.
+   -------------------------------------------------------------------------- */
+void UpdateBatteryLevel() {
+  
+  int batteryLevel = 1 + rand() % 10;
+  float level = batteryLevel;
+
+  // only if the battery level has changed past its deadband
+  if (ChangeShouldReport(batteryChange, &level, 1, micros())) {      
+    LOG_DEBUG("Battery Level %% is now: %d", batteryLevel);
+    // and update the battery level characteristic to BLE
+    batteryChargedCharacteristic.writeValue(&level, sizeof(level));
+    ChangeCommit(batteryChange, &level, 1, micros());
+    oldBatteryLevel = batteryLevel;
+    BatteryCheck(batteryLevel);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Flash the RGB Green/Blue while we wait for a Central/Gateway
+   -------------------------------------------------------------------------- */
+void ReadyToConnectBlink() {
+  if (readyToConnectBlink) {
+    SetBuiltInRGB(HIGH, HIGH, LOW);
+  } else {
+    SetBuiltInRGB(LOW, HIGH, HIGH);
+  }
+  readyToConnectBlink = !readyToConnectBlink;
+}
+
+/* --------------------------------------------------------------------------
+    Store Stage, keeps a compact frame in flash every FLASH_STORE_PERIOD_MS
+    while no Central/Gateway is connected
+   -------------------------------------------------------------------------- */
+void StoreTelemetry() {
+  if (!flashStore.Ready())
+    return;
+
+  TelemetryFrame frame;
+  frame.flags = TELEMETRY_FRAME_FLAG_STORED;
+  frame.sequence = storeSequence++;
+  frame.timestampMicros = millis();
+  memcpy(frame.acceleration, imuState.acceleration, sizeof(frame.acceleration));
+  memcpy(frame.gyroscope, imuState.gyroDPS, sizeof(frame.gyroscope));
+  memcpy(frame.magnetometer, imuState.magneticField, sizeof(frame.magnetometer));
+  fusion.GetEuler(frame.orientation);
+
+  uint8_t buffer[COMPACT_FRAME_MAX_SIZE];
+  size_t length = EncodeCompactTelemetryFrame(frame, storeChannels, ENCODING_INT16, buffer, sizeof(buffer));
+  if (!flashStore.Append(buffer, length)) {
+    LOG_WARN("[FlashStore] APPEND FAILED: %u", frame.sequence);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Backfill Stage, streams the stored frames from backfillOffset on, the
+    cursor only moves once a chunk is sent so a full transmit queue or a
+    disconnect resumes from the same place
+   -------------------------------------------------------------------------- */
+void UpdateBackfillControl() {
+  uint8_t control[12];
+  PutUint32LE(&control[0], flashStore.Ready() ? flashStore.TailOffset() : 0);
+  PutUint32LE(&control[4], flashStore.Ready() ? flashStore.HeadOffset() : 0);
+  PutUint32LE(&control[8], backfillOffset);
+  backfillControlCharacteristic.writeValue(control, sizeof(control));
+}
+
+void SendBackfill() {
+  if (!backfillActive || !flashStore.Ready() || !backfillDataCharacteristic.subscribed())
+    return;
+
+  // wait for the MTU exchange, a chunk has to hold the largest frame
+  if (linkManager.PayloadSize() < BACKFILL_HEADER_SIZE + 1 + COMPACT_FRAME_MAX_SIZE)
+    return;
+
+  for (int i = 0; i < BACKFILL_CHUNKS_PER_TICK; i++) {
+    uint8_t buffer[BATCH_PAYLOAD_SIZE];
+    uint32_t nextOffset = backfillOffset;
+    size_t length = flashStore.ReadChunk(backfillOffset, &buffer[BACKFILL_HEADER_SIZE],
+      linkManager.PayloadSize() - BACKFILL_HEADER_SIZE, nextOffset);
+
+    if (length == 0) {
+      backfillActive = false;
+      backfillOffset = nextOffset;
+      UpdateBackfillControl();
+      LOG_INFO("[Backfill] Caught up at: %lu", (unsigned long)backfillOffset);
+      return;
+    }
+
+    PutUint32LE(&buffer[0], backfillOffset);
+    PutUint32LE(&buffer[4], nextOffset);
+    if (!Notify(backfillDataCharacteristic, buffer, BACKFILL_HEADER_SIZE + length))
+      return;
+
+    backfillOffset = nextOffset;
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Schema Stage, notifies DEVICE_SCHEMA from schemaOffset on and stops
+    itself at the end, like the backfill the cursor only moves once a chunk
+    is sent
+   -------------------------------------------------------------------------- */
+void UpdateSchemaControl() {
+  uint8_t control[8];
+  PutUint32LE(&control[0], schemaOffset);
+  PutUint32LE(&control[4], DEVICE_SCHEMA_COMPRESSED_SIZE);
+  schemaControlCharacteristic.writeValue(control, sizeof(control));
+}
+
+void StopSchema() {
+  schemaActive = false;
+  scheduler.Stop(schemaTask);
+  UpdateSchemaControl();
+}
+
+void SendSchema() {
+  if (!schemaActive || !schemaDataCharacteristic.subscribed())
+    return;
+
+  size_t chunk = linkManager.PayloadSize() - SCHEMA_HEADER_SIZE;
+  for (int i = 0; i < SCHEMA_CHUNKS_PER_TICK; i++) {
+    uint8_t buffer[BATCH_PAYLOAD_SIZE];
+    size_t length = DEVICE_SCHEMA_COMPRESSED_SIZE - schemaOffset;
+    if (length > chunk) {
+      length = chunk;
+    }
+
+    PutUint32LE(&buffer[0], schemaOffset);
+    memcpy(&buffer[SCHEMA_HEADER_SIZE], &DEVICE_SCHEMA[schemaOffset], length);
+    if (!Notify(schemaDataCharacteristic, buffer, SCHEMA_HEADER_SIZE + length))
+      return;
+
+    schemaOffset += length;
+    if (schemaOffset >= DEVICE_SCHEMA_COMPRESSED_SIZE) {
+      StopSchema();
+      LOG_INFO("[Schema] Sent: %u bytes", (unsigned)DEVICE_SCHEMA_COMPRESSED_SIZE);
+      return;
+    }
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Calibration Stage, refits whatever has new samples outside of the
+    fusion stage and keeps the coefficients once they drifted
+   -------------------------------------------------------------------------- */
+void UpdateCalibration() {
+  uint8_t status[CALIBRATION_STATUS_SIZE];
+  status[0] = calibration.Coefficients().flags;
+  status[1] = calibration.MagnetometerCoverage();
+  status[2] = calibration.AccelerometerPositions();
+  status[3] = (calibration.AtRest() ? CALIBRATION_STATE_REST : 0) |
+              (calibration.Dirty() ? CALIBRATION_STATE_UNSAVED : 0);
+  EncodeCalibration(calibration.Coefficients(), &status[4]);
+  calibrationCharacteristic.writeValue(status, sizeof(status));
+}
+
+void SaveCalibration() {
+  if (calibration.Save()) {
+    calibrationSaved = millis();
+    LOG_INFO("[CALIBRATION] Saved, flags: 0x%02x", calibration.Coefficients().flags);
+  } else {
+    LOG_WARN("[CALIBRATION] SAVE FAILED");
+  }
+}
+
+void CalibrateIMU() {
+  if (calibration.Update()) {
+    UpdateCalibration();
+  }
+
+  // a save may erase the page, so unattended only while nobody is connected
+  if (!BLE.connected() && calibration.Dirty() &&
+      millis() - calibrationSaved >= CALIBRATION_AUTOSAVE_SECONDS * 1000UL) {
+    SaveCalibration();
+    UpdateCalibration();
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Power Stage, accounts the time in each state, stretches the advertising
+    interval and goes dormant once nothing moved for POWER_DORMANT_SECONDS
+   -------------------------------------------------------------------------- */
+void ManagePower() {
+  if (powerManager.Update(motionDetector.Moving())) {
+    PowerChanged();
+  } else {
+    UpdatePowerStatus();
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Trace Stage, streams the captured trace entries oldest first, an entry
+    only leaves the ring once its notification went out
+   -------------------------------------------------------------------------- */
+void SendTrace() {
+  if (traceRing.Empty() || !traceCharacteristic.subscribed())
+    return;
+
+  TraceEntry entries[TRACE_MAX_ENTRIES];
+  size_t count = traceRing.Count() < TRACE_MAX_ENTRIES ? traceRing.Count() : TRACE_MAX_ENTRIES;
+  for (size_t i = 0; i < count; i++) {
+    entries[i] = traceRing.Peek(i);
+  }
+
+  uint8_t buffer[BATCH_PAYLOAD_SIZE];
+  size_t encoded = 0;
+  size_t length = EncodeLatencyTrace(entries, count, (uint16_t)traceRing.Overflows(),
+    buffer, linkManager.PayloadSize(), encoded);
+  if (length > 0 && Notify(traceCharacteristic, buffer, length)) {
+    traceRing.Pop(encoded);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Start and stop the tasks that talk to the Central/Gateway
+   -------------------------------------------------------------------------- */
+void StartTelemetry() {
+  featureExtractor.Reset();
+  ResetChangeChannels();
+  rateController.Reset();
+  rateNotifySent = profiler.NotifySent();
+  rateNotifyDropped = profiler.NotifyDropped();
+  scheduler.Start(rateTask, RATE_TASK_MICROS);
+  scheduler.Start(batchTask);
+  scheduler.Start(featuresTask);
+  scheduler.Start(publishTask, telemetryFrequency * 1000UL);
+  ApplyPublishRate();
+  scheduler.Start(batteryTask, telemetryFrequency * 1000UL);
+  scheduler.Start(backfillTask);
+  scheduler.Start(traceTask);
+}
+
+void StopTelemetry() {
+  // the serial transport streams with or without a Central/Gateway
+#if !(TELEMETRY_TRANSPORTS & TRANSPORT_SERIAL)
+  scheduler.Stop(batchTask);
+  scheduler.Stop(featuresTask);
+  scheduler.Stop(publishTask);
+#endif
+  scheduler.Stop(batteryTask);
+  scheduler.Stop(rateTask);
+  scheduler.Stop(backfillTask);
+  scheduler.Stop(traceTask);
+}
+
+/* --------------------------------------------------------------------------
+    Start the telemetry once per connection, on the first subscription or
+    when CONNECTION_START_TIMEOUT_MICROS ran out without one
+   -------------------------------------------------------------------------- */
+void StartConnection(ConnectionStartCause cause) {
+  if (!connectionTracker.Start(cause))
+    return;
+
+  scheduler.Stop(bleStartTask);
+  StartTelemetry();
+  UpdateConnectionStatus();
+  LOG_INFO("[CONNECTION] Telemetry started: %s, %lu us after connecting",
+    cause == CONNECTION_START_SUBSCRIBED ? "subscribed" : "timeout",
+    (unsigned long)connectionTracker.Status().startMicros);
+}
+
+void StartOnTimeout() {
+  StartConnection(CONNECTION_START_TIMEOUT);
+}
+
+// ************************* BEGIN EVENT HANDLERS ***************************
+
+/* --------------------------------------------------------------------------
+    Initial values of the read only characteristics
+   -------------------------------------------------------------------------- */
+void SetUpVersion() {
+  versionCharacteristic.writeValue(SEMANTIC_VERSION, sizeof(SEMANTIC_VERSION));
+}
+
+void SetUpBatteryCharged() {
+  float level = oldBatteryLevel;
+  batteryChargedCharacteristic.writeValue(&level, sizeof(level));
+  batteryChargedCharacteristic.broadcast();
+}
+
+void SetUpDcm() {
+  uint8_t dcm[DCM_SIZE];
+  dcm[0] = DEVICE_SCHEMA_VERSION;
+  dcm[1] = DEVICE_SCHEMA_COMPRESSION;
+  PutUint32LE(&dcm[2], DEVICE_SCHEMA_HASH);
+  PutUint16LE(&dcm[6], DEVICE_SCHEMA_COMPRESSED_SIZE);
+  PutUint16LE(&dcm[8], DEVICE_SCHEMA_SIZE);
+  memcpy(&dcm[DCM_HEADER_SIZE], STR(DCM), DCM_SIZE - DCM_HEADER_SIZE);
+  dcmCharacteristic.writeValue(dcm, sizeof(dcm));
+}
+
+/* --------------------------------------------------------------------------
+    ENCODING_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void UpdateEncoding() {
+  uint8_t current[2] = { telemetryEncoding, keyframeInterval };
+  encodingCharacteristic.writeValue(current, sizeof(current));
+}
+
+void onEncodingCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  const uint8_t* config = encodingCharacteristic.value();
+  int length = encodingCharacteristic.valueLength();
+
+  if (length >= 1 && config[0] < ENCODING_COUNT && (length < 2 || config[1] > 0)) {
+    telemetryEncoding = (TelemetryEncoding)config[0];
+    if (length >= 2) {
+      keyframeInterval = config[1];
+    }
+    ResetCompactChannels();
+    LOG_INFO("[EVENT] telemetryEncoding: %u", telemetryEncoding);
+    LOG_INFO("[EVENT] keyframeInterval: %u", keyframeInterval);
+  } else {
+    LOG_WARN("[EVENT] telemetryEncoding MUST BE BETWEEN 0 AND %d, keyframeInterval MORE THAN 0", ENCODING_COUNT - 1);
+  }
+
+  UpdateEncoding();
+}
+
+/* --------------------------------------------------------------------------
+    SUBSCRIBERCONFIG_CHARACTERISTIC (write) Event Handler, the config is
+    for the Central/Gateway that wrote it
+   -------------------------------------------------------------------------- */
+void onSubscriberConfigCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  SubscriberConfig config;
+  uint16_t connection = CentralHandle(central);
+  if (DecodeSubscriberConfig(subscriberConfigCharacteristic.value(), subscriberConfigCharacteristic.valueLength(), config) &&
+      subscriberHub.Configure(connection, config)) {
+    int slot = subscriberHub.Slot(connection);
+    ResetSubscriberChannels(slot);
+    subscriberFrameSequence[slot] = 0;
+    LOG_INFO("[EVENT] subscriber %d channels: 0x%04x period: %u ms encoding: %u",
+      slot, config.channels, config.periodMillis, config.encoding);
+  } else {
+    LOG_WARN("[EVENT] subscriberConfig MUST BE %d BYTES WITH AN ENCODING BELOW %d FROM A CONNECTED CENTRAL",
+      SUBSCRIBER_CONFIG_SIZE, ENCODING_COUNT);
+  }
+
+  UpdateSubscriberStatus();
+}
+
+/* --------------------------------------------------------------------------
+    FUSION_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void UpdateFusionConfig() {
+  uint8_t current[2] = { fusion.Algorithm(), fusionOutput };
+  fusionCharacteristic.writeValue(current, sizeof(current));
+}
+
+void onFusionCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  const uint8_t* config = fusionCharacteristic.value();
+  int length = fusionCharacteristic.valueLength();
+
+  if (length >= 1 && config[0] < FUSION_ALGORITHM_COUNT && (length < 2 || config[1] < FUSION_OUTPUT_COUNT)) {
+    fusion.SetAlgorithm((FusionAlgorithm)config[0]);
+    if (length >= 2 && config[1] != fusionOutput) {
+      fusionOutput = (FusionOutput)config[1];
+      ResetCompactChannels();
+    }
+    LOG_INFO("[EVENT] fusionAlgorithm: %u", fusion.Algorithm());
+    LOG_INFO("[EVENT] fusionOutput: %u", fusionOutput);
+  } else {
+    LOG_WARN("[EVENT] fusionAlgorithm MUST BE BETWEEN 0 AND %d, fusionOutput BETWEEN 0 AND %d", FUSION_ALGORITHM_COUNT - 1, FUSION_OUTPUT_COUNT - 1);
+  }
+
+  UpdateFusionConfig();
+}
+
+/* --------------------------------------------------------------------------
+    DECIMATION_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void onDecimationCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  const uint8_t* config = decimationCharacteristic.value();
+  int length = decimationCharacteristic.valueLength();
+
+  bool valid = length >= DECIMATION_CHANNEL_COUNT;
+  for (int channel = 0; valid && channel < DECIMATION_CHANNEL_COUNT; channel++) {
+    valid = config[channel] <= DECIMATOR_MAX_STAGES || config[channel] == DECIMATOR_AUTO;
+  }
+
+  if (valid) {
+    memcpy(decimationConfig, config, DECIMATION_CHANNEL_COUNT);
+    ResolveDecimation();
+    for (int channel = 0; channel < DECIMATION_CHANNEL_COUNT; channel++) {
+      LOG_INFO("[EVENT] decimation[%d]: %u, %.2f Hz", channel, decimationStages[channel], Decimator::OutputHz(imuHz, decimationStages[channel]));
+    }
+  } else {
+    LOG_WARN("[EVENT] decimation MUST BE %d STAGES BETWEEN 0 AND %d OR %d", DECIMATION_CHANNEL_COUNT, DECIMATOR_MAX_STAGES, DECIMATOR_AUTO);
+  }
+
+  UpdateDecimation();
+}
 
 /* --------------------------------------------------------------------------
-    BLE Service Definition UUID and DEVICE NAME
+    RATEBOUNDS_CHARACTERISTIC (write) Event Handler from Central/Gateway
    -------------------------------------------------------------------------- */
-BLEService blePeripheral(STR(SERVICE_UUID)); 
+void PackRateBounds(uint8_t buffer[8]) {
+  const RateBounds& bounds = rateController.Bounds();
+  PutUint16LE(&buffer[0], bounds.minPeriodMillis);
+  PutUint16LE(&buffer[2], bounds.maxPeriodMillis);
+  buffer[4] = bounds.minBatch;
+  buffer[5] = bounds.maxBatch;
+  buffer[6] = (uint8_t)bounds.rssiFloor;
+  buffer[7] = rateControlEnabled ? bounds.backlogPercent : 0;
+}
 
-// ************************* BEGIN CHARACTERISTICS **************************
+void UpdateRateBounds() {
+  uint8_t current[8];
+  PackRateBounds(current);
+  rateBoundsCharacteristic.writeValue(current, sizeof(current));
+}
 
-/* --------------------------------------------------------------------------
-    BLE Peripheral Characteristics - Readable by Central/Gateway
-   -------------------------------------------------------------------------- */
-// Version
-BLECharacteristic       versionCharacteristic("1001", BLERead | BLEWrite, sizeof(SEMANTIC_VERSION));
-BLEDescriptor           versionCharacteristicDesc ("2901", "Version");
+void onRateBoundsCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  const uint8_t* config = rateBoundsCharacteristic.value();
+
+  if (rateBoundsCharacteristic.valueLength() >= 8) {
+    RateBounds bounds;
+    bounds.minPeriodMillis = GetUint16LE(&config[0]);
+    bounds.maxPeriodMillis = GetUint16LE(&config[2]);
+    bounds.minBatch = config[4];
+    bounds.maxBatch = config[5];
+    bounds.rssiFloor = (int8_t)config[6];
+    bounds.backlogPercent = config[7];
+
+    if (bounds.backlogPercent == 0) {
+      rateControlEnabled = false;
+      ApplyPublishRate();
+      LOG_INFO("[EVENT] rateControl: OFF");
+    } else if (bounds.minPeriodMillis >= 20 && rateController.Begin(bounds)) {
+      rateControlEnabled = true;
+      ApplyPublishRate();
+      LOG_INFO("[EVENT] rateControl period: %u..%u ms batch: %u..%u", bounds.minPeriodMillis, bounds.maxPeriodMillis, bounds.minBatch, bounds.maxBatch);
+    } else {
+      LOG_WARN("[EVENT] rateBounds MUST HAVE 20 <= min <= max period, 1 <= min <= max batch, backlog 0 TO 100");
+    }
+  } else {
+    LOG_WARN("[EVENT] rateBounds MUST BE 8 BYTES");
+  }
 
-// Battery Charged
-BLEFloatCharacteristic  batteryChargedCharacteristic("2001", BLERead);
-BLEDescriptor           batteryChargedCharacteristicDesc ("2901", "Battery Charged");
+  UpdateRateBounds();
+}
 
-// Telemetry Frequency
-BLEIntCharacteristic    telemetryFrequencyCharacteristic("3001", BLERead | BLEWrite);
-BLEDescriptor           telemetryFrequencyCharacteristicDesc ("2901", "Telemetry Frequency");
+/* --------------------------------------------------------------------------
+    BACKFILLCONTROL_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void onBackfillControlCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  const uint8_t* control = backfillControlCharacteristic.value();
+
+  if (!flashStore.Ready()) {
+    LOG_WARN("[EVENT] backfill FLASH STORE IS NOT READY");
+  } else if (backfillControlCharacteristic.valueLength() >= 4) {
+    uint32_t offset = GetUint32LE(&control[0]);
+    if (offset == BACKFILL_STOP) {
+      backfillActive = false;
+      LOG_INFO("[EVENT] backfill: STOPPED at %lu", (unsigned long)backfillOffset);
+    } else if (offset == BACKFILL_FORMAT) {
+      backfillActive = false;
+      backfillOffset = 0;
+      flashStore.Format();
+      LOG_INFO("[EVENT] backfill: FORMATTED");
+    } else {
+      backfillOffset = offset;
+      backfillActive = true;
+      LOG_INFO("[EVENT] backfill from: %lu", (unsigned long)offset);
+    }
+  } else {
+    LOG_WARN("[EVENT] backfillControl MUST BE 4 BYTES");
+  }
 
-// Accelerometer
-BLECharacteristic       accelerometerCharacteristic("4001", BLENotify, 3 * sizeof(float));
-BLEDescriptor           accelerometerCharacteristicDesc ("2901", "Accelerometer");
+  UpdateBackfillControl();
+}
 
-// Gyroscope
-BLECharacteristic       gyroscopeCharacteristic("5001", BLENotify, 3 * sizeof(float));
-BLEDescriptor           gyroscopeCharacteristicDesc ("2901", "Gyroscope");
+/* --------------------------------------------------------------------------
+    SCHEMACONTROL_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void onSchemaControlCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
 
-// Magnetometer
-BLECharacteristic       magnetometerCharacteristic("6001", BLENotify, 3 * sizeof(float));
-BLEDescriptor           magnetometerCharacteristicDesc ("2901", "Magnetometer");
+  const uint8_t* control = schemaControlCharacteristic.value();
 
-// Orientation
-BLECharacteristic       orientationCharacteristic("7001", BLENotify, 3 * sizeof(float));
-BLEDescriptor           orientationCharacteristicDesc ("2901", "Orientation");
+  if (schemaControlCharacteristic.valueLength() >= 4) {
+    uint32_t offset = GetUint32LE(&control[0]);
+    if (offset == SCHEMA_STOP) {
+      LOG_INFO("[EVENT] schema: STOPPED at %lu", (unsigned long)schemaOffset);
+      StopSchema();
+      return;
+    } else if (offset < DEVICE_SCHEMA_COMPRESSED_SIZE) {
+      schemaOffset = offset;
+      schemaActive = true;
+      scheduler.Start(schemaTask);
+      LOG_INFO("[EVENT] schema from: %lu", (unsigned long)offset);
+    } else {
+      LOG_WARN("[EVENT] schemaControl MUST BE BELOW %u", (unsigned)DEVICE_SCHEMA_COMPRESSED_SIZE);
+    }
+  } else {
+    LOG_WARN("[EVENT] schemaControl MUST BE 4 BYTES");
+  }
 
-// RGB Led
-BLECharacteristic       rgbLedCharacteristic("8001", BLERead | BLEWrite, 3 * sizeof(byte));
-BLEDescriptor           rgbLedCharacteristicDesc ("2901", "RGB Led");
+  UpdateSchemaControl();
+}
 
-// Device Capability Model
-BLECharacteristic               dcmCharacteristic("9901", BLERead, sizeof(DEVICE_CAPABILITY_MODEL));
-BLEDescriptor                   dcmCharacteristicDesc("2901", "Device Capability Model");
+/* --------------------------------------------------------------------------
+    TRACECONFIG_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void UpdateTraceConfig() {
+  traceConfigCharacteristic.writeValue(&traceFlags, sizeof(traceFlags));
+}
 
+void onTraceConfigCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
 
+  if (traceConfigCharacteristic.valueLength() >= 1 &&
+      (traceConfigCharacteristic[0] & ~(TRACE_STAMP_VECTORS | TRACE_CAPTURE)) == 0) {
+    traceFlags = traceConfigCharacteristic[0];
+    // a new capture starts with an empty trace
+    traceRing.Pop(traceRing.Count());
+    LOG_INFO("[EVENT] traceConfig: 0x%02x", traceFlags);
+  } else {
+    LOG_WARN("[EVENT] traceConfig UNKNOWN FLAGS");
+  }
 
-// ************************** END CHARACTERISTICS ***************************
+  UpdateTraceConfig();
+}
 
 /* --------------------------------------------------------------------------
-    Function to set the onboard Nano RGB LED
+    CLOCKSYNC_CHARACTERISTIC (write) Event Handler from Central/Gateway,
+    answered right away so the time we hold the request stays small
    -------------------------------------------------------------------------- */
-void SetBuiltInRGB(
-  PinStatus redLightPinValue,
-  PinStatus blueLightPinValue,
-  PinStatus greenLightPinValue)
-{
-     digitalWrite(RED_LIGHT_PIN, redLightPinValue);
-     digitalWrite(BLUE_LIGHT_PIN, blueLightPinValue);
-     digitalWrite(GREEN_LIGHT_PIN, greenLightPinValue);    
+void onClockSyncCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  uint32_t received = micros();
+  if (clockSyncCharacteristic.valueLength() != CLOCK_SYNC_REQUEST_SIZE) {
+    LOG_WARN("[EVENT] clockSync MUST BE %d BYTES", CLOCK_SYNC_REQUEST_SIZE);
     return;
+  }
+
+  const uint8_t* request = clockSyncCharacteristic.value();
+  ClockSyncReply reply;
+  reply.centralSent = (uint64_t)GetUint32LE(&request[0]) | ((uint64_t)GetUint32LE(&request[4]) << 32);
+  reply.deviceReceived = received;
+
+  uint8_t buffer[CLOCK_SYNC_REPLY_SIZE];
+  reply.deviceSent = micros();
+  EncodeClockSyncReply(reply, buffer);
+  clockSyncCharacteristic.writeValue(buffer, sizeof(buffer));
+  LOG_DEBUG("[EVENT] clockSync held: %lu us", (unsigned long)(reply.deviceSent - reply.deviceReceived));
 }
 
 /* --------------------------------------------------------------------------
-    Function to set the RGB LED to the color of the battery charge
-      * Green >=50%
-      * Yellow <= 49% && >=20%
-      * Red <=19%
+    CALIBRATION_CHARACTERISTIC (write) Event Handler from Central/Gateway
    -------------------------------------------------------------------------- */
-void BatteryCheck(int level) {
-  if (level >=5 )
-  {
-    Serial.println("BatteryCheck Set Green");
-    SetBuiltInRGB(HIGH, HIGH, LOW);
-  }
-  else if (level >=2 and level <= 4 )
-  {
-    Serial.println("BatteryCheck Set Yellow");
-    SetBuiltInRGB(LOW, HIGH, LOW);
-  }
-  else
-  {
-    Serial.println("BatteryCheck Set Red");
-    SetBuiltInRGB(LOW, HIGH, HIGH);
+void onCalibrationCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  uint8_t command = calibrationCharacteristic.valueLength() >= 1 ? calibrationCharacteristic[0] : 0;
+  switch (command) {
+    case CALIBRATION_COMMAND_SAVE:
+      SaveCalibration();
+      break;
+    case CALIBRATION_COMMAND_CLEAR:
+      calibration.Clear();
+      break;
+    case CALIBRATION_COMMAND_GYROSCOPE:
+      calibration.RestartGyroscope();
+      break;
+    case CALIBRATION_COMMAND_ACCELEROMETER:
+      calibration.RestartAccelerometer();
+      break;
+    case CALIBRATION_COMMAND_MAGNETOMETER:
+      calibration.RestartMagnetometer();
+      break;
+    default:
+      LOG_WARN("[EVENT] calibration MUST BE BETWEEN 1 AND %d", CALIBRATION_COMMAND_MAGNETOMETER);
+      UpdateCalibration();
+      return;
   }
-  return;
+
+  LOG_INFO("[EVENT] calibration command: %u", command);
+  UpdateCalibration();
 }
 
 /* --------------------------------------------------------------------------
-    Function to read the following IMU capabilities
-      Accelerometer
-      Gyroscope
-      MagneticField
-      Orientation
+    LINKPROFILE_CHARACTERISTIC (write) Event Handler from Central/Gateway
    -------------------------------------------------------------------------- */
-void UpdateIMU() {
-  
-  float acceleration[3];
-  float gyroDPS[3];
-  float magneticField[3];
+void UpdateLinkProfile() {
+  uint8_t current = linkManager.Profile();
+  linkProfileCharacteristic.writeValue(&current, sizeof(current));
+}
 
-  if (IMU.accelerationAvailable()) {
-    
-    // read the Accelerometer
-    float x, y, z;
-    IMU.readAcceleration(x, y, z);
-    acceleration[0] = x;
-    acceleration[1] = y;
-    acceleration[2] = z;
-
-    if (accelerometerCharacteristic.subscribed()) {
-      accelerometerCharacteristic.writeValue(acceleration, sizeof(acceleration));
-      Serial.print("[IMU] Acceleration(X): ");
-      Serial.println(acceleration[0]);
-      Serial.print("[IMU] Acceleration(Y): ");
-      Serial.println(acceleration[1]);
-      Serial.print("[IMU] Acceleration(Z): ");
-      Serial.println(acceleration[2]);
-    }
-    #ifdef DEBUG
-      if (!accelerometerCharacteristic.subscribed())
-      {
-        Serial.println("[IMU] Please Subscribe to Acceleration for Notifications");
-      }
-    #endif
-  }
+void onLinkProfileCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
 
-  if (IMU.gyroscopeAvailable()) {
-    // read the Gyro
-    float x, y, z;
-    IMU.readGyroscope(x, y, z);
-    gyroDPS[0] = x;
-    gyroDPS[1] = y;
-    gyroDPS[2] = z;
-
-    if (gyroscopeCharacteristic.subscribed()) {
-      gyroscopeCharacteristic.writeValue(gyroDPS, sizeof(gyroDPS));
-      Serial.print("[IMU] Gyroscope(X): ");
-      Serial.println(gyroDPS[0]);
-      Serial.print("[IMU] Gyroscope(Y): ");
-      Serial.println(gyroDPS[1]);
-      Serial.print("[IMU] Gyroscope(Z): ");
-      Serial.println(gyroDPS[2]);
-    }
-
-    #ifdef DEBUG
-      if (!gyroscopeCharacteristic.subscribed())
-      {
-        Serial.println("[IMU] Please Subscribe to Gyroscope for Notifications");
-      }
-    #endif
+  if (linkProfileCharacteristic.valueLength() >= 1 &&
+      linkManager.SetProfile((LinkProfileId)linkProfileCharacteristic[0])) {
+    LOG_INFO("[EVENT] linkProfile: %u", linkManager.Profile());
+  } else {
+    LOG_WARN("[EVENT] linkProfile MUST BE BETWEEN 0 AND %d", LINK_PROFILE_COUNT - 1);
   }
 
-  if (IMU.magneticFieldAvailable()) {
-    
-    // read the Mag
-    float x, y, z;
-    IMU.readMagneticField(x, y, z);
-    magneticField[0] = x;
-    magneticField[1] = y;
-    magneticField[2] = z;
-
-    if (magnetometerCharacteristic.subscribed()) {
-      magnetometerCharacteristic.writeValue(magneticField, sizeof(magneticField));
-      
-      Serial.print("[IMU] Magnetometer(X): ");
-      Serial.println(magneticField[0]);
-      Serial.print("[IMU] Magnetometer(Y): ");
-      Serial.println(magneticField[1]);
-      Serial.print("[IMU] Magnetometer(Z): ");
-      Serial.println(magneticField[2]);
-    }
-    #ifdef DEBUG
-      if (!magnetometerCharacteristic.subscribed())
-      {
-        Serial.println("[IMU] Please Subscribe to Magnetometer for Notifications");
-      }
-    #endif
+  UpdateLinkProfile();
+  UpdateLinkStatus();
+}
+
+/* --------------------------------------------------------------------------
+    CHANGECONFIG_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void PackChangeConfig(uint8_t buffer[CHANGE_CONFIG_SIZE]) {
+  const uint16_t* fields = &changeConfig.accelerationMilliG;
+  for (int i = 0; i < CHANGE_CONFIG_FIELDS; i++) {
+    PutUint16LE(&buffer[i * 2], fields[i]);
   }
+}
 
-  if (  orientationCharacteristic.subscribed() && 
-        accelerometerCharacteristic.subscribed() &&
-        magnetometerCharacteristic.subscribed() &&
-        gyroscopeCharacteristic.subscribed()) {
-  
-    if (!(micros() - msecsPrevious >= msecsPerReading))
-      return;
-    
-    float heading, pitch, roll;
-    
-    // Update and compute orientation
-    filter.update(
-      gyroDPS[0], gyroDPS[1], gyroDPS[2],
-      acceleration[0], acceleration[1], acceleration[2],
-      magneticField[0], magneticField[1], magneticField[2]
-    );
-
-    heading = filter.getYawRadians();
-    pitch = filter.getPitchRadians();
-    roll = filter.getRollRadians();
-    
-    float orientation[3] = { heading, pitch, roll };
-    orientationCharacteristic.writeValue(orientation, sizeof(orientation));
+void UpdateChangeConfig() {
+  uint8_t current[CHANGE_CONFIG_SIZE];
+  PackChangeConfig(current);
+  changeConfigCharacteristic.writeValue(current, sizeof(current));
+}
 
-    Serial.print("[IMU] Orientation(heading): ");
-    Serial.println(heading);
-    Serial.print("[IMU] Orientation(pitch): ");
-    Serial.println(pitch);
-    Serial.print("[IMU] Orientation(roll): ");
-    Serial.println(roll);
+void onChangeConfigCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
 
-    msecsPrevious = msecsPrevious + msecsPerReading;
-  }
+  const uint8_t* config = changeConfigCharacteristic.value();
+  int length = changeConfigCharacteristic.valueLength();
 
-  #ifdef DEBUG
-    if (!orientationCharacteristic.subscribed())
-    {
-      Serial.println("[IMU] Please Subscribe to Orientation for Notifications");
+  if (length >= (int)CHANGE_CONFIG_SIZE && GetUint16LE(&config[14]) > 0) {
+    uint16_t* fields = &changeConfig.accelerationMilliG;
+    for (int i = 0; i < CHANGE_CONFIG_FIELDS; i++) {
+      fields[i] = GetUint16LE(&config[i * 2]);
     }
-  #endif
+    BeginChangeChannels();
+    ApplyPublishRate();
+    LOG_INFO("[EVENT] changeConfig heartbeat: %u s motion: %u mg", changeConfig.heartbeatSeconds, changeConfig.motionMilliG);
+  } else {
+    LOG_WARN("[EVENT] changeConfig MUST BE %d BYTES, motionPublish MORE THAN 0", (int)CHANGE_CONFIG_SIZE);
+  }
 
+  UpdateChangeConfig();
 }
 
 /* --------------------------------------------------------------------------
-    Read the current voltage level on the A0 analog input pin.
-    This is used here to simulate the charge level of a battery.
+    FEATURECONFIG_CHARACTERISTIC (write) Event Handler from Central/Gateway
    -------------------------------------------------------------------------- */
-void UpdateBatteryLevel() {
-  
-  int batteryLevel = 1 + rand() % 10;
+void UpdateFeatureConfig() {
+  uint8_t current[4];
+  PutUint16LE(&current[0], featureExtractor.WindowLength());
+  PutUint16LE(&current[2], featureExtractor.Overlap());
+  featureConfigCharacteristic.writeValue(current, sizeof(current));
+}
 
-  // only if the battery level has changed
-  if (batteryLevel != oldBatteryLevel) {      
-    Serial.print("Battery Level % is now: ");
-    Serial.println(batteryLevel);
-    // and update the battery level characteristic to BLE
-    batteryChargedCharacteristic.writeValue(batteryLevel);
-    oldBatteryLevel = batteryLevel;
-    BatteryCheck(batteryLevel);
+void onFeatureConfigCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  const uint8_t* config = featureConfigCharacteristic.value();
+
+  if (featureConfigCharacteristic.valueLength() >= 4 &&
+      featureExtractor.Configure(GetUint16LE(&config[0]), GetUint16LE(&config[2]))) {
+    LOG_INFO("[EVENT] featureWindow: %u", featureExtractor.WindowLength());
+    LOG_INFO("[EVENT] featureOverlap: %u", featureExtractor.Overlap());
+  } else {
+    LOG_WARN("[EVENT] featureWindow MUST BE A POWER OF 2 BETWEEN %d AND %d, featureOverlap LESS THAN IT", FEATURE_MIN_WINDOW, FEATURE_MAX_WINDOW);
   }
 
-  // Enable a Pause to Show this Write
-  telemetryStartDelay = millis();
-  telemetryDelayActive = true;
+  UpdateFeatureConfig();
 }
 
-// ************************* BEGIN EVENT HANDLERS ***************************
+/* --------------------------------------------------------------------------
+    BATCHCONFIG_CHARACTERISTIC (write) Event Handler from Central/Gateway
+   -------------------------------------------------------------------------- */
+void UpdateBatchConfig() {
+  uint8_t current[4] = { batchSize, 0, 0, 0 };
+  PutUint16LE(&current[2], batchFlushInterval);
+  batchConfigCharacteristic.writeValue(current, sizeof(current));
+}
+
+void onBatchConfigCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
+
+  if (batchConfigCharacteristic.valueLength() < 4) {
+    LOG_WARN("[EVENT] batchConfig MUST BE 4 BYTES");
+    return;
+  }
+
+  const uint8_t* config = batchConfigCharacteristic.value();
+  uint8_t size = config[0];
+  unsigned short interval = GetUint16LE(&config[2]);
+
+  if (size <= BATCH_MAX_SAMPLES && interval >= 10 && interval <= 30000) {
+    // start over so a new batch size never mixes with queued samples
+    sampleRing.Clear();
+    batchSize = size;
+    batchFlushInterval = interval;
+    batchFlushStart = millis();
+    LOG_INFO("[EVENT] batchSize: %u", batchSize);
+    LOG_INFO("[EVENT] batchFlushInterval: %u", batchFlushInterval);
+  } else {
+    LOG_WARN("[EVENT] batchSize MUST BE BETWEEN 0 AND %u, batchFlushInterval BETWEEN 10 AND 30000", (unsigned)BATCH_MAX_SAMPLES);
+  }
+
+  UpdateBatchConfig();
+}
 
 /* --------------------------------------------------------------------------
     TELEMETRY_FREQUENCY (write) Event Handler from Central/Gateway
    -------------------------------------------------------------------------- */
+void UpdateTelemetryFrequency() {
+  uint8_t current[sizeof(int32_t)];
+  PutUint32LE(current, telemetryFrequency);
+  telemetryFrequencyCharacteristic.writeValue(current, sizeof(current));
+}
+
 void onTelemetryFrequencyCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
   
-  unsigned long val = telemetryFrequencyCharacteristic.value();
+  unsigned long val = 0;
+  if (telemetryFrequencyCharacteristic.valueLength() >= (int)sizeof(int32_t)) {
+    val = GetUint32LE(telemetryFrequencyCharacteristic.value());
+  }
   
   if (val >= 500 && val <= 30000) {
     telemetryFrequency = val;
-    Serial.print("[EVENT] telemetryFrequency: ");
-    Serial.println(telemetryFrequency);
+    ApplyPublishRate();
+    scheduler.SetPeriod(batteryTask, telemetryFrequency * 1000UL);
+    LOG_INFO("[EVENT] telemetryFrequency: %lu", telemetryFrequency);
   } else {
-    Serial.print("[EVENT] telemetryFrequency MUST BE BETWEEN 500 AND 30000: ");
-    Serial.println(telemetryFrequency);
+    LOG_WARN("[EVENT] telemetryFrequency MUST BE BETWEEN 500 AND 30000: %lu", telemetryFrequency);
   }
 
+  UpdateTelemetryFrequency();
 }
 
 /* --------------------------------------------------------------------------
@@ -354,10 +2635,6 @@ void onTelemetryFrequencyCharacteristicWrite(BLEDevice central, BLECharacteristi
    -------------------------------------------------------------------------- */
 void onRgbLedCharacteristicWrite(BLEDevice central, BLECharacteristic characteristic) {
   
-  // Enable a Pause to Show this Write
-  bleStartDelay = millis();
-  bleDelayActive = true;
-
   // parse the array for LED Set
   PinStatus r = rgbLedCharacteristic[0] == 0 ? LOW : HIGH;
   PinStatus g = rgbLedCharacteristic[1] == 0 ? LOW : HIGH;
@@ -366,92 +2643,297 @@ void onRgbLedCharacteristicWrite(BLEDevice central, BLECharacteristic characteri
   SetBuiltInRGB(r, g, b);
   
   // update the serial port with the values captured
-  Serial.print("[EVENT] RGBLED_CHARACTERISTIC (RED): ");
-  Serial.println(r);
-  Serial.print("[EVENT] RGBLED_CHARACTERISTIC (GREEN): ");
-  Serial.println(g);
-  Serial.print("[EVENT] RGBLED_CHARACTERISTIC (BLUE): ");
-  Serial.println(b);
+  LOG_INFO("[EVENT] RGBLED_CHARACTERISTIC (RED): %d", r);
+  LOG_INFO("[EVENT] RGBLED_CHARACTERISTIC (GREEN): %d", g);
+  LOG_INFO("[EVENT] RGBLED_CHARACTERISTIC (BLUE): %d", b);
 
 }
 
 // ************************** END EVENT HANDLERS ****************************
 
 /* --------------------------------------------------------------------------
-    This Function acts as a positive indicater (true) when the 
-    characteristic is setup properly
+    Add every characteristic in CHARACTERISTIC_REGISTRY to the service, the
+    table is expanded into flash so a new characteristic costs one entry
+   -------------------------------------------------------------------------- */
+struct CharacteristicEntry {
+  BLECharacteristic*            characteristic;
+  BLEDescriptor*                descriptor;
+  void                          (*setUp)();
+  BLECharacteristicEventHandler onWrite;
+  const char*                   name;
+};
+
+#define CHARACTERISTIC_ENTRY(id, name, uuid, properties, size, description, setUp, onWrite) \
+  { &name##Characteristic, &name##CharacteristicDesc, setUp, onWrite, #id "_CHARACTERISTIC" },
+const CharacteristicEntry characteristicRegistry[CHARACTERISTIC_COUNT] = {
+  CHARACTERISTIC_REGISTRY(CHARACTERISTIC_ENTRY)
+};
+#undef CHARACTERISTIC_ENTRY
+
+/* --------------------------------------------------------------------------
+    BLESubscribed Event Handler of every characteristic that notifies, a
+    subscription means the Central/Gateway is through service discovery
    -------------------------------------------------------------------------- */
-bool SetUpCharacteristic(int whichCharacteristic)
+void onCharacteristicSubscribed(BLEDevice central, BLECharacteristic characteristic) {
+  StartConnection(CONNECTION_START_SUBSCRIBED);
+}
+
+void SetUpCharacteristics()
 {
-  bool result = false;
-  switch (whichCharacteristic) {
-
-    case VERSION_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(versionCharacteristic); 
-      versionCharacteristic.addDescriptor(versionCharacteristicDesc);
-      versionCharacteristic.setValue(SEMANTIC_VERSION, 14);
-      result = true;
-      break;
+  for (int i = 0; i < CHARACTERISTIC_COUNT; i++) {
+    const CharacteristicEntry& entry = characteristicRegistry[i];
 
-    case BATTERYCHARGED_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(batteryChargedCharacteristic); 
-      batteryChargedCharacteristic.addDescriptor(batteryChargedCharacteristicDesc);
-      batteryChargedCharacteristic.writeValue(oldBatteryLevel);
-      batteryChargedCharacteristic.broadcast();
-      result = true;
-      break;
+    blePeripheral.addCharacteristic(*entry.characteristic);
+    entry.characteristic->addDescriptor(*entry.descriptor);
+    if (entry.setUp != NULL) {
+      entry.setUp();
+    }
+    if (entry.onWrite != NULL) {
+      entry.characteristic->setEventHandler(BLEWritten, entry.onWrite);
+    }
+    if (entry.characteristic->properties() & (BLENotify | BLEIndicate)) {
+      entry.characteristic->setEventHandler(BLESubscribed, onCharacteristicSubscribed);
+    }
+    LOG_INFO("[SUCCESS] SetUpCharacteristic->%s", entry.name);
+  }
+}
 
-    case TELEMETRYFREQUENCY_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(telemetryFrequencyCharacteristic); 
-      telemetryFrequencyCharacteristic.addDescriptor(telemetryFrequencyCharacteristicDesc);
-      telemetryFrequencyCharacteristic.setValue(telemetryFrequency);
-      telemetryFrequencyCharacteristic.setEventHandler(BLEWritten, onTelemetryFrequencyCharacteristicWrite);
-      result = true;
-      break;
-  
-    case ACCELEROMETER_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(accelerometerCharacteristic); 
-      accelerometerCharacteristic.addDescriptor(accelerometerCharacteristicDesc);
-      result = true;
-      break;
+/* --------------------------------------------------------------------------
+    Add the tasks to the scheduler and start the ones that always run
+   -------------------------------------------------------------------------- */
+void SetUpScheduler() {
+  unsigned long samplePeriod = SamplePeriodMicros();
+  sampleTask = scheduler.AddPeriodic("sample", SAMPLE_PRIORITY, samplePeriod, SampleIMU);
+  fusionTask = scheduler.AddPeriodic("fusion", FUSION_PRIORITY, samplePeriod, FuseIMU);
+  batchTask = scheduler.AddPeriodic("batch", BATCH_PRIORITY, BATCH_TASK_MICROS, FlushBatch);
+  featuresTask = scheduler.AddPeriodic("features", FEATURES_PRIORITY, FEATURES_TASK_MICROS, PublishFeatures);
+  publishTask = scheduler.AddPeriodic("publish", PUBLISH_PRIORITY, telemetryFrequency * 1000UL, UpdateIMU);
+  subscriberTask = scheduler.AddPeriodic("subscribers", SUBSCRIBER_PRIORITY, SUBSCRIBER_TASK_MICROS, PublishSubscribers);
+  bleStartTask = scheduler.AddOneShot("bleStart", BLESTART_PRIORITY, StartOnTimeout);
+  ledTask = scheduler.AddPeriodic("led", LED_PRIORITY, READY_TO_CONNECT_MICROS, ReadyToConnectBlink);
+  batteryTask = scheduler.AddPeriodic("battery", BATTERY_PRIORITY, telemetryFrequency * 1000UL, UpdateBatteryLevel);
+  rateTask = scheduler.AddPeriodic("rate", RATE_PRIORITY, RATE_TASK_MICROS, UpdateRate);
+  calibrationTask = scheduler.AddPeriodic("calibration", CALIBRATION_PRIORITY, CALIBRATION_TASK_MICROS, CalibrateIMU);
+  powerTask = scheduler.AddPeriodic("power", POWER_PRIORITY, POWER_TASK_MICROS, ManagePower);
+  storeTask = scheduler.AddPeriodic("store", STORE_PRIORITY, FLASH_STORE_PERIOD_MS * 1000UL, StoreTelemetry);
+  schemaTask = scheduler.AddPeriodic("schema", SCHEMA_PRIORITY, SCHEMA_TASK_MICROS, SendSchema);
+  backfillTask = scheduler.AddPeriodic("backfill", BACKFILL_PRIORITY, BACKFILL_TASK_MICROS, SendBackfill);
+  traceTask = scheduler.AddPeriodic("trace", TRACE_PRIORITY, TRACE_TASK_MICROS, SendTrace);
+  diagnosticsTask = scheduler.AddPeriodic("diagnostics", DIAGNOSTICS_PRIORITY, DIAGNOSTICS_TASK_MICROS, UpdateDiagnostics);
+  logTask = scheduler.AddPeriodic("log", LOG_PRIORITY, LOG_TASK_MICROS, DrainLog);
+
+  // keep the fusion running while we wait so orientation is settled
+  scheduler.Start(sampleTask);
+  scheduler.Start(fusionTask);
+  scheduler.Start(calibrationTask, CALIBRATION_TASK_MICROS);
+  scheduler.Start(powerTask, POWER_TASK_MICROS);
+  scheduler.Start(logTask);
+  scheduler.Start(diagnosticsTask, DIAGNOSTICS_TASK_MICROS);
+  scheduler.Start(ledTask, READY_TO_CONNECT_MICROS);
+
+  // we boot without a Central/Gateway, so start keeping telemetry
+  scheduler.Start(storeTask, FLASH_STORE_PERIOD_MS * 1000UL);
+
+#if TELEMETRY_TRANSPORTS & TRANSPORT_SERIAL
+  scheduler.Start(batchTask);
+  scheduler.Start(featuresTask);
+  scheduler.Start(publishTask, telemetryFrequency * 1000UL);
+#endif
+}
 
-    case GYROSCOPE_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(gyroscopeCharacteristic); 
-      gyroscopeCharacteristic.addDescriptor(gyroscopeCharacteristicDesc);
-      result = true;
-      break;
+/* --------------------------------------------------------------------------
+    Log the jitter and overrun statistics of every task
+   -------------------------------------------------------------------------- */
+void LogSchedulerStats() {
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  for (int task = 0; task < scheduler.TaskCount(); task++) {
+    const TaskStats& stats = scheduler.Stats(task);
+    LOG_INFO("[SCHEDULER] %s runs: %lu overruns: %lu jitter avg/max: %lu/%lu us run max: %lu us",
+      scheduler.TaskName(task),
+      (unsigned long)stats.runs,
+      (unsigned long)stats.overruns,
+      (unsigned long)(stats.runs ? stats.totalJitterMicros / stats.runs : 0),
+      (unsigned long)stats.maxJitterMicros,
+      (unsigned long)stats.maxRunMicros);
+  }
+#endif
+}
 
-    case MAGNETOMETER_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(magnetometerCharacteristic); 
-      magnetometerCharacteristic.addDescriptor(magnetometerCharacteristicDesc);
-      result = true;
-      break;
+/* --------------------------------------------------------------------------
+    Log min/avg/max of every profiled section in microseconds
+   -------------------------------------------------------------------------- */
+void LogProfilerStats() {
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  static const char* const names[PROFILE_SECTION_COUNT] = { "sample", "fusion", "notify", "blePoll", "features", "decimate" };
+  uint32_t cyclesPerMicro = profiler.CounterHz() / 1000000UL;
+  if (cyclesPerMicro == 0)
+    cyclesPerMicro = 1;
+
+  for (int section = 0; section < PROFILE_SECTION_COUNT; section++) {
+    const ProfileSection& stats = profiler.Section(section);
+    if (stats.count == 0)
+      continue;
+    LOG_INFO("[PROFILER] %s count: %lu min/avg/max: %lu/%lu/%lu us",
+      names[section],
+      (unsigned long)stats.count,
+      (unsigned long)(stats.min / cyclesPerMicro),
+      (unsigned long)(stats.total / stats.count / cyclesPerMicro),
+      (unsigned long)(stats.max / cyclesPerMicro));
+  }
+#endif
+}
 
-    case ORIENTATION_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(orientationCharacteristic); 
-      orientationCharacteristic.addDescriptor(orientationCharacteristicDesc);
-      result = true;
-      break;
+/* --------------------------------------------------------------------------
+    Log how many reports each change channel sent and held back
+   -------------------------------------------------------------------------- */
+void LogChangeStats() {
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  static const char* const names[] = { "frame", "accelerometer", "gyroscope", "magnetometer", "orientation", "battery" };
+  const ChangeChannel* channels[] = { &frameChange, &accelerometerChange, &gyroscopeChange, &magnetometerChange, &orientationChange, &batteryChange };
+
+  for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+    LOG_INFO("[CHANGE] %s reported: %lu suppressed: %lu",
+      names[i],
+      (unsigned long)channels[i]->reported,
+      (unsigned long)channels[i]->suppressed);
+  }
+  LOG_INFO("[CHANGE] motion wakes: %lu", (unsigned long)motionDetector.Wakes());
+#endif
+}
 
-    case RGBLED_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(rgbLedCharacteristic); 
-      rgbLedCharacteristic.addDescriptor(rgbLedCharacteristicDesc);
-      rgbLedCharacteristic.setEventHandler(BLEWritten, onRgbLedCharacteristicWrite);
-      result = true;
-      break;
+/* --------------------------------------------------------------------------
+    Log what every telemetry sink sent and failed to send
+   -------------------------------------------------------------------------- */
+void LogTransportStats() {
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  for (int sink = 0; sink < transport.SinkCount(); sink++) {
+    const TransportStats& stats = transport.Stats(sink);
+    LOG_INFO("[TRANSPORT] %s sent: %lu failed: %lu bytes: %lu",
+      transport.SinkName(sink),
+      (unsigned long)stats.sent,
+      (unsigned long)stats.failed,
+      (unsigned long)stats.bytes);
+  }
+#endif
+}
 
-    case DCM_CHARACTERISTIC:
-      blePeripheral.addCharacteristic(dcmCharacteristic); 
-      dcmCharacteristic.addDescriptor(dcmCharacteristicDesc);
-      dcmCharacteristic.setValue(DEVICE_CAPABILITY_MODEL, 256);
-      result = whichCharacteristic;
-      break;
+/* --------------------------------------------------------------------------
+    Log what a subscriber sent, dropped and had refused by its link
+   -------------------------------------------------------------------------- */
+void LogSubscriberStats(int slot) {
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  const SubscriberStats& stats = subscriberHub.Stats(slot);
+  LOG_INFO("[SUBSCRIBER] %d queued: %lu sent: %lu dropped: %lu blocked: %lu",
+    slot,
+    (unsigned long)stats.queued,
+    (unsigned long)stats.sent,
+    (unsigned long)stats.dropped,
+    (unsigned long)stats.blocked);
+#endif
+}
 
-    default:
-      break;
+/* --------------------------------------------------------------------------
+    Connection Tracking, a bit per connection handle the controller has up.
+    The first Central/Gateway brings the device to full rate and starts
+    the telemetry, the last one to leave stops it again, each one in
+    between only takes or frees its subscriber slot
+   -------------------------------------------------------------------------- */
+int ConnectionCount() {
+  int count = 0;
+  for (uint32_t handles = connectedHandles; handles != 0; handles &= handles - 1) {
+    count++;
+  }
+  return count;
+}
+
+void CentralConnected(uint16_t handle) {
+
+  if (ConnectionCount() == 1) {
+    // full rate first, the Central/Gateway is about to subscribe
+    powerManager.Connected();
+    PowerChanged();
+    scheduler.Stop(ledTask);
+    scheduler.Stop(storeTask);
+    linkManager.Connected();
+    UpdateLinkStatus();
+    connectionTracker.Connected();
+    UpdateConnectionStatus();
+    // it may have subscribed already, in the same poll it connected in
+    if (!connectionTracker.Started()) {
+      scheduler.Start(bleStartTask, CONNECTION_START_TIMEOUT_MICROS);
+    }
+    scheduler.Start(subscriberTask);
+    digitalWrite(ONBOARD_LED, HIGH);
+  }
+
+  int slot = subscriberHub.Attach(handle);
+  if (slot != SUBSCRIBER_NO_SLOT) {
+    ResetSubscriberChannels(slot);
+    subscriberFrameSequence[slot] = 0;
+    subscriberCredits[slot] = SUBSCRIBER_NOTIFY_BURST;
+  }
+  UpdateSubscriberStatus();
+
+  LOG_INFO("[STARTED] Connected to central on handle %u, subscriber slot %d, %d connected",
+    handle, slot, ConnectionCount());
+
+  // the controller stops advertising on a connection, the next one is welcome
+  if (subscriberHub.ActiveCount() < SUBSCRIBER_MAX_SLOTS) {
+    BLE.advertise();
+  }
+}
+
+void CentralDisconnected(uint16_t handle) {
+
+  int slot = subscriberHub.Slot(handle);
+  if (slot != SUBSCRIBER_NO_SLOT) {
+    LogSubscriberStats(slot);
   }
-  return result;
+  subscriberHub.Detach(handle);
+  UpdateSubscriberStatus();
+
+  LOG_INFO("[STOPPED] Disconnected from central on handle %u, %d connected", handle, ConnectionCount());
+  if (ConnectionCount() > 0)
+    return;
+
+  StopTelemetry();
+  scheduler.Stop(bleStartTask);
+  scheduler.Stop(subscriberTask);
+  connectionTracker.Disconnected();
+  UpdateConnectionStatus();
+  scheduler.Start(ledTask, READY_TO_CONNECT_MICROS);
+  scheduler.Start(storeTask, FLASH_STORE_PERIOD_MS * 1000UL);
+  backfillActive = false;
+  schemaOffset = 0;
+  StopSchema();
+  linkManager.Disconnected();
+  UpdateLinkStatus();
+  powerManager.Disconnected();
+  PowerChanged();
+  LogSchedulerStats();
+  LogProfilerStats();
+  LogChangeStats();
+  LogTransportStats();
+  scheduler.ResetStats();
+  transport.ResetStats();
+  profiler.Reset();
+
+  digitalWrite(ONBOARD_LED, LOW);
+  SetBuiltInRGB(LOW, LOW, LOW);
+}
 
+void TrackConnections() {
+  for (uint16_t handle = 0; handle < LINK_MAX_HANDLE; handle++) {
+    uint32_t bit = 1UL << handle;
+    bool connected = ATT.connected(handle);
+    if (connected && !(connectedHandles & bit)) {
+      connectedHandles |= bit;
+      CentralConnected(handle);
+    } else if (!connected && (connectedHandles & bit)) {
+      connectedHandles &= ~bit;
+      CentralDisconnected(handle);
+    }
+  }
 }
 
 /* --------------------------------------------------------------------------
@@ -465,87 +2947,62 @@ void setup() {
   pinMode(BLUE_LIGHT_PIN, OUTPUT);
   pinMode(LED_BUILTIN, OUTPUT);
 
-  // initialize serial communication
-  Serial.begin(9600);    
+  // initialize serial communication, the log is drained from loop()
+#if TELEMETRY_TRANSPORTS & TRANSPORT_SERIAL
+  Serial.begin(SERIAL_TRANSPORT_BAUD);
+#else
+  Serial.begin(SERIAL_LOG_BAUD);
+#endif
   //while (!Serial);
+  LogBegin(micros);
+  BeginProfiler();
     
   // begin IMU initialization
   if (!IMU.begin()) {
-    Serial.println("[FAILED] Starting IMU");
-    while (1);
+    LOG_ERROR("[FAILED] Starting IMU");
+    while (1) {
+      DrainLog();
+    }
   } else {
-    Serial.println("[SUCCESS] Starting IMU");
+    LOG_INFO("[SUCCESS] Starting IMU");
     
-    // start the MadgwickAHRS filter to run at the IMU sample rate
-    filter.begin(IMU_HZ);
-    msecsPerReading = 1000000 / IMU_HZ;
-    msecsPrevious = micros();
+    // start the orientation fusion to run at the IMU sample rate
+    fusion.Begin((FusionAlgorithm)FUSION_ALGORITHM, IMU_HZ);
+
+    #if IMU_FIFO_MODE
+      if (imuFifo.Begin(imuBus, (Lsm9ds1FifoMode)IMU_FIFO_MODE, IMU_FIFO_WATERMARK, IMU_HZ)) {
+        LOG_INFO("[SUCCESS] Starting IMU FIFO (mode %d)", IMU_FIFO_MODE);
+      } else {
+        LOG_ERROR("[FAILED] Starting IMU FIFO, polling the IMU instead");
+      }
+    #endif
   }
 
   // begin BLE initialization
   if (!BLE.begin()) {
-    Serial.println("[FAILED] Starting BLE");
-    while (1);
+    LOG_ERROR("[FAILED] Starting BLE");
+    while (1) {
+      DrainLog();
+    }
   } else {
-    Serial.println("[SUCCESS] Starting BLE");
+    LOG_INFO("[SUCCESS] Starting BLE");
   }
+
+  ResetCompactChannels();
+  BeginChangeChannels();
+
+  // until the gateway sets its own, publish no faster than every 100 ms
+  RateBounds rateBounds = { 100, 30000, 1, BATCH_MAX_SAMPLES, -90, 50 };
+  rateController.Begin(rateBounds);
+  BeginFlashStore();
+  BeginCalibration();
+  linkManager.Begin(linkBus, (LinkProfileId)LINK_PROFILE, BATCH_PAYLOAD_SIZE);
+  connectionTracker.Begin(micros);
+  BeginTransport();
   
   // Setup the Characteristics
-  if (!SetUpCharacteristic(VERSION_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->VERSION_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->VERSION_CHARACTERISTIC");
-  }
-  
-  if (!SetUpCharacteristic(BATTERYCHARGED_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->BATTERYCHARGED_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->BATTERYCHARGED_CHARACTERISTIC");
-  }
-
-  if (!SetUpCharacteristic(TELEMETRYFREQUENCY_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->TELEMETRYFREQUENCY_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->TELEMETRYFREQUENCY_CHARACTERISTIC");
-  }
-
-  if (!SetUpCharacteristic(ACCELEROMETER_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->ACCELEROMETER_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->ACCELEROMETER_CHARACTERISTIC");
-  }
-
-  if (!SetUpCharacteristic(GYROSCOPE_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->GYROSCOPE_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->GYROSCOPE_CHARACTERISTIC");
-  }
-
-  if (!SetUpCharacteristic(MAGNETOMETER_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->MAGNETOMETER_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->MAGNETOMETER_CHARACTERISTIC");
-  }
-
-  if (!SetUpCharacteristic(ORIENTATION_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->ORIENTATION_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->ORIENTATION_CHARACTERISTIC");
-  }
-
-  if (!SetUpCharacteristic(RGBLED_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->RGBLED_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->RGBLED_CHARACTERISTIC");
-  }
-
-  if (!SetUpCharacteristic(DCM_CHARACTERISTIC)) {
-    Serial.println("[FAILED] SetUpCharacteristic->DCM_CHARACTERISTIC");
-  } else {
-    Serial.println("[SUCCESS] SetUpCharacteristic->DCM_CHARACTERISTIC");
-  }
+  SetUpCharacteristics();
 
-  
   /* 
     Set a local name for the BLE device
     This name will appear in advertising packets
@@ -560,19 +3017,29 @@ void setup() {
   BLE.setAdvertisedService(blePeripheral);
   BLE.addService(blePeripheral);
 
+  // the GATT table has the attribute handles once the service is added
+  subscriberHub.Begin(subscriberBus);
+  subscriberDataHandle = FindValueHandle(subscriberDataCharacteristic);
+  if (subscriberDataHandle == 0) {
+    LOG_ERROR("[FAILED] Finding the Subscriber Data handle, subscribers get no records");
+  }
+
     /* Start advertising BLE.  It will start continuously transmitting BLE
      advertising packets and will be visible to remote BLE central devices
      until it receives a new connection */
   BLE.advertise();
 
-  readyToConnectDelay = millis();
-  readyToConnectDelayActive = true;
+  SetUpScheduler();
+
+  // no Central/Gateway yet, drop to the advertising rate unless we stream
+  powerManager.Begin(powerBus, TELEMETRY_TRANSPORTS & TRANSPORT_SERIAL);
+  PowerChanged();
 
   // Set leds to idle
   digitalWrite(LED_BUILTIN, HIGH);
   SetBuiltInRGB(HIGH, LOW, HIGH);
 
-  Serial.println("[READY] Bluetooth device active, waiting for connections...");
+  LOG_INFO("[READY] Bluetooth device active, waiting for connections...");
 
   return;
 }
@@ -582,56 +3049,13 @@ void setup() {
    -------------------------------------------------------------------------- */
 void loop() {
 
-  // listen for BLE peripherals to connect:
-  BLEDevice central = BLE.central();
-  
-  if (readyToConnectDelayActive && ((millis() - readyToConnectDelay) >= 1000)) {
-    SetBuiltInRGB(HIGH, HIGH, LOW);
-    readyToConnectDelay = millis();
-    readyToConnectDelayActive = false;
-  }
-  else if (!readyToConnectDelayActive && ((millis() - readyToConnectDelay) >= 1000)) {
-    SetBuiltInRGB(LOW, HIGH, HIGH);
-    readyToConnectDelay = millis();
-    readyToConnectDelayActive = true;
+  // the HCI transport, connections come and go in here
+  {
+    ProfileScope scope(profiler, PROFILE_BLE_POLL);
+    BLE.poll();
   }
+  TrackConnections();
 
-  // if a central is connected to peripheral:
-  if (central) {
-
-    bleStartDelay = millis();
-    bleDelayActive = true;
-    telemetryStartDelay = millis();
-    telemetryDelayActive = true;
-
-    digitalWrite(ONBOARD_LED, HIGH);
-
-    // print the central's MAC address:
-    Serial.print("[STARTED] Connected to central: ");
-    Serial.println(central.address());
-
-    // while the central is still connected to peripheral:
-    while (central.connected()) {
-      
-      if (bleDelayActive && ((millis() - bleStartDelay) >= 5000)) {
-        bleDelayActive = false;
-      }
-
-      if (!bleDelayActive) {
-        if (telemetryDelayActive && ((millis() - telemetryStartDelay) >= telemetryFrequency)) {
-          UpdateBatteryLevel();
-          UpdateIMU();
-          telemetryStartDelay = millis();
-        }
-      }
-
-    }
-
-    // when the central disconnects, print it out:
-    digitalWrite(ONBOARD_LED, LOW);
-    SetBuiltInRGB(LOW, LOW, LOW);
-
-    Serial.print(F("[STOPPED] Disconnected from central: "));
-    Serial.println(central.address());
-  }
+  profiler.CountLoop();
+  scheduler.Run(powerManager.MaxSleepMicros());
 }
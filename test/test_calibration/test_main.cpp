@@ -0,0 +1,377 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the IMU calibration on synthetic distorted
+              data, the ellipsoid and sphere fits, the magnetometer hard and
+              soft iron, the gyro bias at rest, the accelerometer offsets
+              from rest positions and the coefficients kept across a power
+              cycle in a simulated flash page
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ImuCalibration.h>
+#include <EllipsoidFit.h>
+
+#define TEST_PI               3.14159265f
+#define TEST_FIELD            48.0f         // uT, the earth's field
+#define TEST_MAG_POINTS       600
+#define TEST_MAG_TUMBLE        233          // prime, steps through the points out of order
+#define TEST_PAGE_SIZE        512
+
+// hard iron, and a symmetric soft iron that stretches and shears the sphere
+static const float hardIron[3] = { 22.0f, -14.0f, 31.0f };
+static const float softIron[9] = {
+  1.20f, 0.08f, -0.05f,
+  0.08f, 0.92f,  0.06f,
+  -0.05f, 0.06f, 1.05f
+};
+static const float gyroBias[3] = { 1.6f, -0.9f, 0.35f };
+static const float accelOffset[3] = { 0.045f, -0.030f, 0.020f };
+
+static ImuCalibration calibration;
+static uint8_t page[TEST_PAGE_SIZE];
+
+static bool PageRead(uint32_t offset, void* data, size_t length) {
+  if (offset + length > sizeof(page))
+    return false;
+  memcpy(data, &page[offset], length);
+  return true;
+}
+
+static bool PageProgram(uint32_t offset, const void* data, size_t length) {
+  if (offset + length > sizeof(page))
+    return false;
+  for (size_t i = 0; i < length; i++) {
+    page[offset + i] &= ((const uint8_t*)data)[i];
+  }
+  return true;
+}
+
+static bool PageErase(uint32_t index) {
+  if (index != 0)
+    return false;
+  memset(page, 0xFF, sizeof(page));
+  return true;
+}
+
+static const FlashDevice device = { TEST_PAGE_SIZE, 1, PageRead, PageProgram, PageErase };
+
+static float Noise(float amplitude) {
+  return amplitude * (2.0f * rand() / RAND_MAX - 1.0f);
+}
+
+static float Length(const float v[3]) {
+  return sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+/* --------------------------------------------------------------------------
+    What the magnetometer reads for the n-th of count directions spread
+    evenly over the sphere (a Fibonacci lattice), through the soft iron
+    and with the hard iron on top
+   -------------------------------------------------------------------------- */
+static void Distorted(int n, int count, float noise, float reading[3]) {
+  float z = 1.0f - 2.0f * (n + 0.5f) / count;
+  float r = sqrtf(1.0f - z * z);
+  float angle = n * TEST_PI * (3.0f - sqrtf(5.0f));
+  float field[3] = { TEST_FIELD * r * cosf(angle), TEST_FIELD * r * sinf(angle), TEST_FIELD * z };
+  for (int i = 0; i < 3; i++) {
+    reading[i] = softIron[i * 3] * field[0] + softIron[i * 3 + 1] * field[1] + softIron[i * 3 + 2] * field[2] +
+      hardIron[i] + Noise(noise);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    A block of rest (or shaken) samples with gravity along down, the gyro
+    bias and the accel offset on top
+   -------------------------------------------------------------------------- */
+static void Block(const float down[3], float shake, Lsm9ds1FifoSample* samples, size_t count) {
+  float length = Length(down);
+  for (size_t n = 0; n < count; n++) {
+    samples[n].timestampMicros = (uint32_t)n * 8403;
+    for (int i = 0; i < 3; i++) {
+      samples[n].acceleration[i] = down[i] / length + accelOffset[i] + Noise(0.002f) + Noise(shake * 0.1f);
+      samples[n].gyroscope[i] = gyroBias[i] + Noise(0.05f) + Noise(shake * 20.0f);
+    }
+  }
+}
+
+static void Hold(const float down[3], int windows) {
+  Lsm9ds1FifoSample samples[CALIBRATION_REST_SAMPLES];
+  for (int window = 0; window < windows; window++) {
+    Block(down, 0.0f, samples, CALIBRATION_REST_SAMPLES);
+    calibration.Correct(samples, CALIBRATION_REST_SAMPLES);
+  }
+}
+
+// the six faces and two corners, every one over 30 degrees from the rest
+static const float positions[8][3] = {
+  { 0, 0, 1 }, { 0, 0, -1 }, { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 1, 1, 1 }, { -1, -1, 1 }
+};
+
+void setUp(void) {
+  srand(11);
+  memset(page, 0xFF, sizeof(page));
+  calibration.Begin();
+}
+
+void tearDown(void) {
+}
+
+void test_ellipsoid_fit_recovers_hard_and_soft_iron(void) {
+  EllipsoidFit fit;
+  fit.Reset(CALIBRATION_MAG_SCALE);
+  float readings[TEST_MAG_POINTS][3];
+  for (int n = 0; n < TEST_MAG_POINTS; n++) {
+    Distorted(n, TEST_MAG_POINTS, 0.3f, readings[n]);
+    fit.Add(readings[n]);
+  }
+
+  float center[3];
+  float correction[9];
+  float radius, ratio;
+  TEST_ASSERT_TRUE(fit.Solve(center, correction, radius, ratio));
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.3f, hardIron[i], center[i]);
+  }
+
+  // the correction undoes the soft iron up to the geometric mean scale
+  float scale = radius / TEST_FIELD;
+  for (int row = 0; row < 3; row++) {
+    for (int column = 0; column < 3; column++) {
+      float product = 0;
+      for (int k = 0; k < 3; k++) {
+        product += correction[row * 3 + k] * softIron[k * 3 + column];
+      }
+      TEST_ASSERT_FLOAT_WITHIN(0.01f, row == column ? scale : 0.0f, product);
+    }
+  }
+
+  // and every reading lands on the sphere
+  for (int n = 0; n < TEST_MAG_POINTS; n++) {
+    float d[3] = { readings[n][0] - center[0], readings[n][1] - center[1], readings[n][2] - center[2] };
+    float corrected[3];
+    for (int i = 0; i < 3; i++) {
+      corrected[i] = correction[i * 3] * d[0] + correction[i * 3 + 1] * d[1] + correction[i * 3 + 2] * d[2];
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.02f * radius, radius, Length(corrected));
+  }
+  TEST_ASSERT_GREATER_THAN_FLOAT(1.2f, ratio);
+  TEST_ASSERT_LESS_THAN_FLOAT(1.6f, ratio);
+}
+
+void test_ellipsoid_fit_needs_an_ellipsoid(void) {
+  EllipsoidFit fit;
+  fit.Reset(CALIBRATION_MAG_SCALE);
+  float center[3];
+  float correction[9];
+  float radius, ratio;
+
+  // a turn about z only is a circle, not an ellipsoid
+  for (int n = 0; n < 200; n++) {
+    float angle = 2.0f * TEST_PI * n / 200;
+    float point[3] = { 30.0f * cosf(angle) + 5.0f, 30.0f * sinf(angle), 10.0f };
+    fit.Add(point);
+  }
+  TEST_ASSERT_FALSE(fit.Solve(center, correction, radius, ratio));
+}
+
+void test_sphere_fit_finds_accel_offset(void) {
+  float points[8][3];
+  for (int n = 0; n < 8; n++) {
+    float length = Length(positions[n]);
+    for (int i = 0; i < 3; i++) {
+      points[n][i] = positions[n][i] / length + accelOffset[i];
+    }
+  }
+
+  float center[3];
+  float radius;
+  TEST_ASSERT_TRUE(SphereFit(points, 8, center, radius));
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, accelOffset[i], center[i]);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f, radius);
+
+  // three points do not pin a sphere down
+  TEST_ASSERT_FALSE(SphereFit(points, 3, center, radius));
+}
+
+void test_magnetometer_calibrated_by_rotating(void) {
+  float worst = 0;
+
+  // tumbled in figure eights, the directions come in no particular order
+  for (int n = 0; n < TEST_MAG_POINTS; n++) {
+    float reading[3];
+    Distorted(n * TEST_MAG_TUMBLE % TEST_MAG_POINTS, TEST_MAG_POINTS, 0.3f, reading);
+    calibration.CorrectMagnetometer(reading);
+    calibration.Update();
+  }
+  const CalibrationCoefficients& c = calibration.Coefficients();
+  TEST_ASSERT_TRUE(c.flags & CALIBRATION_MAGNETOMETER);
+  TEST_ASSERT_EQUAL_UINT8(100, calibration.MagnetometerCoverage());
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, hardIron[i], c.magOffset[i]);
+  }
+
+  // a second lap comes out on the fitted sphere
+  for (int n = 0; n < TEST_MAG_POINTS; n += 7) {
+    float reading[3];
+    Distorted(n, TEST_MAG_POINTS, 0.0f, reading);
+    calibration.CorrectMagnetometer(reading);
+    float error = fabsf(Length(reading) - c.magField) / c.magField;
+    worst = error > worst ? error : worst;
+  }
+  TEST_ASSERT_LESS_THAN_FLOAT(0.02f, worst);
+}
+
+void test_magnetometer_waits_for_coverage(void) {
+  // turned flat on a table, the fit never sees the top or the bottom
+  for (int n = 0; n < TEST_MAG_POINTS; n++) {
+    float angle = 2.0f * TEST_PI * n / 100;
+    float reading[3] = { 20.0f * cosf(angle) + hardIron[0], 20.0f * sinf(angle) + hardIron[1], -43.0f + hardIron[2] };
+    calibration.CorrectMagnetometer(reading);
+    calibration.Update();
+  }
+  TEST_ASSERT_FALSE(calibration.Coefficients().flags & CALIBRATION_MAGNETOMETER);
+  TEST_ASSERT_LESS_THAN(CALIBRATION_MAG_MIN_BINS * 100 / CALIBRATION_MAG_BINS, calibration.MagnetometerCoverage());
+}
+
+void test_gyro_bias_only_at_rest(void) {
+  Lsm9ds1FifoSample samples[CALIBRATION_REST_SAMPLES];
+  const float flat[3] = { 0, 0, 1 };
+
+  // shaken, nothing is learned
+  Block(flat, 1.0f, samples, CALIBRATION_REST_SAMPLES);
+  calibration.Correct(samples, CALIBRATION_REST_SAMPLES);
+  TEST_ASSERT_FALSE(calibration.AtRest());
+  TEST_ASSERT_FALSE(calibration.Coefficients().flags & CALIBRATION_GYROSCOPE);
+
+  // still, the bias is the mean of the window and comes out of the samples
+  Hold(flat, 4);
+  TEST_ASSERT_TRUE(calibration.AtRest());
+  TEST_ASSERT_TRUE(calibration.Coefficients().flags & CALIBRATION_GYROSCOPE);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, gyroBias[i], calibration.Coefficients().gyroBias[i]);
+  }
+
+  Block(flat, 0.0f, samples, CALIBRATION_REST_SAMPLES);
+  calibration.Correct(samples, CALIBRATION_REST_SAMPLES);
+  for (int n = 0; n < CALIBRATION_REST_SAMPLES; n++) {
+    for (int i = 0; i < 3; i++) {
+      TEST_ASSERT_FLOAT_WITHIN(0.1f, 0.0f, samples[n].gyroscope[i]);
+    }
+  }
+}
+
+void test_accel_offset_from_rest_positions(void) {
+  // one short of the positions needed, no offsets yet
+  for (int n = 0; n < CALIBRATION_ACCEL_MIN_POSITIONS - 1; n++) {
+    Hold(positions[n], 2);
+    calibration.Update();
+  }
+  TEST_ASSERT_EQUAL_UINT8(CALIBRATION_ACCEL_MIN_POSITIONS - 1, calibration.AccelerometerPositions());
+  TEST_ASSERT_FALSE(calibration.Coefficients().flags & CALIBRATION_ACCELEROMETER);
+
+  for (int n = CALIBRATION_ACCEL_MIN_POSITIONS - 1; n < 8; n++) {
+    Hold(positions[n], 2);
+    calibration.Update();
+  }
+  TEST_ASSERT_EQUAL_UINT8(8, calibration.AccelerometerPositions());
+  TEST_ASSERT_TRUE(calibration.Coefficients().flags & CALIBRATION_ACCELEROMETER);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.003f, accelOffset[i], calibration.Coefficients().accelOffset[i]);
+  }
+
+  // the corrected samples are 1 g long
+  Lsm9ds1FifoSample samples[CALIBRATION_REST_SAMPLES];
+  Block(positions[6], 0.0f, samples, CALIBRATION_REST_SAMPLES);
+  calibration.Correct(samples, CALIBRATION_REST_SAMPLES);
+  for (int n = 0; n < CALIBRATION_REST_SAMPLES; n++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.0f, Length(samples[n].acceleration));
+  }
+}
+
+void test_coefficients_round_trip(void) {
+  CalibrationCoefficients coefficients;
+  CalibrationCoefficients decoded;
+  CalibrationIdentity(coefficients);
+  coefficients.flags = CALIBRATION_GYROSCOPE | CALIBRATION_MAGNETOMETER;
+  memcpy(coefficients.gyroBias, gyroBias, sizeof(gyroBias));
+  memcpy(coefficients.magOffset, hardIron, sizeof(hardIron));
+  memcpy(coefficients.magSoftIron, softIron, sizeof(softIron));
+  coefficients.magField = TEST_FIELD;
+
+  uint8_t buffer[CALIBRATION_PAYLOAD_SIZE];
+  TEST_ASSERT_EQUAL(CALIBRATION_PAYLOAD_SIZE, EncodeCalibration(coefficients, buffer));
+  TEST_ASSERT_TRUE(DecodeCalibration(buffer, sizeof(buffer), decoded));
+  TEST_ASSERT_EQUAL_MEMORY(&coefficients.gyroBias, &decoded.gyroBias, sizeof(coefficients.gyroBias));
+  TEST_ASSERT_EQUAL_MEMORY(&coefficients.magSoftIron, &decoded.magSoftIron, sizeof(coefficients.magSoftIron));
+  TEST_ASSERT_EQUAL_UINT8(coefficients.flags, decoded.flags);
+
+  TEST_ASSERT_FALSE(DecodeCalibration(buffer, sizeof(buffer) - 1, decoded));
+  buffer[0] = CALIBRATION_VERSION + 1;
+  TEST_ASSERT_FALSE(DecodeCalibration(buffer, sizeof(buffer), decoded));
+}
+
+void test_saved_across_power_cycle(void) {
+  const float flat[3] = { 0, 0, 1 };
+  TEST_ASSERT_TRUE(calibration.Begin(device));
+  TEST_ASSERT_FALSE(calibration.Dirty());
+
+  Hold(flat, 2);
+  TEST_ASSERT_TRUE(calibration.Dirty());
+  TEST_ASSERT_TRUE(calibration.Save());
+  TEST_ASSERT_FALSE(calibration.Dirty());
+
+  ImuCalibration restarted;
+  TEST_ASSERT_TRUE(restarted.Begin(device));
+  TEST_ASSERT_EQUAL_UINT8(CALIBRATION_GYROSCOPE, restarted.Coefficients().flags);
+  TEST_ASSERT_EQUAL_MEMORY(calibration.Coefficients().gyroBias, restarted.Coefficients().gyroBias, sizeof(gyroBias));
+  TEST_ASSERT_FALSE(restarted.Dirty());
+}
+
+void test_save_wraps_page_and_skips_torn_slot(void) {
+  const float flat[3] = { 0, 0, 1 };
+  TEST_ASSERT_TRUE(calibration.Begin(device));
+  Hold(flat, 2);
+
+  // more saves than the page has slots, the page is erased and starts over
+  int slots = TEST_PAGE_SIZE / CALIBRATION_SLOT_SIZE;
+  uint32_t saves = calibration.Saves();
+  for (int save = 0; save < slots + 2; save++) {
+    TEST_ASSERT_TRUE(calibration.Save());
+  }
+  TEST_ASSERT_EQUAL_UINT32(slots + 2, calibration.Saves() - saves);
+  TEST_ASSERT_EQUAL_HEX8(0xFF, page[2 * CALIBRATION_SLOT_SIZE]);
+
+  // a slot torn by a power loss fails its crc, the one before it wins
+  float saved = calibration.Coefficients().gyroBias[0];
+  Hold(positions[2], 2);
+  TEST_ASSERT_TRUE(calibration.Coefficients().gyroBias[0] != saved);
+  TEST_ASSERT_TRUE(calibration.Save());
+  page[2 * CALIBRATION_SLOT_SIZE + 4 + 10] = 0x00;
+
+  ImuCalibration restarted;
+  TEST_ASSERT_TRUE(restarted.Begin(device));
+  TEST_ASSERT_EQUAL_FLOAT(saved, restarted.Coefficients().gyroBias[0]);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ellipsoid_fit_recovers_hard_and_soft_iron);
+  RUN_TEST(test_ellipsoid_fit_needs_an_ellipsoid);
+  RUN_TEST(test_sphere_fit_finds_accel_offset);
+  RUN_TEST(test_magnetometer_calibrated_by_rotating);
+  RUN_TEST(test_magnetometer_waits_for_coverage);
+  RUN_TEST(test_gyro_bias_only_at_rest);
+  RUN_TEST(test_accel_offset_from_rest_positions);
+  RUN_TEST(test_coefficients_round_trip);
+  RUN_TEST(test_saved_across_power_cycle);
+  RUN_TEST(test_save_wraps_page_and_skips_torn_slot);
+  return UNITY_END();
+}
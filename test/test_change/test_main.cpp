@@ -0,0 +1,260 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for report on change, a still, shake, still trace
+              replayed through the frame's ChangeChannel and the
+              MotionDetector at the default ChangeConfig, and the bytes it
+              saves against notifying the frame on every tick
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ChangeDetector.h>
+#include <TelemetryFrame.h>
+
+#define TEST_PI               3.14159265f
+#define TEST_RATE_HZ          119
+#define TEST_STILL_SECONDS    20
+#define TEST_SHAKE_SECONDS    10
+#define TEST_SAMPLES          (TEST_RATE_HZ * (2 * TEST_STILL_SECONDS + TEST_SHAKE_SECONDS))
+#define TEST_SHAKE_START      (TEST_RATE_HZ * TEST_STILL_SECONDS)
+#define TEST_SHAKE_END        (TEST_SHAKE_START + TEST_RATE_HZ * TEST_SHAKE_SECONDS)
+
+// the default ChangeConfig of the sketch, { 20, 200, 100, 17, 30, 50, 2000, 100, 1 }
+#define TEST_ACCELERATION     0.020f
+#define TEST_GYROSCOPE        2.0f
+#define TEST_MAGNETOMETER     1.0f
+#define TEST_ORIENTATION      0.017f
+#define TEST_HEARTBEAT        30000000UL
+#define TEST_MOTION           0.050f
+#define TEST_HOLD             2000000UL
+#define TEST_MOTION_PERIOD    100000UL
+#define TEST_IDLE_PERIOD      1500000UL
+
+struct TestReplay {
+  uint32_t  ticks;
+  uint32_t  reports;
+  uint32_t  shakeTicks;
+  uint32_t  shakeReports;
+  uint32_t  maxSilenceMicros;
+  uint32_t  movingMicros;
+  uint32_t  idleMicros;
+};
+
+static float trace[TEST_SAMPLES][12];
+static ChangeChannel frameChange;
+static MotionDetector motionDetector;
+
+static uint32_t SampleMicros(int sample) {
+  return (uint32_t)((uint64_t)sample * 1000000UL / TEST_RATE_HZ);
+}
+
+// uniform noise within +-amplitude, a still device never strays further
+static float Noise(float amplitude) {
+  return amplitude * (2.0f * rand() / RAND_MAX - 1.0f);
+}
+
+/* --------------------------------------------------------------------------
+    Lying flat with the LSM9DS1 noise, then shaken up and down at 2 Hz
+    while turning about z, then flat again. Accel, gyro, mag, orientation
+    in TelemetryFrame order
+   -------------------------------------------------------------------------- */
+static void BuildTrace() {
+  srand(7);
+  for (int n = 0; n < TEST_SAMPLES; n++) {
+    float t = n / (float)TEST_RATE_HZ;
+    bool shaking = n >= TEST_SHAKE_START && n < TEST_SHAKE_END;
+    float shake = shaking ? 0.3f * sinf(2.0f * TEST_PI * 2.0f * t) : 0.0f;
+    float turn = shaking ? 90.0f * sinf(2.0f * TEST_PI * 0.5f * t) : 0.0f;
+    float yaw = shaking ? 0.5f * (1.0f - cosf(2.0f * TEST_PI * 0.5f * t)) : 0.0f;
+    float* v = trace[n];
+
+    v[0] = Noise(0.002f);
+    v[1] = Noise(0.002f);
+    v[2] = 1.0f + shake + Noise(0.002f);
+    v[3] = Noise(0.1f);
+    v[4] = Noise(0.1f);
+    v[5] = turn + Noise(0.1f);
+    v[6] = 30.0f * cosf(yaw) + Noise(0.3f);
+    v[7] = -30.0f * sinf(yaw) + Noise(0.3f);
+    v[8] = -40.0f + Noise(0.3f);
+    v[9] = yaw + Noise(0.002f);
+    v[10] = Noise(0.002f);
+    v[11] = Noise(0.002f);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    The sketch's loop over the trace, the MotionDetector sees every sample
+    and a tick comes every motion period while moving and every telemetry
+    period while idle. fixedPeriod > 0 ticks at that instead and reports
+    every tick, the way the frame went out before report on change
+   -------------------------------------------------------------------------- */
+static TestReplay Replay(uint32_t fixedPeriod) {
+  TestReplay replay = { 0, 0, 0, 0, 0, 0, 0 };
+  uint32_t lastTick = 0;
+  uint32_t lastReport = 0;
+
+  for (int n = 0; n < TEST_SAMPLES; n++) {
+    uint32_t now = SampleMicros(n);
+    const float* v = trace[n];
+    motionDetector.Update(v[0], v[1], v[2], now);
+
+    uint32_t step = SampleMicros(n + 1) - now;
+    if (motionDetector.Moving()) {
+      replay.movingMicros += step;
+    } else {
+      replay.idleMicros += step;
+    }
+
+    uint32_t period = fixedPeriod;
+    if (period == 0) {
+      period = motionDetector.Moving() ? TEST_MOTION_PERIOD : TEST_IDLE_PERIOD;
+    }
+    if (n > 0 && now - lastTick < period)
+      continue;
+    lastTick = now;
+
+    bool shaking = n >= TEST_SHAKE_START && n < TEST_SHAKE_END;
+    replay.ticks++;
+    replay.shakeTicks += shaking ? 1 : 0;
+    if (fixedPeriod == 0 && !ChangeShouldReport(frameChange, v, 12, now))
+      continue;
+
+    ChangeCommit(frameChange, v, 12, now);
+    if (replay.reports > 0 && now - lastReport > replay.maxSilenceMicros) {
+      replay.maxSilenceMicros = now - lastReport;
+    }
+    lastReport = now;
+    replay.reports++;
+    replay.shakeReports += shaking ? 1 : 0;
+  }
+  return replay;
+}
+
+void setUp(void) {
+  ChangeChannelBegin(frameChange, TEST_ACCELERATION, TEST_HEARTBEAT);
+  ChangeChannelSetDeadband(frameChange, 3, 3, TEST_GYROSCOPE);
+  ChangeChannelSetDeadband(frameChange, 6, 3, TEST_MAGNETOMETER);
+  ChangeChannelSetDeadband(frameChange, 9, 3, TEST_ORIENTATION);
+  motionDetector = MotionDetector();
+  motionDetector.Begin(TEST_MOTION, TEST_HOLD);
+}
+
+void tearDown(void) {
+}
+
+void test_first_value_always_reported(void) {
+  TEST_ASSERT_TRUE(ChangeShouldReport(frameChange, trace[0], 12, 0));
+  ChangeCommit(frameChange, trace[0], 12, 0);
+  TEST_ASSERT_FALSE(ChangeShouldReport(frameChange, trace[1], 12, 10000));
+  TEST_ASSERT_EQUAL_UINT32(1, frameChange.suppressed);
+
+  ChangeChannelReset(frameChange);
+  TEST_ASSERT_TRUE(ChangeShouldReport(frameChange, trace[1], 12, 10000));
+}
+
+void test_deadband_per_axis_units(void) {
+  float values[12] = { 0 };
+  ChangeCommit(frameChange, values, 12, 0);
+
+  // a gyro move inside its own deadband but over the accel one stays quiet
+  values[4] = 1.5f;
+  TEST_ASSERT_FALSE(ChangeShouldReport(frameChange, values, 12, 1000));
+  values[4] = 2.5f;
+  TEST_ASSERT_TRUE(ChangeShouldReport(frameChange, values, 12, 1000));
+
+  // and the other way round for the orientation
+  values[4] = 0.0f;
+  values[10] = 0.018f;
+  TEST_ASSERT_TRUE(ChangeShouldReport(frameChange, values, 12, 1000));
+}
+
+void test_heartbeat_ends_silence(void) {
+  ChangeCommit(frameChange, trace[0], 12, 0);
+  TEST_ASSERT_FALSE(ChangeShouldReport(frameChange, trace[0], 12, TEST_HEARTBEAT - 1));
+  TEST_ASSERT_TRUE(ChangeShouldReport(frameChange, trace[0], 12, TEST_HEARTBEAT));
+
+  // across the micros() wrap too
+  ChangeCommit(frameChange, trace[0], 12, 0xFFFFFFFFUL - 1000);
+  TEST_ASSERT_FALSE(ChangeShouldReport(frameChange, trace[0], 12, 1000));
+  TEST_ASSERT_TRUE(ChangeShouldReport(frameChange, trace[0], 12, TEST_HEARTBEAT - 1001));
+}
+
+void test_motion_detector_wakes_and_holds(void) {
+  int wokeAt = -1;
+  int sleptAt = -1;
+  for (int n = 0; n < TEST_SAMPLES; n++) {
+    if (motionDetector.Update(trace[n][0], trace[n][1], trace[n][2], SampleMicros(n))) {
+      if (motionDetector.Moving() && wokeAt < 0) {
+        wokeAt = n;
+      } else if (!motionDetector.Moving()) {
+        sleptAt = n;
+      }
+    }
+  }
+
+  // a tenth of a second into the shake, and the hold after its last motion
+  TEST_ASSERT_EQUAL_UINT32(1, motionDetector.Wakes());
+  TEST_ASSERT_GREATER_OR_EQUAL(TEST_SHAKE_START, wokeAt);
+  TEST_ASSERT_LESS_THAN(TEST_SHAKE_START + TEST_RATE_HZ / 10, wokeAt);
+  TEST_ASSERT_GREATER_OR_EQUAL(TEST_SHAKE_END - TEST_RATE_HZ / 2 + (int)(TEST_RATE_HZ * TEST_HOLD / 1000000UL), sleptAt);
+  TEST_ASSERT_LESS_THAN(TEST_SHAKE_END + (int)(TEST_RATE_HZ * TEST_HOLD / 1000000UL) + TEST_RATE_HZ / 10, sleptAt);
+}
+
+void test_still_reports_heartbeats_only(void) {
+  TestReplay replay = Replay(0);
+
+  // the first frame, a heartbeat per 30 s of each still stretch and the
+  // few frames of the shake settling
+  uint32_t stillReports = replay.reports - replay.shakeReports;
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(1 + 2 * (TEST_STILL_SECONDS * 1000000UL / TEST_HEARTBEAT + 1) + 3, stillReports);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(TEST_HEARTBEAT + TEST_IDLE_PERIOD, replay.maxSilenceMicros);
+}
+
+void test_shake_reported_at_full_rate(void) {
+  TestReplay replay = Replay(0);
+
+  // every motion tick of the shake is a change, none of it is lost
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(TEST_SHAKE_SECONDS * 1000000UL / TEST_MOTION_PERIOD - 2, replay.shakeTicks);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(replay.shakeTicks - 1, replay.shakeReports);
+}
+
+void test_replay_bytes_saved(void) {
+  TestReplay fixed = Replay(TEST_MOTION_PERIOD);
+  setUp();
+  TestReplay change = Replay(0);
+
+  uint32_t fixedBytes = fixed.reports * TELEMETRY_FRAME_SIZE;
+  uint32_t changeBytes = change.reports * TELEMETRY_FRAME_SIZE;
+  float saved = 100.0f * (fixedBytes - changeBytes) / fixedBytes;
+
+  char message[160];
+  snprintf(message, sizeof(message),
+    "fixed %lu frames %lu bytes, on change %lu frames %lu bytes, %.1f%% saved, moving %.1f s idle %.1f s",
+    (unsigned long)fixed.reports, (unsigned long)fixedBytes,
+    (unsigned long)change.reports, (unsigned long)changeBytes, saved,
+    change.movingMicros / 1e6f, change.idleMicros / 1e6f);
+  TEST_MESSAGE(message);
+
+  // the shake and its hold are a quarter of the trace, the rest goes quiet
+  TEST_ASSERT_GREATER_THAN_FLOAT(70.0f, saved);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(fixed.shakeReports - 1, change.shakeReports);
+}
+
+int main(void) {
+  BuildTrace();
+  UNITY_BEGIN();
+  RUN_TEST(test_first_value_always_reported);
+  RUN_TEST(test_deadband_per_axis_units);
+  RUN_TEST(test_heartbeat_ends_silence);
+  RUN_TEST(test_motion_detector_wakes_and_holds);
+  RUN_TEST(test_still_reports_heartbeats_only);
+  RUN_TEST(test_shake_reported_at_full_rate);
+  RUN_TEST(test_replay_bytes_saved);
+  return UNITY_END();
+}
@@ -0,0 +1,181 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the compact telemetry codec, every encoding
+              decoded within CompactErrorBound of the float it came from,
+              keyframes and the delta state kept in step across the link
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <math.h>
+#include <CompactCodec.h>
+#include <CompactFrame.h>
+
+#define TEST_RECORDS          500
+#define TEST_KEYFRAME         16
+
+static CompactChannel encoder;
+static CompactChannel decoder;
+
+// a slow gyro like sweep with a little jitter, well inside the full scale
+static void Signal(int record, float values[3]) {
+  float t = record * 0.01f;
+  values[0] = 250.0f * sinf(t);
+  values[1] = -120.0f * cosf(t * 0.7f) + 0.3f * (record % 5);
+  values[2] = 40.0f * sinf(t * 1.3f + 0.5f);
+}
+
+static void RoundTrip(TelemetryEncoding encoding) {
+  for (int record = 0; record < TEST_RECORDS; record++) {
+    float values[3];
+    float decoded[3];
+    uint8_t buffer[COMPACT_MAX_VECTOR_SIZE];
+    Signal(record, values);
+
+    size_t length = CompactEncodeVector(encoder, encoding, values, 3, buffer);
+    TEST_ASSERT_EQUAL(length, CompactDecodeVector(decoder, buffer, length, decoded, 3));
+    for (int i = 0; i < 3; i++) {
+      TEST_ASSERT_FLOAT_WITHIN(CompactErrorBound(encoding, COMPACT_SCALE_GYROSCOPE, values[i]), values[i], decoded[i]);
+    }
+  }
+}
+
+void setUp(void) {
+  CompactChannelBegin(encoder, COMPACT_SCALE_GYROSCOPE, TEST_KEYFRAME);
+  CompactChannelBegin(decoder, COMPACT_SCALE_GYROSCOPE, TEST_KEYFRAME);
+}
+
+void tearDown(void) {
+}
+
+void test_float32_within_bound(void) {
+  RoundTrip(ENCODING_FLOAT32);
+}
+
+void test_int16_within_bound(void) {
+  RoundTrip(ENCODING_INT16);
+}
+
+void test_half_within_bound(void) {
+  RoundTrip(ENCODING_HALF);
+}
+
+void test_delta8_within_bound(void) {
+  RoundTrip(ENCODING_DELTA8);
+}
+
+void test_delta8_sizes_and_keyframes(void) {
+  float values[3] = { 1.0f, 2.0f, 3.0f };
+  uint8_t buffer[COMPACT_MAX_VECTOR_SIZE];
+
+  // a keyframe is INT16, then deltas of a byte per axis until the interval
+  TEST_ASSERT_EQUAL(1 + 3 * 2, CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer));
+  TEST_ASSERT_TRUE(buffer[0] & COMPACT_KEYFRAME_FLAG);
+  for (int record = 1; record <= TEST_KEYFRAME; record++) {
+    TEST_ASSERT_EQUAL(1 + 3, CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer));
+    TEST_ASSERT_FALSE(buffer[0] & COMPACT_KEYFRAME_FLAG);
+  }
+  CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer);
+  TEST_ASSERT_TRUE(buffer[0] & COMPACT_KEYFRAME_FLAG);
+
+  // a step too large for an int8 delta goes out as a keyframe
+  values[0] = 1500.0f;
+  CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer);
+  CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer);
+  TEST_ASSERT_FALSE(buffer[0] & COMPACT_KEYFRAME_FLAG);
+  values[0] = -1500.0f;
+  CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer);
+  TEST_ASSERT_TRUE(buffer[0] & COMPACT_KEYFRAME_FLAG);
+}
+
+void test_delta8_without_keyframe_is_refused(void) {
+  float values[3] = { 10.0f, 20.0f, 30.0f };
+  float decoded[3];
+  uint8_t buffer[COMPACT_MAX_VECTOR_SIZE];
+
+  CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer);
+  size_t length = CompactEncodeVector(encoder, ENCODING_DELTA8, values, 3, buffer);
+  TEST_ASSERT_EQUAL(0, CompactDecodeVector(decoder, buffer, length, decoded, 3));
+}
+
+void test_delta8_record_not_sent_keeps_the_link_in_step(void) {
+  float values[3];
+  float decoded[3];
+  uint8_t buffer[COMPACT_MAX_VECTOR_SIZE];
+
+  for (int record = 0; record < TEST_RECORDS; record++) {
+    Signal(record, values);
+
+    // every third record the link refuses, only a sent record moves the state
+    CompactChannel next = encoder;
+    size_t length = CompactEncodeVector(next, ENCODING_DELTA8, values, 3, buffer);
+    if (record % 3 == 2)
+      continue;
+    encoder = next;
+
+    TEST_ASSERT_EQUAL(length, CompactDecodeVector(decoder, buffer, length, decoded, 3));
+    for (int i = 0; i < 3; i++) {
+      TEST_ASSERT_FLOAT_WITHIN(CompactErrorBound(ENCODING_DELTA8, COMPACT_SCALE_GYROSCOPE, values[i]), values[i], decoded[i]);
+    }
+  }
+}
+
+void test_half_conversion(void) {
+  TEST_ASSERT_EQUAL_HEX16(0x3C00, FloatToHalf(1.0f));
+  TEST_ASSERT_EQUAL_HEX16(0xC000, FloatToHalf(-2.0f));
+  TEST_ASSERT_EQUAL_HEX16(0x7C00, FloatToHalf(1.0e6f));
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, HalfToFloat(FloatToHalf(0.5f)));
+  TEST_ASSERT_EQUAL_FLOAT(65504.0f, HalfToFloat(0x7BFF));
+}
+
+void test_compact_frame_round_trips(void) {
+  CompactChannel encoders[COMPACT_FRAME_CHANNEL_COUNT];
+  CompactChannel decoders[COMPACT_FRAME_CHANNEL_COUNT];
+  CompactFrameChannelsBegin(encoders, TEST_KEYFRAME);
+  CompactFrameChannelsBegin(decoders, TEST_KEYFRAME);
+
+  TelemetryFrame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.version = TELEMETRY_FRAME_VERSION;
+  for (int record = 0; record < TEST_RECORDS; record++) {
+    frame.sequence = (uint16_t)record;
+    frame.timestampMicros = record * 8403UL;
+    Signal(record, frame.gyroscope);
+    for (int i = 0; i < 3; i++) {
+      frame.acceleration[i] = frame.gyroscope[i] / 1000.0f;
+      frame.magnetometer[i] = frame.gyroscope[i] / 5.0f;
+      frame.orientation[i] = frame.gyroscope[i] / 100.0f;
+    }
+
+    uint8_t buffer[COMPACT_FRAME_MAX_SIZE];
+    size_t length = EncodeCompactTelemetryFrame(frame, encoders, ENCODING_DELTA8, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+
+    TelemetryFrame decoded;
+    TEST_ASSERT_TRUE(DecodeCompactTelemetryFrame(buffer, length, decoders, decoded));
+    TEST_ASSERT_EQUAL_UINT16(frame.sequence, decoded.sequence);
+    TEST_ASSERT_EQUAL_UINT32(frame.timestampMicros, decoded.timestampMicros);
+    for (int i = 0; i < 3; i++) {
+      TEST_ASSERT_FLOAT_WITHIN(CompactErrorBound(ENCODING_DELTA8, COMPACT_SCALE_GYROSCOPE, frame.gyroscope[i]),
+        frame.gyroscope[i], decoded.gyroscope[i]);
+      TEST_ASSERT_FLOAT_WITHIN(CompactErrorBound(ENCODING_DELTA8, COMPACT_SCALE_ACCELERATION, frame.acceleration[i]),
+        frame.acceleration[i], decoded.acceleration[i]);
+    }
+  }
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_float32_within_bound);
+  RUN_TEST(test_int16_within_bound);
+  RUN_TEST(test_half_within_bound);
+  RUN_TEST(test_delta8_within_bound);
+  RUN_TEST(test_delta8_sizes_and_keyframes);
+  RUN_TEST(test_delta8_without_keyframe_is_refused);
+  RUN_TEST(test_delta8_record_not_sent_keeps_the_link_in_step);
+  RUN_TEST(test_half_conversion);
+  RUN_TEST(test_compact_frame_round_trips);
+  return UNITY_END();
+}
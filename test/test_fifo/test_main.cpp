@@ -0,0 +1,345 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the Lsm9ds1Fifo driver against a register level
+              mock of the LSM9DS1: the FIFO set up and torn down, burst
+              drains, the watermark, overruns, timestamps on a sensor off
+              its nominal rate and bus errors
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <string.h>
+#include <Lsm9ds1Fifo.h>
+
+#define TEST_ODR_HZ           119.0f
+#define TEST_PERIOD_MICROS    ((uint32_t)(1000000.0f / TEST_ODR_HZ))
+
+/* --------------------------------------------------------------------------
+    Register level LSM9DS1 mock, a 32 slot FIFO of gyro and accel words read
+    through the output registers, a slot is popped once its accel word is
+    read. The register files are 128 bytes for the accel/gyro and the
+    magnetometer
+   -------------------------------------------------------------------------- */
+struct MockSlot {
+  int16_t gyro[3];
+  int16_t accel[3];
+};
+
+static uint8_t agRegisters[128];
+static uint8_t mRegisters[128];
+static MockSlot fifo[LSM9DS1_FIFO_DEPTH];
+static int fifoCount;
+static bool fifoOverrun;
+static int failAfter;
+static int transfers;
+
+static void MockPush(int16_t value) {
+  if (fifoCount == LSM9DS1_FIFO_DEPTH) {
+    // continuous mode, the oldest slot goes
+    memmove(&fifo[0], &fifo[1], sizeof(MockSlot) * (LSM9DS1_FIFO_DEPTH - 1));
+    fifoCount--;
+    fifoOverrun = true;
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    fifo[fifoCount].gyro[axis] = (int16_t)(value + axis);
+    fifo[fifoCount].accel[axis] = (int16_t)(-value - axis);
+  }
+  fifoCount++;
+}
+
+static bool MockTransfer() {
+  return failAfter < 0 || transfers++ < failAfter;
+}
+
+static bool MockRead(uint8_t address, uint8_t reg, uint8_t* data, size_t length) {
+  if (!MockTransfer())
+    return false;
+
+  if (address == LSM9DS1_M_ADDRESS) {
+    memcpy(data, &mRegisters[reg], length);
+    return true;
+  }
+
+  bool enabled = (agRegisters[LSM9DS1_CTRL_REG9] & LSM9DS1_CTRL_REG9_FIFO_EN) &&
+                 (agRegisters[LSM9DS1_FIFO_CTRL] & 0xE0) == LSM9DS1_FIFO_MODE_CONTINUOUS;
+  if (reg == LSM9DS1_FIFO_SRC) {
+    uint8_t watermark = agRegisters[LSM9DS1_FIFO_CTRL] & 0x1F;
+    uint8_t source = (uint8_t)(enabled ? fifoCount : 0);
+    if (enabled && fifoCount >= watermark)
+      source |= LSM9DS1_FIFO_SRC_FTH;
+    if (fifoOverrun)
+      source |= LSM9DS1_FIFO_SRC_OVRN;
+    fifoOverrun = false;
+    data[0] = source;
+    return true;
+  }
+
+  if ((reg == LSM9DS1_OUT_X_L_G || reg == LSM9DS1_OUT_X_L_XL) && enabled && fifoCount > 0) {
+    // a burst needs the address auto increment
+    TEST_ASSERT_TRUE(agRegisters[LSM9DS1_CTRL_REG8] & LSM9DS1_CTRL_REG8_IF_ADD_INC);
+    const int16_t* words = reg == LSM9DS1_OUT_X_L_G ? fifo[0].gyro : fifo[0].accel;
+    for (size_t i = 0; i < length; i++) {
+      data[i] = (uint8_t)(words[i / 2] >> ((i & 1) * 8));
+    }
+    if (reg == LSM9DS1_OUT_X_L_XL) {
+      memmove(&fifo[0], &fifo[1], sizeof(MockSlot) * (LSM9DS1_FIFO_DEPTH - 1));
+      fifoCount--;
+    }
+    return true;
+  }
+
+  memcpy(data, &agRegisters[reg], length);
+  return true;
+}
+
+static bool MockWrite(uint8_t address, uint8_t reg, uint8_t value) {
+  if (!MockTransfer())
+    return false;
+
+  if (address == LSM9DS1_M_ADDRESS) {
+    mRegisters[reg] = value;
+    return true;
+  }
+
+  // bypass mode empties the FIFO
+  if (reg == LSM9DS1_FIFO_CTRL && (value & 0xE0) == LSM9DS1_FIFO_MODE_BYPASS) {
+    fifoCount = 0;
+    fifoOverrun = false;
+  }
+  agRegisters[reg] = value;
+  return true;
+}
+
+static const Lsm9ds1Bus bus = { MockRead, MockWrite };
+
+void setUp(void) {
+  memset(agRegisters, 0, sizeof(agRegisters));
+  memset(mRegisters, 0, sizeof(mRegisters));
+  // as IMU.begin() leaves them, 119 Hz and the block data update bit
+  agRegisters[LSM9DS1_CTRL_REG1_G] = 0x78;
+  agRegisters[LSM9DS1_CTRL_REG8] = 0x40;
+  mRegisters[LSM9DS1_CTRL_REG3_M] = 0x00;
+  fifoCount = 0;
+  fifoOverrun = false;
+  failAfter = -1;
+  transfers = 0;
+}
+
+void tearDown(void) {
+}
+
+void test_begin_enables_the_fifo_and_end_restores_bypass(void) {
+  Lsm9ds1Fifo imuFifo;
+  MockPush(1);
+  TEST_ASSERT_TRUE(imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ));
+
+  TEST_ASSERT_EQUAL(0, fifoCount);
+  TEST_ASSERT_EQUAL_HEX8(0x40 | LSM9DS1_CTRL_REG8_IF_ADD_INC, agRegisters[LSM9DS1_CTRL_REG8]);
+  TEST_ASSERT_EQUAL_HEX8(LSM9DS1_CTRL_REG9_FIFO_EN, agRegisters[LSM9DS1_CTRL_REG9]);
+  TEST_ASSERT_EQUAL_HEX8(LSM9DS1_FIFO_MODE_CONTINUOUS | 8, agRegisters[LSM9DS1_FIFO_CTRL]);
+
+  imuFifo.End();
+  TEST_ASSERT_EQUAL(LSM9DS1_FIFO_OFF, imuFifo.Mode());
+  TEST_ASSERT_EQUAL_HEX8(0, agRegisters[LSM9DS1_CTRL_REG9]);
+  TEST_ASSERT_EQUAL_HEX8(LSM9DS1_FIFO_MODE_BYPASS, agRegisters[LSM9DS1_FIFO_CTRL]);
+}
+
+void test_drain_reads_every_queued_sample_in_order(void) {
+  Lsm9ds1Fifo imuFifo;
+  imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ);
+  for (int i = 0; i < 5; i++) {
+    MockPush((int16_t)(100 * (i + 1)));
+  }
+
+  Lsm9ds1FifoSample samples[LSM9DS1_FIFO_DEPTH];
+  TEST_ASSERT_EQUAL(5, imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, 1000000UL));
+  TEST_ASSERT_EQUAL(0, fifoCount);
+  for (int i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL_FLOAT(100 * (i + 1) * LSM9DS1_GYRO_SCALE, samples[i].gyroscope[0]);
+    TEST_ASSERT_EQUAL_FLOAT((100 * (i + 1) + 2) * LSM9DS1_GYRO_SCALE, samples[i].gyroscope[2]);
+    TEST_ASSERT_EQUAL_FLOAT(-100 * (i + 1) * LSM9DS1_ACCEL_SCALE, samples[i].acceleration[0]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, imuFifo.Drains());
+  TEST_ASSERT_EQUAL_UINT32(5, imuFifo.Samples());
+}
+
+void test_drain_stops_at_max_samples(void) {
+  Lsm9ds1Fifo imuFifo;
+  imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ);
+  for (int i = 0; i < 10; i++) {
+    MockPush((int16_t)i);
+  }
+
+  Lsm9ds1FifoSample samples[4];
+  TEST_ASSERT_EQUAL(4, imuFifo.Drain(samples, 4, 1000000UL));
+  TEST_ASSERT_EQUAL(6, fifoCount);
+  TEST_ASSERT_EQUAL_FLOAT(3 * LSM9DS1_GYRO_SCALE, samples[3].gyroscope[0]);
+}
+
+void test_watermark_mode_waits_for_the_threshold(void) {
+  Lsm9ds1Fifo imuFifo;
+  imuFifo.Begin(bus, LSM9DS1_FIFO_WATERMARK, 8, TEST_ODR_HZ);
+  for (int i = 0; i < 7; i++) {
+    MockPush((int16_t)i);
+  }
+
+  Lsm9ds1FifoSample samples[LSM9DS1_FIFO_DEPTH];
+  TEST_ASSERT_EQUAL(0, imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, 1000000UL));
+  TEST_ASSERT_EQUAL(7, fifoCount);
+
+  MockPush(7);
+  TEST_ASSERT_EQUAL(8, imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, 1000000UL));
+}
+
+void test_overrun_is_counted(void) {
+  Lsm9ds1Fifo imuFifo;
+  imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ);
+  for (int i = 0; i < LSM9DS1_FIFO_DEPTH + 4; i++) {
+    MockPush((int16_t)i);
+  }
+
+  Lsm9ds1FifoSample samples[LSM9DS1_FIFO_DEPTH];
+  TEST_ASSERT_EQUAL(LSM9DS1_FIFO_DEPTH, imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, 1000000UL));
+  TEST_ASSERT_EQUAL_UINT32(1, imuFifo.Overruns());
+  // the oldest slots were overwritten
+  TEST_ASSERT_EQUAL_FLOAT(4 * LSM9DS1_GYRO_SCALE, samples[0].gyroscope[0]);
+}
+
+void test_timestamps_are_spaced_and_monotonic(void) {
+  Lsm9ds1Fifo imuFifo;
+  imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ);
+  Lsm9ds1FifoSample samples[LSM9DS1_FIFO_DEPTH];
+
+  for (int i = 0; i < 4; i++) {
+    MockPush((int16_t)i);
+  }
+  TEST_ASSERT_EQUAL(4, imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, 1000000UL));
+  TEST_ASSERT_EQUAL_UINT32(1000000UL, samples[3].timestampMicros);
+  TEST_ASSERT_EQUAL_UINT32(1000000UL - 3 * TEST_PERIOD_MICROS, samples[0].timestampMicros);
+
+  // four samples in one period, spread over the gap rather than stepping
+  // back behind the last drain or ahead of now
+  for (int i = 0; i < 4; i++) {
+    MockPush((int16_t)i);
+  }
+  TEST_ASSERT_EQUAL(4, imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, 1000000UL + TEST_PERIOD_MICROS));
+  TEST_ASSERT_EQUAL_UINT32(1000000UL + TEST_PERIOD_MICROS, samples[3].timestampMicros);
+  TEST_ASSERT_TRUE(samples[0].timestampMicros > 1000000UL);
+  for (int i = 1; i < 4; i++) {
+    TEST_ASSERT_EQUAL_UINT32(TEST_PERIOD_MICROS / 4, samples[i].timestampMicros - samples[i - 1].timestampMicros);
+  }
+
+  // a sample left queued behind a short read is newer than the ones read
+  for (int i = 0; i < 4; i++) {
+    MockPush((int16_t)i);
+  }
+  uint32_t now = 1000000UL + 5 * TEST_PERIOD_MICROS;
+  TEST_ASSERT_EQUAL(3, imuFifo.Drain(samples, 3, now));
+  TEST_ASSERT_EQUAL_UINT32(now - TEST_PERIOD_MICROS, samples[2].timestampMicros);
+}
+
+/* --------------------------------------------------------------------------
+    A sensor whose output data rate is off the nominal one by ppm, drained
+    every drainMicros for seconds. Each sample carries its index in the
+    gyro word so the stamp can be held against the time it was taken.
+    Returns the worst error against that time
+   -------------------------------------------------------------------------- */
+static uint32_t DriftRun(int32_t ppm, uint32_t drainMicros, uint32_t seconds, uint32_t& newestLag) {
+  Lsm9ds1Fifo imuFifo;
+  imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ);
+  Lsm9ds1FifoSample samples[LSM9DS1_FIFO_DEPTH];
+
+  double period = 1000000.0 / (TEST_ODR_HZ * (1.0 + ppm / 1000000.0));
+  double taken[4096];
+  int pushed = 0;
+  uint32_t worst = 0;
+  uint32_t last = 0;
+  newestLag = 0;
+
+  for (uint32_t now = drainMicros; now <= seconds * 1000000UL; now += drainMicros) {
+    while ((pushed + 1) * period <= now && pushed < 4096) {
+      taken[pushed] = (pushed + 1) * period;
+      MockPush((int16_t)pushed);
+      pushed++;
+    }
+
+    size_t count = imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, now);
+    for (size_t i = 0; i < count; i++) {
+      uint32_t stamp = samples[i].timestampMicros;
+      TEST_ASSERT_TRUE(stamp > last);
+      TEST_ASSERT_TRUE(stamp <= now);
+      last = stamp;
+      double error = stamp - taken[(int)(samples[i].gyroscope[0] / LSM9DS1_GYRO_SCALE + 0.5f)];
+      error = error < 0 ? -error : error;
+      worst = error > worst ? (uint32_t)error : worst;
+    }
+    if (count > 0)
+      newestLag = now - samples[count - 1].timestampMicros;
+  }
+  return worst;
+}
+
+void test_timestamps_follow_a_sensor_off_its_nominal_rate(void) {
+  const int32_t offsets[] = { -20000, -10000, 10000, 20000 };
+  for (size_t n = 0; n < sizeof(offsets) / sizeof(offsets[0]); n++) {
+    uint32_t newestLag;
+    uint32_t worst = DriftRun(offsets[n], 33600, 20, newestLag);
+
+    // within about a period of when each was taken, for the whole run
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * TEST_PERIOD_MICROS, worst);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(TEST_PERIOD_MICROS, newestLag);
+  }
+}
+
+void test_bus_errors_are_counted(void) {
+  Lsm9ds1Fifo imuFifo;
+  failAfter = 1;
+  TEST_ASSERT_FALSE(imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ));
+  TEST_ASSERT_EQUAL_UINT32(1, imuFifo.BusErrors());
+  TEST_ASSERT_EQUAL(LSM9DS1_FIFO_OFF, imuFifo.Mode());
+
+  failAfter = -1;
+  TEST_ASSERT_TRUE(imuFifo.Begin(bus, LSM9DS1_FIFO_CONTINUOUS, 8, TEST_ODR_HZ));
+  for (int i = 0; i < 5; i++) {
+    MockPush((int16_t)i);
+  }
+
+  // the bus gives out after the source register and two slots
+  Lsm9ds1FifoSample samples[LSM9DS1_FIFO_DEPTH];
+  transfers = 0;
+  failAfter = 1 + 2 * 2;
+  TEST_ASSERT_EQUAL(2, imuFifo.Drain(samples, LSM9DS1_FIFO_DEPTH, 1000000UL));
+  TEST_ASSERT_EQUAL_UINT32(2, imuFifo.BusErrors());
+}
+
+void test_output_data_rate_and_magnetometer_power(void) {
+  TEST_ASSERT_EQUAL_FLOAT(59.5f, Lsm9ds1SetOutputDataRate(bus, 50.0f, true));
+  TEST_ASSERT_EQUAL_HEX8(0x58, agRegisters[LSM9DS1_CTRL_REG1_G]);
+  TEST_ASSERT_TRUE(agRegisters[LSM9DS1_CTRL_REG3_G] & LSM9DS1_CTRL_REG3_G_LP_MODE);
+
+  // the low power mode only goes up to 119 Hz
+  TEST_ASSERT_EQUAL_FLOAT(476.0f, Lsm9ds1SetOutputDataRate(bus, 300.0f, true));
+  TEST_ASSERT_EQUAL_HEX8(0xB8, agRegisters[LSM9DS1_CTRL_REG1_G]);
+  TEST_ASSERT_FALSE(agRegisters[LSM9DS1_CTRL_REG3_G] & LSM9DS1_CTRL_REG3_G_LP_MODE);
+
+  TEST_ASSERT_TRUE(Lsm9ds1SetMagnetometer(bus, false));
+  TEST_ASSERT_EQUAL_HEX8(LSM9DS1_CTRL_REG3_M_POWER_DOWN, mRegisters[LSM9DS1_CTRL_REG3_M]);
+  TEST_ASSERT_TRUE(Lsm9ds1SetMagnetometer(bus, true));
+  TEST_ASSERT_EQUAL_HEX8(0x00, mRegisters[LSM9DS1_CTRL_REG3_M]);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_enables_the_fifo_and_end_restores_bypass);
+  RUN_TEST(test_drain_reads_every_queued_sample_in_order);
+  RUN_TEST(test_drain_stops_at_max_samples);
+  RUN_TEST(test_watermark_mode_waits_for_the_threshold);
+  RUN_TEST(test_overrun_is_counted);
+  RUN_TEST(test_timestamps_are_spaced_and_monotonic);
+  RUN_TEST(test_timestamps_follow_a_sensor_off_its_nominal_rate);
+  RUN_TEST(test_bus_errors_are_counted);
+  RUN_TEST(test_output_data_rate_and_magnetometer_power);
+  return UNITY_END();
+}
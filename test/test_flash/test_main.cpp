@@ -0,0 +1,335 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the FlashStore on a simulated page erase flash
+              that only clears bits, read back in chunks and resumed from
+              an offset, the round robin wear, a remount, and power lost
+              part way through a record or a page header
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <string.h>
+#include <FlashStore.h>
+
+#define TEST_PAGE_SIZE        512
+#define TEST_PAGES            8
+#define TEST_DATA_SIZE        (TEST_PAGE_SIZE - FLASH_STORE_PAGE_HEADER)
+#define TEST_NO_TEAR          0xFFFFFFFFUL
+
+/* --------------------------------------------------------------------------
+    Simulated flash, erase sets a page to 0xFF and program can only clear
+    bits of word aligned words. tearAfter bytes into the next program the
+    power goes, what was written so far stays and the rest never happens
+   -------------------------------------------------------------------------- */
+struct TestFlash {
+  uint8_t   memory[TEST_PAGE_SIZE * TEST_PAGES];
+  uint32_t  erases[TEST_PAGES];
+  uint32_t  programs;
+  uint32_t  misaligned;
+  uint32_t  setBits;              // a program that needed a 0 to go back to 1
+  uint32_t  tearAfter;
+  bool      tearErase;            // the power goes after the next erase
+};
+
+static TestFlash flash;
+static FlashStore store;
+
+static bool FlashRead(uint32_t offset, void* data, size_t length) {
+  if (offset + length > sizeof(flash.memory))
+    return false;
+  memcpy(data, &flash.memory[offset], length);
+  return true;
+}
+
+static bool FlashProgram(uint32_t offset, const void* data, size_t length) {
+  if (offset % 4 != 0 || length % 4 != 0) {
+    flash.misaligned++;
+    return false;
+  }
+  if (offset + length > sizeof(flash.memory))
+    return false;
+
+  const uint8_t* bytes = (const uint8_t*)data;
+  flash.programs++;
+  for (size_t i = 0; i < length; i++) {
+    if (flash.tearAfter != TEST_NO_TEAR && i == flash.tearAfter) {
+      flash.tearAfter = TEST_NO_TEAR;
+      return false;
+    }
+    if (bytes[i] & ~flash.memory[offset + i]) {
+      flash.setBits++;
+    }
+    flash.memory[offset + i] &= bytes[i];
+  }
+  return true;
+}
+
+static bool FlashErase(uint32_t page) {
+  if (page >= TEST_PAGES)
+    return false;
+  memset(&flash.memory[page * TEST_PAGE_SIZE], 0xFF, TEST_PAGE_SIZE);
+  flash.erases[page]++;
+  if (flash.tearErase) {
+    flash.tearErase = false;
+    flash.tearAfter = 0;
+  }
+  return true;
+}
+
+static const FlashDevice device = { TEST_PAGE_SIZE, TEST_PAGES, FlashRead, FlashProgram, FlashErase };
+
+// a sequence number and a pattern from it, 5 to 41 bytes
+static size_t Record(uint32_t sequence, uint8_t* record) {
+  size_t length = 5 + (sequence * 7) % 37;
+  memcpy(record, &sequence, sizeof(sequence));
+  for (size_t i = sizeof(sequence); i < length; i++) {
+    record[i] = (uint8_t)(sequence * 31 + i);
+  }
+  return length;
+}
+
+static void Append(uint32_t first, uint32_t count) {
+  uint8_t record[FLASH_STORE_MAX_RECORD];
+  for (uint32_t sequence = first; sequence < first + count; sequence++) {
+    TEST_ASSERT_TRUE(store.Append(record, Record(sequence, record)));
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Read from offset to the head in chunks of chunkSize, checking every
+    record against its pattern. Returns how many there were, the sequence
+    numbers in order into sequences
+   -------------------------------------------------------------------------- */
+static uint32_t ReadAll(uint32_t offset, size_t chunkSize, uint32_t* sequences, uint32_t maxRecords) {
+  uint8_t chunk[TEST_PAGE_SIZE + 64];
+  uint32_t records = 0;
+  for (int reads = 0; reads < 1000; reads++) {
+    uint32_t next;
+    size_t length = store.ReadChunk(offset, chunk, chunkSize, next);
+    for (size_t at = 0; at < length; at += 1 + chunk[at]) {
+      uint32_t sequence;
+      uint8_t expected[FLASH_STORE_MAX_RECORD];
+      memcpy(&sequence, &chunk[at + 1], sizeof(sequence));
+      TEST_ASSERT_EQUAL(Record(sequence, expected), chunk[at]);
+      TEST_ASSERT_EQUAL_MEMORY(expected, &chunk[at + 1], chunk[at]);
+      if (records < maxRecords) {
+        sequences[records] = sequence;
+      }
+      records++;
+    }
+    if (next == store.HeadOffset() || (length == 0 && next == offset))
+      break;
+    offset = next;
+  }
+  return records;
+}
+
+static void AssertConsecutive(const uint32_t* sequences, uint32_t count, uint32_t first) {
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(first + i, sequences[i]);
+  }
+}
+
+void setUp(void) {
+  memset(&flash, 0, sizeof(flash));
+  memset(flash.memory, 0xFF, sizeof(flash.memory));
+  flash.tearAfter = TEST_NO_TEAR;
+  store = FlashStore();
+  TEST_ASSERT_TRUE(store.Begin(device));
+}
+
+void tearDown(void) {
+}
+
+void test_rejects_unusable_device(void) {
+  FlashDevice small = device;
+  small.pageSize = FLASH_STORE_PAGE_HEADER + FLASH_STORE_RECORD_HEADER + FLASH_STORE_MAX_RECORD;
+  TEST_ASSERT_FALSE(FlashStore().Begin(small));
+  small = device;
+  small.pageCount = FLASH_STORE_MAX_PAGES + 1;
+  TEST_ASSERT_FALSE(FlashStore().Begin(small));
+}
+
+void test_append_read_back_in_chunks(void) {
+  uint32_t sequences[100];
+  TEST_ASSERT_TRUE(store.Empty());
+  Append(0, 60);
+  TEST_ASSERT_FALSE(store.Empty());
+
+  // chunks smaller than two records, and one larger than a page
+  TEST_ASSERT_EQUAL_UINT32(60, ReadAll(0, 48, sequences, 100));
+  AssertConsecutive(sequences, 60, 0);
+  TEST_ASSERT_EQUAL_UINT32(60, ReadAll(0, TEST_PAGE_SIZE + 64, sequences, 100));
+  AssertConsecutive(sequences, 60, 0);
+
+  // only ever cleared bits, a word at a time
+  TEST_ASSERT_EQUAL_UINT32(0, flash.setBits);
+  TEST_ASSERT_EQUAL_UINT32(0, flash.misaligned);
+}
+
+void test_resume_from_offset(void) {
+  uint8_t chunk[128];
+  uint32_t sequences[100];
+  Append(0, 30);
+
+  // the first chunk, then more arrives before the backfill resumes
+  uint32_t next;
+  size_t length = store.ReadChunk(0, chunk, sizeof(chunk), next);
+  uint32_t first = 0;
+  for (size_t at = 0; at < length; at += 1 + chunk[at]) {
+    first++;
+  }
+  TEST_ASSERT_GREATER_THAN_UINT32(0, first);
+  TEST_ASSERT_LESS_THAN_UINT32(30, first);
+  Append(30, 10);
+
+  TEST_ASSERT_EQUAL_UINT32(40 - first, ReadAll(next, 96, sequences, 100));
+  AssertConsecutive(sequences, 40 - first, first);
+}
+
+void test_round_robin_wear_and_oldest_page_lost(void) {
+  uint32_t sequences[200];
+
+  // about five laps of the store
+  Append(0, 1000);
+  TEST_ASSERT_EQUAL_UINT32(1000, store.Records());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, store.PagesLost());
+
+  uint32_t least = flash.erases[0];
+  uint32_t most = flash.erases[0];
+  for (int page = 1; page < TEST_PAGES; page++) {
+    least = flash.erases[page] < least ? flash.erases[page] : least;
+    most = flash.erases[page] > most ? flash.erases[page] : most;
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(4, least);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(least + 1, most);
+
+  // an offset from before the oldest page starts at the oldest record, the
+  // newest records are all there and in order
+  uint32_t records = ReadAll(0, 200, sequences, 200);
+  TEST_ASSERT_GREATER_THAN_UINT32(50, records);
+  TEST_ASSERT_LESS_THAN_UINT32(200, records);
+  AssertConsecutive(sequences, records, 1000 - records);
+  TEST_ASSERT_EQUAL_UINT32(0, flash.setBits);
+}
+
+void test_remount_picks_up_where_it_left_off(void) {
+  uint32_t sequences[200];
+  Append(0, 300);
+  uint32_t head = store.HeadOffset();
+  uint32_t tail = store.TailOffset();
+
+  store = FlashStore();
+  TEST_ASSERT_TRUE(store.Begin(device));
+  TEST_ASSERT_EQUAL_UINT32(head, store.HeadOffset());
+  TEST_ASSERT_EQUAL_UINT32(tail, store.TailOffset());
+
+  // appends go on in the same page
+  Append(300, 5);
+  TEST_ASSERT_EQUAL_UINT32(0, flash.setBits);
+  uint32_t records = ReadAll(tail, 200, sequences, 200);
+  AssertConsecutive(sequences, records, 305 - records);
+}
+
+void test_torn_payload_is_skipped(void) {
+  uint32_t sequences[100];
+  uint8_t record[FLASH_STORE_MAX_RECORD];
+  Append(0, 20);
+
+  // the header and part of the payload made it
+  flash.tearAfter = FLASH_STORE_RECORD_HEADER + 8;
+  TEST_ASSERT_FALSE(store.Append(record, Record(20, record)));
+
+  store = FlashStore();
+  TEST_ASSERT_TRUE(store.Begin(device));
+  Append(21, 10);
+
+  uint32_t records = ReadAll(0, 96, sequences, 100);
+  TEST_ASSERT_EQUAL_UINT32(30, records);
+  AssertConsecutive(sequences, 20, 0);
+  AssertConsecutive(&sequences[20], 10, 21);
+  TEST_ASSERT_EQUAL_UINT32(0, flash.setBits);
+}
+
+void test_torn_header_closes_the_page(void) {
+  uint32_t sequences[100];
+  uint8_t record[FLASH_STORE_MAX_RECORD];
+  Append(0, 20);
+  uint32_t headSequence = store.HeadOffset() / TEST_DATA_SIZE;
+
+  // half the record header, the page can not be appended to after it
+  flash.tearAfter = 2;
+  TEST_ASSERT_FALSE(store.Append(record, Record(20, record)));
+
+  store = FlashStore();
+  TEST_ASSERT_TRUE(store.Begin(device));
+  Append(21, 10);
+  TEST_ASSERT_EQUAL_UINT32(headSequence + 1, store.HeadOffset() / TEST_DATA_SIZE);
+
+  uint32_t records = ReadAll(0, 96, sequences, 100);
+  TEST_ASSERT_EQUAL_UINT32(30, records);
+  AssertConsecutive(sequences, 20, 0);
+  AssertConsecutive(&sequences[20], 10, 21);
+  TEST_ASSERT_EQUAL_UINT32(0, flash.setBits);
+}
+
+void test_torn_page_header_is_a_free_page(void) {
+  uint32_t sequences[100];
+  uint8_t record[FLASH_STORE_MAX_RECORD];
+
+  // fill the first page exactly up to where the next record opens a page
+  uint32_t sequence = 0;
+  uint32_t headSequence = store.HeadOffset() / TEST_DATA_SIZE;
+  for (;; sequence++) {
+    TEST_ASSERT_TRUE(store.Append(record, Record(sequence, record)));
+    uint32_t position = store.HeadOffset() % TEST_DATA_SIZE;
+    size_t length = Record(sequence + 1, record);
+    if (position + FLASH_STORE_RECORD_HEADER + ((length + 3) & ~3u) > TEST_DATA_SIZE)
+      break;
+  }
+  TEST_ASSERT_EQUAL_UINT32(headSequence, store.HeadOffset() / TEST_DATA_SIZE);
+  sequence++;
+
+  // the page is erased, then the power goes before its header is written
+  flash.tearErase = true;
+  TEST_ASSERT_FALSE(store.Append(record, Record(sequence, record)));
+
+  store = FlashStore();
+  TEST_ASSERT_TRUE(store.Begin(device));
+  Append(sequence + 1, 10);
+
+  uint32_t records = ReadAll(0, 96, sequences, 100);
+  TEST_ASSERT_EQUAL_UINT32(sequence + 10, records);
+  AssertConsecutive(sequences, sequence, 0);
+  AssertConsecutive(&sequences[sequence], 10, sequence + 1);
+}
+
+void test_format_empties_the_store(void) {
+  uint32_t sequences[10];
+  Append(0, 50);
+  TEST_ASSERT_TRUE(store.Format());
+  TEST_ASSERT_TRUE(store.Empty());
+  TEST_ASSERT_EQUAL_UINT32(0, ReadAll(0, 96, sequences, 10));
+
+  store = FlashStore();
+  TEST_ASSERT_TRUE(store.Begin(device));
+  TEST_ASSERT_TRUE(store.Empty());
+  Append(0, 5);
+  TEST_ASSERT_EQUAL_UINT32(5, ReadAll(0, 96, sequences, 10));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rejects_unusable_device);
+  RUN_TEST(test_append_read_back_in_chunks);
+  RUN_TEST(test_resume_from_offset);
+  RUN_TEST(test_round_robin_wear_and_oldest_page_lost);
+  RUN_TEST(test_remount_picks_up_where_it_left_off);
+  RUN_TEST(test_torn_payload_is_skipped);
+  RUN_TEST(test_torn_header_closes_the_page);
+  RUN_TEST(test_torn_page_header_is_a_free_page);
+  RUN_TEST(test_format_empties_the_store);
+  return UNITY_END();
+}
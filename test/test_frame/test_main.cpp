@@ -0,0 +1,96 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the packed TelemetryFrame, encode and decode
+              round trip, the little endian layout and the refusals
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <TelemetryFrame.h>
+
+static TelemetryFrame frame;
+
+void setUp(void) {
+  frame.version = TELEMETRY_FRAME_VERSION;
+  frame.flags = 0;
+  frame.sequence = 0xBEEF;
+  frame.timestampMicros = 0x12345678UL;
+  for (int i = 0; i < 3; i++) {
+    frame.acceleration[i] = 0.25f * (i + 1);
+    frame.gyroscope[i] = -125.5f * (i + 1);
+    frame.magnetometer[i] = 33.0f - i;
+    frame.orientation[i] = 0.5f * i - 1.0f;
+  }
+}
+
+void tearDown(void) {
+}
+
+void test_frame_round_trips(void) {
+  uint8_t buffer[TELEMETRY_FRAME_SIZE];
+  TEST_ASSERT_EQUAL(TELEMETRY_FRAME_SIZE, EncodeTelemetryFrame(frame, buffer, sizeof(buffer)));
+
+  TelemetryFrame decoded;
+  TEST_ASSERT_TRUE(DecodeTelemetryFrame(buffer, sizeof(buffer), decoded));
+  TEST_ASSERT_EQUAL_UINT8(frame.version, decoded.version);
+  TEST_ASSERT_EQUAL_UINT8(frame.flags, decoded.flags);
+  TEST_ASSERT_EQUAL_UINT16(frame.sequence, decoded.sequence);
+  TEST_ASSERT_EQUAL_UINT32(frame.timestampMicros, decoded.timestampMicros);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_FLOAT(frame.acceleration[i], decoded.acceleration[i]);
+    TEST_ASSERT_EQUAL_FLOAT(frame.gyroscope[i], decoded.gyroscope[i]);
+    TEST_ASSERT_EQUAL_FLOAT(frame.magnetometer[i], decoded.magnetometer[i]);
+    TEST_ASSERT_EQUAL_FLOAT(frame.orientation[i], decoded.orientation[i]);
+  }
+}
+
+void test_frame_layout_is_little_endian(void) {
+  uint8_t buffer[TELEMETRY_FRAME_SIZE];
+  EncodeTelemetryFrame(frame, buffer, sizeof(buffer));
+
+  const uint8_t header[TELEMETRY_FRAME_HEADER_SIZE] = {
+    TELEMETRY_FRAME_VERSION, 0x00, 0xEF, 0xBE, 0x78, 0x56, 0x34, 0x12
+  };
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(header, buffer, sizeof(header));
+
+  // the accelerometer starts right behind the header, then gyro, mag, orientation
+  TEST_ASSERT_EQUAL_FLOAT(frame.acceleration[0], GetFloatLE(&buffer[8]));
+  TEST_ASSERT_EQUAL_FLOAT(frame.gyroscope[0], GetFloatLE(&buffer[20]));
+  TEST_ASSERT_EQUAL_FLOAT(frame.magnetometer[0], GetFloatLE(&buffer[32]));
+  TEST_ASSERT_EQUAL_FLOAT(frame.orientation[2], GetFloatLE(&buffer[52]));
+}
+
+void test_frame_fits_one_notification(void) {
+  // 59 byte ATT MTU less the 3 byte notification header
+  TEST_ASSERT_LESS_OR_EQUAL(59 - 3, TELEMETRY_FRAME_SIZE);
+}
+
+void test_short_buffer_is_refused(void) {
+  uint8_t buffer[TELEMETRY_FRAME_SIZE];
+  TEST_ASSERT_EQUAL(0, EncodeTelemetryFrame(frame, buffer, sizeof(buffer) - 1));
+
+  EncodeTelemetryFrame(frame, buffer, sizeof(buffer));
+  TelemetryFrame decoded;
+  TEST_ASSERT_FALSE(DecodeTelemetryFrame(buffer, sizeof(buffer) - 1, decoded));
+}
+
+void test_unknown_version_is_refused(void) {
+  uint8_t buffer[TELEMETRY_FRAME_SIZE];
+  EncodeTelemetryFrame(frame, buffer, sizeof(buffer));
+  buffer[0] = TELEMETRY_FRAME_VERSION + 1;
+
+  TelemetryFrame decoded;
+  TEST_ASSERT_FALSE(DecodeTelemetryFrame(buffer, sizeof(buffer), decoded));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_round_trips);
+  RUN_TEST(test_frame_layout_is_little_endian);
+  RUN_TEST(test_frame_fits_one_notification);
+  RUN_TEST(test_short_buffer_is_refused);
+  RUN_TEST(test_unknown_version_is_refused);
+  return UNITY_END();
+}
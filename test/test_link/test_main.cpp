@@ -0,0 +1,234 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the LinkManager against a mocked LinkBus, the
+              profiles within the specification, what is asked for on
+              connecting and on a profile change, requests the stack
+              refuses, the MTU exchange and the payload size that follows
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <string.h>
+#include <LinkProfile.h>
+
+#define TEST_MAX_PAYLOAD      200
+
+/* --------------------------------------------------------------------------
+    Mocked link, counts what the LinkManager asked for and grants what the
+    test says
+   -------------------------------------------------------------------------- */
+struct TestBus {
+  int             prefers;
+  int             connectionRequests;
+  int             dataLengthRequests;
+  LinkParameters  preferred;
+  LinkParameters  requested;
+  uint16_t        octets;
+  bool            grantConnection;
+  bool            grantDataLength;
+  uint16_t        mtu;
+};
+
+static TestBus bus;
+static LinkManager manager;
+
+static void Prefer(const LinkParameters& parameters) {
+  bus.prefers++;
+  bus.preferred = parameters;
+}
+
+static bool RequestConnection(const LinkParameters& parameters) {
+  bus.connectionRequests++;
+  bus.requested = parameters;
+  return bus.grantConnection;
+}
+
+static bool RequestDataLength(uint16_t octets) {
+  bus.dataLengthRequests++;
+  bus.octets = octets;
+  return bus.grantDataLength;
+}
+
+static uint16_t Mtu() {
+  return bus.mtu;
+}
+
+static const LinkBus linkBus = { Prefer, RequestConnection, RequestDataLength, Mtu };
+
+static void AssertParameters(const LinkParameters& expected, const LinkParameters& actual) {
+  TEST_ASSERT_EQUAL_UINT16(expected.minInterval, actual.minInterval);
+  TEST_ASSERT_EQUAL_UINT16(expected.maxInterval, actual.maxInterval);
+  TEST_ASSERT_EQUAL_UINT16(expected.latency, actual.latency);
+  TEST_ASSERT_EQUAL_UINT16(expected.supervisionTimeout, actual.supervisionTimeout);
+  TEST_ASSERT_EQUAL_UINT16(expected.dataLength, actual.dataLength);
+}
+
+void setUp(void) {
+  memset(&bus, 0, sizeof(bus));
+  bus.grantConnection = true;
+  bus.grantDataLength = true;
+  manager = LinkManager();
+  manager.Begin(linkBus, LINK_PROFILE_HIGH_THROUGHPUT, TEST_MAX_PAYLOAD);
+}
+
+void tearDown(void) {
+}
+
+void test_profiles_within_specification(void) {
+  for (int profile = 0; profile < LINK_PROFILE_COUNT; profile++) {
+    const LinkParameters& parameters = LinkProfileParameters((LinkProfileId)profile);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT16(6, parameters.minInterval);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT16(parameters.maxInterval, parameters.minInterval);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT16(3200, parameters.maxInterval);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT16(499, parameters.latency);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT16(27, parameters.dataLength);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT16(251, parameters.dataLength);
+
+    // timeout (10 ms) over (1 + latency) * max interval (1.25 ms) * 2
+    uint32_t timeoutMicros = parameters.supervisionTimeout * 10000UL;
+    uint32_t eventsMicros = (1UL + parameters.latency) * parameters.maxInterval * 1250UL * 2;
+    TEST_ASSERT_GREATER_THAN_UINT32(eventsMicros, timeoutMicros);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(32000000UL, timeoutMicros);
+  }
+
+  // out of range falls back to the default profile
+  AssertParameters(LinkProfileParameters(LINK_PROFILE_HIGH_THROUGHPUT), LinkProfileParameters(LINK_PROFILE_COUNT));
+}
+
+void test_begin_prefers_without_requesting(void) {
+  TEST_ASSERT_EQUAL_INT(1, bus.prefers);
+  AssertParameters(LinkProfileParameters(LINK_PROFILE_HIGH_THROUGHPUT), bus.preferred);
+  TEST_ASSERT_EQUAL_INT(0, bus.connectionRequests);
+  TEST_ASSERT_EQUAL_INT(0, bus.dataLengthRequests);
+  TEST_ASSERT_EQUAL_UINT8(0, manager.Status().flags);
+  TEST_ASSERT_EQUAL_UINT16(LINK_DEFAULT_MTU - LINK_ATT_HEADER_SIZE, manager.PayloadSize());
+
+  // nobody to ask while disconnected
+  bus.mtu = 247;
+  TEST_ASSERT_FALSE(manager.Update());
+}
+
+void test_connected_requests_profile(void) {
+  manager.Connected();
+  TEST_ASSERT_EQUAL_INT(1, bus.connectionRequests);
+  TEST_ASSERT_EQUAL_INT(1, bus.dataLengthRequests);
+  AssertParameters(LinkProfileParameters(LINK_PROFILE_HIGH_THROUGHPUT), bus.requested);
+  TEST_ASSERT_EQUAL_UINT16(251, bus.octets);
+  TEST_ASSERT_EQUAL_UINT8(LINK_FLAG_CONNECTED | LINK_FLAG_REQUESTED | LINK_FLAG_DATA_LENGTH, manager.Status().flags);
+}
+
+void test_mtu_exchange_sets_payload(void) {
+  manager.Connected();
+  TEST_ASSERT_EQUAL_UINT16(LINK_DEFAULT_MTU - LINK_ATT_HEADER_SIZE, manager.PayloadSize());
+
+  // the exchange comes some time after the connection
+  bus.mtu = 104;
+  TEST_ASSERT_TRUE(manager.Update());
+  TEST_ASSERT_EQUAL_UINT16(104, manager.Status().mtu);
+  TEST_ASSERT_EQUAL_UINT16(101, manager.PayloadSize());
+  TEST_ASSERT_TRUE(manager.Status().flags & LINK_FLAG_MTU_EXCHANGED);
+  TEST_ASSERT_FALSE(manager.Update());
+
+  // never more than the firmware has buffers for
+  bus.mtu = 247;
+  TEST_ASSERT_TRUE(manager.Update());
+  TEST_ASSERT_EQUAL_UINT16(247, manager.Status().mtu);
+  TEST_ASSERT_EQUAL_UINT16(TEST_MAX_PAYLOAD, manager.PayloadSize());
+}
+
+void test_unknown_mtu_keeps_default(void) {
+  bus.mtu = 0;
+  manager.Connected();
+  TEST_ASSERT_FALSE(manager.Update());
+  TEST_ASSERT_EQUAL_UINT16(LINK_DEFAULT_MTU, manager.Status().mtu);
+  TEST_ASSERT_EQUAL_UINT16(LINK_DEFAULT_MTU - LINK_ATT_HEADER_SIZE, manager.PayloadSize());
+  TEST_ASSERT_FALSE(manager.Status().flags & LINK_FLAG_MTU_EXCHANGED);
+}
+
+void test_set_profile_asks_again_when_connected(void) {
+  TEST_ASSERT_TRUE(manager.SetProfile(LINK_PROFILE_LOW_POWER));
+  TEST_ASSERT_EQUAL_INT(2, bus.prefers);
+  TEST_ASSERT_EQUAL_INT(0, bus.connectionRequests);
+
+  manager.Connected();
+  AssertParameters(LinkProfileParameters(LINK_PROFILE_LOW_POWER), bus.requested);
+
+  TEST_ASSERT_TRUE(manager.SetProfile(LINK_PROFILE_LOW_LATENCY));
+  TEST_ASSERT_EQUAL_INT(2, bus.connectionRequests);
+  AssertParameters(LinkProfileParameters(LINK_PROFILE_LOW_LATENCY), bus.requested);
+  AssertParameters(LinkProfileParameters(LINK_PROFILE_LOW_LATENCY), manager.Status().requested);
+
+  // out of range changes nothing
+  TEST_ASSERT_FALSE(manager.SetProfile(LINK_PROFILE_COUNT));
+  TEST_ASSERT_EQUAL_INT(2, bus.connectionRequests);
+  TEST_ASSERT_EQUAL_UINT8(LINK_PROFILE_LOW_LATENCY, manager.Profile());
+}
+
+void test_refused_requests_not_flagged(void) {
+  bus.grantConnection = false;
+  manager.Connected();
+  TEST_ASSERT_EQUAL_UINT8(LINK_FLAG_CONNECTED | LINK_FLAG_DATA_LENGTH, manager.Status().flags);
+
+  // a stack with no data length request
+  LinkBus noDataLength = linkBus;
+  noDataLength.requestDataLength = 0;
+  bus.grantConnection = true;
+  manager.Begin(noDataLength, LINK_PROFILE_LOW_LATENCY, TEST_MAX_PAYLOAD);
+  manager.Connected();
+  TEST_ASSERT_EQUAL_INT(1, bus.dataLengthRequests);
+  TEST_ASSERT_EQUAL_UINT8(LINK_FLAG_CONNECTED | LINK_FLAG_REQUESTED, manager.Status().flags);
+}
+
+void test_disconnect_back_to_default_mtu(void) {
+  bus.mtu = 247;
+  manager.Connected();
+  TEST_ASSERT_EQUAL_UINT16(TEST_MAX_PAYLOAD, manager.PayloadSize());
+
+  manager.Disconnected();
+  TEST_ASSERT_EQUAL_UINT8(0, manager.Status().flags);
+  TEST_ASSERT_EQUAL_UINT16(LINK_DEFAULT_MTU, manager.Status().mtu);
+  TEST_ASSERT_EQUAL_UINT16(LINK_DEFAULT_MTU - LINK_ATT_HEADER_SIZE, manager.PayloadSize());
+
+  // the next Central starts over, and is asked again
+  bus.mtu = 0;
+  manager.Connected();
+  TEST_ASSERT_EQUAL_INT(2, bus.connectionRequests);
+  TEST_ASSERT_EQUAL_UINT16(LINK_DEFAULT_MTU - LINK_ATT_HEADER_SIZE, manager.PayloadSize());
+}
+
+void test_status_payload_layout(void) {
+  uint8_t buffer[LINK_STATUS_SIZE];
+  bus.mtu = 247;
+  manager.SetProfile(LINK_PROFILE_LOW_POWER);
+  manager.Connected();
+
+  TEST_ASSERT_EQUAL(0, EncodeLinkStatus(manager.Status(), buffer, LINK_STATUS_SIZE - 1));
+  TEST_ASSERT_EQUAL(LINK_STATUS_SIZE, EncodeLinkStatus(manager.Status(), buffer, sizeof(buffer)));
+
+  const LinkParameters& power = LinkProfileParameters(LINK_PROFILE_LOW_POWER);
+  TEST_ASSERT_EQUAL_UINT8(LINK_PROFILE_LOW_POWER, buffer[0]);
+  TEST_ASSERT_EQUAL_UINT8(manager.Status().flags, buffer[1]);
+  TEST_ASSERT_EQUAL_UINT16(power.minInterval, buffer[2] | buffer[3] << 8);
+  TEST_ASSERT_EQUAL_UINT16(power.maxInterval, buffer[4] | buffer[5] << 8);
+  TEST_ASSERT_EQUAL_UINT16(power.latency, buffer[6] | buffer[7] << 8);
+  TEST_ASSERT_EQUAL_UINT16(power.supervisionTimeout, buffer[8] | buffer[9] << 8);
+  TEST_ASSERT_EQUAL_UINT16(power.dataLength, buffer[10] | buffer[11] << 8);
+  TEST_ASSERT_EQUAL_UINT16(247, buffer[12] | buffer[13] << 8);
+  TEST_ASSERT_EQUAL_UINT16(TEST_MAX_PAYLOAD, buffer[14] | buffer[15] << 8);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_profiles_within_specification);
+  RUN_TEST(test_begin_prefers_without_requesting);
+  RUN_TEST(test_connected_requests_profile);
+  RUN_TEST(test_mtu_exchange_sets_payload);
+  RUN_TEST(test_unknown_mtu_keeps_default);
+  RUN_TEST(test_set_profile_asks_again_when_connected);
+  RUN_TEST(test_refused_requests_not_flagged);
+  RUN_TEST(test_disconnect_back_to_default_mtu);
+  RUN_TEST(test_status_payload_layout);
+  return UNITY_END();
+}
@@ -0,0 +1,269 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the RateController, the bounds, the back off
+              and the creep back, and a minute of batched telemetry over a
+              simulated lossy link that a congested gateway throttles for
+              twenty seconds, against the fixed rate it replaces
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <stdio.h>
+#include <RateController.h>
+#include <SampleRingBuffer.h>
+
+#define TEST_TICK_MILLIS      10
+#define TEST_SECONDS          60
+#define TEST_SAMPLE_MILLIS    100     // the queued samples, after decimation
+#define TEST_CONGESTED_FROM   20
+#define TEST_CONGESTED_UNTIL  40
+#define TEST_CLEAN_CAPACITY   20      // notifications per second the gateway takes
+#define TEST_BUSY_CAPACITY    3
+#define TEST_LOSS_PERMILLE    10      // lost on air whatever the capacity
+
+struct TestLink {
+  uint32_t  seed;
+  uint32_t  acceptedThisSecond;
+};
+
+struct TestRun {
+  uint32_t  queued;
+  uint32_t  delivered;
+  uint32_t  dropped;
+  uint32_t  notifySent;
+  uint32_t  notifyFailed;
+  uint32_t  longestStallMillis;
+  uint32_t  recoveredMillis;      // after the congestion, within one back off of the fastest period
+  uint16_t  slowestPeriodMillis;
+  uint8_t   largestBatch;
+};
+
+// the slowest period with the largest batch still carries every sample
+static const RateBounds bounds = { 100, 800, 1, 8, -90, 50 };
+static RateController controller;
+static SampleRingBuffer<uint32_t, 64> queue;
+static TestLink link;
+
+static RateInputs Inputs(uint32_t sent, uint32_t failed, uint8_t backlog, int8_t rssi, bool active) {
+  RateInputs inputs;
+  inputs.notifySent = sent;
+  inputs.notifyFailed = failed;
+  inputs.backlogPercent = backlog;
+  inputs.rssi = rssi;
+  inputs.active = active;
+  return inputs;
+}
+
+/* --------------------------------------------------------------------------
+    The gateway takes so many notifications a second and refuses the rest,
+    the way writeValue() fails once the stack's buffers are full, and some
+    are lost on air on top
+   -------------------------------------------------------------------------- */
+static bool LinkSend(uint32_t nowMillis) {
+  bool congested = nowMillis >= TEST_CONGESTED_FROM * 1000UL && nowMillis < TEST_CONGESTED_UNTIL * 1000UL;
+  uint32_t capacity = congested ? TEST_BUSY_CAPACITY : TEST_CLEAN_CAPACITY;
+
+  link.seed = link.seed * 1103515245UL + 12345UL;
+  if ((link.seed >> 16) % 1000 < TEST_LOSS_PERMILLE)
+    return false;
+  if (link.acceptedThisSecond >= capacity)
+    return false;
+  link.acceptedThisSecond++;
+  return true;
+}
+
+/* --------------------------------------------------------------------------
+    A minute of the sketch's batch mode, samples queued at a steady rate,
+    a batch sent every period and the controller stepped once a second.
+    controlled false keeps the fastest period and smallest batch
+   -------------------------------------------------------------------------- */
+static TestRun Run(bool controlled) {
+  TestRun run = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+  uint32_t lastSample = 0;
+  uint32_t lastPublish = 0;
+  uint32_t lastDelivered = 0;
+  uint32_t sent = 0;
+  uint32_t failed = 0;
+
+  for (uint32_t now = 0; now < TEST_SECONDS * 1000UL; now += TEST_TICK_MILLIS) {
+    if (now - lastSample >= TEST_SAMPLE_MILLIS) {
+      queue.Push(now);
+      run.queued++;
+      lastSample = now;
+    }
+
+    uint16_t period = controlled ? controller.PeriodMillis() : bounds.minPeriodMillis;
+    uint8_t batch = controlled ? controller.BatchSize() : bounds.minBatch;
+    if (now - lastPublish >= period && !queue.Empty()) {
+      size_t count = queue.Count() < batch ? queue.Count() : batch;
+      queue.Pop(count);
+      if (LinkSend(now)) {
+        run.delivered += count;
+        sent++;
+        lastDelivered = now;
+      } else {
+        queue.CountDropped(count);
+        failed++;
+      }
+      lastPublish = now;
+    }
+    if (now - lastDelivered > run.longestStallMillis) {
+      run.longestStallMillis = now - lastDelivered;
+    }
+
+    if (now % 1000 == 1000 - TEST_TICK_MILLIS) {
+      link.acceptedThisSecond = 0;
+      uint8_t backlog = (uint8_t)(queue.Count() * 100 / queue.Capacity());
+      // moving the whole minute, so always active like the sketch
+      bool active = true;
+      if (controlled) {
+        controller.Update(Inputs(sent, failed, backlog, -60, active));
+      }
+      run.notifySent += sent;
+      run.notifyFailed += failed;
+      sent = 0;
+      failed = 0;
+
+      if (controller.PeriodMillis() > run.slowestPeriodMillis) {
+        run.slowestPeriodMillis = controller.PeriodMillis();
+      }
+      if (controller.BatchSize() > run.largestBatch) {
+        run.largestBatch = controller.BatchSize();
+      }
+      if (now >= TEST_CONGESTED_UNTIL * 1000UL && run.recoveredMillis == 0 &&
+          controller.PeriodMillis() <= 2 * bounds.minPeriodMillis) {
+        run.recoveredMillis = now + TEST_TICK_MILLIS - TEST_CONGESTED_UNTIL * 1000UL;
+      }
+    }
+  }
+  run.dropped = queue.Dropped() + queue.Overflows();
+  return run;
+}
+
+void setUp(void) {
+  TEST_ASSERT_TRUE(controller.Begin(bounds));
+  queue = SampleRingBuffer<uint32_t, 64>();
+  link.seed = 1;
+  link.acceptedThisSecond = 0;
+}
+
+void tearDown(void) {
+}
+
+void test_inconsistent_bounds_rejected(void) {
+  RateBounds bad = bounds;
+  bad.minPeriodMillis = 1000;
+  TEST_ASSERT_FALSE(controller.Begin(bad));
+  bad = bounds;
+  bad.minBatch = 0;
+  TEST_ASSERT_FALSE(controller.Begin(bad));
+  bad = bounds;
+  bad.backlogPercent = 101;
+  TEST_ASSERT_FALSE(controller.Begin(bad));
+
+  // and the old bounds stay
+  TEST_ASSERT_EQUAL_UINT16(bounds.maxPeriodMillis, controller.Bounds().maxPeriodMillis);
+  TEST_ASSERT_EQUAL_UINT16(bounds.minPeriodMillis, controller.PeriodMillis());
+}
+
+void test_backoff_halves_rate_within_bounds(void) {
+  TEST_ASSERT_TRUE(controller.Update(Inputs(10, 1, 0, -60, true)));
+  TEST_ASSERT_EQUAL_UINT16(200, controller.PeriodMillis());
+  TEST_ASSERT_EQUAL_UINT8(2, controller.BatchSize());
+  TEST_ASSERT_EQUAL_UINT8(RATE_FLAG_FAILED | RATE_FLAG_ACTIVE, controller.Flags());
+
+  for (int step = 0; step < 10; step++) {
+    controller.Update(Inputs(10, 1, 0, -60, true));
+  }
+  TEST_ASSERT_EQUAL_UINT16(bounds.maxPeriodMillis, controller.PeriodMillis());
+  TEST_ASSERT_EQUAL_UINT8(bounds.maxBatch, controller.BatchSize());
+  TEST_ASSERT_EQUAL_UINT32(11, controller.Backoffs());
+}
+
+void test_backlog_grows_batch_rssi_backs_off(void) {
+  // a backed up queue only needs a larger batch, a slower rate would grow it
+  uint32_t backoffs = controller.Backoffs();
+  controller.Update(Inputs(10, 0, 60, -60, true));
+  TEST_ASSERT_EQUAL_UINT8(RATE_FLAG_BACKLOG | RATE_FLAG_ACTIVE, controller.Flags());
+  TEST_ASSERT_EQUAL_UINT16(100, controller.PeriodMillis());
+  TEST_ASSERT_EQUAL_UINT8(2, controller.BatchSize());
+  TEST_ASSERT_EQUAL_UINT32(backoffs, controller.Backoffs());
+
+  controller.Update(Inputs(10, 0, 0, -95, false));
+  TEST_ASSERT_EQUAL_UINT8(RATE_FLAG_RSSI, controller.Flags());
+  TEST_ASSERT_EQUAL_UINT16(200, controller.PeriodMillis());
+  TEST_ASSERT_EQUAL_UINT8(4, controller.BatchSize());
+
+  // an RSSI we could not read is not a weak one
+  TEST_ASSERT_FALSE(controller.Update(Inputs(10, 0, 0, RATE_RSSI_UNKNOWN, false)));
+  TEST_ASSERT_EQUAL_UINT8(0, controller.Flags());
+}
+
+void test_creeps_back_only_while_active(void) {
+  for (int step = 0; step < 3; step++) {
+    controller.Update(Inputs(10, 1, 0, -60, true));
+  }
+  TEST_ASSERT_EQUAL_UINT16(800, controller.PeriodMillis());
+
+  // nothing more to send, nothing to probe for
+  TEST_ASSERT_FALSE(controller.Update(Inputs(10, 0, 0, -60, false)));
+  TEST_ASSERT_FALSE(controller.Update(Inputs(0, 0, 0, -60, true)));
+
+  TEST_ASSERT_TRUE(controller.Update(Inputs(10, 0, 0, -60, true)));
+  TEST_ASSERT_EQUAL_UINT16(700, controller.PeriodMillis());
+  TEST_ASSERT_EQUAL_UINT8(7, controller.BatchSize());
+
+  int steps = 1;
+  while (controller.PeriodMillis() > bounds.minPeriodMillis && steps < 100) {
+    controller.Update(Inputs(10, 0, 0, -60, true));
+    steps++;
+  }
+  TEST_ASSERT_EQUAL_UINT16(bounds.minPeriodMillis, controller.PeriodMillis());
+  TEST_ASSERT_EQUAL_UINT8(bounds.minBatch, controller.BatchSize());
+  TEST_ASSERT_LESS_THAN(30, steps);
+}
+
+void test_lossy_link_against_fixed_rate(void) {
+  TestRun fixed = Run(false);
+  setUp();
+  TestRun controlled = Run(true);
+
+  char message[256];
+  snprintf(message, sizeof(message),
+    "fixed %lu of %lu samples, %lu failed notifies, stall %lu ms; controlled %lu of %lu, %lu failed, stall %lu ms, "
+    "slowest %u ms batch %u, recovered in %lu ms",
+    (unsigned long)fixed.delivered, (unsigned long)fixed.queued, (unsigned long)fixed.notifyFailed,
+    (unsigned long)fixed.longestStallMillis,
+    (unsigned long)controlled.delivered, (unsigned long)controlled.queued, (unsigned long)controlled.notifyFailed,
+    (unsigned long)controlled.longestStallMillis,
+    controlled.slowestPeriodMillis, controlled.largestBatch, (unsigned long)controlled.recoveredMillis);
+  TEST_MESSAGE(message);
+
+  // the congested gateway costs the fixed rate most of those twenty seconds
+  TEST_ASSERT_GREATER_THAN_UINT32(fixed.queued / 5, fixed.dropped);
+
+  // the controller carries them in larger, slower batches
+  TEST_ASSERT_GREATER_THAN_UINT32(fixed.delivered, controlled.delivered);
+  TEST_ASSERT_LESS_THAN_UINT32(controlled.queued / 10, controlled.dropped);
+  TEST_ASSERT_LESS_THAN_UINT32(fixed.notifyFailed / 4, controlled.notifyFailed);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(bounds.maxPeriodMillis * 2, controlled.longestStallMillis);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT16(bounds.maxPeriodMillis, controlled.slowestPeriodMillis);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT8(bounds.maxBatch, controlled.largestBatch);
+
+  // and is back near the fastest period soon after the gateway clears,
+  // the odd loss on air still costs it a back off now and then
+  TEST_ASSERT_GREATER_THAN_UINT32(0, controlled.recoveredMillis);
+  TEST_ASSERT_LESS_THAN_UINT32(15000, controlled.recoveredMillis);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_inconsistent_bounds_rejected);
+  RUN_TEST(test_backoff_halves_rate_within_bounds);
+  RUN_TEST(test_backlog_grows_batch_rssi_backs_off);
+  RUN_TEST(test_creeps_back_only_while_active);
+  RUN_TEST(test_lossy_link_against_fixed_rate);
+  return UNITY_END();
+}
@@ -0,0 +1,379 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the decoupled sampling path, a mock IMU trace
+              replayed at the sample rate into the SampleRingBuffer, fused
+              per sample and drained at a slower notify rate. Then the
+              sketch itself, src/main.cpp on the hostbench shims, with a
+              CSV trace replayed through its SampleIMU and FuseIMU tasks by
+              a sensor running off its nominal rate
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <Arduino.h>
+#include <HostShim.h>
+#include <FusionEngine.h>
+#include <SampleRingBuffer.h>
+#include <TelemetryBatch.h>
+#include <LatencyTrace.h>
+#include <Lsm9ds1Fifo.h>
+
+#define TEST_SAMPLE_HZ        119
+#define TEST_NOTIFY_HZ        10
+#define TEST_SECONDS          30
+#define TEST_RING_CAPACITY    32
+#define TEST_DEGREES          (180.0f / (float)M_PI)
+
+#define TEST_TRACE_FILE       "imu_trace.csv"
+#define TEST_RATE_ERROR_PPM   15000.0     // the sensor runs 1.5% fast
+#define TEST_LOOP_MICROS      50
+#define TEST_CONNECT_MICROS   500000UL
+#define TEST_SETTLE_MICROS    500000UL
+#define TEST_SKETCH_SECONDS   20
+#define TEST_BATCH_SIZE       4
+#define TEST_FLUSH_MS         100
+#define TEST_FIFO_PERIOD      ((unsigned long)(8 * 1000000.0 / TEST_SAMPLE_HZ) / 2)   // SamplePeriodMicros()
+
+// the sketch of src/main.cpp
+void setup();
+void loop();
+
+struct MockSample {
+  uint32_t  sequence;
+  float     gyroscope[3];
+  float     acceleration[3];
+  float     magnetometer[3];
+};
+
+/* --------------------------------------------------------------------------
+    Mock IMU, a board held still at a roll and pitch, gravity and a level
+    north field seen through that tilt, with a small gyro noise
+   -------------------------------------------------------------------------- */
+static void MockRead(uint32_t sequence, float roll, float pitch, MockSample& sample) {
+  float noise = (float)((sequence * 7919) % 11) * 0.02f - 0.1f;
+  sample.sequence = sequence;
+  sample.gyroscope[0] = noise;
+  sample.gyroscope[1] = -noise;
+  sample.gyroscope[2] = noise * 0.5f;
+  sample.acceleration[0] = -sinf(pitch);
+  sample.acceleration[1] = cosf(pitch) * sinf(roll);
+  sample.acceleration[2] = cosf(pitch) * cosf(roll);
+  sample.magnetometer[0] = cosf(pitch);
+  sample.magnetometer[1] = sinf(roll) * sinf(pitch);
+  sample.magnetometer[2] = cosf(roll) * sinf(pitch);
+}
+
+static void Fuse(FusionEngine& engine, const MockSample& sample) {
+  engine.Update(sample.gyroscope[0], sample.gyroscope[1], sample.gyroscope[2],
+    sample.acceleration[0], sample.acceleration[1], sample.acceleration[2],
+    sample.magnetometer[0], sample.magnetometer[1], sample.magnetometer[2]);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_every_sample_is_fused_between_notifies(void) {
+  FusionEngine engine;
+  SampleRingBuffer<MockSample, TEST_RING_CAPACITY> ring;
+  engine.Begin(FUSION_MADGWICK, TEST_SAMPLE_HZ);
+
+  uint32_t fused = 0;
+  uint32_t expected = 0;
+  uint32_t samples = TEST_SAMPLE_HZ * TEST_SECONDS;
+  for (uint32_t sequence = 0; sequence < samples; sequence++) {
+    MockSample sample;
+    MockRead(sequence, 0.0f, 0.0f, sample);
+    ring.Push(sample);
+
+    // the notify rate drains whatever the sample rate queued since
+    if ((sequence + 1) % (TEST_SAMPLE_HZ / TEST_NOTIFY_HZ) == 0) {
+      for (size_t i = 0; i < ring.Count(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(expected++, ring.Peek(i).sequence);
+        Fuse(engine, ring.Peek(i));
+        fused++;
+      }
+      ring.Pop(ring.Count());
+    }
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(samples, ring.Pushed());
+  TEST_ASSERT_EQUAL_UINT32(samples - ring.Count(), fused);
+  TEST_ASSERT_EQUAL_UINT32(0, ring.Overflows());
+  TEST_ASSERT_EQUAL_UINT32(0, ring.Dropped());
+}
+
+void test_fusion_converges_on_the_replayed_tilt(void) {
+  const float roll = 20.0f / TEST_DEGREES;
+  const float pitch = -10.0f / TEST_DEGREES;
+  FusionEngine engine;
+  engine.Begin(FUSION_MADGWICK, TEST_SAMPLE_HZ);
+
+  for (uint32_t sequence = 0; sequence < TEST_SAMPLE_HZ * TEST_SECONDS; sequence++) {
+    MockSample sample;
+    MockRead(sequence, roll, pitch, sample);
+    Fuse(engine, sample);
+  }
+
+  float euler[3];
+  engine.GetEuler(euler);
+  TEST_ASSERT_FLOAT_WITHIN(2.0f, 0.0f, euler[0] * TEST_DEGREES);
+  TEST_ASSERT_FLOAT_WITHIN(2.0f, pitch * TEST_DEGREES, euler[1] * TEST_DEGREES);
+  TEST_ASSERT_FLOAT_WITHIN(2.0f, roll * TEST_DEGREES, euler[2] * TEST_DEGREES);
+}
+
+void test_a_stalled_notify_keeps_the_latest_samples(void) {
+  SampleRingBuffer<MockSample, TEST_RING_CAPACITY> ring;
+
+  // nothing drains for a second, the ring overwrites its oldest samples
+  for (uint32_t sequence = 0; sequence < TEST_SAMPLE_HZ; sequence++) {
+    MockSample sample;
+    MockRead(sequence, 0.0f, 0.0f, sample);
+    ring.Push(sample);
+  }
+
+  TEST_ASSERT_TRUE(ring.Full());
+  TEST_ASSERT_EQUAL_UINT32(TEST_SAMPLE_HZ - TEST_RING_CAPACITY, ring.Overflows());
+  TEST_ASSERT_EQUAL_UINT32(TEST_SAMPLE_HZ - TEST_RING_CAPACITY, ring.Peek(0).sequence);
+  TEST_ASSERT_EQUAL_UINT32(TEST_SAMPLE_HZ - 1, ring.Peek(ring.Count() - 1).sequence);
+}
+
+/* --------------------------------------------------------------------------
+    The trace, a row of ax,ay,az (g), gx,gy,gz (dps), mx,my,mz (uT) per
+    sample as the hostbench replays it, next to this file. It always moves
+    so the calibration never takes a gyro bias out, and no two rows read
+    the same, so every sample that comes out names the row it came from
+   -------------------------------------------------------------------------- */
+static std::vector<HostImuSample> trace;
+
+static bool LoadTrace() {
+  char path[512];
+  const char* slash = strrchr(__FILE__, '/');
+  size_t directory = slash ? (size_t)(slash - __FILE__ + 1) : 0;
+  snprintf(path, sizeof(path), "%.*s%s", (int)directory, __FILE__, TEST_TRACE_FILE);
+
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    HostImuSample sample;
+    if (sscanf(line, "%f,%f,%f,%f,%f,%f,%f,%f,%f",
+               &sample.acceleration[0], &sample.acceleration[1], &sample.acceleration[2],
+               &sample.gyroscope[0], &sample.gyroscope[1], &sample.gyroscope[2],
+               &sample.magnetometer[0], &sample.magnetometer[1], &sample.magnetometer[2]) == 9) {
+      trace.push_back(sample);
+    }
+  }
+  fclose(file);
+  return !trace.empty();
+}
+
+static void TraceRow(uint32_t index, HostImuSample& sample) {
+  sample = trace[index % trace.size()];
+}
+
+// what the driver reads back for a trace value, through the LSM9DS1 LSBs
+static float Quantized(float value, float scale) {
+  return (int16_t)roundf(value / scale) * scale;
+}
+
+static bool SameRow(const TelemetrySample& sample, size_t row) {
+  for (int axis = 0; axis < 3; axis++) {
+    if (sample.acceleration[axis] != Quantized(trace[row].acceleration[axis], LSM9DS1_ACCEL_SCALE) ||
+        sample.gyroscope[axis] != Quantized(trace[row].gyroscope[axis], LSM9DS1_GYRO_SCALE))
+      return false;
+  }
+  return true;
+}
+
+/* --------------------------------------------------------------------------
+    The Central/Gateway takes the raw samples in batches, every sample the
+    fusion stage took once it subscribed, and the latency trace of the
+    frames, which has when the newest sample of each was taken and fused
+   -------------------------------------------------------------------------- */
+static struct {
+  bool                          run;
+  double                        traceHz;
+  unsigned long                 endMicros;
+  std::vector<TelemetrySample>  batched;
+  uint32_t                      undecoded;
+  uint32_t                      traced;
+  int32_t                       fuseMin;
+  int32_t                       fuseMax;
+  int64_t                       fuseTotal;
+} sketch;
+
+static void Notified(uint16_t, const char* uuid, const uint8_t* data, int length) {
+  if (strcmp(uuid, "A002") == 0) {
+    TelemetrySample samples[TEST_RING_CAPACITY];
+    uint16_t sequence;
+    size_t count;
+    if (DecodeTelemetryBatch(data, length, sequence, samples, TEST_RING_CAPACITY, count)) {
+      sketch.batched.insert(sketch.batched.end(), samples, samples + count);
+    } else {
+      sketch.undecoded++;
+    }
+  } else if (strcmp(uuid, "9904") == 0) {
+    TraceEntry entries[TEST_RING_CAPACITY];
+    uint16_t lost;
+    size_t count;
+    if (!DecodeLatencyTrace(data, length, lost, entries, TEST_RING_CAPACITY, count))
+      return;
+    for (size_t i = 0; i < count; i++) {
+      // the batches skip the fusion stage and trace no fused time
+      if (entries[i].fusedMicros == 0)
+        continue;
+      int32_t latency = (int32_t)(entries[i].fusedMicros - entries[i].sampledMicros);
+      sketch.fuseMin = sketch.traced == 0 || latency < sketch.fuseMin ? latency : sketch.fuseMin;
+      sketch.fuseMax = sketch.traced == 0 || latency > sketch.fuseMax ? latency : sketch.fuseMax;
+      sketch.fuseTotal += latency;
+      sketch.traced++;
+    }
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Boot the sketch once on the simulated clock, connect and subscribe to
+    the batches and the latency trace, then run it TEST_SKETCH_SECONDS
+   -------------------------------------------------------------------------- */
+static void RunSketch() {
+  if (sketch.run)
+    return;
+  sketch.run = true;
+
+  TEST_ASSERT_TRUE_MESSAGE(LoadTrace(), "no " TEST_TRACE_FILE " next to the test");
+  sketch.traceHz = TEST_SAMPLE_HZ * (1.0 + TEST_RATE_ERROR_PPM / 1e6);
+  HostImuBegin(TraceRow, sketch.traceHz);
+  HostImuRateError(TEST_RATE_ERROR_PPM);
+  HostOnNotify(Notified);
+
+  setup();
+  while (micros() < TEST_CONNECT_MICROS) {
+    loop();
+    HostClockAdvance(TEST_LOOP_MICROS);
+  }
+
+  // [0] batch size, [1] reserved, [2..3] flush interval (ms)
+  const uint8_t batchConfig[4] = { TEST_BATCH_SIZE, 0, TEST_FLUSH_MS, 0 };
+  const uint8_t traceConfig[1] = { 0x02 };
+  const uint8_t telemetryFrequency[4] = { 0xF4, 0x01, 0, 0 };   // 500 ms, the fastest frame rate
+  HostCentralConnect(0, 185);
+  HostCentralWrite(0, "3002", batchConfig, sizeof(batchConfig));
+  HostCentralWrite(0, "9903", traceConfig, sizeof(traceConfig));
+  HostCentralWrite(0, "3001", telemetryFrequency, sizeof(telemetryFrequency));
+
+  // the connection wakes the power manager to the full rate, the samples
+  // queued at the idle rate before it get the new spacing
+  while (micros() < TEST_CONNECT_MICROS + TEST_SETTLE_MICROS) {
+    loop();
+    HostClockAdvance(TEST_LOOP_MICROS);
+  }
+  HostCentralSubscribe(0, "A002");
+  HostCentralSubscribe(0, "A001");
+  HostCentralSubscribe(0, "9904");
+
+  sketch.endMicros = micros() + TEST_SKETCH_SECONDS * 1000000UL;
+  while (micros() < sketch.endMicros) {
+    loop();
+    HostClockAdvance(TEST_LOOP_MICROS);
+  }
+}
+
+// the trace sample the n-th batched sample is, counted from IMU.begin()
+static uint32_t TraceIndex(size_t n) {
+  const TelemetrySample& sample = sketch.batched[n];
+  size_t row = 0;
+  while (row < trace.size() && !SameRow(sample, row)) {
+    row++;
+  }
+  TEST_ASSERT_TRUE_MESSAGE(row < trace.size(), "a batched sample is no row of the trace");
+
+  // the lap of the trace it was taken in, the one its stamp is closest to
+  double taken = (sample.timestampMicros - HostImuStatistics().startMicros) * sketch.traceHz / 1e6;
+  double lap = floor((taken - row) / trace.size() + 0.5);
+  return (uint32_t)(lap * trace.size() + row);
+}
+
+void test_sketch_fuses_every_sample_once_in_order(void) {
+  RunSketch();
+  const HostImuStats& imu = HostImuStatistics();
+  TEST_ASSERT_EQUAL_UINT32(0, sketch.undecoded);
+  TEST_ASSERT_EQUAL_UINT32(0, imu.overruns);
+  TEST_ASSERT_TRUE(sketch.batched.size() > TEST_SKETCH_SECONDS * TEST_SAMPLE_HZ * 9 / 10);
+
+  // each sample the one after the last, nothing dropped or repeated between the stages
+  uint32_t first = TraceIndex(0);
+  for (size_t n = 1; n < sketch.batched.size(); n++) {
+    size_t row = (first + n) % trace.size();
+    if (!SameRow(sketch.batched[n], row)) {
+      char message[96];
+      snprintf(message, sizeof(message), "batched sample %u is not trace row %u", (unsigned)n, (unsigned)row);
+      TEST_FAIL_MESSAGE(message);
+    }
+  }
+
+  // and nothing held back, the newest batched sample no older than a
+  // sampling tick and the batch flush interval
+  uint32_t last = first + (uint32_t)sketch.batched.size() - 1;
+  double taken = imu.startMicros + last * 1e6 / sketch.traceHz;
+  TEST_ASSERT_TRUE(sketch.endMicros - taken <= TEST_FIFO_PERIOD + TEST_FLUSH_MS * 1000UL);
+
+  char message[96];
+  snprintf(message, sizeof(message), "%u samples fused and batched in order, the last %.0f us before the end",
+    (unsigned)sketch.batched.size(), sketch.endMicros - taken);
+  TEST_MESSAGE(message);
+}
+
+void test_sketch_stamps_follow_a_sensor_off_its_rate(void) {
+  RunSketch();
+  const HostImuStats& imu = HostImuStatistics();
+
+  // against when the model took each sample, for the whole run
+  double worst = 0;
+  uint32_t first = TraceIndex(0);
+  for (size_t n = 0; n < sketch.batched.size(); n++) {
+    double taken = imu.startMicros + (first + n) * 1e6 / sketch.traceHz;
+    double error = fabs(sketch.batched[n].timestampMicros - taken);
+    worst = error > worst ? error : worst;
+  }
+  TEST_ASSERT_TRUE(worst <= 2 * TEST_FIFO_PERIOD);
+
+  char message[96];
+  snprintf(message, sizeof(message), "sample stamps within %.0f us of when they were taken", worst);
+  TEST_MESSAGE(message);
+}
+
+void test_sketch_fuses_within_a_sample_period(void) {
+  RunSketch();
+  TEST_ASSERT_TRUE(sketch.traced > 0);
+
+  // never fused before it was taken, and no later than the next sampling tick
+  TEST_ASSERT_TRUE(sketch.fuseMin >= 0);
+  TEST_ASSERT_TRUE(sketch.fuseMax <= (int32_t)TEST_FIFO_PERIOD);
+
+  char message[96];
+  snprintf(message, sizeof(message), "sampled->fused over %u frames min/avg/max %d/%.0f/%d us",
+    sketch.traced, sketch.fuseMin, (double)sketch.fuseTotal / sketch.traced, sketch.fuseMax);
+  TEST_MESSAGE(message);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_sample_is_fused_between_notifies);
+  RUN_TEST(test_fusion_converges_on_the_replayed_tilt);
+  RUN_TEST(test_a_stalled_notify_keeps_the_latest_samples);
+  RUN_TEST(test_sketch_fuses_every_sample_once_in_order);
+  RUN_TEST(test_sketch_stamps_follow_a_sensor_off_its_rate);
+  RUN_TEST(test_sketch_fuses_within_a_sample_period);
+  return UNITY_END();
+}
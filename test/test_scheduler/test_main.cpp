@@ -0,0 +1,196 @@
+/* ==========================================================================
+    File:     test_main.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host tests for the CooperativeScheduler against an injected
+              clock: periods, priorities, one-shots, overruns, the idle
+              hint and a micros() wrap
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <unity.h>
+#include <CooperativeScheduler.h>
+
+static unsigned long now;
+static unsigned long idled;
+static char order[16];
+static int ran;
+static unsigned long busyMicros;
+
+static unsigned long Clock() {
+  return now;
+}
+
+static void Idle(unsigned long idleMicros) {
+  idled = idleMicros;
+  now += idleMicros;
+}
+
+static void Record(char task) {
+  if (ran < (int)sizeof(order) - 1)
+    order[ran] = task;
+  ran++;
+  now += busyMicros;
+}
+
+static void TaskA() { Record('a'); }
+static void TaskB() { Record('b'); }
+static void TaskC() { Record('c'); }
+
+void setUp(void) {
+  now = 1000;
+  idled = 0;
+  ran = 0;
+  busyMicros = 0;
+  memset(order, 0, sizeof(order));
+}
+
+void tearDown(void) {
+}
+
+void test_periodic_runs_once_per_period(void) {
+  CooperativeScheduler scheduler(Clock);
+  int task = scheduler.AddPeriodic("a", 1, 1000, TaskA);
+  scheduler.Start(task, 1000);
+
+  for (int step = 0; step <= 10000; step += 100) {
+    scheduler.RunPending(1000);
+    now += 100;
+  }
+
+  TEST_ASSERT_EQUAL(10, ran);
+  TEST_ASSERT_EQUAL_UINT32(10, scheduler.Stats(task).runs);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.Stats(task).overruns);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.Stats(task).maxJitterMicros);
+}
+
+void test_priority_orders_due_tasks(void) {
+  CooperativeScheduler scheduler(Clock);
+  int c = scheduler.AddPeriodic("c", 3, 1000, TaskC);
+  int a = scheduler.AddPeriodic("a", 1, 1000, TaskA);
+  int b = scheduler.AddPeriodic("b", 2, 1000, TaskB);
+  scheduler.Start(c);
+  scheduler.Start(b);
+  scheduler.Start(a);
+
+  scheduler.RunPending(1000);
+  TEST_ASSERT_EQUAL_STRING("abc", order);
+}
+
+void test_one_shot_runs_once(void) {
+  CooperativeScheduler scheduler(Clock);
+  int task = scheduler.AddOneShot("a", 1, TaskA);
+  TEST_ASSERT_FALSE(scheduler.Active(task));
+
+  scheduler.Start(task, 500);
+  TEST_ASSERT_EQUAL(500, scheduler.RunPending(10000));
+  now += 500;
+  scheduler.RunPending(10000);
+  now += 5000;
+  scheduler.RunPending(10000);
+
+  TEST_ASSERT_EQUAL(1, ran);
+  TEST_ASSERT_FALSE(scheduler.Active(task));
+}
+
+void test_overrun_skips_missed_runs(void) {
+  CooperativeScheduler scheduler(Clock);
+  int task = scheduler.AddPeriodic("a", 1, 1000, TaskA);
+  scheduler.Start(task, 1000);
+
+  // the loop was stuck for three and a half periods
+  now += 4500;
+  scheduler.RunPending(1000);
+  scheduler.RunPending(1000);
+  TEST_ASSERT_EQUAL(1, ran);
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler.Stats(task).overruns);
+  TEST_ASSERT_EQUAL_UINT32(3500, scheduler.Stats(task).maxJitterMicros);
+
+  now += 1000;
+  scheduler.RunPending(1000);
+  TEST_ASSERT_EQUAL(2, ran);
+}
+
+void test_run_idles_until_the_next_deadline(void) {
+  CooperativeScheduler scheduler(Clock, Idle);
+  int a = scheduler.AddPeriodic("a", 1, 3000, TaskA);
+  int b = scheduler.AddPeriodic("b", 2, 2000, TaskB);
+  scheduler.Start(a, 3000);
+  scheduler.Start(b, 2000);
+
+  scheduler.Run(10000);
+  TEST_ASSERT_EQUAL(2000, idled);
+  scheduler.Run(10000);
+  TEST_ASSERT_EQUAL_STRING("b", order);
+  TEST_ASSERT_EQUAL(1000, idled);
+  scheduler.Run(10000);
+  TEST_ASSERT_EQUAL_STRING("ba", order);
+
+  // capped at maxIdle with nothing due sooner
+  scheduler.Stop(a);
+  scheduler.Stop(b);
+  scheduler.Run(750);
+  TEST_ASSERT_EQUAL(750, idled);
+}
+
+void test_shorter_period_pulls_the_deadline_in(void) {
+  CooperativeScheduler scheduler(Clock);
+  int task = scheduler.AddPeriodic("a", 1, 10000, TaskA);
+  scheduler.Start(task, 10000);
+
+  scheduler.SetPeriod(task, 1000);
+  now += 1000;
+  scheduler.RunPending(10000);
+  TEST_ASSERT_EQUAL(1, ran);
+}
+
+void test_run_time_is_measured(void) {
+  CooperativeScheduler scheduler(Clock);
+  int task = scheduler.AddPeriodic("a", 1, 1000, TaskA);
+  scheduler.Start(task);
+
+  busyMicros = 250;
+  scheduler.RunPending(1000);
+  TEST_ASSERT_EQUAL_UINT32(250, scheduler.Stats(task).maxRunMicros);
+
+  scheduler.ResetStats();
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.Stats(task).runs);
+}
+
+void test_deadlines_survive_the_clock_wrap(void) {
+  CooperativeScheduler scheduler(Clock);
+  int task = scheduler.AddPeriodic("a", 1, 1000, TaskA);
+  now = (unsigned long)-1500;
+  scheduler.Start(task, 1000);
+
+  for (int step = 0; step <= 5000; step += 100) {
+    scheduler.RunPending(1000);
+    now += 100;
+  }
+
+  TEST_ASSERT_EQUAL(5, ran);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.Stats(task).overruns);
+}
+
+void test_task_table_is_bounded(void) {
+  CooperativeScheduler scheduler(Clock);
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    TEST_ASSERT_EQUAL(i, scheduler.AddPeriodic("a", 1, 1000, TaskA));
+  }
+  TEST_ASSERT_EQUAL(-1, scheduler.AddOneShot("b", 1, TaskB));
+  TEST_ASSERT_EQUAL(SCHEDULER_MAX_TASKS, scheduler.TaskCount());
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_periodic_runs_once_per_period);
+  RUN_TEST(test_priority_orders_due_tasks);
+  RUN_TEST(test_one_shot_runs_once);
+  RUN_TEST(test_overrun_skips_missed_runs);
+  RUN_TEST(test_run_idles_until_the_next_deadline);
+  RUN_TEST(test_shorter_period_pulls_the_deadline_in);
+  RUN_TEST(test_run_time_is_measured);
+  RUN_TEST(test_deadlines_survive_the_clock_wrap);
+  RUN_TEST(test_task_table_is_bounded);
+  return UNITY_END();
+}
@@ -0,0 +1,470 @@
+/* ==========================================================================
+    File:     CentralSim.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Multi central simulator, runs the firmware's subscriber stage
+              on the host libraries against a mocked BLE stack with one
+              link per Central/Gateway, each with its own throughput, and
+              checks that every Central decodes what it asked for and that
+              a slow link never costs a fast one a record
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "../fleetsim/SimImuSource.h"
+#include <SubscriberHub.h>
+#include <FeatureExtractor.h>
+#include <FusionEngine.h>
+#include <CompactCodec.h>
+#include <CompactFrame.h>
+#include <TelemetryFrame.h>
+#include <deque>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_TICK_MICROS         500UL
+#define SIM_MAX_PAYLOAD         182         // BLE_ATT_MTU 185 less the ATT header
+#define SIM_SUBSCRIBER_MICROS   10000UL     // SUBSCRIBER_TASK_MICROS
+#define SIM_LINK_BUFFERS        4           // controller TX buffers per link
+
+// the characteristic UUIDs of CHARACTERISTIC_REGISTRY the subscribers take
+enum SIM_UUIDS: uint16_t {
+  SIM_UUID_ACCELEROMETER  = 0x4001,
+  SIM_UUID_GYROSCOPE      = 0x5001,
+  SIM_UUID_MAGNETOMETER   = 0x6001,
+  SIM_UUID_ORIENTATION    = 0x7001,
+  SIM_UUID_FRAME          = 0xA001,
+  SIM_UUID_FEATURES       = 0xB001
+};
+
+// SUBSCRIBER_CHANNELS of the firmware, the record is the channel here
+enum SIM_CHANNELS: int {
+  SIM_FRAME = 0,
+  SIM_ACCELEROMETER,
+  SIM_GYROSCOPE,
+  SIM_MAGNETOMETER,
+  SIM_ORIENTATION,
+  SIM_FEATURES,
+  SIM_CHANNEL_COUNT
+};
+
+static const char* const channelNames[SIM_CHANNEL_COUNT] = { "frame", "accel", "gyro", "mag", "orientation", "features" };
+static const uint16_t channelUuids[SIM_CHANNEL_COUNT] = {
+  SIM_UUID_FRAME, SIM_UUID_ACCELEROMETER, SIM_UUID_GYROSCOPE, SIM_UUID_MAGNETOMETER, SIM_UUID_ORIENTATION, SIM_UUID_FEATURES
+};
+static const char* const encodingNames[ENCODING_COUNT] = { "f32", "i16", "f16", "d8" };
+
+/* --------------------------------------------------------------------------
+    One Central/Gateway, the controller end of its link and what it
+    decodes on its end
+      linkRate        notifications per second the link carries
+      intervalMicros  connection interval, the link delivers in bursts
+   -------------------------------------------------------------------------- */
+struct MockCentral {
+  char              name[32];
+  uint16_t          connection;
+  uint32_t          linkRate;
+  uint32_t          intervalMicros;
+  SubscriberConfig  config;
+  int               slot;
+
+  std::deque<std::vector<uint8_t> > buffers;
+  double            credit;
+  uint32_t          nextEventMicros;
+
+  CompactChannel    frameChannels[COMPACT_FRAME_CHANNEL_COUNT];
+  CompactChannel    vectorChannels[4];
+  bool              seenFrame;
+  uint16_t          nextSequence;
+  uint64_t          received[SIM_CHANNEL_COUNT];
+  uint64_t          bytes;
+  uint64_t          gaps;
+  uint64_t          errors;
+  uint64_t          latencyTotal;
+  uint32_t          latencyMax;
+};
+
+static std::vector<MockCentral> centrals;
+static SubscriberHub hub;
+static uint32_t simNow = 0;
+static uint16_t payloadSize = 182;
+
+static MockCentral* FindCentral(uint16_t connection) {
+  for (MockCentral& central : centrals) {
+    if (central.connection == connection)
+      return &central;
+  }
+  return 0;
+}
+
+/* --------------------------------------------------------------------------
+    Mocked stack, a notification takes one of the link's controller
+    buffers and is refused while they are all in use, the connection
+    events free them at the link rate
+   -------------------------------------------------------------------------- */
+static bool MockSend(uint16_t connection, int record, const uint8_t* data, size_t length) {
+  MockCentral* central = FindCentral(connection);
+  if (!central || central->buffers.size() >= SIM_LINK_BUFFERS)
+    return false;
+
+  std::vector<uint8_t> notification(2 + length);
+  PutUint16LE(&notification[0], channelUuids[record]);
+  memcpy(&notification[2], data, length);
+  central->buffers.push_back(notification);
+  return true;
+}
+
+static uint16_t MockPayloadSize(uint16_t) {
+  return payloadSize - 2;
+}
+
+static void Deliver(MockCentral& central, const uint8_t* value, size_t length) {
+  uint16_t uuid = GetUint16LE(&value[0]);
+  const uint8_t* payload = &value[2];
+  length -= 2;
+
+  int channel = 0;
+  while (channel < SIM_CHANNEL_COUNT && channelUuids[channel] != uuid) {
+    channel++;
+  }
+  if (channel == SIM_CHANNEL_COUNT || !(central.config.channels & (1U << channel))) {
+    central.errors++;
+    return;
+  }
+
+  bool decoded = true;
+  if (channel == SIM_FRAME) {
+    TelemetryFrame frame;
+    decoded = DecodeCompactTelemetryFrame(payload, length, central.frameChannels, frame);
+    if (decoded) {
+      if (central.seenFrame && frame.sequence != central.nextSequence) {
+        central.gaps += (uint16_t)(frame.sequence - central.nextSequence);
+      }
+      central.seenFrame = true;
+      central.nextSequence = frame.sequence + 1;
+      uint32_t latency = simNow - frame.timestampMicros;
+      central.latencyTotal += latency;
+      if (latency > central.latencyMax) {
+        central.latencyMax = latency;
+      }
+    }
+  } else if (channel == SIM_FEATURES) {
+    FeatureSet features;
+    decoded = DecodeFeatureSet(payload, length, features);
+  } else {
+    float values[4];
+    if (central.config.encoding == ENCODING_FLOAT32) {
+      decoded = length == 3 * sizeof(float);
+    } else {
+      decoded = CompactDecodeVector(central.vectorChannels[channel - SIM_ACCELEROMETER], payload, length, values, 3) == length;
+    }
+  }
+
+  if (decoded) {
+    central.received[channel]++;
+    central.bytes += length + 2;
+  } else {
+    central.errors++;
+  }
+}
+
+static void ConnectionEvent(MockCentral& central) {
+  central.credit += central.linkRate * (double)central.intervalMicros / 1000000.0;
+  while (central.credit >= 1.0 && !central.buffers.empty()) {
+    const std::vector<uint8_t>& notification = central.buffers.front();
+    Deliver(central, notification.data(), notification.size());
+    central.buffers.pop_front();
+    central.credit -= 1.0;
+  }
+
+  // an idle link does not save up for later
+  if (central.buffers.empty() && central.credit > 1.0) {
+    central.credit = 1.0;
+  }
+  central.nextEventMicros += central.intervalMicros;
+}
+
+/* --------------------------------------------------------------------------
+    Device, the shared sampling pipeline and the firmware's subscriber
+    stage (QueueSubscriber() and PublishSubscribers() in main.cpp)
+   -------------------------------------------------------------------------- */
+struct SimState {
+  SimImuSource      source;
+  FusionEngine      fusion;
+  FeatureExtractor  features;
+  SimImuSample      latest;
+  uint32_t          sampleMicros;
+  float             orientation[3];
+  CompactChannel    vectorChannels[SUBSCRIBER_MAX_SLOTS][4];
+  CompactChannel    frameChannels[SUBSCRIBER_MAX_SLOTS][COMPACT_FRAME_CHANNEL_COUNT];
+  uint16_t          frameSequence[SUBSCRIBER_MAX_SLOTS];
+  uint64_t          samples;
+};
+
+static SimState device;
+
+static void BeginSlot(int slot, uint8_t keyframeInterval) {
+  CompactChannelBegin(device.vectorChannels[slot][0], COMPACT_SCALE_ACCELERATION, keyframeInterval);
+  CompactChannelBegin(device.vectorChannels[slot][1], COMPACT_SCALE_GYROSCOPE, keyframeInterval);
+  CompactChannelBegin(device.vectorChannels[slot][2], COMPACT_SCALE_MAGNETOMETER, keyframeInterval);
+  CompactChannelBegin(device.vectorChannels[slot][3], COMPACT_SCALE_ORIENTATION, keyframeInterval);
+  CompactFrameChannelsBegin(device.frameChannels[slot], keyframeInterval);
+  device.frameSequence[slot] = 0;
+}
+
+static void Sample() {
+  device.source.Next(device.latest);
+  device.sampleMicros = simNow;
+  device.samples++;
+  device.fusion.Update(
+    device.latest.gyroscope[0], device.latest.gyroscope[1], device.latest.gyroscope[2],
+    device.latest.acceleration[0], device.latest.acceleration[1], device.latest.acceleration[2],
+    device.latest.magnetometer[0], device.latest.magnetometer[1], device.latest.magnetometer[2]);
+
+  if (!hub.Wants(SIM_FEATURES))
+    return;
+
+  float values[FEATURE_AXES];
+  memcpy(&values[0], device.latest.acceleration, 3 * sizeof(float));
+  memcpy(&values[3], device.latest.gyroscope, 3 * sizeof(float));
+  if (device.features.Push(values, simNow)) {
+    FeatureSet features;
+    device.features.Compute(features);
+    uint8_t buffer[FEATURE_PAYLOAD_SIZE];
+    size_t length = EncodeFeatureSet(features, buffer, sizeof(buffer));
+    hub.Fanout(SIM_FEATURES, SIM_FEATURES, buffer, length);
+  }
+}
+
+static void QueueSubscriber(int slot) {
+  TelemetryEncoding encoding = (TelemetryEncoding)hub.Config(slot).encoding;
+  uint8_t buffer[TELEMETRY_FRAME_SIZE];
+
+  if (hub.Wants(slot, SIM_FRAME) && hub.Room(slot)) {
+    TelemetryFrame frame;
+    frame.flags = 0;
+    frame.sequence = device.frameSequence[slot]++;
+    frame.timestampMicros = device.sampleMicros;
+    memcpy(frame.acceleration, device.latest.acceleration, sizeof(frame.acceleration));
+    memcpy(frame.gyroscope, device.latest.gyroscope, sizeof(frame.gyroscope));
+    memcpy(frame.magnetometer, device.latest.magnetometer, sizeof(frame.magnetometer));
+    memcpy(frame.orientation, device.orientation, sizeof(frame.orientation));
+    size_t length = EncodeCompactTelemetryFrame(frame, device.frameChannels[slot], encoding, buffer, sizeof(buffer));
+    hub.Queue(slot, SIM_FRAME, buffer, length);
+  }
+
+  const float* vectors[4] = {
+    device.latest.acceleration, device.latest.gyroscope, device.latest.magnetometer, device.orientation
+  };
+  for (int i = 0; i < 4; i++) {
+    if (!hub.Wants(slot, SIM_ACCELEROMETER + i) || !hub.Room(slot))
+      continue;
+
+    size_t length;
+    if (encoding == ENCODING_FLOAT32) {
+      memcpy(buffer, vectors[i], 3 * sizeof(float));
+      length = 3 * sizeof(float);
+    } else {
+      length = CompactEncodeVector(device.vectorChannels[slot][i], encoding, vectors[i], 3, buffer);
+    }
+    hub.Queue(slot, SIM_ACCELEROMETER + i, buffer, length);
+  }
+}
+
+static void PublishSubscribers() {
+  bool euler = false;
+  for (int slot = 0; slot < SUBSCRIBER_MAX_SLOTS; slot++) {
+    if (!hub.Due(slot, simNow))
+      continue;
+    if (!euler) {
+      device.fusion.GetEuler(device.orientation);
+      euler = true;
+    }
+    QueueSubscriber(slot);
+  }
+  hub.Drain();
+}
+
+/* --------------------------------------------------------------------------
+    Options
+   -------------------------------------------------------------------------- */
+static bool ParseChannels(char* list, uint16_t& channels) {
+  channels = 0;
+  for (char* name = strtok(list, "+"); name; name = strtok(0, "+")) {
+    int channel = 0;
+    while (channel < SIM_CHANNEL_COUNT && strcmp(name, channelNames[channel]) != 0) {
+      channel++;
+    }
+    if (channel == SIM_CHANNEL_COUNT)
+      return false;
+    channels |= 1U << channel;
+  }
+  return channels != 0;
+}
+
+// NAME:LINK_RATE:INTERVAL_MS:PERIOD_MS:CHANNELS:ENCODING, central is zeroed
+static bool ParseCentral(const char* spec, MockCentral& central) {
+  char copy[256];
+  char* fields[6];
+  int count = 0;
+  snprintf(copy, sizeof(copy), "%s", spec);
+  for (char* field = copy; field && count < 6; count++) {
+    fields[count] = field;
+    field = strchr(field, ':');
+    if (field) {
+      *field++ = 0;
+    }
+  }
+  if (count != 6)
+    return false;
+
+  snprintf(central.name, sizeof(central.name), "%s", fields[0]);
+  central.linkRate = strtoul(fields[1], 0, 10);
+  central.intervalMicros = (uint32_t)(atof(fields[2]) * 1000.0);
+  central.config.periodMillis = (uint16_t)atoi(fields[3]);
+
+  int encoding = 0;
+  while (encoding < ENCODING_COUNT && strcmp(fields[5], encodingNames[encoding]) != 0) {
+    encoding++;
+  }
+  central.config.encoding = (uint8_t)encoding;
+  return ParseChannels(fields[4], central.config.channels) && encoding < ENCODING_COUNT &&
+         central.linkRate > 0 && central.intervalMicros >= 7500;
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: centralsim [options]\n"
+    "  --seconds N        simulated time (30)\n"
+    "  --mtu N            granted ATT MTU of every link (185)\n"
+    "  --central SPEC     add a Central/Gateway, the first one replaces the defaults\n"
+    "                     NAME:LINK_RATE:INTERVAL_MS:PERIOD_MS:CHANNELS:ENCODING\n"
+    "                     LINK_RATE notifications/s, CHANNELS frame+accel+gyro+mag+orientation+features\n"
+    "                     ENCODING f32, i16, f16 or d8\n"
+    "  the device has %d subscriber slots, any more Centrals get none\n", SUBSCRIBER_MAX_SLOTS);
+}
+
+int main(int argc, char** argv) {
+  static const char* const defaults[] = {
+    "gateway:300:15:10:frame:f32",
+    "phone:40:30:20:accel+gyro+orientation:i16",
+    "logger:100:30:50:frame+features:d8"
+  };
+  std::vector<const char*> specs;
+  int seconds = 30;
+  int mtu = 185;
+
+  for (int i = 1; i < argc; i++) {
+    const char* option = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : 0;
+    if (!value) {
+      Usage();
+      return 2;
+    } else if (strcmp(option, "--seconds") == 0) {
+      seconds = atoi(value);
+    } else if (strcmp(option, "--mtu") == 0) {
+      mtu = atoi(value);
+    } else if (strcmp(option, "--central") == 0) {
+      specs.push_back(value);
+    } else {
+      Usage();
+      return 2;
+    }
+    i++;
+  }
+  if (specs.empty()) {
+    specs.assign(defaults, defaults + sizeof(defaults) / sizeof(defaults[0]));
+  }
+  if (seconds < 1 || mtu < 23) {
+    Usage();
+    return 2;
+  }
+  payloadSize = (uint16_t)(mtu - 3 < SIM_MAX_PAYLOAD ? mtu - 3 : SIM_MAX_PAYLOAD);
+
+  // the Centrals connect one after the other and write their configs
+  const SubscriberBus bus = { MockSend, MockPayloadSize };
+  hub.Begin(bus);
+  centrals.resize(specs.size());
+  for (size_t i = 0; i < specs.size(); i++) {
+    MockCentral& central = centrals[i];
+    if (!ParseCentral(specs[i], central)) {
+      fprintf(stderr, "[centralsim] could not parse %s\n", specs[i]);
+      Usage();
+      return 2;
+    }
+    central.connection = (uint16_t)i;
+    central.nextEventMicros = central.intervalMicros;
+    CompactFrameChannelsBegin(central.frameChannels, COMPACT_DEFAULT_KEYFRAME);
+    CompactChannelBegin(central.vectorChannels[0], COMPACT_SCALE_ACCELERATION);
+    CompactChannelBegin(central.vectorChannels[1], COMPACT_SCALE_GYROSCOPE);
+    CompactChannelBegin(central.vectorChannels[2], COMPACT_SCALE_MAGNETOMETER);
+    CompactChannelBegin(central.vectorChannels[3], COMPACT_SCALE_ORIENTATION);
+
+    central.slot = hub.Attach(central.connection);
+    if (central.slot != SUBSCRIBER_NO_SLOT) {
+      hub.Configure(central.connection, central.config);
+      BeginSlot(central.slot, COMPACT_DEFAULT_KEYFRAME);
+    }
+  }
+
+  device.source.BeginSynthetic(1);
+  device.fusion.Begin(FUSION_MADGWICK, SIM_IMU_HZ);
+  device.samples = 0;
+
+  uint32_t end = seconds * 1000000UL;
+  double nextSample = 0.0;
+  uint32_t nextSubscriber = 0;
+  for (simNow = 0; simNow < end; simNow += SIM_TICK_MICROS) {
+    if (simNow >= nextSample) {
+      Sample();
+      nextSample += 1000000.0 / SIM_IMU_HZ;
+    }
+    if (simNow >= nextSubscriber) {
+      PublishSubscribers();
+      nextSubscriber += SIM_SUBSCRIBER_MICROS;
+    }
+    for (MockCentral& central : centrals) {
+      if (simNow >= central.nextEventMicros) {
+        ConnectionEvent(central);
+      }
+    }
+  }
+
+  // a Central whose link carries well over what it asked for loses nothing
+  printf("%-10s %5s %6s %6s %-4s %9s %9s %8s %8s %6s %6s %s\n",
+    "central", "slot", "link/s", "period", "enc", "wanted/s", "recv/s", "dropped", "blocked", "gaps", "errors", "frame latency avg/max ms");
+  bool failed = false;
+  for (MockCentral& central : centrals) {
+    uint64_t received = 0;
+    for (int channel = 0; channel < SIM_CHANNEL_COUNT; channel++) {
+      received += central.received[channel];
+    }
+
+    if (central.slot == SUBSCRIBER_NO_SLOT) {
+      printf("%-10s %5s  no slot, %d taken\n", central.name, "-", SUBSCRIBER_MAX_SLOTS);
+      continue;
+    }
+
+    const SubscriberStats& stats = hub.Stats(central.slot);
+    double wantedRate = (stats.queued + stats.dropped) / (double)seconds;
+    bool headroom = central.linkRate >= wantedRate * 1.25;
+    bool isolated = !headroom || (stats.dropped == 0 && central.gaps == 0);
+    if (!isolated || central.errors > 0) {
+      failed = true;
+    }
+
+    uint64_t frames = central.received[SIM_FRAME];
+    printf("%-10s %5d %6u %6u %-4s %9.1f %9.1f %8u %8u %6llu %6llu %.1f/%.1f%s\n",
+      central.name, central.slot, central.linkRate, central.config.periodMillis,
+      encodingNames[central.config.encoding], wantedRate, received / (double)seconds,
+      stats.dropped, stats.blocked,
+      (unsigned long long)central.gaps, (unsigned long long)central.errors,
+      frames ? central.latencyTotal / 1000.0 / frames : 0.0, central.latencyMax / 1000.0,
+      isolated ? "" : "  LOST RECORDS");
+  }
+
+  printf("samples            %llu\n", (unsigned long long)device.samples);
+  printf("result             %s\n", failed ? "FAILED" : "ok");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+/* ==========================================================================
+    File:     DecimBench.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host benchmark for the Decimator, the cost of the cascade per
+              IMU sample and the frequency response of every output rate,
+              how flat the kept band is and how far a tone that would
+              alias into it is pushed down
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <Decimator.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES 1
+#else
+#define BENCH_CYCLES 0
+#endif
+
+#define BENCH_PI              3.14159265358979323846
+#define BENCH_KEPT_BAND       0.3     // of the output rate, see Decimator.h
+#define BENCH_OUTPUTS         512     // fitted per tone once the cascade settled
+#define BENCH_SWEEP_TONES     160
+#define BENCH_MAX_RIPPLE_DB   0.1
+#define BENCH_MIN_REJECT_DB   55.0
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t Cycles() {
+#if BENCH_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* --------------------------------------------------------------------------
+    Cost, random blocks through all the stages for the given seconds
+   -------------------------------------------------------------------------- */
+static void Timing(double seconds, int block) {
+  static Decimator decimator;
+  static DecimatorBlock blocks[64];
+
+  srand(1);
+  for (int b = 0; b < 64; b++) {
+    blocks[b].count = (uint16_t)block;
+    for (int axis = 0; axis < DECIMATOR_AXES; axis++) {
+      for (int i = 0; i < DECIMATOR_BLOCK; i++) {
+        blocks[b].values[axis][i] = (float)rand() / RAND_MAX - 0.5f;
+      }
+    }
+  }
+
+  uint64_t samples = 0;
+  uint64_t cycles = 0;
+  Clock::time_point start = Clock::now();
+  Clock::time_point stop = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+  while (Clock::now() < stop) {
+    uint64_t before = Cycles();
+    for (int b = 0; b < 64; b++) {
+      decimator.Push(blocks[b]);
+    }
+    cycles += Cycles() - before;
+    samples += 64 * block;
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+  // every output of a stage is the centre and the pairs, for every axis
+  double multiplies = 0.0;
+  for (int stage = 1; stage <= DECIMATOR_MAX_STAGES; stage++) {
+    multiplies += (double)DECIMATOR_AXES * (DECIMATOR_SIDE_TAPS + 1) / (1UL << stage);
+  }
+
+  printf("timing (%d axes, %d samples per block)\n", DECIMATOR_AXES, block);
+  printf("  samples          %llu\n", (unsigned long long)samples);
+  printf("  ns per sample    %.1f\n", elapsed * 1e9 / samples);
+#if BENCH_CYCLES
+  printf("  cycles per sample %.1f\n", (double)cycles / samples);
+#else
+  printf("  cycles per sample n/a on this host\n");
+#endif
+  printf("  multiplies per sample %.1f\n", multiplies);
+  printf("  state            %u bytes\n\n", (unsigned)sizeof(Decimator));
+}
+
+/* --------------------------------------------------------------------------
+    Response to one tone, fed a sample at a time so every output of the
+    stage is seen. The outputs are fitted to a cosine and sine at the
+    frequency the tone lands on, which is exact for a linear filter
+   -------------------------------------------------------------------------- */
+static double AliasHz(double toneHz, double outputHz) {
+  double alias = fmod(toneHz, outputHz);
+  return alias > outputHz / 2.0 ? outputHz - alias : alias;
+}
+
+static double ToneGainDb(double inputHz, int stages, double toneHz) {
+  static Decimator decimator;
+  decimator.Reset();
+
+  double outputHz = Decimator::OutputHz((float)inputHz, stages);
+  double aliasHz = AliasHz(toneHz, outputHz);
+  uint32_t settle = (uint32_t)Decimator::DelaySamples(stages) * 2 + (1UL << stages);
+
+  DecimatorBlock block;
+  memset(&block, 0, sizeof(block));
+  block.count = 1;
+
+  // priming with the first sample would start on a step, start on zero
+  decimator.Push(block);
+
+  double cc = 0, ss = 0, cs = 0, yc = 0, ys = 0;
+  uint32_t seen = decimator.Outputs(stages);
+  uint32_t fitted = 0;
+  for (uint32_t n = 0; fitted < BENCH_OUTPUTS; n++) {
+    block.values[0][0] = (float)sin(2.0 * BENCH_PI * toneHz * n / inputHz);
+    decimator.Push(block);
+    if (decimator.Outputs(stages) == seen)
+      continue;
+    seen = decimator.Outputs(stages);
+    if (n < settle)
+      continue;
+
+    double phase = 2.0 * BENCH_PI * aliasHz * fitted / outputHz;
+    double c = cos(phase);
+    double s = sin(phase);
+    double y = decimator.Output(stages, 0);
+    cc += c * c;
+    ss += s * s;
+    cs += c * s;
+    yc += y * c;
+    ys += y * s;
+    fitted++;
+  }
+
+  // least squares a cos + b sin, a tone on DC or the output Nyquist has no sine
+  double a, b;
+  double det = cc * ss - cs * cs;
+  if (ss < 1e-6 * BENCH_OUTPUTS || fabs(det) < 1e-9) {
+    a = yc / cc;
+    b = 0.0;
+  } else {
+    a = (yc * ss - ys * cs) / det;
+    b = (ys * cc - yc * cs) / det;
+  }
+  double amplitude = sqrt(a * a + b * b);
+  return 20.0 * log10(amplitude > 1e-9 ? amplitude : 1e-9);
+}
+
+/* --------------------------------------------------------------------------
+    Worst ripple in the kept band and the weakest rejection of a tone above
+    the output Nyquist that lands inside it, for one output rate
+   -------------------------------------------------------------------------- */
+static bool Sweep(double inputHz, int stages, int points, bool print) {
+  double outputHz = Decimator::OutputHz((float)inputHz, stages);
+  double keptHz = BENCH_KEPT_BAND * outputHz;
+  double ripple = 0.0;
+  double reject = 1e9;
+
+  if (print) {
+    printf("response, %d stages, %.2f Hz out, kept band %.2f Hz\n", stages, outputHz, keptHz);
+    printf("  %10s %10s %10s\n", "tone Hz", "lands Hz", "gain dB");
+  }
+
+  for (int i = 0; i < BENCH_SWEEP_TONES; i++) {
+    double toneHz = (inputHz / 2.0) * (i + 0.5) / BENCH_SWEEP_TONES;
+    double aliasHz = AliasHz(toneHz, outputHz);
+    bool kept = toneHz <= keptHz;
+    bool aliased = toneHz > outputHz / 2.0 && aliasHz <= keptHz;
+    bool shown = print && (i % (BENCH_SWEEP_TONES / points) == 0);
+    if (!kept && !aliased && !shown)
+      continue;
+
+    double gain = ToneGainDb(inputHz, stages, toneHz);
+    if (kept && fabs(gain) > ripple) {
+      ripple = fabs(gain);
+    }
+    if (aliased && -gain < reject) {
+      reject = -gain;
+    }
+    if (shown) {
+      printf("  %10.2f %10.2f %10.1f%s\n", toneHz, aliasHz, gain, aliased ? "  aliases into the kept band" : "");
+    }
+  }
+
+  bool ok = ripple <= BENCH_MAX_RIPPLE_DB && reject >= BENCH_MIN_REJECT_DB;
+  double delayMillis = Decimator::DelaySamples(stages) * 1000.0 / inputHz;
+  printf("  %d stages %8.2f Hz  delay %7.0f ms  ripple %.3f dB  rejection %5.1f dB%s\n",
+    stages, outputHz, delayMillis, ripple, reject, ok ? "" : "  OUT OF SPEC");
+  if (print) {
+    printf("\n");
+  }
+  return ok;
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: decimbench [--rate HZ] [--seconds N] [--block N] [--stages N] [--points N]\n"
+    "  --rate HZ          IMU output data rate, 119 by default\n"
+    "  --seconds N        how long the timing runs, 2 by default\n"
+    "  --block N          samples per Push(), 1 to %d, %d by default\n"
+    "  --stages N         print the whole sweep for one output rate\n"
+    "  --points N         rows of that sweep, 20 by default\n",
+    DECIMATOR_BLOCK, DECIMATOR_BLOCK);
+}
+
+int main(int argc, char** argv) {
+  double rate = 119.0;
+  double seconds = 2.0;
+  int block = DECIMATOR_BLOCK;
+  int detail = 0;
+  int points = 20;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      rate = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--block") == 0 && i + 1 < argc) {
+      block = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--stages") == 0 && i + 1 < argc) {
+      detail = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--points") == 0 && i + 1 < argc) {
+      points = atoi(argv[++i]);
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (rate <= 0.0 || block < 1 || block > DECIMATOR_BLOCK || detail < 0 || detail > DECIMATOR_MAX_STAGES ||
+      points < 1 || points > BENCH_SWEEP_TONES) {
+    Usage();
+    return 1;
+  }
+
+  printf("half band taps, centre then outwards\n ");
+  for (int tap = 0; tap <= DECIMATOR_SIDE_TAPS; tap++) {
+    printf(" %.9f", Decimator::Coefficient(tap));
+  }
+  printf("\n\n");
+
+  Timing(seconds, block);
+
+  if (detail > 0) {
+    Sweep(rate, detail, points, true);
+  }
+
+  printf("output rates\n");
+  bool ok = true;
+  for (int stages = 1; stages <= DECIMATOR_MAX_STAGES; stages++) {
+    ok = Sweep(rate, stages, points, false) && ok;
+  }
+  printf("result             %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+/* ==========================================================================
+    File:     FeatureBench.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host benchmark for the FeatureExtractor, the cost of a window
+              (RMS, peak, crest and the FFT band levels of every axis) for
+              each window length, and a check of the levels against a tone
+              on every axis whose RMS and band are known
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <FeatureExtractor.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES 1
+#else
+#define BENCH_CYCLES 0
+#endif
+
+#define BENCH_PI              3.14159265358979323846
+#define BENCH_SAMPLES         1024    // random input, cycled through
+#define BENCH_MAX_LEVEL_ERROR 0.002   // of the tone RMS, float rounding only
+#define BENCH_MAX_BAND_ERROR  0.02    // square sum of the bands against the RMS
+#define BENCH_MAX_CODEC_ERROR 0.001   // half floats in the Features payload
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t Cycles() {
+#if BENCH_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static double Seconds(Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+/* --------------------------------------------------------------------------
+    Cost of one window length, random samples pushed for the given seconds.
+    Push() is timed per sample and Compute() per window, the window cost is
+    what the sketch pays every hop on top of the samples
+   -------------------------------------------------------------------------- */
+static void Timing(double seconds, double rate, int length, int overlap) {
+  static float samples[BENCH_SAMPLES][FEATURE_AXES];
+  static FeatureExtractor extractor;
+  static FeatureSet features;
+  static uint8_t payload[FEATURE_PAYLOAD_SIZE];
+
+  srand(1);
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    for (int axis = 0; axis < FEATURE_AXES; axis++) {
+      samples[i][axis] = (float)rand() / RAND_MAX - 0.5f;
+    }
+  }
+  extractor.Configure((uint16_t)length, (uint16_t)overlap);
+
+  uint64_t pushed = 0;
+  uint64_t windows = 0;
+  uint64_t computeCycles = 0;
+  Clock::duration pushTime = Clock::duration::zero();
+  Clock::duration computeTime = Clock::duration::zero();
+  Clock::duration encodeTime = Clock::duration::zero();
+
+  Clock::time_point stop = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+  int next = 0;
+  while (Clock::now() < stop) {
+
+    // a hop of samples at a time, so the clock is read once per window
+    Clock::time_point before = Clock::now();
+    bool ready = false;
+    while (!ready) {
+      ready = extractor.Push(samples[next], (uint32_t)pushed);
+      next = (next + 1) & (BENCH_SAMPLES - 1);
+      pushed++;
+    }
+    pushTime += Clock::now() - before;
+
+    before = Clock::now();
+    uint64_t beforeCycles = Cycles();
+    extractor.Compute(features);
+    computeCycles += Cycles() - beforeCycles;
+    computeTime += Clock::now() - before;
+
+    before = Clock::now();
+    EncodeFeatureSet(features, payload, sizeof(payload));
+    encodeTime += Clock::now() - before;
+    windows++;
+  }
+
+  int hop = length - overlap;
+  printf("  %6d %7d %4d %9llu %10.1f %11.1f %9.1f %9.1f %8.2f\n",
+    length, overlap, hop, (unsigned long long)windows,
+    Seconds(computeTime) * 1e9 / windows,
+#if BENCH_CYCLES
+    (double)computeCycles / windows,
+#else
+    0.0,
+#endif
+    Seconds(pushTime) * 1e9 / pushed,
+    Seconds(encodeTime) * 1e9 / windows,
+    rate / hop);
+}
+
+/* --------------------------------------------------------------------------
+    A whole number of cycles of a tone on every axis, each in the middle of
+    its own band, so the RMS is the amplitude over root two, the peak is the
+    amplitude and the levels of the bands square sum to the RMS
+   -------------------------------------------------------------------------- */
+static bool Levels(int length, bool print) {
+  static FeatureExtractor extractor;
+  FeatureSet features;
+  extractor.Configure((uint16_t)length, 0);
+
+  int bins = length / 2;
+  int binsPerBand = bins / FEATURE_BANDS > 0 ? bins / FEATURE_BANDS : 1;
+  int bands[FEATURE_AXES];
+  int cycles[FEATURE_AXES];
+  double amplitudes[FEATURE_AXES];
+  for (int axis = 0; axis < FEATURE_AXES; axis++) {
+    bands[axis] = 1 + axis % (FEATURE_BANDS - 3);
+    cycles[axis] = 1 + bands[axis] * binsPerBand + binsPerBand / 2;
+    amplitudes[axis] = 0.5 + 0.25 * axis;
+  }
+
+  float values[FEATURE_AXES];
+  for (int n = 0; n < length; n++) {
+    for (int axis = 0; axis < FEATURE_AXES; axis++) {
+      // an offset on top, the mean comes out before the levels
+      values[axis] = (float)(amplitudes[axis] * cos(2.0 * BENCH_PI * cycles[axis] * n / length) + 0.1 * axis);
+    }
+    extractor.Push(values, (uint32_t)n);
+  }
+  if (!extractor.Compute(features)) {
+    printf("  %6d no window after %d samples  FAILED\n", length, length);
+    return false;
+  }
+
+  uint8_t payload[FEATURE_PAYLOAD_SIZE];
+  FeatureSet decoded;
+  bool decodes = EncodeFeatureSet(features, payload, sizeof(payload)) == FEATURE_PAYLOAD_SIZE &&
+    DecodeFeatureSet(payload, sizeof(payload), decoded);
+
+  double levelError = 0.0;
+  double bandError = 0.0;
+  double codecError = 0.0;
+  bool peaks = true;
+  for (int axis = 0; axis < FEATURE_AXES; axis++) {
+    double rms = amplitudes[axis] / sqrt(2.0);
+    double squares = 0.0;
+    int loudest = 0;
+    for (int band = 0; band < FEATURE_BANDS; band++) {
+      squares += (double)features.bands[axis][band] * features.bands[axis][band];
+      if (features.bands[axis][band] > features.bands[axis][loudest]) {
+        loudest = band;
+      }
+    }
+    levelError = fmax(levelError, fabs(features.rms[axis] - rms) / rms);
+    levelError = fmax(levelError, fabs(features.peak[axis] - amplitudes[axis]) / rms);
+    levelError = fmax(levelError, fabs(features.crest[axis] - sqrt(2.0)) / sqrt(2.0));
+    bandError = fmax(bandError, fabs(sqrt(squares) - rms) / rms);
+    peaks = peaks && loudest == bands[axis];
+
+    if (decodes) {
+      codecError = fmax(codecError, fabs(decoded.rms[axis] - features.rms[axis]) / rms);
+      for (int band = 0; band < FEATURE_BANDS; band++) {
+        codecError = fmax(codecError, fabs(decoded.bands[axis][band] - features.bands[axis][band]) / rms);
+      }
+    }
+
+    if (print) {
+      printf("    axis %d  band %d  rms %.4f (%.4f)  peak %.4f  crest %.4f  bands",
+        axis, bands[axis], features.rms[axis], rms, features.peak[axis], features.crest[axis]);
+      for (int band = 0; band < FEATURE_BANDS; band++) {
+        printf(" %.3f", features.bands[axis][band]);
+      }
+      printf("\n");
+    }
+  }
+
+  bool ok = decodes && peaks && levelError <= BENCH_MAX_LEVEL_ERROR &&
+    bandError <= BENCH_MAX_BAND_ERROR && codecError <= BENCH_MAX_CODEC_ERROR;
+  printf("  %6d  levels %.5f  bands %.5f  codec %.5f  tone bands %s%s\n",
+    length, levelError, bandError, codecError, peaks ? "right" : "WRONG", ok ? "" : "  OUT OF SPEC");
+  return ok;
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: featurebench [--rate HZ] [--seconds N] [--window N] [--overlap N] [--levels]\n"
+    "  --rate HZ          IMU output data rate, for the windows per second, 119 by default\n"
+    "  --seconds N        how long the timing runs per window length, 1 by default\n"
+    "  --window N         time only this window length, %d to %d, a power of two\n"
+    "  --overlap N        samples shared by consecutive windows of --window, half by default\n"
+    "  --levels           print the levels of every axis for the tone check\n",
+    FEATURE_MIN_WINDOW, FEATURE_MAX_WINDOW);
+}
+
+int main(int argc, char** argv) {
+  double rate = 119.0;
+  double seconds = 1.0;
+  int window = 0;
+  int overlap = -1;
+  bool print = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      rate = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+      window = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--overlap") == 0 && i + 1 < argc) {
+      overlap = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--levels") == 0) {
+      print = true;
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (rate <= 0.0 || seconds <= 0.0 ||
+      (window != 0 && (window < FEATURE_MIN_WINDOW || window > FEATURE_MAX_WINDOW || (window & (window - 1)) != 0)) ||
+      (overlap >= 0 && window == 0) || overlap >= (window > 0 ? window : FEATURE_MAX_WINDOW)) {
+    Usage();
+    return 1;
+  }
+
+  printf("timing (%d axes, %d bands, state %u bytes per extractor)\n",
+    FEATURE_AXES, FEATURE_BANDS, (unsigned)sizeof(FeatureExtractor));
+  printf("  %6s %7s %4s %9s %10s %11s %9s %9s %8s\n",
+    "window", "overlap", "hop", "windows", "ns/window", "cycles/win", "ns/push", "ns/encode", "win/s");
+  for (int length = FEATURE_MIN_WINDOW; length <= FEATURE_MAX_WINDOW; length <<= 1) {
+    if (window != 0 && length != window)
+      continue;
+    Timing(seconds, rate, length, overlap >= 0 ? overlap : length / 2);
+  }
+#if !BENCH_CYCLES
+  printf("  cycles per window n/a on this host\n");
+#endif
+
+  printf("\ntone levels\n");
+  bool ok = true;
+  for (int length = FEATURE_MIN_WINDOW; length <= FEATURE_MAX_WINDOW; length <<= 1) {
+    ok = Levels(length, print) && ok;
+  }
+  printf("result             %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
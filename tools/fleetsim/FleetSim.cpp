@@ -0,0 +1,523 @@
+/* ==========================================================================
+    File:     FleetSim.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Fleet simulator and load generator for gateway capacity
+              testing, runs hundreds of simulated peripherals, each one
+              src/main.cpp itself on the shims of tools/hostbench in its
+              own process on the host's clock, and writes every
+              notification to a file or a local UDP socket standing in
+              for the BLE link
+
+              A process per device because the sketch keeps its state in
+              globals, the firmware is built once and forked per device so
+              what the gateway sees is what the firmware sends
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "SimImuSource.h"
+#include "../hostbench/HostShim.h"
+#include <Arduino.h>
+#include <ChangeDetector.h>
+#include <CompactCodec.h>
+#include <CooperativeScheduler.h>
+#include <TelemetryBatch.h>
+#include <TelemetryFrame.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_LOOP_MICROS       200         // what one loop() costs the device, and lets the others run
+#define SIM_PHASE_MICROS      100000UL    // the devices start spread over this
+#define SIM_CONNECT_MICROS    500000UL    // the Central/Gateway connects this long after the start
+#define SIM_SINK_BUFFER       65536
+#define SIM_RECORD_HEADER     10
+#define SIM_MAX_PAYLOAD       514         // the largest ATT MTU less the ATT header
+#define SIM_TASK_NAME         16
+
+// the scheduler and the report on change channels of src/main.cpp, and its sketch
+extern CooperativeScheduler scheduler;
+extern ChangeChannel accelerometerChange;
+extern ChangeChannel gyroscopeChange;
+extern ChangeChannel magnetometerChange;
+extern ChangeChannel orientationChange;
+extern ChangeChannel frameChange;
+void setup();
+void loop();
+
+typedef std::chrono::steady_clock Clock;
+
+/* --------------------------------------------------------------------------
+    What the Central/Gateway of every device asks for
+      period              telemetryFrequency it writes, 0 keeps the default
+      encoding            the Telemetry Encoding it writes
+      batchSize           samples per batch, 0 subscribes to the frame and
+                          the vectors instead
+      mtu                 the ATT MTU of the connection
+      linkRate            notifications per second the link drains, 0 for
+                          no limit
+      reportOnChange      false writes the ChangeConfig with no deadbands
+   -------------------------------------------------------------------------- */
+struct SimConfig {
+  uint32_t          period;
+  TelemetryEncoding encoding;
+  uint8_t           batchSize;
+  uint16_t          mtu;
+  uint32_t          linkRate;
+  bool              reportOnChange;
+};
+
+/* --------------------------------------------------------------------------
+    A device's counters, in memory shared with the parent so it can print
+    the progress while the devices run and sum them at the end
+   -------------------------------------------------------------------------- */
+struct SimCounters {
+  std::atomic<uint64_t> notifies;
+  std::atomic<uint64_t> bytes;
+  uint64_t  samples;
+  uint64_t  overruns;     // samples the FIFO overwrote before the sketch read them
+  uint64_t  refused;      // refused by the link, out of credit
+  uint64_t  suppressed;   // held back by report on change
+  int       taskCount;
+  char      taskNames[SCHEDULER_MAX_TASKS][SIM_TASK_NAME];
+  TaskStats tasks[SCHEDULER_MAX_TASKS];
+  bool      finished;
+};
+
+/* --------------------------------------------------------------------------
+    Output, one record per notification, little endian
+      [0..1]   device
+      [2..3]   characteristic UUID
+      [4..7]   timestamp (micros since the simulator started)
+      [8..9]   payload length
+      then the payload, byte for byte what the characteristic carries
+    a file gets the records back to back, every device appends whole
+    records to it, UDP one record per datagram
+   -------------------------------------------------------------------------- */
+struct SimSink {
+  int                 file;
+  int                 socket;
+  struct sockaddr_in  address;
+};
+
+// the device this process runs
+static struct {
+  uint16_t              id;
+  SimSink               sink;
+  SimImuSource          source;
+  SimCounters*          counters;
+  std::vector<uint8_t>  buffer;
+} device;
+
+static void FlushSink() {
+  if (device.sink.file >= 0 && !device.buffer.empty()) {
+    if (write(device.sink.file, device.buffer.data(), device.buffer.size()) < 0) {
+      perror("[fleetsim] write");
+    }
+  }
+  device.buffer.clear();
+}
+
+static void Notified(uint16_t, const char* uuid, const uint8_t* data, int length) {
+  uint8_t record[SIM_RECORD_HEADER + SIM_MAX_PAYLOAD];
+  size_t size = length < SIM_MAX_PAYLOAD ? (size_t)length : SIM_MAX_PAYLOAD;
+  PutUint16LE(&record[0], device.id);
+  PutUint16LE(&record[2], (uint16_t)strtoul(uuid, 0, 16));
+  PutUint32LE(&record[4], micros());
+  PutUint16LE(&record[8], (uint16_t)size);
+  memcpy(&record[SIM_RECORD_HEADER], data, size);
+
+  if (device.sink.socket >= 0) {
+    sendto(device.sink.socket, record, SIM_RECORD_HEADER + size, 0,
+           (const struct sockaddr*)&device.sink.address, sizeof(device.sink.address));
+  }
+  if (device.sink.file >= 0) {
+    device.buffer.insert(device.buffer.end(), record, record + SIM_RECORD_HEADER + size);
+    if (device.buffer.size() >= SIM_SINK_BUFFER) {
+      FlushSink();
+    }
+  }
+
+  device.counters->notifies.fetch_add(1, std::memory_order_relaxed);
+  device.counters->bytes.fetch_add(length, std::memory_order_relaxed);
+}
+
+static void ImuSample(uint32_t index, HostImuSample& sample) {
+  SimImuSample next;
+  device.source.Sample(index, next);
+  memcpy(sample.acceleration, next.acceleration, sizeof(sample.acceleration));
+  memcpy(sample.gyroscope, next.gyroscope, sizeof(sample.gyroscope));
+  memcpy(sample.magnetometer, next.magnetometer, sizeof(sample.magnetometer));
+}
+
+/* --------------------------------------------------------------------------
+    One device, in its own process. The sketch boots on the host's clock,
+    the Central/Gateway connects, writes its config and subscribes, then
+    loop() runs until the end like the firmware's main loop does
+   -------------------------------------------------------------------------- */
+static void RunDevice(const SimConfig& config, unsigned long startedMicros, unsigned long endMicros) {
+  device.buffer.reserve(SIM_SINK_BUFFER + SIM_RECORD_HEADER + SIM_MAX_PAYLOAD);
+
+  // the clock counts from the simulator's start, the fork took some of it
+  HostClockAdvance(startedMicros);
+  HostClockRealTime();
+  HostClockAdvance((device.id * 7919UL) % SIM_PHASE_MICROS);
+
+  HostImuBegin(ImuSample, SIM_IMU_HZ);
+  HostOnNotify(Notified);
+  if (config.linkRate > 0) {
+    HostLinkBudget(1, 1000000UL / config.linkRate);
+  }
+  setup();
+
+  unsigned long connect = micros() + SIM_CONNECT_MICROS;
+  while (micros() < connect) {
+    loop();
+    HostClockAdvance(SIM_LOOP_MICROS);
+  }
+
+  const uint8_t encoding[2] = { (uint8_t)config.encoding, COMPACT_DEFAULT_KEYFRAME };
+  HostCentralConnect(0, config.mtu);
+  HostCentralWrite(0, "3004", encoding, sizeof(encoding));
+  if (config.period > 0) {
+    uint8_t frequency[4];
+    PutUint32LE(frequency, config.period);
+    HostCentralWrite(0, "3001", frequency, sizeof(frequency));
+  }
+  if (!config.reportOnChange) {
+    // the ChangeConfig defaults with every deadband at 0
+    const uint16_t fields[9] = { 0, 0, 0, 0, 30, 50, 2000, 100, 1 };
+    uint8_t changeConfig[sizeof(fields)];
+    for (int i = 0; i < 9; i++) {
+      PutUint16LE(&changeConfig[i * 2], fields[i]);
+    }
+    HostCentralWrite(0, "3006", changeConfig, sizeof(changeConfig));
+  }
+  if (config.batchSize > 0) {
+    // [0] batch size, [1] reserved, [2..3] flush interval (ms)
+    const uint8_t batchConfig[4] = { config.batchSize, 0, 100, 0 };
+    HostCentralWrite(0, "3002", batchConfig, sizeof(batchConfig));
+    HostCentralSubscribe(0, "A002");
+  } else {
+    static const char* const uuids[5] = { "A001", "4001", "5001", "6001", "7001" };
+    for (const char* uuid : uuids) {
+      HostCentralSubscribe(0, uuid);
+    }
+  }
+
+  while (micros() < endMicros) {
+    loop();
+    HostClockAdvance(SIM_LOOP_MICROS);
+  }
+  FlushSink();
+
+  SimCounters& counters = *device.counters;
+  counters.samples = HostImuStatistics().read;
+  counters.overruns = HostImuStatistics().overruns;
+  counters.refused = HostLinkStatistics().refused;
+  counters.suppressed = (uint64_t)accelerometerChange.suppressed + gyroscopeChange.suppressed +
+    magnetometerChange.suppressed + orientationChange.suppressed + frameChange.suppressed;
+  counters.taskCount = scheduler.TaskCount();
+  for (int task = 0; task < scheduler.TaskCount(); task++) {
+    snprintf(counters.taskNames[task], SIM_TASK_NAME, "%s", scheduler.TaskName(task));
+    counters.tasks[task] = scheduler.Stats(task);
+  }
+  counters.finished = true;
+}
+
+/* --------------------------------------------------------------------------
+    Replay trace, a CSV of ax,ay,az,gx,gy,gz,mx,my,mz (g, dps, uT) per line
+    at IMU_HZ, lines that do not parse (a header) are skipped
+   -------------------------------------------------------------------------- */
+static bool LoadTrace(const char* path, std::vector<SimImuSample>& trace) {
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    SimImuSample sample;
+    if (sscanf(line, "%f,%f,%f,%f,%f,%f,%f,%f,%f",
+               &sample.acceleration[0], &sample.acceleration[1], &sample.acceleration[2],
+               &sample.gyroscope[0], &sample.gyroscope[1], &sample.gyroscope[2],
+               &sample.magnetometer[0], &sample.magnetometer[1], &sample.magnetometer[2]) == 9) {
+      trace.push_back(sample);
+    }
+  }
+  fclose(file);
+  return !trace.empty();
+}
+
+static bool ParseEncoding(const char* name, TelemetryEncoding& encoding) {
+  static const char* const names[ENCODING_COUNT] = { "f32", "i16", "f16", "d8" };
+  for (int i = 0; i < ENCODING_COUNT; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      encoding = (TelemetryEncoding)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: fleetsim [options]\n"
+    "  --devices N        simulated peripherals, a process each (100)\n"
+    "  --seconds N        how long to run (10)\n"
+    "  --period MS        telemetryFrequency the gateway writes, 500 to 30000 (device default)\n"
+    "  --encoding E       f32, i16, f16 or d8 (f32)\n"
+    "  --batch N          samples per batch, 0 subscribes to the frame and vectors (0)\n"
+    "  --mtu N            granted ATT MTU (185)\n"
+    "  --link-rate N      notifications per second the link drains, 0 no limit (0)\n"
+    "  --no-change        publish every period, no report on change\n"
+    "  --replay FILE      replay a CSV trace instead of synthetic IMU data\n"
+    "  --out FILE         write the records to FILE\n"
+    "  --udp HOST:PORT    send each record as a UDP datagram\n");
+}
+
+int main(int argc, char** argv) {
+  int deviceCount = 100;
+  int seconds = 10;
+  int mtu = 185;
+  const char* replayPath = 0;
+  const char* outPath = 0;
+  const char* udpTarget = 0;
+
+  SimConfig config;
+  config.period = 0;
+  config.encoding = ENCODING_FLOAT32;
+  config.batchSize = 0;
+  config.linkRate = 0;
+  config.reportOnChange = true;
+
+  for (int i = 1; i < argc; i++) {
+    const char* option = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : 0;
+    bool used = true;
+
+    if (strcmp(option, "--no-change") == 0) {
+      config.reportOnChange = false;
+      continue;
+    } else if (!value) {
+      used = false;
+    } else if (strcmp(option, "--devices") == 0) {
+      deviceCount = atoi(value);
+    } else if (strcmp(option, "--seconds") == 0) {
+      seconds = atoi(value);
+    } else if (strcmp(option, "--period") == 0) {
+      config.period = strtoul(value, 0, 10);
+    } else if (strcmp(option, "--encoding") == 0) {
+      used = ParseEncoding(value, config.encoding);
+    } else if (strcmp(option, "--batch") == 0) {
+      config.batchSize = (uint8_t)atoi(value);
+    } else if (strcmp(option, "--mtu") == 0) {
+      mtu = atoi(value);
+    } else if (strcmp(option, "--link-rate") == 0) {
+      config.linkRate = strtoul(value, 0, 10);
+    } else if (strcmp(option, "--replay") == 0) {
+      replayPath = value;
+    } else if (strcmp(option, "--out") == 0) {
+      outPath = value;
+    } else if (strcmp(option, "--udp") == 0) {
+      udpTarget = value;
+    } else {
+      used = false;
+    }
+
+    if (!used) {
+      Usage();
+      return 2;
+    }
+    i++;
+  }
+
+  if (deviceCount < 1 || deviceCount > 65535 || seconds < 1 || mtu < 23 || mtu > 517 ||
+      (config.period != 0 && (config.period < 500 || config.period > 30000))) {
+    Usage();
+    return 2;
+  }
+  config.mtu = (uint16_t)mtu;
+
+  // the firmware refuses a batch bigger than its BLE_ATT_MTU takes
+  size_t batchCapacity = TelemetryBatchCapacity(BLE_ATT_MTU - 3);
+  if (config.batchSize > batchCapacity) {
+    fprintf(stderr, "[fleetsim] batch %u does not fit BLE_ATT_MTU %d, using %u\n",
+      config.batchSize, BLE_ATT_MTU, (unsigned)batchCapacity);
+    config.batchSize = (uint8_t)batchCapacity;
+  }
+
+  std::vector<SimImuSample> trace;
+  if (replayPath && !LoadTrace(replayPath, trace)) {
+    fprintf(stderr, "[fleetsim] could not read a trace from %s\n", replayPath);
+    return 1;
+  }
+
+  SimSink sink;
+  sink.file = -1;
+  sink.socket = -1;
+  if (outPath) {
+    sink.file = open(outPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (sink.file < 0) {
+      fprintf(stderr, "[fleetsim] could not open %s\n", outPath);
+      return 1;
+    }
+  }
+  if (udpTarget) {
+    char host[64];
+    int port = 0;
+    const char* colon = strrchr(udpTarget, ':');
+    size_t hostLength = colon ? (size_t)(colon - udpTarget) : 0;
+    if (colon && hostLength < sizeof(host)) {
+      memcpy(host, udpTarget, hostLength);
+      host[hostLength] = 0;
+      port = atoi(colon + 1);
+    }
+    memset(&sink.address, 0, sizeof(sink.address));
+    sink.address.sin_family = AF_INET;
+    sink.address.sin_port = htons((uint16_t)port);
+    if (port <= 0 || inet_pton(AF_INET, host, &sink.address.sin_addr) != 1) {
+      fprintf(stderr, "[fleetsim] --udp needs HOST:PORT with an IPv4 host\n");
+      return 2;
+    }
+    sink.socket = socket(AF_INET, SOCK_DGRAM, 0);
+  }
+
+  // the counters of every device, shared with the device processes
+  size_t countersSize = sizeof(SimCounters) * deviceCount;
+  void* shared = mmap(0, countersSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("[fleetsim] mmap");
+    return 1;
+  }
+  SimCounters* counters = (SimCounters*)shared;
+  for (int i = 0; i < deviceCount; i++) {
+    new (&counters[i]) SimCounters();
+  }
+
+  fprintf(stderr, "[fleetsim] %d devices for %d s, period %u ms, encoding %u, batch %u, MTU %d\n",
+    deviceCount, seconds, config.period, config.encoding, config.batchSize, mtu);
+  fflush(stderr);
+
+  // a device per process, each with its own IMU data
+  Clock::time_point start = Clock::now();
+  unsigned long endMicros = seconds * 1000000UL;
+  std::vector<pid_t> children;
+  for (int i = 0; i < deviceCount; i++) {
+    pid_t child = fork();
+    if (child < 0) {
+      perror("[fleetsim] fork");
+      break;
+    }
+    if (child == 0) {
+      device.id = (uint16_t)i;
+      device.sink = sink;
+      device.counters = &counters[i];
+      if (trace.empty()) {
+        device.source.BeginSynthetic(i + 1);
+      } else {
+        device.source.BeginReplay(&trace, (size_t)i * 37);
+      }
+      unsigned long started = (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start).count();
+      RunDevice(config, started, endMicros);
+      _exit(0);
+    }
+    children.push_back(child);
+  }
+
+  // a progress line a second while the devices run
+  uint64_t lastNotifies = 0;
+  uint64_t lastBytes = 0;
+  for (int second = 1; second <= seconds; second++) {
+    std::this_thread::sleep_until(start + std::chrono::seconds(second));
+    uint64_t notifies = 0;
+    uint64_t bytes = 0;
+    for (int i = 0; i < deviceCount; i++) {
+      notifies += counters[i].notifies.load(std::memory_order_relaxed);
+      bytes += counters[i].bytes.load(std::memory_order_relaxed);
+    }
+    fprintf(stderr, "[fleetsim] %3d s  %8llu notifies/s  %10llu bytes/s\n", second,
+      (unsigned long long)(notifies - lastNotifies), (unsigned long long)(bytes - lastBytes));
+    lastNotifies = notifies;
+    lastBytes = bytes;
+  }
+
+  for (pid_t child : children) {
+    waitpid(child, 0, 0);
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  struct rusage usage;
+  getrusage(RUSAGE_CHILDREN, &usage);
+  double cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+  // aggregate the counters and the scheduling jitter of every device
+  uint64_t samples = 0, notifies = 0, bytes = 0, overruns = 0, refused = 0, suppressed = 0;
+  struct { uint64_t runs; uint64_t jitter; uint32_t maxJitter; uint64_t overruns; } tasks[SCHEDULER_MAX_TASKS];
+  memset(tasks, 0, sizeof(tasks));
+  const char* taskNames[SCHEDULER_MAX_TASKS] = { 0 };
+  int finished = 0;
+
+  for (int i = 0; i < deviceCount; i++) {
+    const SimCounters& counted = counters[i];
+    if (!counted.finished)
+      continue;
+    finished++;
+    samples += counted.samples;
+    notifies += counted.notifies.load();
+    bytes += counted.bytes.load();
+    overruns += counted.overruns;
+    refused += counted.refused;
+    suppressed += counted.suppressed;
+
+    for (int task = 0; task < counted.taskCount; task++) {
+      const TaskStats& stats = counted.tasks[task];
+      taskNames[task] = counted.taskNames[task];
+      tasks[task].runs += stats.runs;
+      tasks[task].jitter += stats.totalJitterMicros;
+      tasks[task].overruns += stats.overruns;
+      if (stats.maxJitterMicros > tasks[task].maxJitter) {
+        tasks[task].maxJitter = stats.maxJitterMicros;
+      }
+    }
+  }
+
+  printf("devices            %d (%d finished)\n", deviceCount, finished);
+  printf("cpu                %.1f%% of one core\n", cpu * 100.0 / elapsed);
+  printf("elapsed            %.2f s\n", elapsed);
+  printf("samples/s          %.0f\n", samples / elapsed);
+  printf("notifies/s         %.0f\n", notifies / elapsed);
+  printf("bytes/s            %.0f\n", bytes / elapsed);
+  printf("overruns           %llu\n", (unsigned long long)overruns);
+  printf("refused            %llu\n", (unsigned long long)refused);
+  printf("suppressed         %llu\n", (unsigned long long)suppressed);
+  for (int task = 0; task < SCHEDULER_MAX_TASKS; task++) {
+    if (!taskNames[task] || tasks[task].runs == 0)
+      continue;
+    printf("jitter %-12s runs %llu avg %llu us max %u us overruns %llu\n", taskNames[task],
+      (unsigned long long)tasks[task].runs,
+      (unsigned long long)(tasks[task].jitter / tasks[task].runs),
+      tasks[task].maxJitter, (unsigned long long)tasks[task].overruns);
+  }
+
+  if (sink.file >= 0) {
+    close(sink.file);
+  }
+  if (sink.socket >= 0) {
+    close(sink.socket);
+  }
+  munmap(shared, countersSize);
+  return finished == deviceCount ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+/* ==========================================================================
+    File:     SimImuSource.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  IMU data for the host simulators, see SimImuSource.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "SimImuSource.h"
+#include <math.h>
+
+SimImuSource::SimImuSource()
+  : _trace(0), _offset(0), _random(1), _step(0),
+    _frequency(1.0f), _amplitude(0.5f), _motionPeriod(10 * SIM_IMU_HZ) {
+}
+
+void SimImuSource::BeginSynthetic(uint32_t seed) {
+  _trace = 0;
+  _random = seed * 2654435761UL + 1;
+  _step = 0;
+  _frequency = 0.5f + (seed % 16) * 0.25f;
+  _amplitude = 0.2f + (seed % 5) * 0.2f;
+  _motionPeriod = (5 + seed % 20) * SIM_IMU_HZ;
+}
+
+void SimImuSource::BeginReplay(const std::vector<SimImuSample>* trace, size_t offset) {
+  _trace = trace;
+  _offset = offset;
+  _step = 0;
+}
+
+float SimImuSource::Noise() {
+  // xorshift32, cheap and the same on every host
+  _random ^= _random << 13;
+  _random ^= _random >> 17;
+  _random ^= _random << 5;
+  return ((_random & 0xFFFF) / 32768.0f - 1.0f);
+}
+
+void SimImuSource::Next(SimImuSample& sample) {
+  Sample(_step++, sample);
+}
+
+void SimImuSource::Sample(uint32_t index, SimImuSample& sample) {
+  if (_trace && !_trace->empty()) {
+    sample = (*_trace)[(_offset + index) % _trace->size()];
+    return;
+  }
+
+  // still for half of each motion period, then a swing around z
+  bool moving = (index % _motionPeriod) >= _motionPeriod / 2;
+  float t = (float)index / SIM_IMU_HZ;
+  float swing = moving ? _amplitude * sinf(2.0f * (float)M_PI * _frequency * t) : 0.0f;
+
+  sample.acceleration[0] = swing + 0.002f * Noise();
+  sample.acceleration[1] = 0.5f * swing + 0.002f * Noise();
+  sample.acceleration[2] = 1.0f + 0.002f * Noise();
+  sample.gyroscope[0] = 0.3f * Noise();
+  sample.gyroscope[1] = 0.3f * Noise();
+  sample.gyroscope[2] = 90.0f * swing + 0.3f * Noise();
+  sample.magnetometer[0] = 22.0f + 0.2f * Noise();
+  sample.magnetometer[1] = 5.0f + 0.2f * Noise();
+  sample.magnetometer[2] = -40.0f + 0.2f * Noise();
+}
@@ -0,0 +1,53 @@
+/* ==========================================================================
+    File:     SimImuSource.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  IMU data for the host simulators, a synthetic still/moving
+              pattern per device or a recorded trace replayed from an
+              offset, one sample per IMU output data rate tick
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef SIM_IMU_SOURCE_H
+#define SIM_IMU_SOURCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define SIM_IMU_HZ              119
+
+struct SimImuSample {
+  float     acceleration[3];    // g
+  float     gyroscope[3];       // dps
+  float     magnetometer[3];    // uT
+};
+
+/* --------------------------------------------------------------------------
+    Either synthetic (a still/moving pattern with its own phase and noise)
+    or a recorded trace replayed from an offset. Sample() takes the tick
+    since the start, Next() the one after the last
+   -------------------------------------------------------------------------- */
+class SimImuSource {
+public:
+  SimImuSource();
+
+  void BeginSynthetic(uint32_t seed);
+  void BeginReplay(const std::vector<SimImuSample>* trace, size_t offset);
+
+  void Sample(uint32_t index, SimImuSample& sample);
+  void Next(SimImuSample& sample);
+
+private:
+  float Noise();
+
+  const std::vector<SimImuSample>* _trace;
+  size_t    _offset;
+  uint32_t  _random;
+  uint32_t  _step;
+  float     _frequency;
+  float     _amplitude;
+  uint32_t  _motionPeriod;
+};
+
+#endif
@@ -0,0 +1,613 @@
+/* ==========================================================================
+    File:     FusionBench.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host benchmark for the FusionEngine, replays an IMU trace
+              through every algorithm and through the MadgwickAHRS filter
+              the sketch used before, and reports the updates per second,
+              the cost of the Euler angles and the angular error against
+              the true motion and against that Madgwick
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <FusionEngine.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES 1
+#else
+#define BENCH_CYCLES 0
+#endif
+
+#define BENCH_PI              3.14159265358979323846
+#define BENCH_DEG             (180.0 / BENCH_PI)
+#define BENCH_GYRO_STEP       0.001       // seconds either side for the synthetic gyro
+#define BENCH_FIELD_UT        50.0
+#define BENCH_DIP_DEG         60.0
+#define BENCH_GYRO_NOISE      0.3         // dps, about the LSM9DS1 at 119 Hz
+#define BENCH_ACCEL_NOISE     0.005       // g
+#define BENCH_MAG_NOISE       0.3         // uT
+#define BENCH_MAX_EXCESS_DEG  0.5         // the engine's Madgwick against the reference
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t Cycles() {
+#if BENCH_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* --------------------------------------------------------------------------
+    Reference, the MadgwickAHRS filter as the sketch ran it before the
+    FusionEngine, the bit trick 1/sqrt with one Newton step and the Euler
+    angles worked out on the first getter after every update
+   -------------------------------------------------------------------------- */
+class MadgwickReference {
+public:
+  void begin(float sampleFrequency) {
+    beta = FUSION_DEFAULT_BETA;
+    q0 = 1.0f;
+    q1 = q2 = q3 = 0.0f;
+    invSampleFreq = 1.0f / sampleFrequency;
+    anglesComputed = false;
+  }
+
+  void update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz) {
+    if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+      updateIMU(gx, gy, gz, ax, ay, az);
+      return;
+    }
+
+    gx *= 0.0174533f;
+    gy *= 0.0174533f;
+    gz *= 0.0174533f;
+
+    float qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+      float recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+      ax *= recipNorm;
+      ay *= recipNorm;
+      az *= recipNorm;
+
+      recipNorm = invSqrt(mx * mx + my * my + mz * mz);
+      mx *= recipNorm;
+      my *= recipNorm;
+      mz *= recipNorm;
+
+      float _2q0mx = 2.0f * q0 * mx;
+      float _2q0my = 2.0f * q0 * my;
+      float _2q0mz = 2.0f * q0 * mz;
+      float _2q1mx = 2.0f * q1 * mx;
+      float _2q0 = 2.0f * q0;
+      float _2q1 = 2.0f * q1;
+      float _2q2 = 2.0f * q2;
+      float _2q3 = 2.0f * q3;
+      float _2q0q2 = 2.0f * q0 * q2;
+      float _2q2q3 = 2.0f * q2 * q3;
+      float q0q0 = q0 * q0;
+      float q0q1 = q0 * q1;
+      float q0q2 = q0 * q2;
+      float q0q3 = q0 * q3;
+      float q1q1 = q1 * q1;
+      float q1q2 = q1 * q2;
+      float q1q3 = q1 * q3;
+      float q2q2 = q2 * q2;
+      float q2q3 = q2 * q3;
+      float q3q3 = q3 * q3;
+
+      float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+      float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+      float _2bx = sqrtf(hx * hx + hy * hy);
+      float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+      float _4bx = 2.0f * _2bx;
+      float _4bz = 2.0f * _2bz;
+
+      float s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _2bz * q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q3 + _2bz * q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+      float s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) + _2bz * q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q2 + _2bz * q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q3 - _4bz * q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+      float s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_4bx * q2 - _2bz * q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q1 + _2bz * q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q0 - _4bz * q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+      float s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_4bx * q3 + _2bz * q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q0 + _2bz * q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+      recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+      qDot1 -= beta * s0 * recipNorm;
+      qDot2 -= beta * s1 * recipNorm;
+      qDot3 -= beta * s2 * recipNorm;
+      qDot4 -= beta * s3 * recipNorm;
+    }
+    integrate(qDot1, qDot2, qDot3, qDot4);
+  }
+
+  void updateIMU(float gx, float gy, float gz, float ax, float ay, float az) {
+    gx *= 0.0174533f;
+    gy *= 0.0174533f;
+    gz *= 0.0174533f;
+
+    float qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+      float recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+      ax *= recipNorm;
+      ay *= recipNorm;
+      az *= recipNorm;
+
+      float _2q0 = 2.0f * q0;
+      float _2q1 = 2.0f * q1;
+      float _2q2 = 2.0f * q2;
+      float _2q3 = 2.0f * q3;
+      float _4q0 = 4.0f * q0;
+      float _4q1 = 4.0f * q1;
+      float _4q2 = 4.0f * q2;
+      float _8q1 = 8.0f * q1;
+      float _8q2 = 8.0f * q2;
+      float q0q0 = q0 * q0;
+      float q1q1 = q1 * q1;
+      float q2q2 = q2 * q2;
+      float q3q3 = q3 * q3;
+
+      float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+      float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+      float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+      float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+      recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+      qDot1 -= beta * s0 * recipNorm;
+      qDot2 -= beta * s1 * recipNorm;
+      qDot3 -= beta * s2 * recipNorm;
+      qDot4 -= beta * s3 * recipNorm;
+    }
+    integrate(qDot1, qDot2, qDot3, qDot4);
+  }
+
+  float getRollRadians()  { if (!anglesComputed) computeAngles(); return roll; }
+  float getPitchRadians() { if (!anglesComputed) computeAngles(); return pitch; }
+  float getYawRadians()   { if (!anglesComputed) computeAngles(); return yaw; }
+
+  void getQuaternion(float q[4]) const {
+    q[0] = q0;
+    q[1] = q1;
+    q[2] = q2;
+    q[3] = q3;
+  }
+
+private:
+  static float invSqrt(float x) {
+    float halfx = 0.5f * x;
+    float y = x;
+    int32_t i;
+    memcpy(&i, &y, sizeof(i));
+    i = 0x5f3759df - (i >> 1);
+    memcpy(&y, &i, sizeof(y));
+    return y * (1.5f - (halfx * y * y));
+  }
+
+  void integrate(float qDot1, float qDot2, float qDot3, float qDot4) {
+    q0 += qDot1 * invSampleFreq;
+    q1 += qDot2 * invSampleFreq;
+    q2 += qDot3 * invSampleFreq;
+    q3 += qDot4 * invSampleFreq;
+
+    float recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 *= recipNorm;
+    q1 *= recipNorm;
+    q2 *= recipNorm;
+    q3 *= recipNorm;
+    anglesComputed = false;
+  }
+
+  void computeAngles() {
+    roll = atan2f(q0 * q1 + q2 * q3, 0.5f - q1 * q1 - q2 * q2);
+    pitch = asinf(-2.0f * (q1 * q3 - q0 * q2));
+    yaw = atan2f(q1 * q2 + q0 * q3, 0.5f - q2 * q2 - q3 * q3);
+    anglesComputed = true;
+  }
+
+  float beta;
+  float q0, q1, q2, q3;
+  float invSampleFreq;
+  float roll, pitch, yaw;
+  bool  anglesComputed;
+};
+
+// ************************** TRACE *****************************************
+
+struct BenchSample {
+  float gyroscope[3];       // dps
+  float acceleration[3];    // g
+  float magnetometer[3];    // uT
+  float truth[4];           // w, x, y, z
+};
+
+static void QuaternionMultiply(const double a[4], const double b[4], double q[4]) {
+  q[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+  q[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+  q[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+  q[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+// yaw about z, then pitch about y, then roll about x, as FusionEngine::GetEuler()
+static void EulerToQuaternion(double yaw, double pitch, double roll, double q[4]) {
+  double cy = cos(yaw / 2), sy = sin(yaw / 2);
+  double cp = cos(pitch / 2), sp = sin(pitch / 2);
+  double cr = cos(roll / 2), sr = sin(roll / 2);
+  q[0] = cy * cp * cr + sy * sp * sr;
+  q[1] = cy * cp * sr - sy * sp * cr;
+  q[2] = cy * sp * cr + sy * cp * sr;
+  q[3] = sy * cp * cr - cy * sp * sr;
+}
+
+// a vector of the earth frame as the sensor sees it, R(q) transposed
+static void EarthToSensor(const double q[4], const double earth[3], float sensor[3]) {
+  double w = q[0], x = q[1], y = q[2], z = q[3];
+  double r[3][3] = {
+    { 1 - 2 * (y * y + z * z), 2 * (x * y - w * z),     2 * (x * z + w * y) },
+    { 2 * (x * y + w * z),     1 - 2 * (x * x + z * z), 2 * (y * z - w * x) },
+    { 2 * (x * z - w * y),     2 * (y * z + w * x),     1 - 2 * (x * x + y * y) }
+  };
+  for (int i = 0; i < 3; i++) {
+    sensor[i] = (float)(r[0][i] * earth[0] + r[1][i] * earth[1] + r[2][i] * earth[2]);
+  }
+}
+
+// angle between two orientations in degrees, the bit trick leaves MadgwickAHRS a little off unit length
+static double AngleBetween(const float a[4], const float b[4]) {
+  double dot = 0.0, aa = 0.0, bb = 0.0;
+  for (int i = 0; i < 4; i++) {
+    dot += (double)a[i] * b[i];
+    aa += (double)a[i] * a[i];
+    bb += (double)b[i] * b[i];
+  }
+  dot = fabs(dot) / sqrt(aa * bb);
+  return 2.0 * acos(dot > 1.0 ? 1.0 : dot) * BENCH_DEG;
+}
+
+// zero mean, unit variance, the same sequence every run
+static double Gaussian() {
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * BENCH_PI * v);
+}
+
+/* --------------------------------------------------------------------------
+    Synthetic motion, a sway on every axis at unrelated frequencies with
+    the sensor noise on top and a constant gyro bias when asked for
+   -------------------------------------------------------------------------- */
+static void SyntheticOrientation(double seconds, double q[4]) {
+  double yaw = 60.0 / BENCH_DEG * sin(2 * BENCH_PI * 0.05 * seconds);
+  double pitch = 20.0 / BENCH_DEG * sin(2 * BENCH_PI * 0.11 * seconds);
+  double roll = 30.0 / BENCH_DEG * sin(2 * BENCH_PI * 0.07 * seconds);
+  EulerToQuaternion(yaw, pitch, roll, q);
+}
+
+static void Synthetic(std::vector<BenchSample>& trace, double rate, double seconds, double noise, double bias) {
+  srand(1);
+  const double gravity[3] = { 0.0, 0.0, 1.0 };
+  const double field[3] = {
+    BENCH_FIELD_UT * cos(BENCH_DIP_DEG / BENCH_DEG), 0.0, -BENCH_FIELD_UT * sin(BENCH_DIP_DEG / BENCH_DEG)
+  };
+
+  size_t count = (size_t)(rate * seconds);
+  trace.resize(count);
+  for (size_t n = 0; n < count; n++) {
+    BenchSample& sample = trace[n];
+    double t = n / rate;
+    double q[4];
+    SyntheticOrientation(t, q);
+    EarthToSensor(q, gravity, sample.acceleration);
+    EarthToSensor(q, field, sample.magnetometer);
+
+    // the body rate that turns q(t - h) into q(t + h)
+    double before[4], after[4], delta[4];
+    SyntheticOrientation(t - BENCH_GYRO_STEP, before);
+    SyntheticOrientation(t + BENCH_GYRO_STEP, after);
+    before[1] = -before[1];
+    before[2] = -before[2];
+    before[3] = -before[3];
+    QuaternionMultiply(before, after, delta);
+
+    for (int axis = 0; axis < 3; axis++) {
+      sample.gyroscope[axis] = (float)(delta[axis + 1] / BENCH_GYRO_STEP * BENCH_DEG + bias + noise * BENCH_GYRO_NOISE * Gaussian());
+      sample.acceleration[axis] += (float)(noise * BENCH_ACCEL_NOISE * Gaussian());
+      sample.magnetometer[axis] += (float)(noise * BENCH_MAG_NOISE * Gaussian());
+    }
+    for (int i = 0; i < 4; i++) {
+      sample.truth[i] = (float)q[i];
+    }
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Replayed trace, a row per sample of ax,ay,az (g), gx,gy,gz (dps),
+    mx,my,mz (uT) and optionally yaw,pitch,roll (radians) of the true
+    motion, false when a row has none
+   -------------------------------------------------------------------------- */
+static bool Replay(std::vector<BenchSample>& trace, const char* path, bool& truth) {
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  char line[512];
+  truth = true;
+  while (fgets(line, sizeof(line), file)) {
+    double values[12];
+    int count = 0;
+    char* cursor = line;
+    while (count < 12) {
+      char* end;
+      values[count] = strtod(cursor, &end);
+      if (end == cursor)
+        break;
+      count++;
+      cursor = end;
+      while (*cursor == ',' || *cursor == ' ' || *cursor == '\t')
+        cursor++;
+    }
+    // a header or a comment
+    if (count < 9)
+      continue;
+
+    BenchSample sample;
+    for (int axis = 0; axis < 3; axis++) {
+      sample.acceleration[axis] = (float)values[axis];
+      sample.gyroscope[axis] = (float)values[3 + axis];
+      sample.magnetometer[axis] = (float)values[6 + axis];
+    }
+    double q[4] = { 1.0, 0.0, 0.0, 0.0 };
+    if (count == 12) {
+      EulerToQuaternion(values[9], values[10], values[11], q);
+    } else {
+      truth = false;
+    }
+    for (int i = 0; i < 4; i++) {
+      sample.truth[i] = (float)q[i];
+    }
+    trace.push_back(sample);
+  }
+  fclose(file);
+  return !trace.empty();
+}
+
+// ************************** RUNS ******************************************
+
+struct BenchResult {
+  double nsPerUpdate;
+  double cyclesPerUpdate;
+  double nsPerEuler;
+  double errorMean;
+  double errorRms;
+  double errorMax;
+  double referenceMean;     // against the MadgwickAHRS output
+};
+
+// algorithm FUSION_ALGORITHM_COUNT is the reference
+static void Orientations(int algorithm, const std::vector<BenchSample>& trace, double rate, std::vector<float>& q) {
+  q.resize(trace.size() * 4);
+  if (algorithm == FUSION_ALGORITHM_COUNT) {
+    static MadgwickReference reference;
+    reference.begin((float)rate);
+    for (size_t n = 0; n < trace.size(); n++) {
+      const BenchSample& s = trace[n];
+      reference.update(s.gyroscope[0], s.gyroscope[1], s.gyroscope[2], s.acceleration[0], s.acceleration[1], s.acceleration[2],
+        s.magnetometer[0], s.magnetometer[1], s.magnetometer[2]);
+      reference.getQuaternion(&q[n * 4]);
+    }
+    return;
+  }
+
+  static FusionEngine engine;
+  engine.Begin((FusionAlgorithm)algorithm, (float)rate);
+  for (size_t n = 0; n < trace.size(); n++) {
+    const BenchSample& s = trace[n];
+    engine.Update(s.gyroscope[0], s.gyroscope[1], s.gyroscope[2], s.acceleration[0], s.acceleration[1], s.acceleration[2],
+      s.magnetometer[0], s.magnetometer[1], s.magnetometer[2]);
+    engine.GetQuaternion(&q[n * 4]);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Cost, the whole trace through the filter for the given seconds, every
+    other pass reading the Euler angles after each update the way the
+    sketch used to. The reads cost the difference between the two
+   -------------------------------------------------------------------------- */
+static void Timing(int algorithm, const std::vector<BenchSample>& trace, double rate, double seconds, BenchResult& result) {
+  static MadgwickReference reference;
+  static FusionEngine engine;
+  reference.begin((float)rate);
+  engine.Begin(algorithm < FUSION_ALGORITHM_COUNT ? (FusionAlgorithm)algorithm : FUSION_MADGWICK, (float)rate);
+
+  uint64_t passes = 0;
+  uint64_t cycles = 0;
+  double updateSeconds = 0.0;
+  double readSeconds = 0.0;
+  volatile float sink = 0.0f;
+  Clock::time_point start = Clock::now();
+  Clock::time_point stop = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+  while (Clock::now() < stop) {
+    for (int read = 0; read < 2; read++) {
+      Clock::time_point before = Clock::now();
+      uint64_t beforeCycles = Cycles();
+      for (size_t n = 0; n < trace.size(); n++) {
+        const BenchSample& s = trace[n];
+        float euler[3];
+        if (algorithm == FUSION_ALGORITHM_COUNT) {
+          reference.update(s.gyroscope[0], s.gyroscope[1], s.gyroscope[2], s.acceleration[0], s.acceleration[1], s.acceleration[2],
+            s.magnetometer[0], s.magnetometer[1], s.magnetometer[2]);
+          if (read) {
+            euler[0] = reference.getYawRadians();
+            euler[1] = reference.getPitchRadians();
+            euler[2] = reference.getRollRadians();
+            sink = sink + euler[0] + euler[1] + euler[2];
+          }
+        } else {
+          engine.Update(s.gyroscope[0], s.gyroscope[1], s.gyroscope[2], s.acceleration[0], s.acceleration[1], s.acceleration[2],
+            s.magnetometer[0], s.magnetometer[1], s.magnetometer[2]);
+          if (read) {
+            engine.GetEuler(euler);
+            sink = sink + euler[0] + euler[1] + euler[2];
+          }
+        }
+      }
+      double elapsed = std::chrono::duration<double>(Clock::now() - before).count();
+      if (read) {
+        readSeconds += elapsed;
+      } else {
+        updateSeconds += elapsed;
+        cycles += Cycles() - beforeCycles;
+      }
+    }
+    passes++;
+  }
+
+  double updates = (double)passes * trace.size();
+  result.nsPerUpdate = updateSeconds * 1e9 / updates;
+  result.cyclesPerUpdate = cycles / updates;
+  result.nsPerEuler = readSeconds > updateSeconds ? (readSeconds - updateSeconds) * 1e9 / updates : 0.0;
+}
+
+static void Accuracy(const std::vector<float>& q, const std::vector<float>& reference, const std::vector<BenchSample>& trace,
+                     size_t settle, bool truth, BenchResult& result) {
+  double total = 0.0, squares = 0.0, worst = 0.0, against = 0.0;
+  size_t counted = 0;
+  for (size_t n = settle; n < trace.size(); n++) {
+    against += AngleBetween(&q[n * 4], &reference[n * 4]);
+    if (truth) {
+      double error = AngleBetween(&q[n * 4], trace[n].truth);
+      total += error;
+      squares += error * error;
+      if (error > worst) {
+        worst = error;
+      }
+    }
+    counted++;
+  }
+  result.errorMean = counted ? total / counted : 0.0;
+  result.errorRms = counted ? sqrt(squares / counted) : 0.0;
+  result.errorMax = worst;
+  result.referenceMean = counted ? against / counted : 0.0;
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: fusionbench [--rate HZ] [--trace-seconds N] [--noise K] [--bias DPS] [--replay FILE]\n"
+    "                   [--seconds N] [--settle S] [--max-error DEG]\n"
+    "  --rate HZ          IMU output data rate, 119 by default\n"
+    "  --trace-seconds N  length of the synthetic sway, 120 by default\n"
+    "  --noise K          sensor noise in multiples of the LSM9DS1's, 1 by default\n"
+    "  --bias DPS         constant gyro bias on every axis, 0 by default\n"
+    "  --replay FILE      CSV of ax,ay,az,gx,gy,gz,mx,my,mz and optionally yaw,pitch,roll\n"
+    "                     at --rate, without them the error is only against MadgwickAHRS\n"
+    "  --seconds N        how long each timing runs, 1 by default\n"
+    "  --settle S         seconds before the error counts, 10 by default\n"
+    "  --max-error DEG    fails when an algorithm is worse on average, 3 by default\n");
+}
+
+int main(int argc, char** argv) {
+  double rate = 119.0;
+  double traceSeconds = 120.0;
+  double noise = 1.0;
+  double bias = 0.0;
+  const char* replay = 0;
+  double seconds = 1.0;
+  double settle = 10.0;
+  double maxError = 3.0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      rate = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--trace-seconds") == 0 && i + 1 < argc) {
+      traceSeconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+      noise = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--bias") == 0 && i + 1 < argc) {
+      bias = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay = argv[++i];
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--settle") == 0 && i + 1 < argc) {
+      settle = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--max-error") == 0 && i + 1 < argc) {
+      maxError = atof(argv[++i]);
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (rate <= 0.0 || traceSeconds <= 0.0 || noise < 0.0 || seconds <= 0.0 || settle < 0.0) {
+    Usage();
+    return 1;
+  }
+
+  std::vector<BenchSample> trace;
+  bool truth = true;
+  if (replay) {
+    if (!Replay(trace, replay, truth)) {
+      fprintf(stderr, "fusionbench: no samples in %s\n", replay);
+      return 1;
+    }
+  } else {
+    Synthetic(trace, rate, traceSeconds, noise, bias);
+  }
+  size_t settleSamples = (size_t)(settle * rate);
+  if (settleSamples >= trace.size()) {
+    fprintf(stderr, "fusionbench: the trace is over before the %.0f s settle\n", settle);
+    return 1;
+  }
+
+  if (replay) {
+    printf("fusionbench, %s, %zu samples at %.1f Hz\n\n", replay, trace.size(), rate);
+  } else {
+    printf("fusionbench, synthetic sway, %zu samples at %.1f Hz, noise x%.1f, bias %.2f dps\n\n", trace.size(), rate, noise, bias);
+  }
+
+  static const char* const names[FUSION_ALGORITHM_COUNT + 1] = { "madgwick", "mahony", "complementary", "madgwickahrs" };
+  std::vector<float> reference;
+  Orientations(FUSION_ALGORITHM_COUNT, trace, rate, reference);
+
+  printf("%-14s %10s %10s %12s %10s %9s %9s %9s %9s\n",
+    "algorithm", "ns/update", "cycles", "updates/s", "euler ns", "err mean", "err rms", "err max", "vs ahrs");
+  bool ok = true;
+  BenchResult results[FUSION_ALGORITHM_COUNT + 1];
+  for (int algorithm = FUSION_ALGORITHM_COUNT; algorithm >= 0; algorithm--) {
+    std::vector<float> q;
+    BenchResult& result = results[algorithm];
+    Orientations(algorithm, trace, rate, q);
+    Timing(algorithm, trace, rate, seconds, result);
+    Accuracy(q, reference, trace, settleSamples, truth, result);
+
+    printf("%-14s %10.1f", names[algorithm], result.nsPerUpdate);
+#if BENCH_CYCLES
+    printf(" %10.1f", result.cyclesPerUpdate);
+#else
+    printf(" %10s", "n/a");
+#endif
+    printf(" %12.0f %10.1f", 1e9 / result.nsPerUpdate, result.nsPerEuler);
+    if (truth) {
+      printf(" %9.3f %9.3f %9.3f", result.errorMean, result.errorRms, result.errorMax);
+    } else {
+      printf(" %9s %9s %9s", "n/a", "n/a", "n/a");
+    }
+    printf(" %9.3f\n", result.referenceMean);
+
+    if (truth && result.errorMean > maxError) {
+      ok = false;
+    }
+  }
+
+  // the engine's Madgwick replaced MadgwickAHRS, it must be no worse
+  if (truth && results[FUSION_MADGWICK].errorMean > results[FUSION_ALGORITHM_COUNT].errorMean + BENCH_MAX_EXCESS_DEG) {
+    ok = false;
+  }
+  printf("\nresult             %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
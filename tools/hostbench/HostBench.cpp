@@ -0,0 +1,491 @@
+/* ==========================================================================
+    File:     HostBench.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host benchmark of src/main.cpp as it is, built against the
+              shims of HostShim.h. Replays an IMU trace, synthetic or
+              from a file, through setup() and loop() on a simulated clock
+              with a Central/Gateway subscribed to the telemetry, and
+              reports samples per second, the host time and simulated
+              latency of every stage, the bytes on air per second and the
+              orientation error against the motion of the trace
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "HostShim.h"
+#include <Arduino.h>
+#include <CompactFrame.h>
+#include <FusionEngine.h>
+#include <LatencyTrace.h>
+#include <Profiler.h>
+#include <TelemetryFrame.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define BENCH_PI              3.14159265358979323846
+#define BENCH_DEG             (180.0 / BENCH_PI)
+#define BENCH_LOOP_MICROS     50          // simulated cost of one loop()
+#define BENCH_CONNECT_MICROS  500000UL    // the Central/Gateway connects
+#define BENCH_CONNECTION      0
+#define BENCH_SYNTHETIC_HZ    1e6f        // the synthetic trace has a sample every micro
+#define BENCH_GYRO_STEP       0.001       // seconds either side for the synthetic gyro
+#define BENCH_FIELD_UT        50.0        // synthetic magnetic field
+#define BENCH_DIP_DEG         60.0
+#define BENCH_SHAKE_HZ        1.3         // the synthetic shake, enough to count as motion
+#define BENCH_TRACE_ENTRIES   16
+#define BENCH_SECTIONS        6
+
+// the Profiler and the sketch of src/main.cpp
+extern Profiler profiler;
+void setup();
+void loop();
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* const sectionNames[BENCH_SECTIONS] = { "sample", "fusion", "notify", "blePoll", "features", "decimate" };
+
+// ************************** MOTION ****************************************
+
+static void QuaternionMultiply(const double a[4], const double b[4], double q[4]) {
+  q[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+  q[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+  q[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+  q[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+// yaw about z, then pitch about y, then roll about x, as FusionEngine::GetEuler()
+static void EulerToQuaternion(double yaw, double pitch, double roll, double q[4]) {
+  double cy = cos(yaw / 2), sy = sin(yaw / 2);
+  double cp = cos(pitch / 2), sp = sin(pitch / 2);
+  double cr = cos(roll / 2), sr = sin(roll / 2);
+  q[0] = cy * cp * cr + sy * sp * sr;
+  q[1] = cy * cp * sr - sy * sp * cr;
+  q[2] = cy * sp * cr + sy * cp * sr;
+  q[3] = sy * cp * cr - cy * sp * sr;
+}
+
+// angle between two orientations in degrees
+static double AngleBetween(const double a[4], const double b[4]) {
+  double dot = fabs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+  return 2.0 * acos(dot > 1.0 ? 1.0 : dot) * BENCH_DEG;
+}
+
+// a vector of the earth frame as the sensor sees it, R(q) transposed
+static void EarthToSensor(const double q[4], const double earth[3], float sensor[3]) {
+  double w = q[0], x = q[1], y = q[2], z = q[3];
+  double r[3][3] = {
+    { 1 - 2 * (y * y + z * z), 2 * (x * y - w * z),     2 * (x * z + w * y) },
+    { 2 * (x * y + w * z),     1 - 2 * (x * x + z * z), 2 * (y * z - w * x) },
+    { 2 * (x * z - w * y),     2 * (y * z + w * x),     1 - 2 * (x * x + y * y) }
+  };
+  for (int i = 0; i < 3; i++) {
+    sensor[i] = (float)(r[0][i] * earth[0] + r[1][i] * earth[1] + r[2][i] * earth[2]);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Synthetic motion, a slow sway on every axis at unrelated frequencies
+    so no two line up, and an up and down shake the accelerometer feels
+    on top of gravity
+   -------------------------------------------------------------------------- */
+static double shakeG = 0.1;
+
+static void SyntheticOrientation(double seconds, double q[4]) {
+  double yaw = 60.0 / BENCH_DEG * sin(2 * BENCH_PI * 0.05 * seconds);
+  double pitch = 20.0 / BENCH_DEG * sin(2 * BENCH_PI * 0.11 * seconds);
+  double roll = 30.0 / BENCH_DEG * sin(2 * BENCH_PI * 0.07 * seconds);
+  EulerToQuaternion(yaw, pitch, roll, q);
+}
+
+static void SyntheticSample(uint32_t index, HostImuSample& sample) {
+  double seconds = index / (double)BENCH_SYNTHETIC_HZ;
+  double q[4];
+  SyntheticOrientation(seconds, q);
+
+  const double specificForce[3] = { 0.0, 0.0, 1.0 + shakeG * sin(2 * BENCH_PI * BENCH_SHAKE_HZ * seconds) };
+  const double field[3] = {
+    BENCH_FIELD_UT * cos(BENCH_DIP_DEG / BENCH_DEG), 0.0, -BENCH_FIELD_UT * sin(BENCH_DIP_DEG / BENCH_DEG)
+  };
+  EarthToSensor(q, specificForce, sample.acceleration);
+  EarthToSensor(q, field, sample.magnetometer);
+
+  // the body rate that turns q(t - h) into q(t + h)
+  double before[4], after[4], delta[4];
+  SyntheticOrientation(seconds - BENCH_GYRO_STEP, before);
+  SyntheticOrientation(seconds + BENCH_GYRO_STEP, after);
+  before[1] = -before[1];
+  before[2] = -before[2];
+  before[3] = -before[3];
+  QuaternionMultiply(before, after, delta);
+  for (int axis = 0; axis < 3; axis++) {
+    sample.gyroscope[axis] = (float)(2.0 * delta[axis + 1] / (2.0 * BENCH_GYRO_STEP) * BENCH_DEG);
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Replayed trace, a row per sample of ax,ay,az (g), gx,gy,gz (dps),
+    mx,my,mz (uT) and optionally yaw,pitch,roll (radians) of the true
+    motion. Without them the truth is a Madgwick run over the rows
+   -------------------------------------------------------------------------- */
+static std::vector<HostImuSample> replay;
+static std::vector<double> replayTruth;     // 4 per row
+
+static bool LoadReplay(const char* path, float traceHz) {
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  char line[512];
+  bool euler = true;
+  while (fgets(line, sizeof(line), file)) {
+    double values[12];
+    int count = 0;
+    char* cursor = line;
+    while (count < 12) {
+      char* end;
+      values[count] = strtod(cursor, &end);
+      if (end == cursor)
+        break;
+      count++;
+      cursor = end;
+      while (*cursor == ',' || *cursor == ' ' || *cursor == '\t')
+        cursor++;
+    }
+    // a header or a comment
+    if (count < 9)
+      continue;
+
+    HostImuSample sample;
+    for (int axis = 0; axis < 3; axis++) {
+      sample.acceleration[axis] = (float)values[axis];
+      sample.gyroscope[axis] = (float)values[3 + axis];
+      sample.magnetometer[axis] = (float)values[6 + axis];
+    }
+    replay.push_back(sample);
+
+    double q[4] = { 1.0, 0.0, 0.0, 0.0 };
+    if (count == 12) {
+      EulerToQuaternion(values[9], values[10], values[11], q);
+    } else {
+      euler = false;
+    }
+    replayTruth.insert(replayTruth.end(), q, q + 4);
+  }
+  fclose(file);
+
+  if (!euler) {
+    FusionEngine reference;
+    reference.Begin(FUSION_MADGWICK, traceHz);
+    for (size_t row = 0; row < replay.size(); row++) {
+      const HostImuSample& sample = replay[row];
+      reference.Update(
+        sample.gyroscope[0], sample.gyroscope[1], sample.gyroscope[2],
+        sample.acceleration[0], sample.acceleration[1], sample.acceleration[2],
+        sample.magnetometer[0], sample.magnetometer[1], sample.magnetometer[2]);
+      float q[4];
+      reference.GetQuaternion(q);
+      for (int i = 0; i < 4; i++) {
+        replayTruth[row * 4 + i] = q[i];
+      }
+    }
+  }
+  return !replay.empty();
+}
+
+static void ReplaySample(uint32_t index, HostImuSample& sample) {
+  sample = replay[index < replay.size() ? index : replay.size() - 1];
+}
+
+// ************************** CENTRAL/GATEWAY *******************************
+
+enum BenchSubscription { SUBSCRIBE_FRAME, SUBSCRIBE_ORIENTATION };
+
+static struct {
+  bool              synthetic;
+  float             traceHz;
+  unsigned long     settleMicros;
+  CompactChannel    frameChannels[COMPACT_FRAME_CHANNEL_COUNT];
+  CompactChannel    orientationChannel;
+  uint32_t          records;
+  uint32_t          undecoded;
+  uint32_t          errors;
+  double            errorTotal;
+  double            errorSquares;
+  double            errorMax;
+  uint32_t          traced[3];
+  int64_t           tracedMicros[3];
+  int32_t           tracedMax[3];
+  uint32_t          traceLost;
+} central;
+
+static void TrueOrientation(uint32_t sampleMicros, double q[4]) {
+  double seconds = (sampleMicros - HostImuStatistics().startMicros) / 1e6;
+  if (central.synthetic) {
+    SyntheticOrientation(seconds, q);
+    return;
+  }
+  size_t row = (size_t)(seconds * central.traceHz + 0.5);
+  if (row >= replay.size()) {
+    row = replay.size() - 1;
+  }
+  memcpy(q, &replayTruth[row * 4], 4 * sizeof(double));
+}
+
+static void Orientation(uint32_t sampleMicros, const float euler[3]) {
+  central.records++;
+  if (sampleMicros - HostImuStatistics().startMicros < central.settleMicros)
+    return;
+
+  double q[4], truth[4];
+  EulerToQuaternion(euler[0], euler[1], euler[2], q);
+  TrueOrientation(sampleMicros, truth);
+  double error = AngleBetween(q, truth);
+  central.errors++;
+  central.errorTotal += error;
+  central.errorSquares += error * error;
+  if (error > central.errorMax) {
+    central.errorMax = error;
+  }
+}
+
+static void Traced(const TraceEntry& entry) {
+  // sampled to fused, fused to queued, queued to notified, the magnetometer and batch have no fused.
+  // Signed, a sample stamped ahead of the fusion shows up as a negative stage
+  if (entry.fusedMicros != 0) {
+    int32_t stages[2] = { (int32_t)(entry.fusedMicros - entry.sampledMicros), (int32_t)(entry.queuedMicros - entry.fusedMicros) };
+    for (int stage = 0; stage < 2; stage++) {
+      central.traced[stage]++;
+      central.tracedMicros[stage] += stages[stage];
+      if (stages[stage] > central.tracedMax[stage]) {
+        central.tracedMax[stage] = stages[stage];
+      }
+    }
+  }
+  int32_t notified = (int32_t)(entry.notifiedMicros - entry.queuedMicros);
+  central.traced[2]++;
+  central.tracedMicros[2] += notified;
+  if (notified > central.tracedMax[2]) {
+    central.tracedMax[2] = notified;
+  }
+}
+
+static void Notified(uint16_t, const char* uuid, const uint8_t* data, int length) {
+  if (strcmp(uuid, "A001") == 0) {
+    TelemetryFrame frame;
+    if (DecodeCompactTelemetryFrame(data, length, central.frameChannels, frame)) {
+      Orientation(frame.timestampMicros, frame.orientation);
+    } else {
+      central.undecoded++;
+    }
+  } else if (strcmp(uuid, "7001") == 0) {
+    // stamped with its sequence and sample time, then the vector
+    float euler[3];
+    bool decoded = length > VECTOR_STAMP_SIZE;
+    if (decoded && length - VECTOR_STAMP_SIZE == 3 * sizeof(float)) {
+      for (int axis = 0; axis < 3; axis++) {
+        euler[axis] = GetFloatLE(&data[VECTOR_STAMP_SIZE + axis * sizeof(float)]);
+      }
+    } else if (decoded) {
+      decoded = CompactDecodeVector(central.orientationChannel, &data[VECTOR_STAMP_SIZE], length - VECTOR_STAMP_SIZE, euler, 3) > 0;
+    }
+    if (decoded) {
+      Orientation(GetUint32LE(&data[2]), euler);
+    } else {
+      central.undecoded++;
+    }
+  } else if (strcmp(uuid, "9904") == 0) {
+    TraceEntry entries[BENCH_TRACE_ENTRIES];
+    uint16_t lost;
+    size_t count;
+    if (DecodeLatencyTrace(data, length, lost, entries, BENCH_TRACE_ENTRIES, count)) {
+      central.traceLost = lost;
+      for (size_t i = 0; i < count; i++) {
+        Traced(entries[i]);
+      }
+    }
+  }
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: hostbench [--seconds N] [--replay FILE [--replay-hz HZ] | --shake G] [--mtu N] [--encoding f32|i16|f16|d8]\n"
+    "                 [--subscribe frame|orientation] [--period MS] [--stream] [--budget N] [--settle S] [--max-error DEG] [--log]\n"
+    "  --seconds N        simulated seconds after the connection, 60 by default\n"
+    "  --replay FILE      CSV of ax,ay,az,gx,gy,gz,mx,my,mz and optionally yaw,pitch,roll,\n"
+    "                     a synthetic sway by default\n"
+    "  --replay-hz HZ     sample rate of the file, 119 by default\n"
+    "  --shake G          peak of the synthetic shake, 0.1 by default\n"
+    "  --mtu N            ATT MTU of the connection, 185 by default\n"
+    "  --encoding E       telemetry encoding the Central/Gateway asks for, f32 by default\n"
+    "  --subscribe S      the Telemetry Frame (A001) or the Orientation (7001)\n"
+    "  --period MS        Telemetry Frequency the Central/Gateway writes, the device default otherwise\n"
+    "  --stream           no report on change deadbands, every publish goes out\n"
+    "  --budget N         notifications per 7.5 ms connection event, unlimited by default\n"
+    "  --settle S         seconds before the orientation error counts, 10 by default\n"
+    "  --max-error DEG    fails above this mean orientation error, 2 by default\n"
+    "  --log              echo the Serial output to stderr\n");
+}
+
+int main(int argc, char** argv) {
+  double seconds = 60.0;
+  const char* replayPath = 0;
+  float replayHz = 119.0f;
+  int mtu = 185;
+  int encoding = ENCODING_FLOAT32;
+  BenchSubscription subscription = SUBSCRIBE_FRAME;
+  int budget = 0;
+  double settle = 10.0;
+  double maxError = 2.0;
+  int period = 0;
+  bool stream = false;
+  bool log = false;
+
+  static const char* const encodings[ENCODING_COUNT] = { "f32", "i16", "f16", "d8" };
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (strcmp(argv[i], "--replay-hz") == 0 && i + 1 < argc) {
+      replayHz = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "--shake") == 0 && i + 1 < argc) {
+      shakeG = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--mtu") == 0 && i + 1 < argc) {
+      mtu = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc) {
+      i++;
+      for (encoding = 0; encoding < ENCODING_COUNT && strcmp(argv[i], encodings[encoding]) != 0; encoding++) {
+      }
+    } else if (strcmp(argv[i], "--subscribe") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "frame") == 0) {
+        subscription = SUBSCRIBE_FRAME;
+      } else if (strcmp(argv[i], "orientation") == 0) {
+        subscription = SUBSCRIBE_ORIENTATION;
+      } else {
+        Usage();
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+      budget = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--settle") == 0 && i + 1 < argc) {
+      settle = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--max-error") == 0 && i + 1 < argc) {
+      maxError = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--period") == 0 && i + 1 < argc) {
+      period = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      stream = true;
+    } else if (strcmp(argv[i], "--log") == 0) {
+      log = true;
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (seconds <= 0.0 || replayHz <= 0.0f || mtu < 23 || mtu > 517 || encoding >= ENCODING_COUNT ||
+      period < 0 || budget < 0 || settle < 0.0) {
+    Usage();
+    return 1;
+  }
+
+  central.synthetic = replayPath == 0;
+  central.traceHz = central.synthetic ? BENCH_SYNTHETIC_HZ : replayHz;
+  central.settleMicros = (unsigned long)(settle * 1e6);
+  if (!central.synthetic && !LoadReplay(replayPath, replayHz)) {
+    fprintf(stderr, "hostbench: no samples in %s\n", replayPath);
+    return 1;
+  }
+  CompactFrameChannelsBegin(central.frameChannels, COMPACT_DEFAULT_KEYFRAME);
+  CompactChannelBegin(central.orientationChannel, COMPACT_SCALE_ORIENTATION, COMPACT_DEFAULT_KEYFRAME);
+
+  HostImuBegin(central.synthetic ? SyntheticSample : ReplaySample, central.traceHz);
+  HostOnNotify(Notified);
+  HostLinkBudget(budget, 7500);
+  HostSerialEcho(log ? stderr : 0);
+
+  Clock::time_point start = Clock::now();
+  setup();
+
+  // connects, asks for its encoding and the trace and subscribes, all in one poll
+  while (micros() < BENCH_CONNECT_MICROS) {
+    loop();
+    HostClockAdvance(BENCH_LOOP_MICROS);
+  }
+  const uint8_t encodingConfig[2] = { (uint8_t)encoding, COMPACT_DEFAULT_KEYFRAME };
+  const uint8_t traceConfig[1] = { (uint8_t)(subscription == SUBSCRIBE_ORIENTATION ? 0x03 : 0x02) };
+  HostCentralConnect(BENCH_CONNECTION, (uint16_t)mtu);
+  HostCentralWrite(BENCH_CONNECTION, "3004", encodingConfig, sizeof(encodingConfig));
+  HostCentralWrite(BENCH_CONNECTION, "9903", traceConfig, sizeof(traceConfig));
+  if (period > 0) {
+    uint8_t frequency[4];
+    PutUint32LE(frequency, (uint32_t)period);
+    HostCentralWrite(BENCH_CONNECTION, "3001", frequency, sizeof(frequency));
+  }
+  if (stream) {
+    // the ChangeConfig defaults with every deadband at 0
+    const uint16_t fields[9] = { 0, 0, 0, 0, 30, 50, 2000, 100, 1 };
+    uint8_t changeConfig[sizeof(fields)];
+    for (int i = 0; i < 9; i++) {
+      PutUint16LE(&changeConfig[i * 2], fields[i]);
+    }
+    HostCentralWrite(BENCH_CONNECTION, "3006", changeConfig, sizeof(changeConfig));
+  }
+  HostCentralSubscribe(BENCH_CONNECTION, subscription == SUBSCRIBE_ORIENTATION ? "7001" : "A001");
+  HostCentralSubscribe(BENCH_CONNECTION, "9904");
+
+  unsigned long connected = micros();
+  unsigned long end = connected + (unsigned long)(seconds * 1e6);
+  unsigned long loops = 0;
+  while (micros() < end) {
+    loop();
+    HostClockAdvance(BENCH_LOOP_MICROS);
+    loops++;
+  }
+  double wall = std::chrono::duration<double>(Clock::now() - start).count();
+  double simulated = (micros() - connected) / 1e6;
+
+  const HostImuStats& imu = HostImuStatistics();
+  const HostLinkStats& link = HostLinkStatistics();
+  printf("hostbench, %s, %s%s, %s, MTU %d\n",
+    central.synthetic ? "synthetic sway" : replayPath, subscription == SUBSCRIBE_FRAME ? "frame" : "orientation",
+    stream ? " streamed" : " on change", encodings[encoding], mtu);
+  printf("  simulated        %.1f s in %.2f s wall, %lu loops\n", simulated, wall, loops);
+  printf("  samples          %u produced, %u read, %u overruns\n", imu.produced, imu.read, imu.overruns);
+  printf("  samples/s        %.1f simulated, %.0f host\n", imu.read / (micros() / 1e6), imu.read / wall);
+
+  printf("host time per section (ns)\n");
+  printf("  %-10s %10s %10s %10s %10s\n", "section", "count", "min", "avg", "max");
+  for (int section = 0; section < BENCH_SECTIONS; section++) {
+    const ProfileSection& stats = profiler.Section(section);
+    printf("  %-10s %10u %10u %10.0f %10u\n", sectionNames[section], stats.count,
+      stats.count ? stats.min : 0, stats.count ? (double)stats.total / stats.count : 0.0, stats.max);
+  }
+
+  static const char* const stageNames[3] = { "sampled->fused", "fused->queued", "queued->notified" };
+  printf("simulated latency per stage (us), %u trace entries lost\n", central.traceLost);
+  for (int stage = 0; stage < 3; stage++) {
+    printf("  %-18s %8u records  avg %8.0f  max %8d\n", stageNames[stage], central.traced[stage],
+      central.traced[stage] ? (double)central.tracedMicros[stage] / central.traced[stage] : 0.0, central.tracedMax[stage]);
+  }
+
+  printf("link\n");
+  printf("  notifications    %u sent, %u refused\n", link.notifications, link.refused);
+  printf("  payload          %.0f bytes/s\n", link.payloadBytes / simulated);
+  printf("  on air           %.0f bytes/s\n", link.airBytes / simulated);
+  printf("  serial           %.0f bytes/s\n", link.serialBytes / (micros() / 1e6));
+
+  double mean = central.errors ? central.errorTotal / central.errors : 0.0;
+  printf("orientation, %u records, %u undecoded, %u after %.0f s settle\n",
+    central.records, central.undecoded, central.errors, settle);
+  printf("  error deg        mean %.3f  rms %.3f  max %.3f\n",
+    mean, central.errors ? sqrt(central.errorSquares / central.errors) : 0.0, central.errorMax);
+
+  bool ok = central.errors > 0 && central.undecoded == 0 && mean <= maxError;
+  printf("result             %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,940 @@
+/* ==========================================================================
+    File:     HostShim.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shims of the Arduino core, Wire, Arduino_LSM9DS1 and
+              ArduinoBLE that src/main.cpp is built against for the
+              hostbench, see HostShim.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include "HostShim.h"
+#include <Arduino.h>
+#include <Wire.h>
+#include <Arduino_LSM9DS1.h>
+#include <ArduinoBLE.h>
+#include <utility/ATT.h>
+#include <utility/GATT.h>
+#include <utility/HCI.h>
+#include <local/BLELocalCharacteristic.h>
+#include <Lsm9ds1Fifo.h>
+#include <TelemetryFrame.h>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+
+/* --------------------------------------------------------------------------
+    LSM9DS1 registers the model needs beyond the ones Lsm9ds1Fifo.h has
+   -------------------------------------------------------------------------- */
+#define HOST_CTRL_REG6_XL         0x20
+#define HOST_CTRL_REG1_M          0x20
+#define HOST_MAG_SCALE            (400.0f / 32768.0f)     // uT per LSB at 4 gauss
+#define HOST_MAG_HZ               20.0                    // CTRL_REG1_M as IMU.begin() sets it
+#define HOST_REGISTER_COUNT       128
+
+#define HOST_MAX_CONNECTIONS      8
+#define HOST_RSSI                 -60
+#define HOST_RSSI_NOT_CONNECTED   127
+#define HOST_SERIAL_ROOM          1024
+#define HOST_ATT_OP_NOTIFY        0x1B
+#define HOST_FIRST_HANDLE         1
+
+// ************************** ARDUINO CORE **********************************
+
+static unsigned long hostMicros = 0;
+static bool realTime = false;
+static std::chrono::steady_clock::time_point realTimeBase;
+static FILE* serialEcho = 0;
+static HostLinkStats linkStats;
+
+static unsigned long Now() {
+  if (realTime) {
+    hostMicros = (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - realTimeBase).count();
+  }
+  return hostMicros;
+}
+
+unsigned long micros() {
+  return Now();
+}
+
+unsigned long millis() {
+  return Now() / 1000UL;
+}
+
+void HostClockAdvance(unsigned long us) {
+  if (realTime) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  } else {
+    hostMicros += us;
+  }
+}
+
+void HostClockRealTime() {
+  // carry on from the simulated time so micros() never steps back
+  realTimeBase = std::chrono::steady_clock::now() - std::chrono::microseconds(hostMicros);
+  realTime = true;
+}
+
+void delay(unsigned long ms) {
+  HostClockAdvance(ms * 1000UL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  HostClockAdvance(us);
+}
+
+void pinMode(int, int) {
+}
+
+void digitalWrite(int, PinStatus) {
+}
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long) {
+}
+
+int HardwareSerial::availableForWrite() {
+  return HOST_SERIAL_ROOM;
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  return write(&value, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (serialEcho) {
+    fwrite(buffer, 1, size, serialEcho);
+  }
+  linkStats.serialBytes += size;
+  return size;
+}
+
+void HostSerialEcho(FILE* file) {
+  serialEcho = file;
+}
+
+/* --------------------------------------------------------------------------
+    DWT cycle counter on the host steady clock, in nanoseconds
+   -------------------------------------------------------------------------- */
+typedef std::chrono::steady_clock HostClock;
+
+static HostClock::time_point cycleBase = HostClock::now();
+
+HostDwtRegisters       hostDwt;
+HostCoreDebugRegisters hostCoreDebug;
+uint32_t               SystemCoreClock = 1000000000UL;
+
+HostCycleCounter::operator uint32_t() const {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(HostClock::now() - cycleBase).count();
+}
+
+HostCycleCounter& HostCycleCounter::operator=(uint32_t value) {
+  cycleBase = HostClock::now() - std::chrono::nanoseconds(value);
+  return *this;
+}
+
+// ************************** LSM9DS1 MODEL *********************************
+
+/* --------------------------------------------------------------------------
+    Register model of the LSM9DS1, the accel/gyro put out a trace sample
+    per period of the output data rate in CTRL_REG1_G, into the 32 slot
+    FIFO when it is on or the output registers when it is not. The
+    magnetometer runs at 20 Hz unless powered down in CTRL_REG3_M
+   -------------------------------------------------------------------------- */
+struct HostImuSlot {
+  int16_t gyro[3];
+  int16_t accel[3];
+};
+
+static const double hostOutputDataRates[] = { 0.0, 14.9, 59.5, 119.0, 238.0, 476.0, 952.0, 0.0 };
+
+static struct {
+  HostImuSource source;
+  double        traceHz;
+  double        rateError;
+  bool          running;
+  HostImuStats  stats;
+  uint8_t       ag[HOST_REGISTER_COUNT];
+  uint8_t       m[HOST_REGISTER_COUNT];
+  HostImuSlot   fifo[LSM9DS1_FIFO_DEPTH];
+  int           fifoCount;
+  bool          fifoOverrun;
+  HostImuSlot   output;
+  bool          accelReady;
+  bool          gyroReady;
+  double        nextSample;         // micros since startMicros
+  float         magnetic[3];
+  bool          magneticReady;
+  double        nextMagnetic;
+} imu;
+
+static int16_t Raw(float value, float scale) {
+  float raw = roundf(value / scale);
+  if (raw > 32767.0f)
+    return 32767;
+  if (raw < -32768.0f)
+    return -32768;
+  return (int16_t)raw;
+}
+
+static bool FifoEnabled() {
+  return (imu.ag[LSM9DS1_CTRL_REG9] & LSM9DS1_CTRL_REG9_FIFO_EN) &&
+         (imu.ag[LSM9DS1_FIFO_CTRL] & 0xE0) == LSM9DS1_FIFO_MODE_CONTINUOUS;
+}
+
+static double OutputDataRate() {
+  return hostOutputDataRates[imu.ag[LSM9DS1_CTRL_REG1_G] >> 5] * (1.0 + imu.rateError);
+}
+
+static void TraceSample(double at, HostImuSample& sample) {
+  memset(&sample, 0, sizeof(sample));
+  if (imu.source) {
+    imu.source((uint32_t)(at * imu.traceHz / 1e6 + 1e-6), sample);
+  }
+}
+
+static void ImuAdvance() {
+  if (!imu.running)
+    return;
+
+  double now = (double)(Now() - imu.stats.startMicros);
+  double rate = OutputDataRate();
+  if (rate <= 0.0) {
+    imu.nextSample = now;
+  }
+  while (rate > 0.0 && imu.nextSample <= now) {
+    HostImuSample sample;
+    TraceSample(imu.nextSample, sample);
+
+    HostImuSlot slot;
+    for (int axis = 0; axis < 3; axis++) {
+      slot.gyro[axis] = Raw(sample.gyroscope[axis], LSM9DS1_GYRO_SCALE);
+      slot.accel[axis] = Raw(sample.acceleration[axis], LSM9DS1_ACCEL_SCALE);
+    }
+
+    if (FifoEnabled()) {
+      if (imu.fifoCount == LSM9DS1_FIFO_DEPTH) {
+        // continuous mode, the oldest slot goes
+        memmove(&imu.fifo[0], &imu.fifo[1], sizeof(HostImuSlot) * (LSM9DS1_FIFO_DEPTH - 1));
+        imu.fifoCount--;
+        imu.fifoOverrun = true;
+        imu.stats.overruns++;
+      }
+      imu.fifo[imu.fifoCount++] = slot;
+    } else {
+      imu.output = slot;
+      imu.accelReady = true;
+      imu.gyroReady = true;
+    }
+    imu.stats.produced++;
+    imu.nextSample += 1e6 / rate;
+  }
+
+  bool magneticOn = (imu.m[LSM9DS1_CTRL_REG3_M] & LSM9DS1_CTRL_REG3_M_MD_MASK) != LSM9DS1_CTRL_REG3_M_POWER_DOWN;
+  if (!magneticOn) {
+    imu.nextMagnetic = now;
+  }
+  while (magneticOn && imu.nextMagnetic <= now) {
+    HostImuSample sample;
+    TraceSample(imu.nextMagnetic, sample);
+    for (int axis = 0; axis < 3; axis++) {
+      imu.magnetic[axis] = Raw(sample.magnetometer[axis], HOST_MAG_SCALE) * HOST_MAG_SCALE;
+    }
+    imu.magneticReady = true;
+    imu.nextMagnetic += 1e6 / HOST_MAG_HZ;
+  }
+}
+
+static void PutWords(const int16_t* words, uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length && i < 6; i++) {
+    data[i] = (uint8_t)(words[i / 2] >> ((i & 1) * 8));
+  }
+}
+
+static void ImuReadRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t length) {
+  ImuAdvance();
+
+  if (address == LSM9DS1_M_ADDRESS) {
+    for (size_t i = 0; i < length; i++) {
+      data[i] = imu.m[(reg + i) % HOST_REGISTER_COUNT];
+    }
+    return;
+  }
+
+  bool fifo = FifoEnabled();
+  if (reg == LSM9DS1_FIFO_SRC && length == 1) {
+    uint8_t watermark = imu.ag[LSM9DS1_FIFO_CTRL] & 0x1F;
+    uint8_t source = (uint8_t)(fifo ? imu.fifoCount : 0);
+    if (fifo && imu.fifoCount >= watermark)
+      source |= LSM9DS1_FIFO_SRC_FTH;
+    if (imu.fifoOverrun)
+      source |= LSM9DS1_FIFO_SRC_OVRN;
+    imu.fifoOverrun = false;
+    data[0] = source;
+    return;
+  }
+
+  // the output registers read the FIFO head while it is on, the accel word moves it on
+  const HostImuSlot& slot = (fifo && imu.fifoCount > 0) ? imu.fifo[0] : imu.output;
+  if (reg == LSM9DS1_OUT_X_L_G) {
+    PutWords(slot.gyro, data, length);
+    return;
+  }
+  if (reg == LSM9DS1_OUT_X_L_XL) {
+    PutWords(slot.accel, data, length);
+    if (fifo && imu.fifoCount > 0) {
+      memmove(&imu.fifo[0], &imu.fifo[1], sizeof(HostImuSlot) * (LSM9DS1_FIFO_DEPTH - 1));
+      imu.fifoCount--;
+      imu.stats.read++;
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    data[i] = imu.ag[(reg + i) % HOST_REGISTER_COUNT];
+  }
+}
+
+static void ImuWriteRegister(uint8_t address, uint8_t reg, uint8_t value) {
+  ImuAdvance();
+
+  if (address == LSM9DS1_M_ADDRESS) {
+    imu.m[reg % HOST_REGISTER_COUNT] = value;
+    return;
+  }
+
+  // bypass mode empties the FIFO
+  if (reg == LSM9DS1_FIFO_CTRL && (value & 0xE0) == LSM9DS1_FIFO_MODE_BYPASS) {
+    imu.fifoCount = 0;
+    imu.fifoOverrun = false;
+  }
+  imu.ag[reg % HOST_REGISTER_COUNT] = value;
+}
+
+void HostImuBegin(HostImuSource source, double traceHz) {
+  imu.source = source;
+  imu.traceHz = traceHz;
+}
+
+void HostImuRateError(double ppm) {
+  imu.rateError = ppm / 1e6;
+}
+
+const HostImuStats& HostImuStatistics() {
+  return imu.stats;
+}
+
+LSM9DS1Class IMU;
+
+int LSM9DS1Class::begin() {
+  memset(imu.ag, 0, sizeof(imu.ag));
+  memset(imu.m, 0, sizeof(imu.m));
+
+  // as Arduino_LSM9DS1 leaves them, 119 Hz 2000 dps, 119 Hz 4 g, 20 Hz 4 gauss
+  imu.ag[LSM9DS1_CTRL_REG1_G] = 0x78;
+  imu.ag[HOST_CTRL_REG6_XL] = 0x70;
+  imu.ag[LSM9DS1_CTRL_REG8] = LSM9DS1_CTRL_REG8_IF_ADD_INC;
+  imu.m[HOST_CTRL_REG1_M] = 0xB4;
+  imu.m[LSM9DS1_CTRL_REG3_M] = 0x00;
+
+  imu.fifoCount = 0;
+  imu.fifoOverrun = false;
+  imu.accelReady = false;
+  imu.gyroReady = false;
+  imu.magneticReady = false;
+  imu.nextSample = 1e6 / OutputDataRate();
+  imu.nextMagnetic = 1e6 / HOST_MAG_HZ;
+  memset(&imu.stats, 0, sizeof(imu.stats));
+  imu.stats.startMicros = Now();
+  imu.running = true;
+  return 1;
+}
+
+void LSM9DS1Class::end() {
+  imu.running = false;
+}
+
+int LSM9DS1Class::accelerationAvailable() {
+  ImuAdvance();
+  return imu.accelReady;
+}
+
+int LSM9DS1Class::readAcceleration(float& x, float& y, float& z) {
+  ImuAdvance();
+  x = imu.output.accel[0] * LSM9DS1_ACCEL_SCALE;
+  y = imu.output.accel[1] * LSM9DS1_ACCEL_SCALE;
+  z = imu.output.accel[2] * LSM9DS1_ACCEL_SCALE;
+  imu.accelReady = false;
+  return 1;
+}
+
+float LSM9DS1Class::accelerationSampleRate() {
+  return (float)hostOutputDataRates[imu.ag[LSM9DS1_CTRL_REG1_G] >> 5];
+}
+
+int LSM9DS1Class::gyroscopeAvailable() {
+  ImuAdvance();
+  return imu.gyroReady;
+}
+
+int LSM9DS1Class::readGyroscope(float& x, float& y, float& z) {
+  ImuAdvance();
+  x = imu.output.gyro[0] * LSM9DS1_GYRO_SCALE;
+  y = imu.output.gyro[1] * LSM9DS1_GYRO_SCALE;
+  z = imu.output.gyro[2] * LSM9DS1_GYRO_SCALE;
+  if (imu.gyroReady) {
+    imu.stats.read++;
+  }
+  imu.gyroReady = false;
+  return 1;
+}
+
+float LSM9DS1Class::gyroscopeSampleRate() {
+  return accelerationSampleRate();
+}
+
+int LSM9DS1Class::magneticFieldAvailable() {
+  ImuAdvance();
+  return imu.magneticReady;
+}
+
+int LSM9DS1Class::readMagneticField(float& x, float& y, float& z) {
+  ImuAdvance();
+  x = imu.magnetic[0];
+  y = imu.magnetic[1];
+  z = imu.magnetic[2];
+  imu.magneticReady = false;
+  return 1;
+}
+
+float LSM9DS1Class::magneticFieldSampleRate() {
+  return (float)HOST_MAG_HZ;
+}
+
+// ************************** WIRE ******************************************
+
+TwoWire Wire;
+TwoWire Wire1;
+
+TwoWire::TwoWire()
+  : _address(0), _writtenLength(0), _register(0), _readLength(0), _readIndex(0) {
+}
+
+void TwoWire::begin() {
+}
+
+void TwoWire::setClock(uint32_t) {
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  _address = address;
+  _writtenLength = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (_writtenLength >= HOST_WIRE_BUFFER_SIZE)
+    return 0;
+  _written[_writtenLength++] = value;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+  if (_writtenLength == 0)
+    return 0;
+
+  // the top bit asks the magnetometer to auto increment, the register is the rest
+  _register = _written[0] & 0x7F;
+  for (size_t i = 1; i < _writtenLength; i++) {
+    ImuWriteRegister(_address, (uint8_t)(_register + i - 1), _written[i]);
+  }
+  return 0;
+}
+
+size_t TwoWire::requestFrom(uint8_t address, size_t length, bool) {
+  if (length > HOST_WIRE_BUFFER_SIZE) {
+    length = HOST_WIRE_BUFFER_SIZE;
+  }
+  ImuReadRegisters(address, _register, _read, length);
+  _readLength = length;
+  _readIndex = 0;
+  return length;
+}
+
+int TwoWire::available() {
+  return (int)(_readLength - _readIndex);
+}
+
+int TwoWire::read() {
+  return _readIndex < _readLength ? _read[_readIndex++] : -1;
+}
+
+// ************************** BLE *******************************************
+
+struct HostConnection {
+  bool      connected;
+  uint16_t  mtu;
+  int       budget;
+  uint32_t  budgetEvent;
+};
+
+struct HostEvent {
+  enum Type { CONNECT, DISCONNECT, SUBSCRIBE, WRITE } type;
+  uint16_t              connection;
+  uint16_t              mtu;
+  BLELocalCharacteristic* characteristic;
+  std::vector<uint8_t>  data;
+};
+
+static HostConnection connections[HOST_MAX_CONNECTIONS];
+static std::deque<HostEvent> events;
+static std::vector<BLELocalAttribute*> gattTable;
+static uint16_t nextHandle = HOST_FIRST_HANDLE;
+static HostNotifyHandler notifyHandler = 0;
+static int packetsPerEvent = 0;
+static unsigned long eventMicros = 7500;
+
+// every characteristic the sketch declared, they are globals so this is built during static init
+static std::vector<BLELocalCharacteristic*>& Characteristics() {
+  static std::vector<BLELocalCharacteristic*> characteristics;
+  return characteristics;
+}
+
+static BLELocalCharacteristic* FindCharacteristic(const char* uuid) {
+  for (BLELocalCharacteristic* characteristic : Characteristics()) {
+    if (strcasecmp(characteristic->uuid(), uuid) == 0)
+      return characteristic;
+  }
+  return 0;
+}
+
+static BLELocalCharacteristic* FindValueHandle(uint16_t handle) {
+  for (BLELocalCharacteristic* characteristic : Characteristics()) {
+    if (characteristic->handle() != 0 && characteristic->valueHandle() == handle)
+      return characteristic;
+  }
+  return 0;
+}
+
+static void Address(uint16_t connection, uint8_t address[6]) {
+  const uint8_t base[6] = { 0x00, 0x00, 0x00, 0xEE, 0xFF, 0xC0 };
+  memcpy(address, base, sizeof(base));
+  address[0] = (uint8_t)connection;
+}
+
+static bool Connected(uint16_t connection) {
+  return connection < HOST_MAX_CONNECTIONS && connections[connection].connected;
+}
+
+/* --------------------------------------------------------------------------
+    One packet to the Central/Gateway, false when the budget of the
+    connection event is spent
+   -------------------------------------------------------------------------- */
+static bool Deliver(uint16_t connection, const char* uuid, const uint8_t* data, int length) {
+  HostConnection& link = connections[connection];
+  if (packetsPerEvent > 0) {
+    uint32_t event = (uint32_t)(Now() / eventMicros);
+    if (event != link.budgetEvent) {
+      link.budgetEvent = event;
+      link.budget = packetsPerEvent;
+    }
+    if (link.budget == 0) {
+      linkStats.refused++;
+      return false;
+    }
+    link.budget--;
+  }
+
+  linkStats.notifications++;
+  linkStats.payloadBytes += length;
+  linkStats.airBytes += length + HOST_AIR_OVERHEAD;
+  if (notifyHandler) {
+    notifyHandler(connection, uuid, data, length);
+  }
+  return true;
+}
+
+void HostOnNotify(HostNotifyHandler handler) {
+  notifyHandler = handler;
+}
+
+void HostLinkBudget(int packets, unsigned long micros) {
+  packetsPerEvent = packets;
+  eventMicros = micros > 0 ? micros : 1;
+  for (int i = 0; i < HOST_MAX_CONNECTIONS; i++) {
+    connections[i].budgetEvent = 0xFFFFFFFFUL;
+  }
+}
+
+const HostLinkStats& HostLinkStatistics() {
+  return linkStats;
+}
+
+void HostCentralConnect(uint16_t connection, uint16_t mtu) {
+  HostEvent event;
+  event.type = HostEvent::CONNECT;
+  event.connection = connection;
+  event.mtu = mtu;
+  event.characteristic = 0;
+  events.push_back(event);
+}
+
+void HostCentralDisconnect(uint16_t connection) {
+  HostEvent event;
+  event.type = HostEvent::DISCONNECT;
+  event.connection = connection;
+  event.mtu = 0;
+  event.characteristic = 0;
+  events.push_back(event);
+}
+
+bool HostCentralSubscribe(uint16_t connection, const char* uuid) {
+  BLELocalCharacteristic* characteristic = FindCharacteristic(uuid);
+  if (characteristic == 0 || !(characteristic->properties() & (BLENotify | BLEIndicate)))
+    return false;
+
+  HostEvent event;
+  event.type = HostEvent::SUBSCRIBE;
+  event.connection = connection;
+  event.mtu = 0;
+  event.characteristic = characteristic;
+  events.push_back(event);
+  return true;
+}
+
+bool HostCentralWrite(uint16_t connection, const char* uuid, const uint8_t* data, int length) {
+  BLELocalCharacteristic* characteristic = FindCharacteristic(uuid);
+  if (characteristic == 0 || !(characteristic->properties() & (BLEWrite | BLEWriteWithoutResponse)))
+    return false;
+
+  HostEvent event;
+  event.type = HostEvent::WRITE;
+  event.connection = connection;
+  event.mtu = 0;
+  event.characteristic = characteristic;
+  event.data.assign(data, data + length);
+  events.push_back(event);
+  return true;
+}
+
+/* --------------------------------------------------------------------------
+    Local Characteristic
+   -------------------------------------------------------------------------- */
+BLELocalCharacteristic::BLELocalCharacteristic(const char* uuid, uint8_t properties, int valueSize)
+  : BLELocalAttribute(uuid), _properties(properties), _value(valueSize > 0 ? valueSize : 1, 0),
+    _valueLength(0), _subscribed(false), _handle(0) {
+  memset(_handlers, 0, sizeof(_handlers));
+  Characteristics().push_back(this);
+}
+
+int BLELocalCharacteristic::writeValue(const uint8_t* value, int length) {
+  if (length > valueSize()) {
+    length = valueSize();
+  }
+  memcpy(_value.data(), value, length);
+  _valueLength = length;
+
+  if (!(_properties & (BLENotify | BLEIndicate)) || !_subscribed)
+    return 1;
+
+  // like ATT.handleNotify, cut to each MTU and count the connections it reached
+  int notified = 0;
+  for (uint16_t connection = 0; connection < HOST_MAX_CONNECTIONS; connection++) {
+    if (!connections[connection].connected)
+      continue;
+    int payload = connections[connection].mtu - 3;
+    if (Deliver(connection, uuid(), _value.data(), length < payload ? length : payload)) {
+      notified++;
+    }
+  }
+  return notified;
+}
+
+void BLELocalCharacteristic::Written(uint16_t connection, const uint8_t* value, int length) {
+  if (length > valueSize()) {
+    length = valueSize();
+  }
+  memcpy(_value.data(), value, length);
+  _valueLength = length;
+  if (_handlers[BLEWritten]) {
+    _handlers[BLEWritten](BLEDevice(connection), BLECharacteristic(this));
+  }
+}
+
+void BLELocalCharacteristic::Subscribe(uint16_t connection, bool subscribed) {
+  if (_subscribed == subscribed)
+    return;
+  _subscribed = subscribed;
+  int event = subscribed ? BLESubscribed : BLEUnsubscribed;
+  if (_handlers[event]) {
+    _handlers[event](BLEDevice(connection), BLECharacteristic(this));
+  }
+}
+
+void BLELocalCharacteristic::setEventHandler(int event, BLECharacteristicEventHandler handler) {
+  if (event >= 0 && event < BLECharacteristicEventLast) {
+    _handlers[event] = handler;
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Characteristic handles, the globals of the sketch never go away so
+    neither do the local characteristics behind them
+   -------------------------------------------------------------------------- */
+BLECharacteristic::BLECharacteristic() : _local(0) {
+}
+
+BLECharacteristic::BLECharacteristic(const char* uuid, uint8_t properties, int valueSize, bool)
+  : _local(new BLELocalCharacteristic(uuid, properties, valueSize)) {
+}
+
+const char* BLECharacteristic::uuid() const {
+  return _local ? _local->uuid() : "";
+}
+
+uint8_t BLECharacteristic::properties() const {
+  return _local ? _local->properties() : 0;
+}
+
+int BLECharacteristic::valueSize() const {
+  return _local ? _local->valueSize() : 0;
+}
+
+const uint8_t* BLECharacteristic::value() const {
+  return _local ? _local->value() : 0;
+}
+
+int BLECharacteristic::valueLength() const {
+  return _local ? _local->valueLength() : 0;
+}
+
+uint8_t BLECharacteristic::operator[](int offset) const {
+  return (_local && offset < _local->valueLength()) ? _local->value()[offset] : 0;
+}
+
+int BLECharacteristic::writeValue(const uint8_t* value, int length) {
+  return _local ? _local->writeValue(value, length) : 0;
+}
+
+int BLECharacteristic::writeValue(const void* value, int length) {
+  return writeValue((const uint8_t*)value, length);
+}
+
+int BLECharacteristic::broadcast() {
+  return 1;
+}
+
+bool BLECharacteristic::subscribed() {
+  return _local && _local->subscribed();
+}
+
+void BLECharacteristic::addDescriptor(BLEDescriptor&) {
+}
+
+void BLECharacteristic::setEventHandler(int event, BLECharacteristicEventHandler handler) {
+  if (_local) {
+    _local->setEventHandler(event, handler);
+  }
+}
+
+void BLEService::addCharacteristic(BLECharacteristic& characteristic) {
+  if (characteristic.local()) {
+    _characteristics.push_back(characteristic.local());
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Device and Local Device
+   -------------------------------------------------------------------------- */
+BLEDevice::operator bool() const {
+  return Connected(_handle);
+}
+
+bool BLEDevice::connected() const {
+  return Connected(_handle);
+}
+
+String BLEDevice::address() const {
+  uint8_t address[6];
+  Address(_handle, address);
+  char text[18];
+  snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x",
+    address[5], address[4], address[3], address[2], address[1], address[0]);
+  return String(text);
+}
+
+int BLEDevice::rssi() {
+  return Connected(_handle) ? HOST_RSSI : HOST_RSSI_NOT_CONNECTED;
+}
+
+bool BLEDevice::disconnect() {
+  if (!Connected(_handle))
+    return false;
+  HostCentralDisconnect(_handle);
+  return true;
+}
+
+BLELocalDevice BLE;
+
+class HostServiceAttribute : public BLELocalAttribute {
+public:
+  HostServiceAttribute(const char* uuid) : BLELocalAttribute(uuid) {}
+  enum BLEAttributeType type() const { return BLETypeService; }
+};
+
+int BLELocalDevice::begin() {
+  return 1;
+}
+
+void BLELocalDevice::end() {
+}
+
+void BLELocalDevice::poll(unsigned long) {
+  while (!events.empty()) {
+    HostEvent event = events.front();
+    events.pop_front();
+    if (event.connection >= HOST_MAX_CONNECTIONS)
+      continue;
+
+    HostConnection& link = connections[event.connection];
+    switch (event.type) {
+      case HostEvent::CONNECT:
+        link.connected = true;
+        link.mtu = event.mtu;
+        link.budget = packetsPerEvent;
+        link.budgetEvent = 0xFFFFFFFFUL;
+        break;
+
+      case HostEvent::DISCONNECT:
+        link.connected = false;
+        if (!connected()) {
+          // the CCCDs go with the last connection
+          for (BLELocalCharacteristic* characteristic : Characteristics()) {
+            characteristic->Subscribe(event.connection, false);
+          }
+        }
+        break;
+
+      case HostEvent::SUBSCRIBE:
+        if (link.connected) {
+          event.characteristic->Subscribe(event.connection, true);
+        }
+        break;
+
+      case HostEvent::WRITE:
+        if (link.connected) {
+          event.characteristic->Written(event.connection, event.data.data(), (int)event.data.size());
+        }
+        break;
+    }
+  }
+}
+
+bool BLELocalDevice::connected() const {
+  for (int i = 0; i < HOST_MAX_CONNECTIONS; i++) {
+    if (connections[i].connected)
+      return true;
+  }
+  return false;
+}
+
+int BLELocalDevice::rssi() {
+  return connected() ? HOST_RSSI : HOST_RSSI_NOT_CONNECTED;
+}
+
+void BLELocalDevice::setLocalName(const char*) {
+}
+
+void BLELocalDevice::setDeviceName(const char*) {
+}
+
+void BLELocalDevice::setManufacturerData(const uint8_t*, int) {
+}
+
+void BLELocalDevice::setAdvertisedServiceUuid(const char*) {
+}
+
+void BLELocalDevice::setAdvertisedService(const BLEService&) {
+}
+
+/* --------------------------------------------------------------------------
+    Lays the service out in the GATT table, every characteristic takes a
+    declaration and a value handle, a CCCD when it notifies and its user
+    description
+   -------------------------------------------------------------------------- */
+void BLELocalDevice::addService(BLEService& service) {
+  gattTable.push_back(new HostServiceAttribute(service.uuid()));
+  nextHandle++;
+  for (BLELocalCharacteristic* characteristic : service.characteristics()) {
+    characteristic->setHandle(nextHandle);
+    gattTable.push_back(characteristic);
+    nextHandle += 2 + ((characteristic->properties() & (BLENotify | BLEIndicate)) ? 1 : 0) + 1;
+  }
+}
+
+void BLELocalDevice::setAdvertisingInterval(uint16_t) {
+}
+
+void BLELocalDevice::setConnectionInterval(uint16_t, uint16_t) {
+}
+
+int BLELocalDevice::advertise() {
+  return 1;
+}
+
+void BLELocalDevice::stopAdvertise() {
+}
+
+/* --------------------------------------------------------------------------
+    ATT, GATT and HCI
+   -------------------------------------------------------------------------- */
+ATTClass ATT;
+GATTClass GATT;
+HCIClass HCI;
+
+bool ATTClass::connected(uint16_t handle) const {
+  return Connected(handle);
+}
+
+uint16_t ATTClass::mtu(uint16_t handle) const {
+  return Connected(handle) ? connections[handle].mtu : 0;
+}
+
+uint16_t ATTClass::connectionHandle(uint8_t addressType, const uint8_t address[6]) const {
+  if (addressType != 0)
+    return 0xFFFF;
+  for (uint16_t connection = 0; connection < HOST_MAX_CONNECTIONS; connection++) {
+    uint8_t known[6];
+    Address(connection, known);
+    if (connections[connection].connected && memcmp(known, address, sizeof(known)) == 0)
+      return connection;
+  }
+  return 0xFFFF;
+}
+
+unsigned int GATTClass::attributeCount() const {
+  return (unsigned int)gattTable.size();
+}
+
+BLELocalAttribute* GATTClass::attribute(unsigned int index) const {
+  return index < gattTable.size() ? gattTable[index] : 0;
+}
+
+int HCIClass::leConnUpdate(uint16_t, uint16_t, uint16_t, uint16_t, uint16_t) {
+  return 0;
+}
+
+// only notifications go out this way, [0] opcode, [1..2] value handle, the value
+int HCIClass::sendAclPkt(uint16_t handle, uint8_t, uint8_t plen, void* data) {
+  const uint8_t* pdu = (const uint8_t*)data;
+  if (!Connected(handle) || plen < 3 || pdu[0] != HOST_ATT_OP_NOTIFY)
+    return -1;
+
+  BLELocalCharacteristic* characteristic = FindValueHandle(GetUint16LE(&pdu[1]));
+  if (characteristic == 0)
+    return -1;
+  return Deliver(handle, characteristic->uuid(), &pdu[3], plen - 3) ? 0 : 1;
+}
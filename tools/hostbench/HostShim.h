@@ -0,0 +1,92 @@
+/* ==========================================================================
+    File:     HostShim.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  The bench side of the host shims src/main.cpp is built against
+              for the hostbench, drives the simulated clock, the IMU trace
+              the LSM9DS1 model replays, and the Central/Gateway on the
+              other end of the BLE link
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* --------------------------------------------------------------------------
+    Simulated Clock, micros() and millis() read it, delay() moves it on.
+    Nothing else does, so a run is the same every time however fast the
+    host is
+   -------------------------------------------------------------------------- */
+void HostClockAdvance(unsigned long micros);
+
+// from here on the clock follows the host's steady clock and delay() sleeps,
+// for running the sketch in real time
+void HostClockRealTime();
+
+/* --------------------------------------------------------------------------
+    IMU Trace, the LSM9DS1 model asks for the trace sample under the
+    current time at its output data rate. A slower output data rate skips
+    trace samples rather than slowing the trace down
+   -------------------------------------------------------------------------- */
+struct HostImuSample {
+  float acceleration[3];          // g
+  float gyroscope[3];             // dps
+  float magnetometer[3];          // uT
+};
+
+typedef void (*HostImuSource)(uint32_t index, HostImuSample& sample);
+
+struct HostImuStats {
+  unsigned long startMicros;      // IMU.begin(), trace sample 0
+  uint32_t      produced;         // samples the accel/gyro put out
+  uint32_t      read;             // samples the sketch read
+  uint32_t      overruns;         // samples the FIFO overwrote
+};
+
+void HostImuBegin(HostImuSource source, double traceHz);
+
+// the accel/gyro run ppm off their nominal output data rate, a real part
+// never runs exactly at it
+void HostImuRateError(double ppm);
+
+const HostImuStats& HostImuStatistics();
+
+/* --------------------------------------------------------------------------
+    Central/Gateway, the events are handed to the sketch on its next
+    BLE.poll() in the order they were made
+   -------------------------------------------------------------------------- */
+void HostCentralConnect(uint16_t connection, uint16_t mtu);
+void HostCentralDisconnect(uint16_t connection);
+bool HostCentralSubscribe(uint16_t connection, const char* uuid);
+bool HostCentralWrite(uint16_t connection, const char* uuid, const uint8_t* data, int length);
+
+/* --------------------------------------------------------------------------
+    Link, every notification and Subscriber Data packet the sketch sends.
+    With a budget the link takes that many per connection event and
+    refuses the rest, the way a full controller buffer does. On air is the
+    payload plus the ATT, L2CAP and link layer headers of each packet
+   -------------------------------------------------------------------------- */
+#define HOST_AIR_OVERHEAD   (3 + 4 + 2)
+
+typedef void (*HostNotifyHandler)(uint16_t connection, const char* uuid, const uint8_t* data, int length);
+
+struct HostLinkStats {
+  uint32_t  notifications;
+  uint32_t  refused;
+  uint64_t  payloadBytes;
+  uint64_t  airBytes;
+  uint64_t  serialBytes;
+};
+
+void HostOnNotify(HostNotifyHandler handler);
+void HostLinkBudget(int packetsPerEvent, unsigned long eventMicros);
+const HostLinkStats& HostLinkStatistics();
+
+// the Serial port output, the log unless the serial transport is on
+void HostSerialEcho(FILE* file);
+
+#endif
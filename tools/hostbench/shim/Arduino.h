@@ -0,0 +1,88 @@
+/* ==========================================================================
+    File:     Arduino.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the Arduino core for the hostbench build of
+              src/main.cpp, a simulated microsecond clock, pins that go
+              nowhere, a Serial port that counts what it is given and the
+              DWT cycle counter on the host clock, see HostShim.h
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+
+enum PinStatus { LOW = 0, HIGH = 1 };
+
+#define INPUT           0
+#define OUTPUT          1
+#define LED_BUILTIN     13
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, PinStatus value);
+
+class String {
+public:
+  String(const char* value = "") : _value(value ? value : "") {}
+  const char* c_str() const   { return _value.c_str(); }
+  unsigned int length() const { return (unsigned int)_value.size(); }
+
+private:
+  std::string _value;
+};
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  operator bool() const { return true; }
+  int availableForWrite();
+  size_t write(uint8_t value);
+  size_t write(const uint8_t* buffer, size_t size);
+};
+
+extern HardwareSerial Serial;
+
+/* --------------------------------------------------------------------------
+    Cortex-M4 DWT cycle counter, reads the host steady clock in nanoseconds
+    so the Profiler in src/main.cpp times the host run of every section
+   -------------------------------------------------------------------------- */
+struct HostCycleCounter {
+  operator uint32_t() const;
+  HostCycleCounter& operator=(uint32_t value);
+};
+
+struct HostDwtRegisters {
+  uint32_t          CTRL;
+  HostCycleCounter  CYCCNT;
+};
+
+struct HostCoreDebugRegisters {
+  uint32_t          DEMCR;
+};
+
+extern HostDwtRegisters       hostDwt;
+extern HostCoreDebugRegisters hostCoreDebug;
+extern uint32_t               SystemCoreClock;
+
+#define DWT                           (&hostDwt)
+#define CoreDebug                     (&hostCoreDebug)
+#define DWT_CTRL_CYCCNTENA_Msk        0x00000001UL
+#define CoreDebug_DEMCR_TRCENA_Msk    0x01000000UL
+
+#endif
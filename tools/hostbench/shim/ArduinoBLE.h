@@ -0,0 +1,146 @@
+/* ==========================================================================
+    File:     ArduinoBLE.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the ArduinoBLE peripheral API, characteristics
+              keep their value and subscription, notifications go to the
+              simulated Central/Gateway of HostShim.h, and the GATT table
+              is laid out when the service is added
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_ARDUINO_BLE_H
+#define HOST_ARDUINO_BLE_H
+
+#include "Arduino.h"
+#include <vector>
+
+enum BLEProperty {
+  BLEBroadcast            = 0x01,
+  BLERead                 = 0x02,
+  BLEWriteWithoutResponse = 0x04,
+  BLEWrite                = 0x08,
+  BLENotify               = 0x10,
+  BLEIndicate             = 0x20
+};
+
+enum BLECharacteristicEvent {
+  BLESubscribed   = 0,
+  BLEUnsubscribed = 1,
+  BLEWritten      = 3,
+  BLEUpdated      = BLEWritten,
+  BLECharacteristicEventLast
+};
+
+enum BLEDeviceEvent {
+  BLEConnected    = 0,
+  BLEDisconnected = 1,
+  BLEDeviceEventLast
+};
+
+class BLELocalCharacteristic;
+
+class BLEDevice {
+public:
+  BLEDevice(uint16_t handle = 0xFFFF) : _handle(handle) {}
+
+  operator bool() const;
+  bool connected() const;
+  String address() const;
+  int rssi();
+  bool disconnect();
+
+  bool operator==(const BLEDevice& other) const { return _handle == other._handle; }
+  bool operator!=(const BLEDevice& other) const { return _handle != other._handle; }
+
+private:
+  uint16_t _handle;
+};
+
+class BLECharacteristic;
+typedef void (*BLECharacteristicEventHandler)(BLEDevice device, BLECharacteristic characteristic);
+typedef void (*BLEDeviceEventHandler)(BLEDevice device);
+
+class BLEDescriptor {
+public:
+  BLEDescriptor(const char* uuid, const char* value) : _uuid(uuid), _value(value) {}
+  const char* uuid() const  { return _uuid; }
+
+private:
+  const char* _uuid;
+  const char* _value;
+};
+
+/* --------------------------------------------------------------------------
+    A handle on the local characteristic, copies share it like they do in
+    ArduinoBLE, so the copy an event handler gets is the same one
+   -------------------------------------------------------------------------- */
+class BLECharacteristic {
+public:
+  BLECharacteristic();
+  BLECharacteristic(const char* uuid, uint8_t properties, int valueSize, bool fixedLength = false);
+  BLECharacteristic(BLELocalCharacteristic* local) : _local(local) {}
+
+  const char* uuid() const;
+  uint8_t properties() const;
+
+  int valueSize() const;
+  const uint8_t* value() const;
+  int valueLength() const;
+  uint8_t operator[](int offset) const;
+
+  int writeValue(const uint8_t* value, int length);
+  int writeValue(const void* value, int length);
+  int broadcast();
+
+  bool subscribed();
+  void addDescriptor(BLEDescriptor& descriptor);
+  void setEventHandler(int event, BLECharacteristicEventHandler handler);
+
+  BLELocalCharacteristic* local() const { return _local; }
+
+private:
+  BLELocalCharacteristic* _local;
+};
+
+class BLEService {
+public:
+  BLEService(const char* uuid) : _uuid(uuid) {}
+
+  const char* uuid() const { return _uuid; }
+  void addCharacteristic(BLECharacteristic& characteristic);
+
+  const std::vector<BLELocalCharacteristic*>& characteristics() const { return _characteristics; }
+
+private:
+  const char*                           _uuid;
+  std::vector<BLELocalCharacteristic*>  _characteristics;
+};
+
+class BLELocalDevice {
+public:
+  int begin();
+  void end();
+
+  // hands the Central/Gateway events of HostShim.h that are due to the sketch
+  void poll(unsigned long timeout = 0);
+
+  bool connected() const;
+  int rssi();
+
+  void setLocalName(const char* name);
+  void setDeviceName(const char* name);
+  void setManufacturerData(const uint8_t* data, int length);
+  void setAdvertisedServiceUuid(const char* uuid);
+  void setAdvertisedService(const BLEService& service);
+  void addService(BLEService& service);
+  void setAdvertisingInterval(uint16_t interval);
+  void setConnectionInterval(uint16_t minimum, uint16_t maximum);
+
+  int advertise();
+  void stopAdvertise();
+};
+
+extern BLELocalDevice BLE;
+
+#endif
@@ -0,0 +1,39 @@
+/* ==========================================================================
+    File:     Arduino_LSM9DS1.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the Arduino_LSM9DS1 library, reads the register
+              model of the LSM9DS1 in HostShim.cpp that replays the trace
+              the bench hands it
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_ARDUINO_LSM9DS1_H
+#define HOST_ARDUINO_LSM9DS1_H
+
+#include "Arduino.h"
+
+class LSM9DS1Class {
+public:
+  int begin();
+  void end();
+
+  // g
+  int readAcceleration(float& x, float& y, float& z);
+  int accelerationAvailable();
+  float accelerationSampleRate();
+
+  // degrees per second
+  int readGyroscope(float& x, float& y, float& z);
+  int gyroscopeAvailable();
+  float gyroscopeSampleRate();
+
+  // uT
+  int readMagneticField(float& x, float& y, float& z);
+  int magneticFieldAvailable();
+  float magneticFieldSampleRate();
+};
+
+extern LSM9DS1Class IMU;
+
+#endif
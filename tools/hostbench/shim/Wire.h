@@ -0,0 +1,47 @@
+/* ==========================================================================
+    File:     Wire.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the Wire library, Wire1 talks to the register
+              model of the LSM9DS1 in HostShim.cpp
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+#define HOST_WIRE_BUFFER_SIZE   32
+
+class TwoWire {
+public:
+  TwoWire();
+
+  void begin();
+  void setClock(uint32_t frequency);
+
+  // the first byte written is the register, the rest are written to it
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  uint8_t endTransmission(bool stopBit = true);
+
+  // reads from the register of the last transmission on
+  size_t requestFrom(uint8_t address, size_t length, bool stopBit = true);
+  int available();
+  int read();
+
+private:
+  uint8_t _address;
+  uint8_t _written[HOST_WIRE_BUFFER_SIZE];
+  size_t  _writtenLength;
+  uint8_t _register;
+  uint8_t _read[HOST_WIRE_BUFFER_SIZE];
+  size_t  _readLength;
+  size_t  _readIndex;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif
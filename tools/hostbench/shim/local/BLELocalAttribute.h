@@ -0,0 +1,34 @@
+/* ==========================================================================
+    File:     BLELocalAttribute.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the ArduinoBLE local attribute, an entry of the
+              GATT table
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_BLE_LOCAL_ATTRIBUTE_H
+#define HOST_BLE_LOCAL_ATTRIBUTE_H
+
+#include <stdint.h>
+
+enum BLEAttributeType {
+  BLETypeUnknown        = 0x0000,
+  BLETypeService        = 0x2800,
+  BLETypeCharacteristic = 0x2803,
+  BLETypeDescriptor     = 0x2900
+};
+
+class BLELocalAttribute {
+public:
+  BLELocalAttribute(const char* uuid) : _uuid(uuid) {}
+  virtual ~BLELocalAttribute() {}
+
+  const char* uuid() const { return _uuid; }
+  virtual enum BLEAttributeType type() const { return BLETypeUnknown; }
+
+private:
+  const char* _uuid;
+};
+
+#endif
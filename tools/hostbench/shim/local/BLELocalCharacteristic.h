@@ -0,0 +1,50 @@
+/* ==========================================================================
+    File:     BLELocalCharacteristic.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the ArduinoBLE local characteristic, its value,
+              subscription, event handlers and GATT handles
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_BLE_LOCAL_CHARACTERISTIC_H
+#define HOST_BLE_LOCAL_CHARACTERISTIC_H
+
+#include "BLELocalAttribute.h"
+#include "../ArduinoBLE.h"
+
+class BLELocalCharacteristic : public BLELocalAttribute {
+public:
+  BLELocalCharacteristic(const char* uuid, uint8_t properties, int valueSize);
+
+  enum BLEAttributeType type() const { return BLETypeCharacteristic; }
+
+  uint8_t properties() const      { return _properties; }
+  int valueSize() const           { return (int)_value.size(); }
+  const uint8_t* value() const    { return _value.data(); }
+  int valueLength() const         { return _valueLength; }
+
+  // the sketch side, notifies the subscribed Central/Gateway
+  int writeValue(const uint8_t* value, int length);
+
+  // the Central/Gateway side, a write or a CCCD change fires the handler
+  void Written(uint16_t connection, const uint8_t* value, int length);
+  void Subscribe(uint16_t connection, bool subscribed);
+
+  bool subscribed() const         { return _subscribed; }
+  void setEventHandler(int event, BLECharacteristicEventHandler handler);
+
+  uint16_t handle() const         { return _handle; }
+  uint16_t valueHandle() const    { return (uint16_t)(_handle + 1); }
+  void setHandle(uint16_t handle) { _handle = handle; }
+
+private:
+  uint8_t                       _properties;
+  std::vector<uint8_t>          _value;
+  int                           _valueLength;
+  bool                          _subscribed;
+  uint16_t                      _handle;
+  BLECharacteristicEventHandler _handlers[BLECharacteristicEventLast];
+};
+
+#endif
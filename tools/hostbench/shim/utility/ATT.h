@@ -0,0 +1,24 @@
+/* ==========================================================================
+    File:     ATT.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the ArduinoBLE ATT layer, the connections of the
+              simulated Central/Gateway and their MTU
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_ATT_H
+#define HOST_ATT_H
+
+#include "../ArduinoBLE.h"
+
+class ATTClass {
+public:
+  bool connected(uint16_t handle) const;
+  uint16_t mtu(uint16_t handle) const;
+  uint16_t connectionHandle(uint8_t addressType, const uint8_t address[6]) const;
+};
+
+extern ATTClass ATT;
+
+#endif
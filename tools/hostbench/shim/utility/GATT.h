@@ -0,0 +1,22 @@
+/* ==========================================================================
+    File:     GATT.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the ArduinoBLE GATT table
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_GATT_H
+#define HOST_GATT_H
+
+#include "../local/BLELocalAttribute.h"
+
+class GATTClass {
+public:
+  unsigned int attributeCount() const;
+  BLELocalAttribute* attribute(unsigned int index) const;
+};
+
+extern GATTClass GATT;
+
+#endif
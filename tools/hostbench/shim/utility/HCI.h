@@ -0,0 +1,24 @@
+/* ==========================================================================
+    File:     HCI.h
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host shim of the ArduinoBLE HCI layer, connection updates are
+              taken as asked and ACL packets go to the simulated
+              Central/Gateway
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#ifndef HOST_HCI_H
+#define HOST_HCI_H
+
+#include "../ArduinoBLE.h"
+
+class HCIClass {
+public:
+  int leConnUpdate(uint16_t handle, uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t supervisionTimeout);
+  int sendAclPkt(uint16_t handle, uint8_t cid, uint8_t plen, void* data);
+};
+
+extern HCIClass HCI;
+
+#endif
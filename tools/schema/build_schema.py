@@ -0,0 +1,306 @@
+# ==========================================================================
+#   File:     build_schema.py
+#   Author:   Larry W Jordan Jr (larouex@gmail.com)
+#   Purpose:  Builds the Device Capability Schema, the characteristics of
+#             CHARACTERISTIC_REGISTRY in src/main.cpp, the enumerations the
+#             firmware advertises and the payload layouts in layouts.json,
+#             deflated into DeviceSchema.h for the firmware to serve
+#
+#             As a PlatformIO extra script (pre:) it writes the header to
+#             the build directory before the sketch compiles. On its own
+#               python tools/schema/build_schema.py --print
+#               python tools/schema/build_schema.py --inflate SCHEMA.bin
+#             prints the schema, or inflates and checks one read back over
+#             the Schema Data characteristic
+#
+#   (c) 2020 Larouex Software Design LLC
+#   This code is licensed under MIT license (see LICENSE.txt for details)    
+# ==========================================================================
+import json
+import os
+import re
+import shlex
+import sys
+import zlib
+
+SCHEMA_COMPRESSION_ZLIB = 1
+SCHEMA_MAX_SIZE = 0xFFFF
+
+# the firmware environment in platformio.ini, whose build_flags --print reads
+FIRMWARE_ENV = "nano33ble"
+
+ENUM_DEFINES = {
+    "TELEMETRY_ENCODINGS": "encodings",
+    "FUSION_ALGORITHMS": "fusion",
+    "LINK_PROFILES": "link",
+    "POWER_STATES": "power",
+    "CONNECTION_PHASES": "connection",
+}
+
+PROPERTIES = {
+    "BLERead": "read",
+    "BLEWrite": "write",
+    "BLEWriteWithoutResponse": "writeWithoutResponse",
+    "BLENotify": "notify",
+    "BLEIndicate": "indicate",
+    "BLEBroadcast": "broadcast",
+}
+
+
+def fail(message):
+    sys.stderr.write("build_schema: %s\n" % message)
+    sys.exit(1)
+
+
+def split_arguments(text):
+    # top level commas only, sizes like sizeof(float) carry their own
+    arguments, depth, current = [], 0, ""
+    for char in text:
+        if char == "," and depth == 0:
+            arguments.append(current.strip())
+            current = ""
+            continue
+        if char == "(":
+            depth += 1
+        elif char == ")":
+            depth -= 1
+        current += char
+    arguments.append(current.strip())
+    return arguments
+
+
+def read_registry(project):
+    source = open(os.path.join(project, "src", "main.cpp")).read()
+    start = source.find("#define CHARACTERISTIC_REGISTRY(X)")
+    if start < 0:
+        fail("no CHARACTERISTIC_REGISTRY in src/main.cpp")
+
+    # the macro runs until the first line without a continuation
+    lines = []
+    for line in source[start:].splitlines()[1:]:
+        lines.append(line.rstrip())
+        if not line.rstrip().endswith("\\"):
+            break
+    block = re.sub(r"/\*.*?\*/", "", " ".join(line.rstrip("\\") for line in lines))
+
+    characteristics = []
+    for match in re.finditer(r"\bX\(", block):
+        depth, end = 1, match.end()
+        while depth:
+            depth += {"(": 1, ")": -1}.get(block[end], 0)
+            end += 1
+        arguments = split_arguments(block[match.end():end - 1])
+        if len(arguments) != 8:
+            fail("registry row with %d fields: %s" % (len(arguments), arguments[0]))
+        properties = [PROPERTIES[p.strip()] for p in arguments[3].split("|")]
+        characteristics.append({
+            "uuid": arguments[2].strip('\\"').upper(),
+            "id": arguments[0],
+            "name": arguments[5].strip('\\"'),
+            "properties": properties,
+        })
+    return characteristics
+
+
+def read_enums(project):
+    enums = {}
+    for root, _, files in os.walk(os.path.join(project, "lib")):
+        for name in sorted(files):
+            if not name.endswith(".h"):
+                continue
+            text = open(os.path.join(root, name)).read()
+            for define, key in ENUM_DEFINES.items():
+                match = re.search(r"#define\s+%s\s+\"([^\"]*)\"" % define, text)
+                if match:
+                    enums[key] = match.group(1).split(",")
+    missing = [define for define, key in ENUM_DEFINES.items() if key not in enums]
+    if missing:
+        fail("no %s in lib/" % ", ".join(missing))
+    # in ENUM_DEFINES order whatever order the headers were walked in
+    return dict((key, enums[key]) for key in ENUM_DEFINES.values())
+
+
+def flag_defines(flags):
+    # the -D NAME=VALUE (or -DNAME=VALUE) of a build_flags value, quoted the
+    # way the compiler gets them
+    defines, tokens = {}, shlex.split(flags)
+    for i, token in enumerate(tokens):
+        if token == "-D" and i + 1 < len(tokens):
+            define = tokens[i + 1]
+        elif token.startswith("-D") and len(token) > 2:
+            define = token[2:]
+        else:
+            continue
+        name, _, value = define.partition("=")
+        defines[name] = value
+    return defines
+
+
+def ini_build_flags(project, environment):
+    # build_flags of [env:ENVIRONMENT] with its ${section.option} expanded,
+    # when there is no PlatformIO env to ask
+    options, section, option = {}, None, None
+    for line in open(os.path.join(project, "platformio.ini")):
+        if line.strip().startswith(";") or not line.strip():
+            continue
+        if line.startswith("["):
+            section, option = line.strip()[1:-1], None
+        elif line[0] in " \t" and option is not None:
+            options[(section, option)] += "\n" + line.strip()
+        elif "=" in line:
+            option, _, value = line.partition("=")
+            option = option.strip()
+            options[(section, option)] = value.strip()
+
+    def expand(match):
+        name, _, key = match.group(1).partition(".")
+        return re.sub(r"\$\{([^}]+)\}", expand, options.get((name, key), ""))
+
+    flags = options.get(("env:" + environment, "build_flags"))
+    if flags is None:
+        fail("no build_flags for [env:%s] in platformio.ini" % environment)
+    return re.sub(r"\$\{([^}]+)\}", expand, flags)
+
+
+def env_build_flags(env):
+    # the project option as PlatformIO expanded it, not CPPDEFINES, which a
+    # pre: script sees before the build_flags are parsed into it
+    flags = env.GetProjectOption("build_flags", "")
+    if isinstance(flags, (list, tuple)):
+        flags = "\n".join(flags)
+    return flags
+
+
+def build_schema(project, defines):
+    layouts = json.load(open(os.path.join(project, "tools", "schema", "layouts.json")))
+    characteristics = read_registry(project)
+
+    known = set(c["uuid"] for c in characteristics)
+    for uuid in layouts["layouts"]:
+        if uuid not in known:
+            fail("layouts.json describes %s, which is not in the registry" % uuid)
+    for characteristic in characteristics:
+        layout = layouts["layouts"].get(characteristic["uuid"])
+        if layout is None:
+            sys.stderr.write("build_schema: no layout for %s %s\n" % (characteristic["uuid"], characteristic["name"]))
+        else:
+            characteristic.update(layout)
+
+    return {
+        "schema": layouts["schema"],
+        "dcm": defines.get("DCM", "").strip('\\"'),
+        "firmware": defines.get("VERSION", "").strip('\\"'),
+        "service": defines.get("SERVICE_UUID", "").strip('\\"'),
+        "enums": read_enums(project),
+        "types": layouts["types"],
+        "codecs": layouts["codecs"],
+        "characteristics": characteristics,
+    }
+
+
+def encode_schema(schema):
+    # compact and in a fixed order, so the same schema always hashes the same
+    inflated = json.dumps(schema, separators=(",", ":")).encode("utf-8")
+    deflated = zlib.compress(inflated, 9)
+    if len(inflated) > SCHEMA_MAX_SIZE or len(deflated) > SCHEMA_MAX_SIZE:
+        fail("the schema is %d bytes, %d deflated, it must stay under 64K" % (len(inflated), len(deflated)))
+    return inflated, deflated, zlib.crc32(inflated) & 0xFFFFFFFF
+
+
+def write_header(path, schema, inflated, deflated, crc):
+    rows = []
+    for i in range(0, len(deflated), 16):
+        rows.append("  " + " ".join("0x%02x," % b for b in deflated[i:i + 16]))
+
+    text = "\r\n".join([
+        "/* ==========================================================================",
+        "    File:     DeviceSchema.h",
+        "    Purpose:  Generated by tools/schema/build_schema.py, do not edit",
+        "  ==========================================================================*/",
+        "#ifndef DEVICE_SCHEMA_H",
+        "#define DEVICE_SCHEMA_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        "#define DEVICE_SCHEMA_VERSION           %d" % schema["schema"],
+        "#define DEVICE_SCHEMA_COMPRESSION       %d" % SCHEMA_COMPRESSION_ZLIB,
+        "#define DEVICE_SCHEMA_HASH              0x%08xUL" % crc,
+        "#define DEVICE_SCHEMA_SIZE              %d" % len(inflated),
+        "#define DEVICE_SCHEMA_COMPRESSED_SIZE   %d" % len(deflated),
+        "",
+        "static const uint8_t DEVICE_SCHEMA[DEVICE_SCHEMA_COMPRESSED_SIZE] = {",
+    ] + rows + [
+        "};",
+        "",
+        "#endif",
+        "",
+    ])
+
+    # only touch the header when it changed, so nothing rebuilds for nothing
+    if os.path.exists(path) and open(path, "rb").read() == text.encode("ascii"):
+        return
+    if not os.path.isdir(os.path.dirname(path)):
+        os.makedirs(os.path.dirname(path))
+    open(path, "wb").write(text.encode("ascii"))
+
+
+def inflate(path, expected):
+    data = open(path, "rb").read()
+    try:
+        inflated = zlib.decompress(data)
+    except zlib.error as error:
+        fail("%s does not inflate: %s" % (path, error))
+    crc = zlib.crc32(inflated) & 0xFFFFFFFF
+    print(json.dumps(json.loads(inflated.decode("utf-8")), indent=2))
+    sys.stderr.write("%d bytes, %d inflated, hash 0x%08x\n" % (len(data), len(inflated), crc))
+    if expected is not None and crc != expected:
+        fail("hash 0x%08x, the device advertised 0x%08x" % (crc, expected))
+
+
+def main(arguments):
+    project = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".."))
+    out, hash_value = None, None
+    i = 0
+    while i < len(arguments):
+        if arguments[i] == "--out" and i + 1 < len(arguments):
+            out = arguments[i + 1]
+            i += 2
+        elif arguments[i] == "--hash" and i + 1 < len(arguments):
+            hash_value = int(arguments[i + 1], 16)
+            i += 2
+        elif arguments[i] == "--inflate" and i + 1 < len(arguments):
+            inflate(arguments[i + 1], hash_value)
+            return
+        elif arguments[i] == "--print":
+            print(json.dumps(build_schema(project, flag_defines(ini_build_flags(project, FIRMWARE_ENV))), indent=2))
+            return
+        else:
+            sys.stderr.write(
+                "usage: build_schema.py [--out DIR] | --print | [--hash HEX] --inflate SCHEMA.bin\n"
+                "  --out DIR          write DeviceSchema.h to DIR\n"
+                "  --print            print the schema as served\n"
+                "  --inflate FILE     inflate a schema read from the device, --hash checks it\n")
+            sys.exit(1)
+
+    schema = build_schema(project, flag_defines(ini_build_flags(project, FIRMWARE_ENV)))
+    inflated, deflated, crc = encode_schema(schema)
+    write_header(os.path.join(out or ".", "DeviceSchema.h"), schema, inflated, deflated, crc)
+    print("schema %d bytes, %d deflated, hash 0x%08x" % (len(inflated), len(deflated), crc))
+
+
+try:
+    Import("env")  # noqa: F821, only defined when PlatformIO runs us
+except NameError:
+    env = None
+
+if env is None:
+    if __name__ == "__main__":
+        main(sys.argv[1:])
+else:
+    project = env.subst("$PROJECT_DIR")  # noqa: F821
+    schema = build_schema(project, flag_defines(env_build_flags(env)))  # noqa: F821
+    inflated, deflated, crc = encode_schema(schema)
+    directory = os.path.join(env.subst("$BUILD_DIR"), "schema")  # noqa: F821
+    write_header(os.path.join(directory, "DeviceSchema.h"), schema, inflated, deflated, crc)
+    env.Append(CPPPATH=[directory])  # noqa: F821
+    print("Device Capability Schema: %d bytes, %d deflated, hash 0x%08x" % (len(inflated), len(deflated), crc))
@@ -0,0 +1,337 @@
+/* ==========================================================================
+    File:     SerialDecode.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host decoder for the serial transport, reads the COBS framed
+              records from the Nano 33 BLE USB port (or a file), prints the
+              log frames, writes the records in the fleet simulator capture
+              format and checks the batch stream for loss. --throughput runs
+              the framing over a pseudo-tty to see how fast it goes
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <SerialFrame.h>
+#include <TelemetryFrame.h>
+#include <TelemetryBatch.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define CAPTURE_RECORD_HEADER   10
+#define READ_CHUNK              4096
+#define POLL_MILLIS             100
+#define IMU_HZ                  119
+
+// the characteristic UUID of the batch records, see CHARACTERISTIC_REGISTRY
+#define UUID_BATCH              0xA002
+
+// what the firmware sends, BATCH_PAYLOAD_SIZE with the default BLE_ATT_MTU
+#define BATCH_PAYLOAD_SIZE      182
+
+typedef std::chrono::steady_clock Clock;
+
+static Clock::time_point started = Clock::now();
+
+static uint32_t HostMicros() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count();
+}
+
+struct DecodeStats {
+  uint64_t                      bytes;
+  uint64_t                      logBytes;
+  std::map<uint16_t, uint64_t>  records;
+  uint64_t                      batchSamples;
+  uint64_t                      lostBatches;
+  bool                          hasBatch;
+  uint16_t                      lastBatch;
+};
+
+/* --------------------------------------------------------------------------
+    Capture, the fleet simulator record format so traceanalyze reads it
+      [0..1]   device
+      [2..3]   characteristic UUID
+      [4..7]   host micros when the frame was decoded
+      [8..9]   payload length
+      then the payload
+   -------------------------------------------------------------------------- */
+static void WriteCapture(FILE* capture, uint16_t device, uint16_t uuid, const uint8_t* payload, size_t length) {
+  uint8_t header[CAPTURE_RECORD_HEADER];
+  PutUint16LE(&header[0], device);
+  PutUint16LE(&header[2], uuid);
+  PutUint32LE(&header[4], HostMicros());
+  PutUint16LE(&header[8], (uint16_t)length);
+  fwrite(header, 1, sizeof(header), capture);
+  fwrite(payload, 1, length, capture);
+}
+
+static void Consume(SerialFrameDecoder& decoder, const uint8_t* data, size_t length,
+                    DecodeStats& stats, FILE* capture, uint16_t device, bool printLog) {
+  stats.bytes += length;
+
+  for (size_t i = 0; i < length; i++) {
+    if (!decoder.Push(data[i]))
+      continue;
+
+    uint16_t record = decoder.Record();
+    if (record == SERIAL_FRAME_LOG) {
+      stats.logBytes += decoder.Length();
+      if (printLog) {
+        fwrite(decoder.Payload(), 1, decoder.Length(), stderr);
+      }
+      continue;
+    }
+
+    stats.records[record]++;
+    if (capture) {
+      WriteCapture(capture, device, record, decoder.Payload(), decoder.Length());
+    }
+
+    // every sample goes out in a batch, a sequence gap is a lost batch
+    if (record == UUID_BATCH) {
+      TelemetrySample samples[BATCH_PAYLOAD_SIZE / TELEMETRY_BATCH_SAMPLE_SIZE + 1];
+      uint16_t sequence;
+      size_t count;
+      if (DecodeTelemetryBatch(decoder.Payload(), decoder.Length(), sequence,
+                               samples, sizeof(samples) / sizeof(samples[0]), count)) {
+        stats.batchSamples += count;
+        if (stats.hasBatch) {
+          stats.lostBatches += (uint16_t)(sequence - stats.lastBatch - 1);
+        }
+        stats.hasBatch = true;
+        stats.lastBatch = sequence;
+      }
+    }
+  }
+}
+
+static void PrintStats(const DecodeStats& stats, const SerialFrameDecoder& decoder, double seconds) {
+  if (seconds <= 0.0) {
+    seconds = 1e-6;
+  }
+
+  printf("bytes:          %llu in %.2f s, %.1f kB/s\n",
+    (unsigned long long)stats.bytes, seconds, stats.bytes / seconds / 1000.0);
+  printf("frames:         %lu, crc errors: %lu, framing errors: %lu\n",
+    (unsigned long)decoder.Frames(), (unsigned long)decoder.CrcErrors(), (unsigned long)decoder.FramingErrors());
+  for (const auto& record : stats.records) {
+    printf("record %04X:    %llu, %.1f per second\n",
+      record.first, (unsigned long long)record.second, record.second / seconds);
+  }
+  if (stats.hasBatch) {
+    double samplesPerSecond = stats.batchSamples / seconds;
+    printf("batch samples:  %llu, %.0f per second (%.1f x the %d Hz stream), batches lost: %llu\n",
+      (unsigned long long)stats.batchSamples, samplesPerSecond, samplesPerSecond / IMU_HZ, IMU_HZ,
+      (unsigned long long)stats.lostBatches);
+  }
+  printf("log:            %llu bytes\n", (unsigned long long)stats.logBytes);
+}
+
+// raw 8N1, the USB CDC port ignores the baud rate
+static bool MakeRaw(int fd) {
+  struct termios settings;
+  if (tcgetattr(fd, &settings) != 0)
+    return false;
+
+  cfmakeraw(&settings);
+  cfsetspeed(&settings, B115200);
+  settings.c_cc[VMIN] = 1;
+  settings.c_cc[VTIME] = 0;
+  return tcsetattr(fd, TCSANOW, &settings) == 0;
+}
+
+/* --------------------------------------------------------------------------
+    Read a port or file until it ends or seconds are up (0 runs until the
+    port closes)
+   -------------------------------------------------------------------------- */
+static int Decode(const char* path, int seconds, FILE* capture, uint16_t device, bool printLog) {
+  int fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    return 1;
+  }
+  if (isatty(fd) && !MakeRaw(fd)) {
+    perror("tcsetattr");
+  }
+
+  SerialFrameDecoder decoder;
+  DecodeStats stats = {};
+  Clock::time_point start = Clock::now();
+  Clock::time_point stop = start + std::chrono::seconds(seconds);
+  uint8_t buffer[READ_CHUNK];
+
+  for (;;) {
+    if (seconds > 0 && Clock::now() >= stop)
+      break;
+
+    struct pollfd input = { fd, POLLIN, 0 };
+    if (poll(&input, 1, POLL_MILLIS) <= 0)
+      continue;
+
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length <= 0)
+      break;
+    Consume(decoder, buffer, (size_t)length, stats, capture, device, printLog);
+  }
+  close(fd);
+
+  PrintStats(stats, decoder, std::chrono::duration<double>(Clock::now() - start).count());
+  return 0;
+}
+
+/* --------------------------------------------------------------------------
+    Throughput over a pseudo-tty, a writer thread pushes batch records as
+    fast as the pty takes them while we decode the other end. Tells how
+    much headroom the framing and decoding leave over the 119 Hz stream
+   -------------------------------------------------------------------------- */
+static void WriteBatches(int fd, std::atomic<bool>& stop, std::atomic<uint64_t>& frames) {
+  TelemetrySample samples[BATCH_PAYLOAD_SIZE / TELEMETRY_BATCH_SAMPLE_SIZE];
+  const size_t count = sizeof(samples) / sizeof(samples[0]);
+  uint8_t payload[BATCH_PAYLOAD_SIZE];
+  uint8_t frame[SERIAL_FRAME_WIRE_SIZE(BATCH_PAYLOAD_SIZE)];
+  uint32_t sampleMicros = 0;
+  uint16_t sequence = 0;
+
+  while (!stop) {
+    for (size_t i = 0; i < count; i++) {
+      TelemetrySample& sample = samples[i];
+      float t = sampleMicros / 1e6f;
+      sample.timestampMicros = sampleMicros;
+      for (int axis = 0; axis < 3; axis++) {
+        sample.acceleration[axis] = sinf(t + axis);
+        sample.gyroscope[axis] = 10.0f * cosf(t + axis);
+        sample.magnetometer[axis] = 40.0f * sinf(0.1f * t + axis);
+      }
+      sampleMicros += 1000000 / IMU_HZ;
+    }
+
+    size_t encoded = 0;
+    size_t length = EncodeTelemetryBatch(samples, count, sequence++, payload, sizeof(payload), encoded);
+    size_t size = EncodeSerialFrame(UUID_BATCH, sampleMicros, payload, length, frame, sizeof(frame));
+
+    size_t written = 0;
+    while (written < size) {
+      ssize_t n = write(fd, &frame[written], size - written);
+      if (n <= 0)
+        return;
+      written += (size_t)n;
+    }
+    frames++;
+  }
+}
+
+static int Throughput(int seconds) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0 || !MakeRaw(slave)) {
+    perror("pty");
+    return 1;
+  }
+
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> sent(0);
+  std::thread writer(WriteBatches, master, std::ref(stop), std::ref(sent));
+
+  SerialFrameDecoder decoder;
+  DecodeStats stats = {};
+  Clock::time_point start = Clock::now();
+  Clock::time_point end = start + std::chrono::seconds(seconds);
+  uint8_t buffer[READ_CHUNK];
+
+  // keep reading after the stop so the writer is never left blocked
+  for (;;) {
+    if (!stop && Clock::now() >= end) {
+      stop = true;
+    }
+
+    struct pollfd input = { slave, POLLIN, 0 };
+    if (poll(&input, 1, POLL_MILLIS) <= 0) {
+      if (stop)
+        break;
+      continue;
+    }
+
+    ssize_t length = read(slave, buffer, sizeof(buffer));
+    if (length <= 0)
+      break;
+    Consume(decoder, buffer, (size_t)length, stats, 0, 0, false);
+  }
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  writer.join();
+  close(slave);
+  close(master);
+
+  printf("sent frames:    %llu\n", (unsigned long long)sent.load());
+  PrintStats(stats, decoder, elapsed);
+  return decoder.Frames() == sent.load() && decoder.CrcErrors() == 0 && stats.lostBatches == 0 ? 0 : 2;
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: serialdecode [options] PORT|FILE\n"
+    "       serialdecode --throughput SECONDS\n"
+    "  --out FILE         write the records in the fleetsim capture format\n"
+    "  --device N         device number in the capture (0)\n"
+    "  --seconds N        stop after N seconds, 0 reads until the port closes (0)\n"
+    "  --quiet            do not print the log frames\n"
+    "  --throughput N     push batch records through a pseudo-tty for N seconds\n");
+}
+
+int main(int argc, char** argv) {
+  const char* path = 0;
+  const char* out = 0;
+  int device = 0;
+  int seconds = 0;
+  int throughput = 0;
+  bool printLog = true;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out = argv[++i];
+    } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      device = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--quiet") == 0) {
+      printLog = false;
+    } else if (strcmp(argv[i], "--throughput") == 0 && i + 1 < argc) {
+      throughput = atoi(argv[++i]);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+
+  if (throughput > 0)
+    return Throughput(throughput);
+
+  if (!path) {
+    Usage();
+    return 1;
+  }
+
+  FILE* capture = 0;
+  if (out && !(capture = fopen(out, "wb"))) {
+    perror(out);
+    return 1;
+  }
+  int result = Decode(path, seconds, capture, (uint16_t)device, printLog);
+  if (capture) {
+    fclose(capture);
+  }
+  return result;
+}
@@ -0,0 +1,296 @@
+/* ==========================================================================
+    File:     TraceAnalyze.cpp
+    Author:   Larry W Jordan Jr (larouex@gmail.com)
+    Purpose:  Host analyzer for latency traces, reads a gateway capture in
+              the fleet simulator record format, joins the Trace entries
+              with the records they describe and prints latency percentiles
+              for every stage from sample to gateway
+
+    (c) 2020 Larouex Software Design LLC
+    This code is licensed under MIT license (see LICENSE.txt for details)    
+  ==========================================================================*/
+#include <TelemetryFrame.h>
+#include <TelemetryBatch.h>
+#include <LatencyTrace.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_RECORD_HEADER   10
+
+// the characteristic UUIDs of CHARACTERISTIC_REGISTRY we look at
+enum TRACE_UUIDS: uint16_t {
+  UUID_ACCELEROMETER  = 0x4001,
+  UUID_GYROSCOPE      = 0x5001,
+  UUID_MAGNETOMETER   = 0x6001,
+  UUID_ORIENTATION    = 0x7001,
+  UUID_FRAME          = 0xA001,
+  UUID_BATCH          = 0xA002,
+  UUID_TRACE          = 0x9904,
+  UUID_CLOCK_SYNC     = 0x9905
+};
+
+/* --------------------------------------------------------------------------
+    Capture, one record per notification, little endian
+      [0..1]   device
+      [2..3]   characteristic UUID
+      [4..7]   gateway micros when the notification arrived
+      [8..9]   payload length
+      then the payload
+    fleetsim writes the same records with the devices' own clock, so a
+    simulator run needs no clock sync
+   -------------------------------------------------------------------------- */
+struct CaptureRecord {
+  uint16_t              device;
+  uint16_t              uuid;
+  uint32_t              arrivedMicros;
+  std::vector<uint8_t>  payload;
+};
+
+static bool ReadCapture(const char* path, std::vector<CaptureRecord>& records) {
+  FILE* file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  uint8_t header[CAPTURE_RECORD_HEADER];
+  while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+    CaptureRecord record;
+    record.device = GetUint16LE(&header[0]);
+    record.uuid = GetUint16LE(&header[2]);
+    record.arrivedMicros = GetUint32LE(&header[4]);
+    record.payload.resize(GetUint16LE(&header[8]));
+    if (fread(record.payload.data(), 1, record.payload.size(), file) != record.payload.size())
+      break;
+    records.push_back(record);
+  }
+  fclose(file);
+  return true;
+}
+
+// device micros wrap, stage differences are taken modulo 2^32
+static int32_t MicrosBetween(uint32_t from, uint32_t to) {
+  return (int32_t)(to - from);
+}
+
+static uint64_t RecordKey(uint16_t device, uint16_t uuid, uint16_t sequence) {
+  return (uint64_t)device << 32 | (uint64_t)uuid << 16 | sequence;
+}
+
+/* --------------------------------------------------------------------------
+    Latency of one stage, percentiles over every record that passed it
+   -------------------------------------------------------------------------- */
+struct StageStats {
+  const char*           name;
+  std::vector<int32_t>  micros;
+};
+
+static int32_t Percentile(const std::vector<int32_t>& sorted, int percent) {
+  size_t index = (sorted.size() - 1) * percent / 100;
+  return sorted[index];
+}
+
+static void PrintStage(StageStats& stage) {
+  if (stage.micros.empty()) {
+    printf("%-18s %8s\n", stage.name, "-");
+    return;
+  }
+  std::sort(stage.micros.begin(), stage.micros.end());
+  printf("%-18s %8zu %9d %9d %9d %9d %9d\n", stage.name, stage.micros.size(),
+    stage.micros.front(), Percentile(stage.micros, 50), Percentile(stage.micros, 90),
+    Percentile(stage.micros, 99), stage.micros.back());
+}
+
+/* --------------------------------------------------------------------------
+    Best clock sync per device, the reply with the shortest round trip
+   -------------------------------------------------------------------------- */
+struct DeviceClock {
+  int64_t   offset;
+  uint32_t  roundTrip;
+};
+
+static void SolveClocks(const std::vector<CaptureRecord>& records, std::map<uint16_t, DeviceClock>& clocks) {
+  for (const CaptureRecord& record : records) {
+    ClockSyncReply reply;
+    if (record.uuid != UUID_CLOCK_SYNC || !DecodeClockSyncReply(record.payload.data(), record.payload.size(), reply))
+      continue;
+
+    // the capture keeps 32 bits of the gateway clock, borrow the rest from t1
+    uint64_t received = (reply.centralSent & ~0xFFFFFFFFULL) | record.arrivedMicros;
+    if (received < reply.centralSent)
+      received += 0x100000000ULL;
+
+    DeviceClock clock;
+    ClockSyncSolve(reply, received, clock.offset, clock.roundTrip);
+    auto found = clocks.find(record.device);
+    if (found == clocks.end() || clock.roundTrip < found->second.roundTrip) {
+      clocks[record.device] = clock;
+    }
+  }
+}
+
+/* --------------------------------------------------------------------------
+    Sequence number and sample time a data record carries, stamped vectors
+    only when the capture was taken with TRACE_STAMP_VECTORS
+   -------------------------------------------------------------------------- */
+static bool RecordStamp(const CaptureRecord& record, bool stamped, uint16_t& sequence, uint32_t& sampled) {
+  const uint8_t* payload = record.payload.data();
+  size_t length = record.payload.size();
+
+  switch (record.uuid) {
+    case UUID_FRAME:
+      if (length < TELEMETRY_FRAME_HEADER_SIZE || (payload[1] & TELEMETRY_FRAME_FLAG_STORED))
+        return false;
+      sequence = GetUint16LE(&payload[2]);
+      sampled = GetUint32LE(&payload[4]);
+      return true;
+
+    case UUID_BATCH: {
+      TelemetrySample samples[255];
+      size_t count = 0;
+      if (!DecodeTelemetryBatch(payload, length, sequence, samples, 255, count) || count == 0)
+        return false;
+      sampled = samples[count - 1].timestampMicros;
+      return true;
+    }
+
+    case UUID_ACCELEROMETER:
+    case UUID_GYROSCOPE:
+    case UUID_MAGNETOMETER:
+    case UUID_ORIENTATION:
+      if (!stamped || length < VECTOR_STAMP_SIZE)
+        return false;
+      sequence = GetUint16LE(&payload[0]);
+      sampled = GetUint32LE(&payload[2]);
+      return true;
+  }
+  return false;
+}
+
+static void Usage() {
+  fprintf(stderr,
+    "usage: traceanalyze [options] CAPTURE\n"
+    "  --stamped          vectors carry the TRACE_STAMP_VECTORS stamp\n"
+    "  --offset MICROS    gateway = device + MICROS for devices without a clock sync\n");
+}
+
+int main(int argc, char** argv) {
+  const char* path = 0;
+  bool stamped = false;
+  int64_t defaultOffset = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stamped") == 0) {
+      stamped = true;
+    } else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc) {
+      defaultOffset = strtoll(argv[++i], 0, 10);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+
+  std::vector<CaptureRecord> records;
+  if (!path || !ReadCapture(path, records)) {
+    Usage();
+    return 1;
+  }
+
+  std::map<uint16_t, DeviceClock> clocks;
+  SolveClocks(records, clocks);
+
+  StageStats sampleToFuse     = { "sample->fuse", {} };
+  StageStats fuseToQueue      = { "fuse->queue", {} };
+  StageStats sampleToQueue    = { "sample->queue", {} };
+  StageStats queueToNotify    = { "queue->notify", {} };
+  StageStats sampleToNotify   = { "sample->notify", {} };
+  StageStats notifyToGateway  = { "notify->gateway", {} };
+  StageStats sampleToGateway  = { "sample->gateway", {} };
+
+  // arrival of every data record on the device clock, and the sequence gaps
+  std::map<uint64_t, uint32_t> arrivals;
+  std::map<uint32_t, uint16_t> lastSequence;
+  uint64_t dataRecords = 0;
+  uint64_t lostRecords = 0;
+
+  for (const CaptureRecord& record : records) {
+    uint16_t sequence = 0;
+    uint32_t sampled = 0;
+    if (!RecordStamp(record, stamped, sequence, sampled))
+      continue;
+
+    auto clock = clocks.find(record.device);
+    int64_t offset = clock != clocks.end() ? clock->second.offset : defaultOffset;
+    uint32_t arrived = record.arrivedMicros - (uint32_t)offset;
+
+    arrivals[RecordKey(record.device, record.uuid, sequence)] = arrived;
+    sampleToGateway.micros.push_back(MicrosBetween(sampled, arrived));
+    dataRecords++;
+
+    uint32_t stream = (uint32_t)record.device << 16 | record.uuid;
+    auto previous = lastSequence.find(stream);
+    if (previous != lastSequence.end()) {
+      uint16_t step = sequence - previous->second;
+      if (step > 1 && step < 0x8000)
+        lostRecords += step - 1;
+    }
+    lastSequence[stream] = sequence;
+  }
+
+  uint64_t traceEntries = 0;
+  uint64_t traceJoined = 0;
+  uint16_t traceLost = 0;
+
+  for (const CaptureRecord& record : records) {
+    TraceEntry entries[255];
+    size_t count = 0;
+    uint16_t lost = 0;
+    if (record.uuid != UUID_TRACE ||
+        !DecodeLatencyTrace(record.payload.data(), record.payload.size(), lost, entries, 255, count))
+      continue;
+
+    traceLost = lost > traceLost ? lost : traceLost;
+    for (size_t i = 0; i < count; i++) {
+      const TraceEntry& entry = entries[i];
+      traceEntries++;
+
+      if (entry.fusedMicros != 0) {
+        sampleToFuse.micros.push_back(MicrosBetween(entry.sampledMicros, entry.fusedMicros));
+        fuseToQueue.micros.push_back(MicrosBetween(entry.fusedMicros, entry.queuedMicros));
+      }
+      sampleToQueue.micros.push_back(MicrosBetween(entry.sampledMicros, entry.queuedMicros));
+      queueToNotify.micros.push_back(MicrosBetween(entry.queuedMicros, entry.notifiedMicros));
+      sampleToNotify.micros.push_back(MicrosBetween(entry.sampledMicros, entry.notifiedMicros));
+
+      auto arrival = arrivals.find(RecordKey(record.device, entry.uuid, entry.sequence));
+      if (arrival != arrivals.end()) {
+        notifyToGateway.micros.push_back(MicrosBetween(entry.notifiedMicros, arrival->second));
+        traceJoined++;
+      }
+    }
+  }
+
+  printf("records            %zu\n", records.size());
+  printf("data records       %llu (%llu lost to sequence gaps)\n",
+    (unsigned long long)dataRecords, (unsigned long long)lostRecords);
+  printf("trace entries      %llu (%llu joined, %u lost on the device)\n",
+    (unsigned long long)traceEntries, (unsigned long long)traceJoined, traceLost);
+  for (const auto& clock : clocks) {
+    printf("clock sync         device %u offset %lld us round trip %u us\n",
+      clock.first, (long long)clock.second.offset, clock.second.roundTrip);
+  }
+
+  printf("\n%-18s %8s %9s %9s %9s %9s %9s\n", "stage (us)", "count", "min", "p50", "p90", "p99", "max");
+  PrintStage(sampleToFuse);
+  PrintStage(fuseToQueue);
+  PrintStage(sampleToQueue);
+  PrintStage(queueToNotify);
+  PrintStage(sampleToNotify);
+  PrintStage(notifyToGateway);
+  PrintStage(sampleToGateway);
+  return 0;
+}